@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_scripts.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "host_registry.h"
+#include "ir_builder.h"
+
+struct Engine {
+    std::string name;
+    std::function<void(const std::string &source, std::ostream &out)> run;
+};
+
+// The VM behind the Optimizer, with only the given transformations.
+static Engine optimizing(const std::string &name, bool inlining, bool valueNumbering, bool hoist, bool strengthReduce,
+                         bool unroll) {
+   OptimizerOptions options;
+   options.inlining = inlining;
+   options.valueNumbering = valueNumbering;
+   options.loopOptions.hoist = hoist;
+   options.loopOptions.strengthReduce = strengthReduce;
+   options.loopOptions.unroll = unroll;
+   return {name, [options](const std::string &source, std::ostream &out) {
+       VM vm(out);
+       vm.setOptimize(true, options);
+       vm.run(source);
+   }};
+}
+
+static std::vector<Engine> engines() {
+   return {
+           {"ast", [](const std::string &source, std::ostream &out) {
+               Interpreter interpreter(out);
+               interpreter.run(source);
+           }},
+           {"vm", [](const std::string &source, std::ostream &out) {
+               VM vm(out);
+               vm.run(source);
+           }},
+           optimizing("opt-none", false, false, false, false, false),
+           optimizing("opt-inl", true, false, false, false, false),
+           optimizing("opt-gvn", false, true, false, false, false),
+           optimizing("opt-licm", false, false, true, false, false),
+           optimizing("opt-sr", false, false, false, true, false),
+           optimizing("opt-unrl", false, false, false, false, true),
+           optimizing("opt", true, true, true, true, true),
+           {"jit", [](const std::string &source, std::ostream &out) {
+               VM vm(out);
+               vm.setJit(true);
+               vm.run(source);
+           }},
+   };
+}
+
+template<typename Body>
+static double bestMillis(int repeat, Body body) {
+   double best = 1e300;
+   for (int r = 0; r < repeat; ++r) {
+      auto start = std::chrono::steady_clock::now();
+      body();
+      auto end = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+   }
+   return best;
+}
+
+// GFLOP/s of the GEMM kernels behind `@` against the naive triple loop.
+static void gemmBenchmarks(int repeat) {
+   std::printf("\n%-12s %-8s %12s  %s\n", "gemm", "kernel", "best ms", "GFLOP/s");
+   for (int n: {64, 256, 512}) {
+      std::vector<double> a(static_cast<size_t>(n) * n), b(a.size()), c(a.size());
+      for (size_t i = 0; i < a.size(); ++i) {
+         a[i] = static_cast<double>(i % 7) - 3.0;
+         b[i] = static_cast<double>(i % 5) * 0.5;
+      }
+      double flops = 2.0 * n * n * n;
+      std::string size = std::to_string(n) + "^3";
+
+      double naive = bestMillis(repeat, [&] { gemmNaive(n, n, n, a.data(), b.data(), c.data()); });
+      std::printf("%-12s %-8s %12.2f  %.2f\n", size.c_str(), "naive", naive, flops / naive / 1e6);
+      for (GemmKernel kernel: {GemmKernel::Generic, GemmKernel::SSE2, GemmKernel::AVX2}) {
+         if (!gemmKernelSupported(kernel)) continue;
+         double ms = bestMillis(repeat, [&] { gemm(n, n, n, a.data(), b.data(), c.data(), kernel); });
+         std::printf("%-12s %-8s %12.2f  %.2f\n", size.c_str(), gemmKernelName(kernel), ms, flops / ms / 1e6);
+      }
+   }
+}
+
+// Parallel GEMM on 1, 2, 4 ... N threads, N being the hardware concurrency.
+static void gemmScaling(int repeat) {
+   const int n = 1024;
+   std::vector<double> a(static_cast<size_t>(n) * n, 1.5), b(a.size(), -0.5), c(a.size());
+   double flops = 2.0 * n * n * n;
+   int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+   std::printf("\n%-12s %-8s %12s  %s\n", "scaling", "threads", "best ms", "GFLOP/s");
+   double single = 0.0;
+   for (int threads = 1;; threads = std::min(threads * 2, cores)) {
+      ThreadPool pool(threads);
+      double ms = bestMillis(repeat, [&] { gemmParallel(n, n, n, a.data(), b.data(), c.data(), pool); });
+      if (threads == 1) single = ms;
+      std::printf("%-12s %-8d %12.2f  %.2f  (%.2fx)\n", "1024^3", threads, ms, flops / ms / 1e6, single / ms);
+      if (threads == cores) break;
+   }
+}
+
+// The first call of each jitScripts() kernel, during which the JIT counts and
+// compiles, against the fastest later call, with and without the JIT.
+static void jitWarmup() {
+   std::printf("\n%-12s %-8s %12s %12s\n", "warm-up", "engine", "first ms", "steady ms");
+   for (const auto &script: jitScripts()) {
+      double interpreted = 0.0;
+      for (bool jit: {false, true}) {
+         std::ostringstream out;
+         VM vm(out);
+         vm.setJit(jit);
+         vm.run(script.source);
+         std::istringstream times(out.str());
+         std::vector<double> rounds;
+         for (double ms; times >> ms;) rounds.push_back(ms);
+         if (rounds.size() < 2) continue;
+         double steady = *std::min_element(rounds.begin() + 1, rounds.end());
+         if (!jit) interpreted = steady;
+         std::printf("%-12s %-8s %12.2f %12.2f", script.name.c_str(), jit ? "jit" : "vm", rounds.front(), steady);
+         if (jit) std::printf("  (%.2fx)", interpreted / steady);
+         std::printf("\n");
+      }
+   }
+}
+
+// SSA construction and verification of a function of n branches that each
+// read the parameter after a join, at n and 4n: linear work grows about 4x.
+static void irScaling(int repeat) {
+   std::printf("\n%-12s %-8s %12s %12s\n", "ir build", "branches", "build ms", "verify ms");
+   double previous[2] = {0.0, 0.0};
+   for (int n: {5000, 20000}) {
+      std::string source = "function f(a) {\n    var s = 0;\n";
+      for (int k = 0; k < n; ++k) {
+         source += "    if (a > " + std::to_string(k) + ") { s = s + a; } else { s = s - a; }\n";
+      }
+      source += "    return s;\n}\nprint(f(3));\n";
+
+      Tokenizer tokenizer(source);
+      std::vector<Token> tokens = tokenizer.tokenize();
+      Parser parser(tokens);
+      HostRegistry hosts;
+      hosts.defineBuiltins(std::cout);
+      hosts.declareIn(parser.scopeManager);
+      std::unique_ptr<Expr> program = parser.parse();
+      Resolver().resolve(*program);
+
+      std::unique_ptr<IrModule> module;
+      double build = bestMillis(repeat, [&] { module = IrBuilder().build(*program); });
+      double verify = bestMillis(repeat, [&] { verifyIr(*module); });
+      std::printf("%-12s %-8d %12.2f %12.2f", "branches", n, build, verify);
+      if (previous[0] > 0.0) std::printf("  (%.1fx, %.1fx)", build / previous[0], verify / previous[1]);
+      std::printf("\n");
+      previous[0] = build;
+      previous[1] = verify;
+   }
+}
+
+// Usage: CompilerBenchmarks [--repeat N] [name-filter]
+int main(int argc, char **argv) {
+   int repeat = 3;
+   std::string filter;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::atoi(argv[++i]));
+      else filter = arg;
+   }
+
+#ifndef NDEBUG
+   std::cout << "note: benchmarks built without optimizations (NDEBUG not defined)\n";
+#endif
+
+   std::printf("%-12s %-8s %12s  %s\n", "benchmark", "engine", "best ms", "output");
+
+   for (const auto &script: benchmarkScripts()) {
+      if (!filter.empty() && script.name.find(filter) == std::string::npos) continue;
+
+      std::string reference;
+      for (const auto &engine: engines()) {
+         std::string output;
+         double best = bestMillis(repeat, [&] {
+             std::ostringstream out;
+             engine.run(script.source, out);
+             output = out.str();
+         });
+
+         if (!output.empty() && output.back() == '\n') output.pop_back();
+         if (reference.empty()) reference = output;
+         std::printf("%-12s %-8s %12.2f  %s%s\n", script.name.c_str(), engine.name.c_str(), best,
+                     output.c_str(), output == reference ? "" : "  (MISMATCH)");
+      }
+   }
+
+   if (filter.empty() || std::string("warm-up").find(filter) != std::string::npos) jitWarmup();
+   if (filter.empty() || std::string("gemm").find(filter) != std::string::npos) gemmBenchmarks(repeat);
+   if (filter.empty() || std::string("scaling").find(filter) != std::string::npos) gemmScaling(repeat);
+   if (filter.empty() || std::string("ir build").find(filter) != std::string::npos) irScaling(repeat);
+
+   return 0;
+}
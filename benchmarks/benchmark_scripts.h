@@ -0,0 +1,241 @@
+#ifndef COMPILER_BENCHMARK_SCRIPTS_H
+#define COMPILER_BENCHMARK_SCRIPTS_H
+
+#include <string>
+#include <vector>
+
+struct BenchmarkScript {
+    std::string name;
+    std::string source;
+};
+
+// A dispatcher over `count` integer cases and as many string cases, called
+// once per case.
+inline std::string dispatchScript(int count) {
+   std::string source = "function byCode(code) {\n    switch (code) {\n";
+   for (int i = 0; i < count; ++i) {
+      source += "        case " + std::to_string(i * 3) + ": return " + std::to_string(i) + ";\n";
+   }
+   source += "        default: return -1;\n    }\n}\nfunction byName(name) {\n    switch (name) {\n";
+   for (int i = 0; i < count; ++i) {
+      source += "        case \"op" + std::to_string(i) + "\": return " + std::to_string(i) + ";\n";
+   }
+   source += "        default: return -1;\n    }\n}\nvar total = 0;\nfor (var r = 0; r < 20; r = r + 1) {\n"
+             "    for (var i = 0; i < " + std::to_string(count) + "; i = i + 1) {\n"
+             "        total = total + byCode(i * 3) + byName(\"op\" + i);\n    }\n}\nprint(total);\n";
+   return source;
+}
+
+inline const std::vector<BenchmarkScript> &benchmarkScripts() {
+   static const std::vector<BenchmarkScript> scripts = {
+           {"fib", R"(
+function fib(n) {
+    if (n < 2) { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+print(fib(25));
+)"},
+           {"loops", R"(
+var total = 0;
+for (var i = 0; i < 1000; i = i + 1) {
+    for (var j = 0; j < 1000; j = j + 1) {
+        total = total + i * j - j;
+    }
+}
+print(total);
+)"},
+           {"strings", R"(
+var s = "";
+for (var i = 0; i < 20000; i = i + 1) {
+    if (i / 100 * 100 == i) { s = s + "|"; } else { s = s + "x"; }
+}
+print(len(s));
+)"},
+           {"calls", R"(
+function step(x, k) { return x + k; }
+function bump(x) { return step(x, 1); }
+var total = 0;
+for (var i = 0; i < 500000; i = i + 1) {
+    total = bump(total) + step(i, -i);
+}
+print(total);
+)"},
+           {"matmul", R"(
+var n = 96;
+var a = matrix(n, n);
+var b = matrix(n, n);
+for (var i = 0; i < n; i = i + 1) {
+    for (var j = 0; j < n; j = j + 1) {
+        put(a, i, j, (i + j) / 2);
+        put(b, i, j, i - j);
+    }
+}
+var c = a;
+var total = 0;
+for (var k = 0; k < 20; k = k + 1) { c = a @ b; total = total + at(c, 5, 7); }
+print(total);
+)"},
+           {"matchain", R"(
+var a = matrix(600, 8);
+var b = matrix(8, 600);
+var c = matrix(600, 8);
+for (var i = 0; i < 8; i = i + 1) { put(a, i, i, 2); put(b, i, i, 3); put(c, i, i, 4); }
+var d = a;
+for (var k = 0; k < 5; k = k + 1) { d = a @ b @ c; }
+print(rows(d), cols(d), at(d, 3, 3));
+)"},
+           {"fused", R"(
+var n = 400;
+var a = matrix(n, n);
+var b = matrix(n, n);
+var c = matrix(n, n);
+for (var i = 0; i < n; i = i + 1) { put(a, i, i, 1); put(b, i, n - 1 - i, 2); put(c, i, 0, 3); }
+var total = 0;
+for (var k = 0; k < 10; k = k + 1) {
+    var d = (a * 2 + b * c - a) * 0.5 + 1;
+    total = total + at(d, 7, 0);
+}
+print(total);
+)"},
+           {"dispatch", dispatchScript(300)},
+           {"config", R"(
+var secondsPerDay = 24 * 60 * 60;
+var scale = 2 * (1 + 3);
+var prefix = "day" + "-" + "total";
+var total = 0;
+for (var i = 0; i < 200000; i = i + 1) {
+    total = total + (secondsPerDay / (scale * 1000) + -(-scale)) * (3 - 2) - (100 - 99);
+}
+print(prefix, total);
+)"},
+           {"flags", R"(
+var TRACE = false;
+var CHECKED = false;
+function trace(n) { return n; }
+function step(n) {
+    if (TRACE) { trace(n); }
+    if (CHECKED) {
+        if (n < 0) { return 0; }
+    }
+    return n + 1;
+}
+var total = 0;
+for (var i = 0; i < 200000; i = i + 1) {
+    total = step(total);
+    while (CHECKED) { trace(total); }
+}
+print(total);
+)"},
+           {"invariant", R"(
+function kernel(n, a, b) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        total = total + (a * b - a / b) * 3 + i;
+    }
+    return total;
+}
+print(kernel(300000, 37, 5));
+)"},
+           {"stride", R"(
+function kernel(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        total = total + i * 12 + 7 - i * 3;
+    }
+    return total;
+}
+print(kernel(300000));
+)"},
+           // stride with its body protected: entering a try should cost nothing.
+           {"guarded", R"(
+function kernel(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        try { total = total + i * 12 + 7 - i * 3; } catch (e) { total = 0; }
+    }
+    return total;
+}
+print(kernel(300000));
+)"},
+           {"cse", R"(
+function kernel(n, cols) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        var row = i / cols;
+        var col = i - row * cols;
+        if (row * cols + col == i) { total = total + (row * cols + col) * 2; }
+        total = total - (row * cols + col) + (i - row * cols);
+    }
+    return total;
+}
+print(kernel(300000, 17));
+)"},
+           {"calls", R"(
+function square(x) { return x * x; }
+function add(a, b) { return a + b; }
+function clamp(x, lo, hi) { if (x < lo) { return lo; } if (x > hi) { return hi; } return x; }
+function norm(x, y) { return add(square(x), square(y)); }
+function kernel(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = add(total, clamp(norm(i, 3), 0, 1000)); }
+    return total;
+}
+print(kernel(100000));
+)"},
+           {"unroll", R"(
+function dot(x) {
+    var total = 0;
+    for (var k = 0; k < 4; k = k + 1) { total = total + x * k; }
+    return total;
+}
+var sum = 0;
+for (var i = 0; i < 50000; i = i + 1) { sum = sum + dot(i); }
+print(sum);
+)"},
+   };
+   return scripts;
+}
+
+// Kernels for the JIT warm-up comparison: each script calls its run()
+// `rounds` times and prints how long each call took, in milliseconds.
+inline std::string roundsScript(const std::string &kernel, int rounds) {
+   return kernel + "var times = \"\";\nfor (var r = 0; r < " + std::to_string(rounds) + "; r = r + 1) {\n"
+                   "    var start = clock();\n    run();\n"
+                   "    times = times + str((clock() - start) * 1000) + \" \";\n}\nprint(times);\n";
+}
+
+inline const std::vector<BenchmarkScript> &jitScripts() {
+   static const std::vector<BenchmarkScript> scripts = {
+           {"fib", roundsScript(R"(
+function fib(n) {
+    if (n < 2) { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+function run() { return fib(20); }
+)", 10)},
+           {"loops", roundsScript(R"(
+function run() {
+    var total = 0;
+    for (var i = 0; i < 300; i = i + 1) {
+        for (var j = 0; j < 300; j = j + 1) { total = total + i * j - j; }
+    }
+    return total;
+}
+)", 10)},
+           {"floats", roundsScript(R"(
+function run() {
+    var s = 0.0;
+    var x = 0.5;
+    for (var i = 0; i < 100000; i = i + 1) {
+        s = s + x * x - s * 0.001;
+        x = x + 0.25;
+        if (x > 4.0) { x = x - 3.5; }
+    }
+    return s;
+}
+)", 10)},
+   };
+   return scripts;
+}
+
+#endif //COMPILER_BENCHMARK_SCRIPTS_H
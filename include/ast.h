@@ -12,6 +12,9 @@
 #include <variant>
 #include <vector>
 
+#include "operators.h"
+#include "types.h"
+
 enum class ExprType : std::uint8_t {
     Literal,
     Identifier,
@@ -37,8 +40,22 @@ enum class ExprType : std::uint8_t {
     Unary,
 };
 
+// Where a variable lives at runtime, as computed by the Resolver. Globals index the
+// program's global table, locals index the enclosing function's frame.
+struct VariableSlot {
+    enum class Kind : std::uint8_t {
+        Unresolved,
+        Global,
+        Local
+    };
+
+    Kind kind = Kind::Unresolved;
+    int index = -1;
+};
+
 struct Expr {
     ExprType type;
+    TypeRef resolvedType;
 
     virtual ~Expr() = default;
 
@@ -71,6 +88,7 @@ struct LiteralExpr : Expr {
 
 struct IdentifierExpr : Expr {
     std::string name;
+    VariableSlot slot;
 
     explicit IdentifierExpr(std::string name) : name(std::move(name)) {
        type = ExprType::Identifier;
@@ -85,10 +103,12 @@ struct BinaryExpr : Expr {
     std::unique_ptr<Expr> left;
     std::string op;
     std::unique_ptr<Expr> right;
+    BinaryOperator operation;
 
     BinaryExpr(std::unique_ptr<Expr> left, std::string op, std::unique_ptr<Expr> right)
             : left(std::move(left)), op(std::move(op)), right(std::move(right)) {
        type = ExprType::Binary;
+       operation = binaryOperatorFromLexeme(this->op);
     }
 
     [[nodiscard]] std::string toString() const override {
@@ -99,9 +119,11 @@ struct BinaryExpr : Expr {
 struct VarDeclarationExpr : Expr {
     std::string name;
     std::unique_ptr<Expr> initializer;
+    TypeRef declaredType;
+    VariableSlot slot;
 
-    VarDeclarationExpr(std::string name, std::unique_ptr<Expr> initializer)
-            : name(std::move(name)), initializer(std::move(initializer)) {
+    VarDeclarationExpr(std::string name, std::unique_ptr<Expr> initializer, TypeRef declaredType = TypeRef())
+            : name(std::move(name)), initializer(std::move(initializer)), declaredType(declaredType) {
        type = ExprType::VarDeclaration;
     }
 
@@ -114,6 +136,7 @@ struct FunctionDeclarationExpr : Expr {
     std::string name;
     std::vector<std::string> params;
     std::unique_ptr<Expr> body;
+    int frameSize = 0;
 
     FunctionDeclarationExpr(std::string name, std::vector<std::string> params, std::unique_ptr<Expr> body)
             : name(std::move(name)), params(std::move(params)), body(std::move(body)) {
@@ -170,17 +193,21 @@ struct IfStatementExpr : Expr {
     }
 };
 
+// A desugared `for` loop keeps its increment separately so `continue` still runs it.
 struct WhileStatementExpr : Expr {
     std::unique_ptr<Expr> condition;
     std::unique_ptr<Expr> body;
+    std::unique_ptr<Expr> increment;
 
-    WhileStatementExpr(std::unique_ptr<Expr> condition, std::unique_ptr<Expr> body)
-            : condition(std::move(condition)), body(std::move(body)) {
+    WhileStatementExpr(std::unique_ptr<Expr> condition, std::unique_ptr<Expr> body,
+                       std::unique_ptr<Expr> increment = nullptr)
+            : condition(std::move(condition)), body(std::move(body)), increment(std::move(increment)) {
        type = ExprType::WhileStatement;
     }
 
     [[nodiscard]] std::string toString() const override {
-       return "While(" + condition->toString() + ", body: " + body->toString() + ")";
+       return "While(" + condition->toString() + ", body: " + body->toString() +
+              (increment ? ", incr: " + increment->toString() : "") + ")";
     }
 };
 
@@ -272,6 +299,7 @@ struct ExpressionStatementExpr : Expr {
 struct AssignmentExpr : Expr {
     std::string name;
     std::unique_ptr<Expr> value;
+    VariableSlot slot;
 
     AssignmentExpr(std::string name, std::unique_ptr<Expr> value)
             : name(std::move(name)), value(std::move(value)) {
@@ -297,6 +325,18 @@ struct MatrixMultiplicationExpr : Expr {
     }
 };
 
+// Appends the operands of a tree of nested '@' nodes, left to right. Matrix
+// products are associative, so an engine may group the chain however it likes.
+inline void collectMatrixChain(const Expr *expr, std::vector<const Expr *> &operands) {
+   if (expr->type != ExprType::MatrixMultiplication) {
+      operands.push_back(expr);
+      return;
+   }
+   auto *mul = static_cast<const MatrixMultiplicationExpr *>(expr);
+   collectMatrixChain(mul->left.get(), operands);
+   collectMatrixChain(mul->right.get(), operands);
+}
+
 struct SwitchStatementExpr : Expr {
     std::unique_ptr<Expr> switchExpr;
     std::vector<std::unique_ptr<Expr>> caseClauses;
@@ -380,6 +420,7 @@ struct TryCatchFinallyStatementExpr : Expr {
 struct CatchClauseExpr : Expr {
     std::string exceptionVarName;
     std::unique_ptr<Expr> block;
+    VariableSlot slot;
 
     CatchClauseExpr(std::string exceptionVarName, std::unique_ptr<Expr> block)
             : exceptionVarName(std::move(exceptionVarName)), block(std::move(block)) {
@@ -394,10 +435,12 @@ struct CatchClauseExpr : Expr {
 struct UnaryExpr : Expr {
     std::string op;
     std::unique_ptr<Expr> right;
+    UnaryOperator operation;
 
     UnaryExpr(std::string op, std::unique_ptr<Expr> right)
             : op(std::move(op)), right(std::move(right)) {
        type = ExprType::Unary;
+       operation = unaryOperatorFromLexeme(this->op);
     }
 
     [[nodiscard]] std::string toString() const override {
@@ -405,4 +448,107 @@ struct UnaryExpr : Expr {
     }
 };
 
+// Calls f(std::unique_ptr<Expr> &) on every non-null direct child of expr, in
+// evaluation order, so passes can rewrite the tree in place.
+template<typename F>
+void forEachChild(Expr *expr, F f) {
+   auto each = [&](std::unique_ptr<Expr> &child) {
+       if (child) f(child);
+   };
+   switch (expr->type) {
+      case ExprType::Literal:
+      case ExprType::Identifier:
+      case ExprType::BreakStatement:
+      case ExprType::ContinueStatement:
+         break;
+      case ExprType::Binary: {
+         auto *binary = static_cast<BinaryExpr *>(expr);
+         each(binary->left);
+         each(binary->right);
+         break;
+      }
+      case ExprType::Unary:
+         each(static_cast<UnaryExpr *>(expr)->right);
+         break;
+      case ExprType::MatrixMultiplication: {
+         auto *mul = static_cast<MatrixMultiplicationExpr *>(expr);
+         each(mul->left);
+         each(mul->right);
+         break;
+      }
+      case ExprType::VarDeclaration:
+         each(static_cast<VarDeclarationExpr *>(expr)->initializer);
+         break;
+      case ExprType::Assignment:
+         each(static_cast<AssignmentExpr *>(expr)->value);
+         break;
+      case ExprType::FunctionDeclaration:
+         each(static_cast<FunctionDeclarationExpr *>(expr)->body);
+         break;
+      case ExprType::FunctionCall:
+         for (auto &arg: static_cast<FunctionCallExpr *>(expr)->arguments) each(arg);
+         break;
+      case ExprType::IfStatement: {
+         auto *stmt = static_cast<IfStatementExpr *>(expr);
+         each(stmt->condition);
+         each(stmt->thenBranch);
+         each(stmt->elseBranch);
+         break;
+      }
+      case ExprType::WhileStatement: {
+         auto *stmt = static_cast<WhileStatementExpr *>(expr);
+         each(stmt->condition);
+         each(stmt->body);
+         each(stmt->increment);
+         break;
+      }
+      case ExprType::DoWhileStatement: {
+         auto *stmt = static_cast<DoWhileStatementExpr *>(expr);
+         each(stmt->body);
+         each(stmt->condition);
+         break;
+      }
+      case ExprType::ForStatement: {
+         auto *stmt = static_cast<ForStatementExpr *>(expr);
+         each(stmt->initializer);
+         each(stmt->condition);
+         each(stmt->increment);
+         each(stmt->body);
+         break;
+      }
+      case ExprType::ReturnStatement:
+         each(static_cast<ReturnStatementExpr *>(expr)->value);
+         break;
+      case ExprType::BlockStatement:
+         for (auto &statement: static_cast<BlockStatementExpr *>(expr)->statements) each(statement);
+         break;
+      case ExprType::ExpressionStatement:
+         each(static_cast<ExpressionStatementExpr *>(expr)->expression);
+         break;
+      case ExprType::SwitchStatement: {
+         auto *stmt = static_cast<SwitchStatementExpr *>(expr);
+         each(stmt->switchExpr);
+         for (auto &clause: stmt->caseClauses) each(clause);
+         each(stmt->defaultClause);
+         break;
+      }
+      case ExprType::CaseClause: {
+         auto *clause = static_cast<CaseClauseExpr *>(expr);
+         each(clause->caseExpr);
+         each(clause->body);
+         break;
+      }
+      case ExprType::TryCatchFinallyStatement: {
+         auto *stmt = static_cast<TryCatchFinallyStatementExpr *>(expr);
+         each(stmt->tryBlock);
+         for (auto &clause: stmt->catches) each(clause);
+         each(stmt->finallyBlock);
+         break;
+      }
+      case ExprType::CatchClause:
+         each(static_cast<CatchClauseExpr *>(expr)->block);
+         break;
+   }
+}
+
 #endif //COMPILER_AST_H
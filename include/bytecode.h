@@ -0,0 +1,199 @@
+#ifndef COMPILER_BYTECODE_H
+#define COMPILER_BYTECODE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "switch_table.h"
+#include "value.h"
+
+// Register-based instruction set. Every instruction is one 32-bit word:
+//
+//   | C:8 | B:8 | A:8 | op:8 |   or   | Bx:16 | A:8 | op:8 |
+//
+// A usually names the destination register. sBx is Bx with a bias, used for
+// jump offsets (relative to the next instruction) and small integer literals;
+// sC is C with a bias of 128.
+//
+// The compiler emits superinstructions for common loop shapes: arithmetic with
+// a small constant operand (`i = i + 1`) and compare-and-branch. An IF* op is
+// always followed by a JMP; the branch is taken when the comparison is false.
+//
+// Ops named *_INT_INT, *_FLOAT_FLOAT and *_INT_CONST are never emitted by the
+// compiler. The VM rewrites a generic op into one of them once it has seen
+// its operand types (quickening) and rewrites it back on a type miss.
+#define COMPILER_OPCODES(X) \
+    X(MOVE)        /* R[A] = R[B]                                  */ \
+    X(LOADK)       /* R[A] = K[Bx]                                 */ \
+    X(LOADINT)     /* R[A] = sBx                                   */ \
+    X(LOADBOOL)    /* R[A] = B != 0                                */ \
+    X(LOADNULL)    /* R[A] = null                                  */ \
+    X(GETGLOBAL)   /* R[A] = G[Bx]                                 */ \
+    X(SETGLOBAL)   /* G[Bx] = R[A]                                 */ \
+    X(ADD)         /* R[A] = R[B] + R[C]                           */ \
+    X(SUB)         \
+    X(MUL)         \
+    X(DIV)         \
+    X(EQ)          /* R[A] = R[B] == R[C]                          */ \
+    X(NE)          \
+    X(LT)          \
+    X(LE)          \
+    X(GT)          \
+    X(GE)          \
+    X(MATMUL)      /* R[A] = R[B] @ R[C]                           */ \
+    X(MATCHAIN)    /* R[A] = R[B] @ .. @ R[B + C - 1], reordered   */ \
+    X(NEG)         /* R[A] = -R[B]                                 */ \
+    X(PLUS)        \
+    X(NOT)         \
+    X(BNOT)        \
+    X(TRUTHY)      /* R[A] = bool(R[B])                            */ \
+    X(JMP)         /* pc += sBx                                    */ \
+    X(JMPF)        /* if !R[A] then pc += sBx                      */ \
+    X(JMPT)        /* if R[A] then pc += sBx                       */ \
+    X(SWITCH)      /* pc += table[Bx][R[A]], if R[A] is a key      */ \
+    X(CALL)        /* R[A] = site[Bx](R[A] .. R[A + argc - 1])     */ \
+    X(TAILCALL)    /* return site[Bx](R[A] .. ), reusing the frame */ \
+    X(RETURN)      /* return R[A]                                  */ \
+    X(DEFFN)       /* bind nested function Bx to its name          */ \
+    X(RETHROW)     /* raise the most recently saved exception      */ \
+    X(DISCARD)     /* drop the most recently saved exception       */ \
+    X(ERROR)       /* raise a RuntimeError with message K[Bx]      */ \
+    X(ADD_CONST)   /* R[A] = R[B] + sC                             */ \
+    X(SUB_CONST)   /* R[A] = R[B] - sC                             */ \
+    COMPILER_BRANCH_OPCODES(X, IFLT) \
+    COMPILER_BRANCH_OPCODES(X, IFLE) \
+    COMPILER_BRANCH_OPCODES(X, IFGT) \
+    COMPILER_BRANCH_OPCODES(X, IFGE) \
+    COMPILER_BRANCH_OPCODES(X, IFEQ) \
+    COMPILER_BRANCH_OPCODES(X, IFNE) \
+    X(ADD_INT_INT) \
+    X(SUB_INT_INT) \
+    X(MUL_INT_INT) \
+    X(LT_INT_INT)  \
+    X(LE_INT_INT)  \
+    X(GT_INT_INT)  \
+    X(GE_INT_INT)  \
+    X(EQ_INT_INT)  \
+    X(NE_INT_INT)  \
+    X(ADD_FLOAT_FLOAT) \
+    X(SUB_FLOAT_FLOAT) \
+    X(MUL_FLOAT_FLOAT) \
+    X(DIV_FLOAT_FLOAT) \
+    X(ADD_INT_CONST) \
+    X(SUB_INT_CONST)
+
+// IFxx A B: unless R[A] xx R[B], take the following JMP.
+// IFxx_CONST A sBx: unless R[A] xx sBx, take the following JMP.
+#define COMPILER_BRANCH_OPCODES(X, name) \
+    X(name)               \
+    X(name##_CONST)       \
+    X(name##_INT_INT)     \
+    X(name##_INT_CONST)
+
+enum class OpCode : std::uint8_t {
+#define COMPILER_OPCODE_ENUM(name) name,
+    COMPILER_OPCODES(COMPILER_OPCODE_ENUM)
+#undef COMPILER_OPCODE_ENUM
+};
+
+using Instruction = std::uint32_t;
+
+constexpr int MAX_REGISTERS = 256;
+constexpr int MAX_BX = 0xffff;
+constexpr int SBX_BIAS = 0x7fff;
+constexpr int SC_BIAS = 0x80;
+
+inline Instruction encodeABC(OpCode op, int a, int b = 0, int c = 0) {
+   return static_cast<Instruction>(op) | static_cast<Instruction>(a) << 8 |
+          static_cast<Instruction>(b) << 16 | static_cast<Instruction>(c) << 24;
+}
+
+inline Instruction encodeABx(OpCode op, int a, int bx) {
+   return static_cast<Instruction>(op) | static_cast<Instruction>(a) << 8 | static_cast<Instruction>(bx) << 16;
+}
+
+inline Instruction encodeAsBx(OpCode op, int a, int sbx) {
+   return encodeABx(op, a, sbx + SBX_BIAS);
+}
+
+inline OpCode opcodeOf(Instruction i) { return static_cast<OpCode>(i & 0xff); }
+
+inline int argA(Instruction i) { return static_cast<int>((i >> 8) & 0xff); }
+
+inline int argB(Instruction i) { return static_cast<int>((i >> 16) & 0xff); }
+
+inline int argC(Instruction i) { return static_cast<int>(i >> 24); }
+
+inline int argBx(Instruction i) { return static_cast<int>(i >> 16); }
+
+inline int argSBx(Instruction i) { return argBx(i) - SBX_BIAS; }
+
+inline int argSC(Instruction i) { return argC(i) - SC_BIAS; }
+
+inline Instruction withOpcode(Instruction i, OpCode op) {
+   return (i & ~Instruction{0xff}) | static_cast<Instruction>(op);
+}
+
+const char *opcodeName(OpCode op);
+
+struct FunctionProto;
+
+struct HostFunction;
+
+class JitFunction;
+
+// A call site names its callee. The VM resolves the name on first execution
+// and caches the target here, already checked against argumentCount; the cache
+// is valid while `epoch` matches the VM's function binding epoch.
+struct CallSite {
+    std::string callee;
+    int argumentCount = 0;
+    FunctionProto *target = nullptr;
+    const HostFunction *host = nullptr;
+    std::uint32_t epoch = 0;
+};
+
+// Exception handling is table-driven: entering or leaving a `try` executes
+// nothing. When an instruction in [start, end) raises, the VM stores the
+// thrown value in R[reg] and continues at target; with reg -1 (a finally
+// handler) it saves the exception for RETHROW instead. A function's entries
+// are ordered innermost first, so the first one covering an instruction
+// handles it.
+struct ExceptionHandler {
+    std::uint32_t start;
+    std::uint32_t end;
+    std::uint32_t target;
+    int reg;
+};
+
+struct FunctionProto {
+    std::string name;
+    int arity = 0;
+    int registerCount = 0;
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<CallSite> callSites;
+    std::vector<SwitchTable> switchTables;
+    std::vector<FunctionProto *> nestedFunctions;
+    std::vector<ExceptionHandler> handlers;
+    // Calls and loop backedges taken, counted by the VM to pick functions for
+    // the BaselineJit, and the native code once it has compiled them.
+    std::uint32_t hotness = 0;
+    const JitFunction *jitCode = nullptr;
+};
+
+// Output of the BytecodeCompiler. functions[0] is the top-level script; the
+// program owns every function, nested ones included.
+struct Program {
+    std::vector<std::unique_ptr<FunctionProto>> functions;
+
+    [[nodiscard]] FunctionProto &main() const { return *functions.front(); }
+};
+
+std::string disassemble(const FunctionProto &function);
+
+std::string disassemble(const Program &program);
+
+#endif //COMPILER_BYTECODE_H
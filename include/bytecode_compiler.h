@@ -0,0 +1,117 @@
+#ifndef COMPILER_BYTECODE_COMPILER_H
+#define COMPILER_BYTECODE_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+
+// Lowers a resolved AST (see Resolver) to register bytecode. A function's
+// locals occupy registers 0 .. frameSize - 1 with the parameters first, and
+// temporaries are allocated stack-wise above them. Globals stay in the VM's
+// global table. `finally` bodies are emitted inline on every path that leaves
+// the protected region: normal completion, break/continue/return, and a
+// rethrowing handler. Protected regions become ExceptionHandler entries, one
+// per stretch of code between the region's start, the jumps that leave it
+// early and its end.
+class BytecodeCompiler {
+public:
+    std::unique_ptr<Program> compile(const Expr &program);
+
+private:
+    struct Loop {
+        std::vector<size_t> breakJumps;
+        std::vector<size_t> continueJumps;
+        size_t tryDepth;
+        bool acceptsContinue;
+    };
+
+    // A protected region (handler >= 0), or a finally body running on the
+    // exceptional path (which holds a saved exception until RETHROW).
+    struct TryRegion {
+        const Expr *finallyBlock;
+        int handler; // in FunctionState::handlers, -1 for none
+        bool holdsException;
+    };
+
+    // A handler being compiled. Its range is open from `start` unless a jump
+    // leaving the region has closed it; closed stretches are already entries
+    // of the function's table, which get the target once it is known.
+    struct HandlerState {
+        int reg;
+        size_t start;
+        bool open;
+        std::vector<size_t> entries;
+    };
+
+    struct FunctionState {
+        FunctionProto *proto = nullptr;
+        int freeRegister = 0;
+        std::vector<Loop> loops;
+        std::vector<TryRegion> tries;
+        std::vector<HandlerState> handlers;
+        std::unordered_map<std::string, int> constantIndex;
+    };
+
+    Program *program = nullptr;
+    FunctionState *current = nullptr;
+
+    void compileFunction(FunctionProto &proto, const Expr *body, int frameSize);
+
+    size_t emit(Instruction instruction);
+
+    size_t emitJump(OpCode op, int a = 0);
+
+    void patchJump(size_t at);
+
+    void emitJumpBack(size_t target, OpCode op = OpCode::JMP, int a = 0);
+
+    int constant(const Value &value);
+
+    int allocateRegister();
+
+    void compileStatement(const Expr *stmt);
+
+    void compileEffect(const Expr *expr);
+
+    void compileInto(const Expr *expr, int target);
+
+    int compileOperand(const Expr *expr);
+
+    int compileLeftOperand(const BinaryExpr *binary);
+
+    size_t compileBranchIfFalse(const Expr *condition);
+
+    void compileAssignment(const AssignmentExpr *assign, int target);
+
+    void compileLogical(const BinaryExpr *binary, int target);
+
+    void compileCall(const FunctionCallExpr *call, int target, OpCode op = OpCode::CALL);
+
+    void storeVariable(const VariableSlot &slot, const std::string &name, int source);
+
+    void compileLoop(const Expr *condition, const Expr *body, const Expr *increment, bool testFirst);
+
+    void compileSwitch(const SwitchStatementExpr *stmt);
+
+    void compileTry(const TryCatchFinallyStatementExpr *stmt);
+
+    void compileRethrowingFinally(const Expr *finallyBlock);
+
+    void compileFunctionDeclaration(const FunctionDeclarationExpr *function);
+
+    int openHandler(int reg);
+
+    void closeHandler(int handler);
+
+    void setHandlerTarget(int handler);
+
+    void leaveTryRegions(size_t depth);
+
+    void reenterTryRegions(size_t depth);
+};
+
+#endif //COMPILER_BYTECODE_COMPILER_H
@@ -0,0 +1,61 @@
+#ifndef COMPILER_C_EMITTER_H
+#define COMPILER_C_EMITTER_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "ir.h"
+#include "c_runtime.h"
+
+// Ahead-of-time backend: translates an optimized IR module into one portable
+// C translation unit that needs only a C99 compiler, libm and pthreads.
+//
+// Each IR function becomes a static C function taking and returning a tagged
+// Value; SSA values are C locals, blocks are labels and phis are parallel
+// copies on each edge. Calls the CallGraph binds are direct C calls; others
+// look their name up in a binding table set by the `define`s that have run,
+// then in the host functions, as the VM does. A protected block's raising
+// instruction runs under a setjmp handler that the runtime longjmps to, with
+// runtime errors caught as their message. Matrices are dense row-major
+// arrays multiplied by a blocked kernel in the emitted runtime, chains in
+// the order planMatrixChain picks. Strings and matrices are reclaimed by the
+// runtime's conservative mark and sweep, rooted in the script's stack.
+//
+// The unit defines `int run_script(void)`, which runs the script and returns
+// its exit status, and, unless built as a library, a main calling it.
+class CEmitter {
+public:
+    std::string emit(const IrModule &module, bool library = false);
+
+private:
+    std::ostream *out = nullptr;
+    const IrModule *module = nullptr;
+    std::unordered_map<std::string, int> bindings;    // function name -> binding slot
+    std::unordered_map<std::string, int> strings;     // string constant -> K index
+    std::unordered_map<const IrFunction *, int> functionIds;
+    std::unordered_map<const IrInstr *, const IrFunction *> targets; // calls the CallGraph binds
+    std::unordered_map<const IrInstr *, int> values;  // per function
+    std::unordered_map<const IrBlock *, int> labels;  // per function
+
+    void collect();
+
+    void emitFunction(const IrFunction &function);
+
+    void emitInstruction(const IrFunction &function, const IrInstr *instr);
+
+    void emitCall(const IrInstr *instr);
+
+    // Phi copies for the edge from -> to, then the jump.
+    void emitEdge(const IrBlock *from, const IrBlock *to, const char *indent);
+
+    [[nodiscard]] std::string value(const IrInstr *instr) const;
+
+    [[nodiscard]] std::string arguments(const IrInstr *instr) const;
+};
+
+// Writes the C for module next to output (as output + ".c") and runs the
+// system C compiler on it. Throws a CompilerError when the compiler fails.
+void buildNative(const IrModule &module, const std::string &output, const NativeBuildOptions &options = {});
+
+#endif //COMPILER_C_EMITTER_H
@@ -0,0 +1,41 @@
+#ifndef COMPILER_C_RUNTIME_H
+#define COMPILER_C_RUNTIME_H
+
+#include <string>
+#include <vector>
+
+// The C runtime the native backends link their code against: tagged Values,
+// operators, matrices, host functions and setjmp-based exceptions, behaving
+// as value.cpp, matrix.cpp and host_registry.cpp do, down to the messages.
+// Runtime state is static unless the includer defines RT_STATE first.
+std::string cRuntime();
+
+// rt_run, run_script and, unless library, main. They expect the program to
+// define rt_init and the script as `Value fn_0(void)`.
+std::string cRuntimeEntry(bool library);
+
+struct CHostFunction {
+    const char *name;
+    int arity; // -1 for variadic
+};
+
+// The host functions the runtime implements as rt_host_<name>.
+const std::vector<CHostFunction> &cHostFunctions();
+
+const CHostFunction *findCHostFunction(const std::string &name);
+
+// text as a C (and assembler) string literal.
+std::string cQuote(const std::string &text);
+
+struct NativeBuildOptions {
+    bool library = false;          // a shared object instead of an executable
+    std::string compiler = "cc";   // overridden by $CC when set
+    std::string flags = "-O2";
+};
+
+// Compiles and links sources into output with the system C compiler. Throws
+// a CompilerError when the compiler fails.
+void runCCompiler(const std::vector<std::string> &sources, const std::string &output,
+                  const NativeBuildOptions &options);
+
+#endif //COMPILER_C_RUNTIME_H
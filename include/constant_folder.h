@@ -0,0 +1,57 @@
+#ifndef COMPILER_CONSTANT_FOLDER_H
+#define COMPILER_CONSTANT_FOLDER_H
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+// Runs after Parser::parse() and before the Resolver, rewriting the tree in
+// place:
+//  - operators whose operands are literals are evaluated with the runtime's own
+//    semantics (applyBinary/applyUnary) and replaced by the resulting literal;
+//    an operation that would throw, or a float result a float literal cannot
+//    hold exactly, is left for the runtime;
+//  - a variable declared with a literal initializer and never assigned
+//    anywhere in the program is replaced by that literal where it is read;
+//  - algebraic identities that hold for every operand value are simplified.
+// A program can only name its own globals and functions, so "never assigned"
+// is decided by this program alone.
+class ConstantFolder {
+public:
+    void fold(Expr &program);
+
+private:
+    struct Binding {
+        std::string name;
+        const LiteralExpr *value; // null when the variable is not a constant
+        int functionDepth;        // 0 for globals
+    };
+
+    std::unordered_set<std::string> assigned;
+    std::vector<Binding> bindings;
+    std::vector<size_t> scopeMarks;
+    int functionDepth = 0;
+
+    void collectAssignments(const Expr *expr);
+
+    void beginScope();
+
+    void endScope();
+
+    void bind(const std::string &name, const Expr *initializer);
+
+    [[nodiscard]] const LiteralExpr *constant(const std::string &name) const;
+
+    void fold(std::unique_ptr<Expr> &expr);
+
+    void visit(Expr *expr);
+
+    void foldBinary(std::unique_ptr<Expr> &expr);
+
+    void foldUnary(std::unique_ptr<Expr> &expr);
+};
+
+#endif //COMPILER_CONSTANT_FOLDER_H
@@ -0,0 +1,153 @@
+#ifndef COMPILER_DATAFLOW_H
+#define COMPILER_DATAFLOW_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+
+// Fixed-size set of small integers, stored 64 per word so that set operations
+// work a word at a time.
+class BitVector {
+public:
+    explicit BitVector(size_t size = 0, bool value = false);
+
+    [[nodiscard]] size_t size() const { return bits; }
+
+    [[nodiscard]] bool test(size_t i) const { return words[i / 64] >> (i % 64) & 1; }
+
+    void set(size_t i) { words[i / 64] |= std::uint64_t(1) << (i % 64); }
+
+    void reset(size_t i) { words[i / 64] &= ~(std::uint64_t(1) << (i % 64)); }
+
+    void setAll();
+
+    // Each returns true when this set changed.
+    bool unionWith(const BitVector &other);
+
+    bool intersectWith(const BitVector &other);
+
+    void subtract(const BitVector &other);
+
+    [[nodiscard]] size_t count() const;
+
+    [[nodiscard]] bool any() const;
+
+    bool operator==(const BitVector &other) const { return bits == other.bits && words == other.words; }
+
+    bool operator!=(const BitVector &other) const { return !(*this == other); }
+
+    // Calls f with each member in increasing order.
+    template<typename F>
+    void forEach(F f) const {
+       for (size_t w = 0; w < words.size(); ++w) {
+          for (std::uint64_t word = words[w]; word; word &= word - 1) {
+             f(w * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+          }
+       }
+    }
+
+private:
+    size_t bits;
+    std::vector<std::uint64_t> words;
+
+    void clearPadding();
+};
+
+enum class DataflowDirection { Forward, Backward };
+
+enum class DataflowMeet { Union, Intersection };
+
+// A gen/kill problem over the blocks of an IR function. Per block,
+//   forward:  out = gen | (in - kill), in = meet of the preds' out
+//   backward: in = gen | (out - kill), out = meet of the succs' in
+// gen and kill are indexed by block id. The boundary holds on entry to the
+// entry block (forward) or on exit from blocks without successors
+// (backward). Exceptional edges are ordinary edges: a block's end state
+// reaches its handler, which is exact because a protected block raises only
+// from its last instruction.
+struct DataflowProblem {
+    DataflowDirection direction = DataflowDirection::Forward;
+    DataflowMeet meet = DataflowMeet::Union;
+    size_t size = 0;
+    std::vector<BitVector> gen;
+    std::vector<BitVector> kill;
+    BitVector boundary;
+};
+
+struct DataflowResult {
+    std::vector<BitVector> in;  // by block id, at block entry
+    std::vector<BitVector> out; // by block id, at block exit
+    int visits = 0;             // block transfers evaluated
+};
+
+// Solves to the maximal fixed point for Intersection and the least for Union.
+// Blocks are swept in reverse postorder (postorder when backward) and only
+// those whose inputs changed are revisited, so a reducible CFG settles in a
+// few sweeps regardless of its size. Unreachable blocks keep empty sets.
+DataflowResult solveDataflow(const IrFunction &function, const DataflowProblem &problem);
+
+// Live SSA values, bit i standing for the value with id i. A phi operand is
+// used at the end of the corresponding predecessor, so it is live out of that
+// block only, and a phi is defined at the top of its own block.
+class Liveness {
+public:
+    explicit Liveness(const IrFunction &function);
+
+    [[nodiscard]] const BitVector &liveIn(const IrBlock *block) const { return in[block->id]; }
+
+    [[nodiscard]] const BitVector &liveOut(const IrBlock *block) const { return out[block->id]; }
+
+    [[nodiscard]] bool isLiveOut(const IrInstr *value, const IrBlock *block) const {
+       return out[block->id].test(static_cast<size_t>(value->id));
+    }
+
+private:
+    std::vector<BitVector> in;
+    std::vector<BitVector> out;
+};
+
+// Which stores of globals may supply the value seen by a loadglobal. A call
+// may write any global, and the function starts with whatever its caller
+// left, so each slot also has an "external" definition for values written
+// outside the function; a store to the slot kills it.
+class ReachingDefinitions {
+public:
+    explicit ReachingDefinitions(const IrFunction &function);
+
+    // Stores of load's slot that may reach it. external, when given, is set
+    // to whether a value from outside the function may reach it as well.
+    [[nodiscard]] std::vector<const IrInstr *> reachingStores(const IrInstr *load, bool *external = nullptr) const;
+
+private:
+    std::vector<const IrInstr *> stores;           // definition i < stores.size()
+    std::unordered_map<int, size_t> slots;         // global slot -> dense index
+    std::unordered_map<const IrInstr *, size_t> definition;
+    std::vector<BitVector> slotDefinitions;        // by dense slot: its stores and external definition
+    BitVector externals;
+    std::vector<BitVector> in;
+
+    [[nodiscard]] size_t externalDefinition(size_t slot) const { return stores.size() + slot; }
+
+    void transfer(const IrInstr *instr, BitVector &gen, BitVector *kill) const;
+};
+
+// A read that may see a variable declared without an initializer before
+// anything was assigned to it.
+struct UninitializedRead {
+    const IrFunction *function;
+    const IrInstr *use;
+    std::string name;
+};
+
+// Definite assignment. For locals, which the IR keeps in SSA values, this
+// follows the unassigned declaration (a Const naming the variable) through
+// phis to its first real uses. For globals it is a forward must-analysis over
+// the script, where a call assigns whatever its callee, or anything the
+// callee calls, stores, and reads what they may read before assigning it;
+// such a read is reported at the call.
+std::vector<UninitializedRead> findUninitializedReads(const IrModule &module);
+
+#endif //COMPILER_DATAFLOW_H
@@ -0,0 +1,46 @@
+#ifndef COMPILER_DEAD_CODE_H
+#define COMPILER_DEAD_CODE_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+// Runs after the ConstantFolder, which turns flag tests into literals, and
+// before the Resolver. Removes:
+//  - statements after a return, break or continue in the same block, or after
+//    a statement that ends in one on every path;
+//  - if statements on a literal condition (replaced by the branch taken),
+//    while and for loops whose condition is a falsy literal, and expression
+//    statements that are just a literal;
+//  - function declarations that no live code calls. Calls are by name and a
+//    program cannot call functions of an earlier one, so this is exact.
+class DeadCodeEliminator {
+public:
+    // Returns the number of AST nodes removed.
+    int eliminate(Expr &program);
+
+private:
+    int removed = 0;
+    std::unordered_map<std::string, std::vector<FunctionDeclarationExpr *>> declarations;
+    std::unordered_set<std::string> liveFunctions;
+
+    void simplifyChildren(Expr *expr);
+
+    void simplify(std::unique_ptr<Expr> &stmt);
+
+    void simplifyBlock(BlockStatementExpr *block);
+
+    void discard(std::unique_ptr<Expr> &stmt);
+
+    void collectDeclarations(Expr *expr);
+
+    void markCalls(Expr *expr);
+
+    void removeDeadFunctions(Expr *expr);
+};
+
+#endif //COMPILER_DEAD_CODE_H
@@ -0,0 +1,35 @@
+#ifndef COMPILER_DOMINATORS_H
+#define COMPILER_DOMINATORS_H
+
+#include <vector>
+
+#include "ir.h"
+
+// Dominator tree of an IR function, exceptional edges included, built with
+// Lengauer-Tarjan in O(E log V). Blocks are looked up by id, so the function
+// must be renumbered (IrFunction::renumber) and keep its blocks while the tree
+// is in use. Unreachable blocks have no dominator and dominate nothing.
+class DominatorTree {
+public:
+    explicit DominatorTree(const IrFunction &function);
+
+    // Immediate dominator; null for the entry and unreachable blocks.
+    [[nodiscard]] IrBlock *idom(const IrBlock *block) const { return idoms[block->id]; }
+
+    [[nodiscard]] const std::vector<IrBlock *> &children(const IrBlock *block) const { return tree[block->id]; }
+
+    // Reflexive: every reachable block dominates itself.
+    [[nodiscard]] bool dominates(const IrBlock *a, const IrBlock *b) const;
+
+    // Blocks in dominator-tree preorder, starting with the entry.
+    [[nodiscard]] const std::vector<IrBlock *> &preorder() const { return order; }
+
+private:
+    std::vector<IrBlock *> idoms;
+    std::vector<std::vector<IrBlock *>> tree;
+    std::vector<int> enter;
+    std::vector<int> leave;
+    std::vector<IrBlock *> order;
+};
+
+#endif //COMPILER_DOMINATORS_H
@@ -38,4 +38,21 @@ private:
     }
 };
 
+class TypeError : public CompilerError {
+public:
+    explicit TypeError(const std::string &message, int line = -1, int column = -1)
+            : CompilerError("[TypeError] " + message, line, column) {}
+};
+
+class RuntimeError : public CompilerError {
+public:
+    explicit RuntimeError(const std::string &message)
+            : CompilerError("[RuntimeError] " + message), detail(message) {}
+
+    [[nodiscard]] const std::string &reason() const { return detail; }
+
+private:
+    std::string detail;
+};
+
 #endif //COMPILER_ERROR_H
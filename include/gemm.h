@@ -0,0 +1,53 @@
+#ifndef COMPILER_GEMM_H
+#define COMPILER_GEMM_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+constexpr std::size_t MATRIX_ALIGNMENT = 64;
+
+struct AlignedDeleter {
+    void operator()(double *data) const { ::operator delete[](data, std::align_val_t{MATRIX_ALIGNMENT}); }
+};
+
+using AlignedDoubles = std::unique_ptr<double[], AlignedDeleter>;
+
+// Zero-filled storage starting on a cache line boundary.
+AlignedDoubles allocateAligned(std::size_t count);
+
+class ThreadPool;
+
+enum class GemmKernel {
+    Generic,
+    SSE2,
+    AVX2
+};
+
+const char *gemmKernelName(GemmKernel kernel);
+
+[[nodiscard]] bool gemmKernelSupported(GemmKernel kernel);
+
+// The fastest kernel the running CPU supports, detected once.
+GemmKernel bestGemmKernel();
+
+// C = alpha * A * B + beta * C for row-major, contiguous A (m x k), B (k x n)
+// and C (m x n). B and A are packed into cache-sized blocks (KC x NC panels of
+// B, MC x KC blocks of A) and multiplied by a register-tiled micro-kernel that
+// applies alpha as it accumulates into C. C must not alias A or B.
+void gemm(int m, int n, int k, const double *a, const double *b, double *c, GemmKernel kernel = bestGemmKernel(),
+          double alpha = 1.0, double beta = 0.0);
+
+// gemm() with C split into output tiles that run as tasks on the pool.
+void gemmParallel(int m, int n, int k, const double *a, const double *b, double *c, ThreadPool &pool,
+                  GemmKernel kernel = bestGemmKernel(), double alpha = 1.0, double beta = 0.0);
+
+// gemm() with the best kernel, on ThreadPool::shared() when the product is
+// large enough to benefit.
+void gemmAutoParallel(int m, int n, int k, const double *a, const double *b, double *c, double alpha = 1.0,
+                      double beta = 0.0);
+
+// Textbook triple loop, for testing and as a benchmark baseline.
+void gemmNaive(int m, int n, int k, const double *a, const double *b, double *c);
+
+#endif //COMPILER_GEMM_H
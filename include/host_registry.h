@@ -0,0 +1,43 @@
+#ifndef COMPILER_HOST_REGISTRY_H
+#define COMPILER_HOST_REGISTRY_H
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+
+#include "scope_manager.h"
+#include "value.h"
+
+using HostCallback = std::function<Value(const Value *args, int count)>;
+
+struct HostFunction {
+    std::string name;
+    int arity; // -1 accepts any number of arguments
+    HostCallback callback;
+};
+
+// Native functions callable from scripts by name. The registry is shared by the
+// parser (so calls to host functions are declared) and the execution engines.
+class HostRegistry {
+public:
+    void define(const std::string &name, int arity, HostCallback callback);
+
+    [[nodiscard]] const HostFunction *find(const std::string &name) const;
+
+    void declareIn(ScopeManager &scopes) const;
+
+    // print, throw, str, len and clock, plus matrix(rows, cols), rows(m),
+    // cols(m), at(m, i, j) and put(m, i, j, value) for dense matrices.
+    void defineBuiltins(std::ostream &out);
+
+private:
+    std::unordered_map<std::string, HostFunction> functions;
+};
+
+// Carries a value raised with the throw() builtin up to the nearest catch.
+struct ScriptException {
+    Value value;
+};
+
+#endif //COMPILER_HOST_REGISTRY_H
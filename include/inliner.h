@@ -0,0 +1,81 @@
+#ifndef COMPILER_INLINER_H
+#define COMPILER_INLINER_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ir.h"
+
+// Which script functions each function calls. Calls go by name and a name
+// is bound when its `define` runs, so a call has a known target only when
+// the name is defined once, at the top level of the script, and that define
+// runs before anything that can reach the call: before the call itself in
+// the script, or before every call from the script that leads to the
+// function containing it. The module is taken as the whole program.
+class CallGraph {
+public:
+    explicit CallGraph(const IrModule &module);
+
+    // The function a call always reaches, or null.
+    [[nodiscard]] IrFunction *target(const IrInstr *call) const;
+
+    // The calls in function with a known target, in block order.
+    [[nodiscard]] const std::vector<IrInstr *> &sites(const IrFunction *function) const;
+
+    // Whether function may call itself, directly or through others.
+    [[nodiscard]] bool isRecursive(const IrFunction *function) const { return recursive.count(function) != 0; }
+
+    // Every function after the functions it calls, recursion aside; the
+    // script comes last.
+    [[nodiscard]] const std::vector<IrFunction *> &bottomUp() const { return order; }
+
+private:
+    std::unordered_map<const IrInstr *, IrFunction *> targets;
+    std::unordered_map<const IrFunction *, std::vector<IrInstr *>> calls;
+    std::unordered_set<const IrFunction *> recursive;
+    std::vector<IrFunction *> order;
+};
+
+struct InlinerOptions {
+    int alwaysSize = 8;    // callees this small are inlined wherever they are called
+    int maxSize = 60;      // callees larger than this are never inlined
+    double growth = 2.0;   // a caller may grow to this multiple of its size, or by maxSize
+    int loopWeight = 8;    // times a call in a loop is assumed to run per enclosing run
+    int constantBonus = 2; // instructions expected to fold away per constant argument
+    // Calls per function from a profiling run. A call site then counts as
+    // often as its callee ran per run of its caller.
+    const std::unordered_map<std::string, long> *profile = nullptr;
+};
+
+struct InlineStats {
+    int inlined = 0; // call sites replaced by the callee's body
+    int grown = 0;   // instructions added
+};
+
+// Replaces calls to small script functions by their bodies, callees first so
+// that what they inline themselves comes along. A call site is worth its
+// callee's size when the saved call overhead, plus what its constant
+// arguments fold, times its expected frequency outweighs it; recursive
+// callees, those with handlers or nested functions, and calls in protected
+// blocks are left alone. Each function is simplified after inlining into it,
+// folding the constants the arguments bring in.
+class Inliner {
+public:
+    explicit Inliner(InlinerOptions options = {}) : options(options) {}
+
+    InlineStats inlineCalls(IrModule &module);
+
+private:
+    InlinerOptions options;
+    InlineStats stats;
+
+    [[nodiscard]] bool canInline(const IrFunction &callee) const;
+
+    [[nodiscard]] double frequency(const IrFunction &caller, const IrFunction &callee, int loopDepth) const;
+
+    void inlineCall(IrFunction &caller, IrInstr *call, const IrFunction &callee);
+};
+
+#endif //COMPILER_INLINER_H
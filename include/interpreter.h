@@ -0,0 +1,75 @@
+#ifndef COMPILER_INTERPRETER_H
+#define COMPILER_INTERPRETER_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "host_registry.h"
+#include "resolver.h"
+#include "switch_table.h"
+#include "value.h"
+
+// Tree-walking evaluator. Relies on Resolver slots, so variable access is an
+// array index into the global table or the current frame; function frames live
+// on one shared value stack. Calls and control flow recurse on the native stack.
+class Interpreter {
+public:
+    explicit Interpreter(std::ostream &out = std::cout);
+
+    HostRegistry &host() { return hostFunctions; }
+
+    void defineGlobal(const std::string &name, Value value);
+
+    // Parses, resolves and runs a program. The interpreter keeps the AST alive.
+    void run(const std::string &source);
+
+    // Resolves and runs an already parsed program that must outlive the interpreter.
+    void execute(Expr &program);
+
+    void setMaxCallDepth(int depth) { maxCallDepth = depth; }
+
+private:
+    enum class Completion : std::uint8_t {
+        Normal,
+        Break,
+        Continue,
+        Return
+    };
+
+    std::ostream &out;
+    HostRegistry hostFunctions;
+    Resolver resolver;
+    std::vector<std::string> hostGlobals;
+    std::vector<Value> globals;
+    std::vector<Value> stack;
+    size_t frameBase = 0;
+    int callDepth = 0;
+    int maxCallDepth = 2000;
+    Value returnValue;
+    std::unordered_map<std::string, const FunctionDeclarationExpr *> functions;
+    std::unordered_map<const SwitchStatementExpr *, std::vector<SwitchStep>> switchPlans;
+    std::vector<std::unique_ptr<Expr>> programs;
+
+    Value &variable(const VariableSlot &slot, const std::string &name);
+
+    Value eval(const Expr *expr);
+
+    Value evalCall(const FunctionCallExpr *call);
+
+    Value callFunction(const FunctionDeclarationExpr *function, const FunctionCallExpr *call);
+
+    Completion exec(const Expr *stmt);
+
+    Completion execBlock(const std::vector<std::unique_ptr<Expr>> &statements);
+
+    Completion execSwitch(const SwitchStatementExpr *stmt);
+
+    Completion execTry(const TryCatchFinallyStatementExpr *stmt);
+};
+
+#endif //COMPILER_INTERPRETER_H
@@ -0,0 +1,178 @@
+#ifndef COMPILER_IR_H
+#define COMPILER_IR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "operators.h"
+#include "switch_table.h"
+#include "value.h"
+
+// SSA intermediate representation. A function is a control-flow graph of
+// basic blocks; each block holds its phis, then straight-line instructions,
+// and ends in exactly one terminator. Instructions are their own values.
+//
+// Locals live only in SSA values. Globals are read and written through
+// LoadGlobal/StoreGlobal, since any call may touch them.
+//
+// Exceptions: a block inside a `try` names its handler block, which begins
+// with a Catch. Such a block raises only from its last instruction (the one
+// before the terminator, or a Rethrow terminator), so the values reaching the
+// handler are exactly those live at the block's end. Predecessor lists include
+// these exceptional edges, and phi operands follow predecessor order.
+#define COMPILER_IR_OPS(X) \
+    X(Const, "const")             /* constant                             */ \
+    X(Param, "param")             /* parameter #index                     */ \
+    X(Phi, "phi")                 \
+    X(Catch, "catch")             /* the exception entering this handler  */ \
+    X(LoadGlobal, "loadglobal")   /* G[index]                             */ \
+    X(StoreGlobal, "storeglobal") /* G[index] = op0                       */ \
+    X(Binary, "binary")           /* op0 `binary` op1, never && or ||     */ \
+    X(Unary, "unary")             /* `unary` op0                          */ \
+    X(Truthy, "truthy")           /* bool(op0)                            */ \
+    X(MatMul, "matmul")           /* op0 @ op1                            */ \
+    X(MatChain, "matchain")       /* op0 @ .. @ opN, reordered            */ \
+    X(Call, "call")               /* name(op0 .. opN)                     */ \
+    X(DefineFunction, "define")   /* bind `function` to its name          */ \
+    X(Error, "error")             /* raise a RuntimeError with `name`     */ \
+    X(Jump, "jump")               /* -> succ0                             */ \
+    X(Branch, "branch")           /* op0 ? succ0 : succ1                  */ \
+    X(Switch, "switch")           /* succ[table[op0]], else succ0         */ \
+    X(Return, "return")           /* return op0                           */ \
+    X(Rethrow, "rethrow")         /* raise the exception caught by op0    */ \
+    X(Unreachable, "unreachable")
+
+enum class IrOp : std::uint8_t {
+#define COMPILER_IR_OP_ENUM(name, text) name,
+    COMPILER_IR_OPS(COMPILER_IR_OP_ENUM)
+#undef COMPILER_IR_OP_ENUM
+};
+
+const char *irOpName(IrOp op);
+
+[[nodiscard]] bool isTerminator(IrOp op);
+
+// False for ops that never produce a value, such as stores and terminators.
+[[nodiscard]] bool producesValue(IrOp op);
+
+struct IrBlock;
+struct IrFunction;
+
+struct IrInstr {
+    IrOp op;
+    int id = -1;
+    IrBlock *block = nullptr;
+    std::vector<IrInstr *> operands;
+    // One entry per use, so an instruction using a value twice appears twice.
+    // Unordered: a removed use is replaced by the last one.
+    std::vector<IrInstr *> users;
+    // Where each use is recorded, so that removing one takes constant time:
+    // operand i is operands[i]->users[useIndex[i]], and users[k] uses this as
+    // its operand userOperand[k].
+    std::vector<size_t> useIndex;
+    std::vector<size_t> userOperand;
+
+    Value constant;                      // Const
+    int index = -1;                      // Param number, global slot
+    BinaryOperator binary = BinaryOperator::Unknown;
+    UnaryOperator unary = UnaryOperator::Unknown;
+    std::string name;                    // callee, global or function name, error message; on a
+                                         // Const, the variable it leaves unassigned (`var x;`)
+    IrFunction *function = nullptr;      // DefineFunction
+    std::shared_ptr<SwitchTable> table;  // Switch: targets are successor indices
+
+    explicit IrInstr(IrOp op) : op(op) {}
+
+    void addOperand(IrInstr *value);
+
+    void setOperand(size_t i, IrInstr *value);
+
+    // Drops every operand, unregistering this instruction as their user.
+    void clearOperands();
+
+    // Points every user at value instead.
+    void replaceAllUsesWith(IrInstr *value);
+
+    // True when executing the instruction can raise an exception.
+    [[nodiscard]] bool mayThrow() const;
+
+    // True when the instruction does more than compute its value: it writes
+    // memory, calls out, binds a function, may throw, or ends the block.
+    [[nodiscard]] bool hasSideEffects() const;
+};
+
+struct IrBlock {
+    int id = -1;
+    std::vector<IrInstr *> phis;
+    std::vector<IrInstr *> instructions; // the terminator is last
+    std::vector<IrBlock *> successors;   // normal successors, as the terminator names them
+    IrBlock *handler = nullptr;          // exceptional successor
+    std::vector<IrBlock *> predecessors;
+
+    [[nodiscard]] IrInstr *terminator() const {
+       return instructions.empty() || !isTerminator(instructions.back()->op) ? nullptr : instructions.back();
+    }
+
+    // Normal successors, then the handler.
+    template<typename F>
+    void forEachSuccessor(F f) const {
+       for (IrBlock *successor: successors) f(successor);
+       if (handler) f(handler);
+    }
+
+    // Position of pred in predecessors, which is also its phi operand index.
+    [[nodiscard]] size_t predecessorIndex(const IrBlock *pred) const;
+
+    // Drops predecessor i and the matching phi operands. The predecessor's
+    // successor list is left to the caller.
+    void removePredecessor(size_t i);
+};
+
+struct IrFunction {
+    std::string name;
+    int arity = 0;
+    std::vector<std::unique_ptr<IrBlock>> blocks; // blocks[0] is the entry
+    std::vector<std::unique_ptr<IrInstr>> values; // owns every instruction ever created
+
+    [[nodiscard]] IrBlock *entry() const { return blocks.front().get(); }
+
+    IrBlock *newBlock();
+
+    IrInstr *newInstr(IrOp op);
+
+    // A copy of instr's op and attributes, with no operands and no block.
+    IrInstr *cloneInstr(const IrInstr &instr);
+
+    // Drops blocks not reachable from the entry, with their edges into
+    // reachable blocks and the matching phi operands, then puts the rest in
+    // reverse postorder and renumbers.
+    void compactBlocks();
+
+    // Renumbers blocks by position and values in block order.
+    void renumber();
+};
+
+// Output of the IrBuilder. functions[0] is the top-level script.
+struct IrModule {
+    std::vector<std::unique_ptr<IrFunction>> functions;
+
+    [[nodiscard]] IrFunction &main() const { return *functions.front(); }
+};
+
+// Blocks reachable from the entry, every block after all of its predecessors
+// except along back edges. Exceptional edges count.
+std::vector<IrBlock *> reversePostorder(const IrFunction &function);
+
+// Checks structural and SSA invariants and throws a CompilerError naming the
+// first violation.
+void verifyIr(const IrFunction &function);
+
+void verifyIr(const IrModule &module);
+
+std::string dumpIr(const IrFunction &function);
+
+std::string dumpIr(const IrModule &module);
+
+#endif //COMPILER_IR_H
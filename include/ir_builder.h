@@ -0,0 +1,120 @@
+#ifndef COMPILER_IR_BUILDER_H
+#define COMPILER_IR_BUILDER_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "ir.h"
+
+// Lowers a resolved AST (see Resolver) to SSA form in one pass, using the
+// on-the-fly construction of Braun et al.: a local's current value is looked up
+// per block, and phis are placed only where a read meets differing definitions
+// at a join. Blocks are sealed once all their predecessors are known, so the
+// work is linear in the size of the program. `finally` bodies are lowered on
+// every path that leaves the protected region, as the BytecodeCompiler does.
+class IrBuilder {
+public:
+    std::unique_ptr<IrModule> build(const Expr &program);
+
+private:
+    struct Loop {
+        IrBlock *breakTarget;
+        IrBlock *continueTarget; // null for a switch
+        size_t tryDepth;
+    };
+
+    // Code protected by a handler, or a finally body running on the
+    // exceptional path (which has no handler of its own).
+    struct TryRegion {
+        const Expr *finallyBlock;
+        IrBlock *handler;
+    };
+
+    struct BlockState {
+        std::unordered_map<int, IrInstr *> definitions;
+        std::vector<std::pair<int, IrInstr *>> incompletePhis;
+        bool sealed = false;
+    };
+
+    struct FunctionState {
+        IrFunction *function = nullptr;
+        IrBlock *current = nullptr; // null while lowering unreachable code
+        std::vector<BlockState> blocks;
+        std::vector<Loop> loops;
+        std::vector<TryRegion> tries;
+        std::unordered_map<IrInstr *, IrInstr *> replaced; // trivial phis removed
+        IrInstr *undefined = nullptr;
+    };
+
+    IrModule *module = nullptr;
+    FunctionState *state = nullptr;
+
+    void buildFunction(IrFunction &function, const Expr *body, int arity);
+
+    IrBlock *newBlock();
+
+    void sealBlock(IrBlock *block);
+
+    // Makes block current; code after a block nothing jumps to is unreachable.
+    void startBlock(IrBlock *block);
+
+    IrInstr *create(IrOp op, const std::vector<IrInstr *> &operands = {});
+
+    // Appends instr to the current block. Inside a `try`, an instruction that
+    // may raise ends its block, which gets an edge to the handler.
+    IrInstr *append(IrInstr *instr);
+
+    IrInstr *emitConstant(const Value &value);
+
+    IrInstr *terminate(IrOp op, const std::vector<IrInstr *> &operands, std::vector<IrBlock *> successors);
+
+    void jumpTo(IrBlock *target);
+
+    [[nodiscard]] IrBlock *currentHandler() const;
+
+    IrInstr *undefinedValue();
+
+    IrInstr *newPhi(IrBlock *block);
+
+    void writeVariable(int slot, IrBlock *block, IrInstr *value);
+
+    IrInstr *readVariable(int slot, IrBlock *block);
+
+    IrInstr *readVariableAtJoin(int slot, IrBlock *block);
+
+    IrInstr *addPhiOperands(int slot, IrInstr *phi);
+
+    IrInstr *tryRemoveTrivialPhi(IrInstr *phi);
+
+    IrInstr *resolveReplaced(IrInstr *value);
+
+    IrInstr *joinValues(IrBlock *join, const std::vector<std::pair<IrBlock *, IrInstr *>> &incoming);
+
+    void lowerStatement(const Expr *stmt);
+
+    IrInstr *lowerExpression(const Expr *expr);
+
+    void lowerBranch(const Expr *condition, IrBlock *ifTrue, IrBlock *ifFalse);
+
+    IrInstr *lowerLogical(const BinaryExpr *binary);
+
+    IrInstr *loadVariable(const VariableSlot &slot, const std::string &name);
+
+    void storeVariable(const VariableSlot &slot, const std::string &name, IrInstr *value);
+
+    void lowerLoop(const Expr *condition, const Expr *body, const Expr *increment, bool testFirst);
+
+    void lowerSwitch(const SwitchStatementExpr *stmt);
+
+    void lowerTry(const TryCatchFinallyStatementExpr *stmt);
+
+    void lowerRethrowingFinally(const Expr *finallyBlock, IrInstr *exception);
+
+    void lowerFunctionDeclaration(const FunctionDeclarationExpr *function);
+
+    void leaveTryRegions(size_t depth);
+};
+
+#endif //COMPILER_IR_BUILDER_H
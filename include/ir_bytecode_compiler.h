@@ -0,0 +1,94 @@
+#ifndef COMPILER_IR_BYTECODE_COMPILER_H
+#define COMPILER_IR_BYTECODE_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "bytecode.h"
+#include "dataflow.h"
+#include "ir.h"
+#include "register_allocator.h"
+
+// Compiles IR to register bytecode, so that optimized IR can run on the VM.
+// Values live in the registers the RegisterAllocator picks; a call passes its
+// arguments in a window above all of them, where the callee's frame begins.
+// Small integer constants become instruction operands, a comparison that
+// only feeds the branch after it becomes a compare-and-branch, and phis turn
+// into copies at the end of the predecessor, before its branch, or on a stub
+// the edge jumps through. Exception handlers are not supported: a function
+// with a catch is rejected with a CompilerError.
+class IrBytecodeCompiler {
+public:
+    std::unique_ptr<Program> compile(IrModule &module);
+
+private:
+    // A register or a constant to load.
+    struct Move {
+        int target;
+        int source;              // -1 for a constant
+        const IrInstr *constant;
+    };
+
+    struct EdgeStub {
+        int label;
+        const IrBlock *from;
+        const IrBlock *to;
+    };
+
+    struct FunctionState {
+        IrFunction *function = nullptr;
+        FunctionProto *proto = nullptr;
+        std::unique_ptr<Liveness> liveness;
+        std::unique_ptr<RegisterAllocator> allocator;
+        std::vector<const IrInstr *> values; // by id
+        int window = 0; // first register above every value; also the scratch register
+        std::unordered_set<const IrInstr *> fused;
+        std::unordered_map<std::string, int> constantIndex;
+        std::unordered_map<const FunctionProto *, int> nestedIndex;
+        std::vector<size_t> labels; // by label: blocks first, by id, then edge stubs
+        std::vector<std::pair<size_t, int>> jumps;
+        std::vector<std::pair<size_t, std::vector<int>>> switches; // SWITCH position, label of each successor
+        std::vector<EdgeStub> stubs;
+    };
+
+    std::unordered_map<const IrFunction *, FunctionProto *> protos;
+    const IrFunction *script = nullptr;
+    FunctionState *current = nullptr;
+
+    void compileFunction(IrFunction &function, FunctionProto &proto);
+
+    [[nodiscard]] bool needsRegister(const IrInstr *value) const;
+
+    [[nodiscard]] int reg(const IrInstr *value) const;
+
+    size_t emit(Instruction instruction);
+
+    void emitJump(int label, OpCode op = OpCode::JMP, int a = 0);
+
+    int constant(const Value &value);
+
+    void emitLoad(int target, const Value &value);
+
+    [[nodiscard]] bool isTailCall(const IrInstr *instr) const;
+
+    void emitInstruction(const IrInstr *instr);
+
+    void emitArguments(const IrInstr *instr);
+
+    void emitTerminator(const IrBlock *block, const IrBlock *next);
+
+    void emitBranch(const IrInstr *branch, const std::vector<int> &targets, int fallthrough);
+
+    std::vector<Move> edgeMoves(const IrBlock *from, const IrBlock *to) const;
+
+    void emitMoves(std::vector<Move> moves);
+
+    int edgeLabel(const IrBlock *from, const IrBlock *to);
+
+    void patch();
+};
+
+#endif //COMPILER_IR_BYTECODE_COMPILER_H
@@ -0,0 +1,35 @@
+#ifndef COMPILER_IR_SIMPLIFIER_H
+#define COMPILER_IR_SIMPLIFIER_H
+
+#include "ir.h"
+
+// Cleans up after IR transformations, until nothing changes:
+//  - folds binary, unary and truthy instructions on constants, unless the
+//    operation raises;
+//  - turns branches and switches on constants into jumps;
+//  - removes trivial phis and instructions whose values nothing needs;
+//  - merges a block into its predecessor when that is its only one and ends
+//    in a jump to it.
+// Leaves the blocks compacted (IrFunction::compactBlocks).
+class IrSimplifier {
+public:
+    // Returns the number of instructions folded or removed.
+    int simplify(IrFunction &function);
+
+    int simplify(IrModule &module);
+
+private:
+    int changes = 0;
+
+    bool foldConstants(IrFunction &function);
+
+    bool foldBranches(IrFunction &function);
+
+    bool removeTrivialPhis(IrFunction &function);
+
+    bool removeDeadCode(IrFunction &function);
+
+    bool mergeBlocks(IrFunction &function);
+};
+
+#endif //COMPILER_IR_SIMPLIFIER_H
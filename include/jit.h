@@ -0,0 +1,81 @@
+#ifndef COMPILER_JIT_H
+#define COMPILER_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bytecode.h"
+#include "value.h"
+
+// The JIT emits System V x86-64 code into pages from mmap; elsewhere
+// BaselineJit::compile always fails and the VM keeps interpreting.
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+                            defined(__OpenBSD__))
+#define COMPILER_JIT_AVAILABLE 1
+#endif
+
+// Native code for one FunctionProto. It works on the VM's register window
+// and globals in place, so it can be entered at any instruction and leaves
+// the interpreter nothing to reconstruct when it exits.
+class JitFunction {
+public:
+    JitFunction(std::uint8_t *code, size_t mappedSize, std::vector<std::uint32_t> offsets,
+                std::vector<bool> entries)
+            : code(code), mappedSize(mappedSize), offsets(std::move(offsets)), entries(std::move(entries)) {}
+
+    JitFunction(const JitFunction &) = delete;
+
+    JitFunction &operator=(const JitFunction &) = delete;
+
+    ~JitFunction();
+
+    // Runs from instruction pc until an instruction the native code does not
+    // handle, which it leaves unexecuted, and returns that instruction's index.
+    size_t run(Value *registers, Value *globals, size_t pc) const {
+       using Entry = std::uint32_t (*)(Value *, Value *, const std::uint8_t *);
+       return reinterpret_cast<Entry>(code)(registers, globals, code + offsets[pc]);
+    }
+
+    // Whether entering at pc is worth it: false where the code would exit
+    // again after only a few instructions.
+    [[nodiscard]] bool entersAt(size_t pc) const { return entries[pc]; }
+
+    [[nodiscard]] size_t codeSize() const { return mappedSize; }
+
+private:
+    std::uint8_t *code;
+    size_t mappedSize;
+    std::vector<std::uint32_t> offsets; // native offset of each instruction
+    std::vector<bool> entries;
+};
+
+// Baseline tier of the VM: translates bytecode one instruction at a time,
+// without analysis, into templates over the NaN-boxed registers. Moves and
+// constants of non-object values, integer and float arithmetic, comparisons,
+// compare-and-branch and jumps on booleans, integers and null run inline.
+// Anything else exits to the interpreter at that instruction: calls and
+// returns, strings and matrices, rethrows, and every type guard that fails,
+// including writes that would drop a reference to an object. The code never
+// calls out or throws, so the interpreter alone deals with errors and
+// reference counts.
+//
+// The code is written while its pages are writable and then mapped read and
+// execute only.
+class BaselineJit {
+public:
+    static bool supported();
+
+    // Compiles function and installs the result as function.jitCode. Returns
+    // false, leaving function to the interpreter, when this host cannot run
+    // the code or when no instruction is worth entering it at.
+    bool compile(FunctionProto &function);
+
+    [[nodiscard]] size_t compiledCount() const { return compiled.size(); }
+
+private:
+    std::vector<std::unique_ptr<JitFunction>> compiled;
+};
+
+#endif //COMPILER_JIT_H
@@ -0,0 +1,91 @@
+#ifndef COMPILER_LOOP_OPTIMIZER_H
+#define COMPILER_LOOP_OPTIMIZER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "ir.h"
+#include "loops.h"
+
+// What an instruction costs to run on a target, and how far the loop
+// transformations may grow the code. On the VM every instruction is one
+// dispatch whatever it computes; native code pays more for a multiply.
+struct LoopCostModel {
+    int multiplyCost = 1;
+    int addCost = 1;
+    int maxUnrollTrip = 16;   // iterations of the longest loop unrolled completely
+    int unrollBudget = 128;   // instructions an unrolled loop may grow to
+    int registerBudget = 200; // values live across a loop before hoisting stops
+
+    static LoopCostModel vm() { return {}; }
+
+    static LoopCostModel native() {
+       LoopCostModel model;
+       model.multiplyCost = 3;
+       return model;
+    }
+};
+
+struct LoopOptions {
+    bool hoist = true;
+    bool strengthReduce = true;
+    bool unroll = true;
+    LoopCostModel costs = LoopCostModel::vm(); // see OptimizerOptions::native()
+};
+
+struct LoopStats {
+    int loops = 0;
+    int hoisted = 0;  // instructions moved to a preheader
+    int reduced = 0;  // multiplications replaced by an induction variable
+    int unrolled = 0; // loops replaced by straight-line code
+
+    LoopStats &operator+=(const LoopStats &other);
+};
+
+// Optimizes the natural loops of simplified IR (see IrSimplifier):
+//  - loop-invariant code motion: instructions whose operands do not change in
+//    the loop move to its preheader. Those that cannot raise move from
+//    anywhere in the loop; one that may raise moves only when nothing with
+//    an effect runs before it on entry to the loop header, which the
+//    rotated loops of the IrBuilder run on every entry;
+//  - complete unrolling of single-block loops whose induction variable runs
+//    a constant number of times;
+//  - strength reduction of `iv * k` (and `iv * k + b`) into an induction
+//    variable of its own, stepped by an add, when the cost model favours it.
+// Globals stay in memory: a loop that calls out or stores a global keeps its
+// loads of it. Loops with exception handlers are left alone. The result is
+// simplified again.
+class LoopOptimizer {
+public:
+    explicit LoopOptimizer(LoopOptions options = {}) : options(options) {}
+
+    LoopStats optimize(IrFunction &function);
+
+    LoopStats optimize(IrModule &module);
+
+private:
+    // phi runs init, init + step, ...; update is its value around the back edge.
+    struct InductionVariable {
+        IrInstr *phi;
+        IrInstr *update;
+        std::int32_t init;
+        std::int32_t step;
+    };
+
+    LoopOptions options;
+    LoopStats stats;
+
+    std::vector<InductionVariable> inductionVariables(const NaturalLoop &loop) const;
+
+    void hoistInvariants(IrFunction &function, const LoopInfo &info);
+
+    void unrollLoops(IrFunction &function, LoopInfo &info);
+
+    int tripCount(const InductionVariable &iv, const IrInstr *compare, bool continueWhenTrue) const;
+
+    void unroll(IrFunction &function, IrBlock *header, IrBlock *exit, int trips);
+
+    void reduceStrength(IrFunction &function, const LoopInfo &info);
+};
+
+#endif //COMPILER_LOOP_OPTIMIZER_H
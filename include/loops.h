@@ -0,0 +1,57 @@
+#ifndef COMPILER_LOOPS_H
+#define COMPILER_LOOPS_H
+
+#include <memory>
+#include <vector>
+
+#include "dominators.h"
+#include "ir.h"
+
+class LoopInfo;
+
+// A natural loop: the header and every block that reaches one of its back
+// edges without passing through it. Back edges into the same header form one
+// loop. Membership is by block id, so the function must not be renumbered
+// while the loop is in use.
+struct NaturalLoop {
+    IrBlock *header = nullptr;
+    std::vector<IrBlock *> blocks;  // in function order, so the header is first
+    std::vector<IrBlock *> latches; // sources of the back edges
+    NaturalLoop *parent = nullptr;  // innermost enclosing loop
+    std::vector<NaturalLoop *> children;
+    int depth = 1;                  // 1 for an outermost loop
+    const LoopInfo *info = nullptr;
+
+    // Whether this loop is the innermost one of block or encloses it.
+    [[nodiscard]] bool contains(const IrBlock *block) const;
+
+    // The only predecessor of the header from outside the loop, when it ends
+    // in a jump to the header and is not protected by a handler; null
+    // otherwise. Code placed at its end runs exactly when the loop is entered.
+    [[nodiscard]] IrBlock *preheader() const;
+};
+
+// The natural loops of a function and how they nest.
+class LoopInfo {
+public:
+    LoopInfo(const IrFunction &function, const DominatorTree &dominators);
+
+    LoopInfo(const LoopInfo &) = delete;
+    LoopInfo &operator=(const LoopInfo &) = delete;
+
+    // Inner loops come before the loops that contain them.
+    [[nodiscard]] const std::vector<std::unique_ptr<NaturalLoop>> &loops() const { return all; }
+
+    // The innermost loop containing block, or null.
+    [[nodiscard]] NaturalLoop *loopFor(const IrBlock *block) const { return innermost[block->id]; }
+
+    // Forgets a loop whose back edges are gone; its blocks and inner loops
+    // go to its parent.
+    void remove(NaturalLoop *loop);
+
+private:
+    std::vector<std::unique_ptr<NaturalLoop>> all;
+    std::vector<NaturalLoop *> innermost;
+};
+
+#endif //COMPILER_LOOPS_H
@@ -0,0 +1,70 @@
+#ifndef COMPILER_MATRIX_H
+#define COMPILER_MATRIX_H
+
+#include <string>
+#include <vector>
+
+#include "gemm.h"
+#include "matrix_expr.h"
+#include "operators.h"
+#include "value.h"
+
+// Dense row-major matrix of doubles with cache-line-aligned storage. The
+// result of a matrix operator starts out as a pending expression (see
+// MatrixExprNode) and is only evaluated once its elements are needed, so that
+// chains of operators run fused without full-size temporaries.
+struct MatrixObject : HeapObject {
+    int rows;
+    int cols;
+    // Elements, or null while the matrix is a pending expression. Storage may
+    // be shared with pending expressions that read it; writers copy first.
+    MatrixStorage data;
+    MatrixExprRef pending;
+
+    // Zero-filled. Throws RuntimeError on negative or oversized dimensions.
+    MatrixObject(int rows, int cols);
+
+    explicit MatrixObject(MatrixExprRef expression);
+
+    // Evaluates a pending expression, then returns the elements.
+    const double *elements();
+
+    // elements() for writing.
+    double *mutableElements();
+
+    // This matrix as an operand of a larger expression.
+    MatrixExprRef expression() const;
+
+    double at(int row, int col) { return elements()[static_cast<std::size_t>(row) * cols + col]; }
+
+    std::string toString();
+};
+
+inline MatrixObject *asMatrix(const Value &value) { return static_cast<MatrixObject *>(value.asObject()); }
+
+// Implements `left @ right`. Throws RuntimeError unless both operands are
+// matrices with matching inner dimensions.
+Value matrixMultiply(const Value &left, const Value &right);
+
+// Implements +, - and * where at least one operand is a matrix: elementwise
+// between same-shaped matrices, or with a number applied to every element.
+Value matrixElementwise(BinaryOperator op, const Value &left, const Value &right);
+
+// Unary minus and plus on a matrix.
+Value matrixUnary(UnaryOperator op, const Value &operand);
+
+// Optimal parenthesization of a product of matrices where matrix i is
+// dims[i] x dims[i + 1]. split[i][j] is the last multiplication of the
+// sub-chain i..j: (i..split) @ (split + 1..j).
+struct MatrixChainPlan {
+    std::vector<std::vector<int>> split;
+    double cost; // scalar multiply-adds
+};
+
+MatrixChainPlan planMatrixChain(const std::vector<int> &dims);
+
+// Multiplies count operands in the order chosen by planMatrixChain. Only the
+// result is a new matrix; intermediates live in reused scratch buffers.
+Value matrixChainMultiply(const Value *operands, int count);
+
+#endif //COMPILER_MATRIX_H
@@ -0,0 +1,54 @@
+#ifndef COMPILER_MATRIX_EXPR_H
+#define COMPILER_MATRIX_EXPR_H
+
+#include <memory>
+
+using MatrixStorage = std::shared_ptr<double[]>;
+
+// Node of a deferred matrix expression. Nodes are immutable and may be shared,
+// so expressions form a DAG. Leaves hold their own reference to the storage
+// they read, which makes a pending expression a snapshot of its inputs.
+struct MatrixExprNode {
+    enum class Kind {
+        Leaf,     // storage
+        Constant, // every element is `offset`
+        Affine,   // scale * left + offset
+        Add,      // left + right
+        Subtract, // left - right
+        Multiply, // left * right, elementwise
+        Product   // left @ right
+    };
+
+    Kind kind;
+    int rows;
+    int cols;
+    int height = 1;
+    MatrixStorage leaf;
+    std::shared_ptr<const MatrixExprNode> left;
+    std::shared_ptr<const MatrixExprNode> right;
+    double scale = 1.0;
+    double offset = 0.0;
+
+    // Elements once computed, shared by every use of the node: always kept
+    // for a Product, and for any node an evaluation reaches more than once.
+    mutable MatrixStorage computed;
+};
+
+using MatrixExprRef = std::shared_ptr<const MatrixExprNode>;
+
+MatrixExprRef matrixLeaf(MatrixStorage storage, int rows, int cols);
+
+// scale * operand + offset; nested affine nodes are folded into one.
+MatrixExprRef matrixAffine(const MatrixExprRef &operand, double scale, double offset);
+
+// Add, Subtract or Multiply of two same-shaped operands, or Product.
+MatrixExprRef matrixBinary(MatrixExprNode::Kind kind, const MatrixExprRef &left, const MatrixExprRef &right);
+
+// Computes the elements of an expression. Elementwise operators run fused,
+// chunk by chunk, in one pass over memory; a product reached only through
+// additions and scaling is computed by one GEMM that accumulates straight into
+// the result, with the rest of the expression as its bias. Nodes the
+// expression reaches along several paths are computed first, once each.
+MatrixStorage evaluateMatrixExpr(const MatrixExprRef &node);
+
+#endif //COMPILER_MATRIX_EXPR_H
@@ -0,0 +1,87 @@
+#ifndef COMPILER_OPERATORS_H
+#define COMPILER_OPERATORS_H
+
+#include <cstdint>
+#include <string>
+
+enum class BinaryOperator : std::uint8_t {
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    And,
+    Or,
+    Unknown
+};
+
+enum class UnaryOperator : std::uint8_t {
+    Plus,
+    Negate,
+    Not,
+    BitwiseNot,
+    Unknown
+};
+
+inline BinaryOperator binaryOperatorFromLexeme(const std::string &op) {
+   if (op == "+") return BinaryOperator::Add;
+   if (op == "-") return BinaryOperator::Subtract;
+   if (op == "*") return BinaryOperator::Multiply;
+   if (op == "/") return BinaryOperator::Divide;
+   if (op == "==") return BinaryOperator::Equal;
+   if (op == "!=") return BinaryOperator::NotEqual;
+   if (op == "<") return BinaryOperator::Less;
+   if (op == "<=") return BinaryOperator::LessEqual;
+   if (op == ">") return BinaryOperator::Greater;
+   if (op == ">=") return BinaryOperator::GreaterEqual;
+   if (op == "&&") return BinaryOperator::And;
+   if (op == "||") return BinaryOperator::Or;
+   return BinaryOperator::Unknown;
+}
+
+inline UnaryOperator unaryOperatorFromLexeme(const std::string &op) {
+   if (op == "+") return UnaryOperator::Plus;
+   if (op == "-") return UnaryOperator::Negate;
+   if (op == "!") return UnaryOperator::Not;
+   if (op == "~") return UnaryOperator::BitwiseNot;
+   return UnaryOperator::Unknown;
+}
+
+inline const char *operatorLexeme(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return "+";
+      case BinaryOperator::Subtract:
+         return "-";
+      case BinaryOperator::Multiply:
+         return "*";
+      case BinaryOperator::Divide:
+         return "/";
+      case BinaryOperator::Equal:
+         return "==";
+      case BinaryOperator::NotEqual:
+         return "!=";
+      case BinaryOperator::Less:
+         return "<";
+      case BinaryOperator::LessEqual:
+         return "<=";
+      case BinaryOperator::Greater:
+         return ">";
+      case BinaryOperator::GreaterEqual:
+         return ">=";
+      case BinaryOperator::And:
+         return "&&";
+      case BinaryOperator::Or:
+         return "||";
+      case BinaryOperator::Unknown:
+         break;
+   }
+   return "?";
+}
+
+#endif //COMPILER_OPERATORS_H
@@ -0,0 +1,59 @@
+#ifndef COMPILER_OPTIMIZER_H
+#define COMPILER_OPTIMIZER_H
+
+#include <memory>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "inliner.h"
+#include "ir.h"
+#include "loop_optimizer.h"
+#include "value_numbering.h"
+
+struct OptimizerOptions {
+    bool inlining = true;
+    InlinerOptions inlinerOptions;
+    bool valueNumbering = true;
+    bool loops = true;
+    LoopOptions loopOptions;
+
+    // For code the native backends compile, where a multiply costs more
+    // than the VM's one dispatch.
+    static OptimizerOptions native() {
+       OptimizerOptions options;
+       options.loopOptions.costs = LoopCostModel::native();
+       return options;
+    }
+};
+
+struct OptimizerReport {
+    bool compiled = false; // false when the program was left to the BytecodeCompiler
+    int simplified = 0;    // instructions folded or removed by the IrSimplifier
+    InlineStats inlining;
+    ValueNumberingStats valueNumbering;
+    LoopStats loops;
+};
+
+// The optimizing pipeline from a resolved AST to bytecode: IrBuilder,
+// IrSimplifier, Inliner, ValueNumbering, LoopOptimizer, then
+// IrBytecodeCompiler. Programs the IR
+// backend cannot compile, those with exception handlers or with a function
+// needing more registers than the VM has, yield null so that the caller can
+// use the BytecodeCompiler instead.
+class Optimizer {
+public:
+    explicit Optimizer(OptimizerOptions options = {}) : options(options) {}
+
+    std::unique_ptr<Program> compile(const Expr &program);
+
+    // The optimized IR, for inspection.
+    std::unique_ptr<IrModule> optimize(const Expr &program);
+
+    [[nodiscard]] const OptimizerReport &report() const { return lastReport; }
+
+private:
+    OptimizerOptions options;
+    OptimizerReport lastReport;
+};
+
+#endif //COMPILER_OPTIMIZER_H
@@ -12,13 +12,16 @@
 #include "token_type.h"
 #include "ast.h"
 #include "scope_manager.h"
+#include "type_context.h"
 
 class Parser {
 public:
-    explicit Parser(const std::vector<Token> &tokens);
+    explicit Parser(const std::vector<Token> &tokens, TypeContext &types = TypeContext::global());
 
     ScopeManager scopeManager;
 
+    TypeContext &types;
+
     std::unique_ptr<Expr> parse();
 
 private:
@@ -40,6 +43,8 @@ private:
 
     [[nodiscard]] static int getAssociativity(TokenType type);
 
+    [[nodiscard]] static std::string unescapeString(const std::string &lexeme);
+
     std::unique_ptr<Expr> expression();
 
     std::unique_ptr<Expr> primary();
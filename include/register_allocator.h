@@ -0,0 +1,38 @@
+#ifndef COMPILER_REGISTER_ALLOCATOR_H
+#define COMPILER_REGISTER_ALLOCATOR_H
+
+#include <functional>
+#include <vector>
+
+#include "dataflow.h"
+#include "ir.h"
+
+// Linear-scan register allocation over the blocks in function order. A value
+// keeps one register from its definition to its last use, live-through blocks
+// included, so allocation never spills or splits; a function that needs more
+// than `limit` registers is rejected with a CompilerError. A value whose last
+// use is an instruction may share its register with that instruction's
+// result. Parameter i stays in register i, where the VM passes it, and a phi
+// prefers the register of its operands, so that most phi copies vanish.
+class RegisterAllocator {
+public:
+    // needsRegister tells which values are kept in registers; the rest are
+    // folded into the instructions using them. Values must be numbered
+    // (IrFunction::renumber) as for the liveness.
+    RegisterAllocator(const IrFunction &function, const Liveness &liveness,
+                      const std::function<bool(const IrInstr *)> &needsRegister, int limit);
+
+    // The register of value, or -1 when it has none.
+    [[nodiscard]] int registerOf(const IrInstr *value) const {
+       return value->id >= 0 && static_cast<size_t>(value->id) < registers.size() ? registers[value->id] : -1;
+    }
+
+    // Registers used: all of them are below this.
+    [[nodiscard]] int count() const { return used; }
+
+private:
+    std::vector<int> registers; // by value id
+    int used = 0;
+};
+
+#endif //COMPILER_REGISTER_ALLOCATOR_H
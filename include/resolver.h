@@ -0,0 +1,52 @@
+#ifndef COMPILER_RESOLVER_H
+#define COMPILER_RESOLVER_H
+
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "scope_manager.h"
+
+// Runs after Parser::parse() and replaces name-based variable access with
+// storage indices. Variables declared outside any function become globals;
+// parameters and locals get a flat slot in their function's frame, with slots
+// reused by sibling blocks, and each FunctionDeclarationExpr records the frame
+// size it needs. Names that are not variables (functions, host names) stay
+// unresolved. Functions cannot capture locals of an enclosing function.
+class Resolver {
+public:
+    // Reserves a global slot for a variable the host defines before the program runs.
+    int declareGlobal(const std::string &name);
+
+    void resolve(Expr &program);
+
+    [[nodiscard]] int globalCount() const { return static_cast<int>(globals.size()); }
+
+    [[nodiscard]] const std::vector<std::string> &globalNames() const { return globals; }
+
+private:
+    struct Frame {
+        std::string function;
+        int nextSlot = 0;
+        int maxSlot = 0;
+    };
+
+    ScopeManager scopes;
+    std::vector<Frame> frames;
+    std::vector<int> scopeMarks;
+    std::vector<std::string> globals;
+
+    void beginScope();
+
+    void endScope();
+
+    VariableSlot declare(const std::string &name, SymbolType kind);
+
+    VariableSlot reference(const std::string &name);
+
+    void visit(Expr *expr);
+
+    void visitFunction(FunctionDeclarationExpr *function);
+};
+
+#endif //COMPILER_RESOLVER_H
@@ -0,0 +1,100 @@
+#ifndef COMPILER_SWITCH_TABLE_H
+#define COMPILER_SWITCH_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "value.h"
+
+struct SwitchStatementExpr;
+
+// Constant-time or logarithmic dispatch over integer and string case values.
+// Each key maps to an opaque target: a case index while planning, a jump
+// offset once compiled to bytecode. Integers are a jump table when their range
+// is dense and a sorted array otherwise; strings use a perfect hash.
+class SwitchTable {
+public:
+    static constexpr int NO_MATCH = -1;
+
+    // Keys already present keep their first target, like the first matching case.
+    void addInteger(std::int32_t key, int target);
+
+    void addString(const std::string &key, int target);
+
+    // Lays out the lookup structures; call after the last add.
+    void build();
+
+    // Target for subject, or NO_MATCH. Matches like Value::equals: a float
+    // subject with an integral value finds the integer key.
+    [[nodiscard]] int lookup(const Value &subject) const;
+
+    // Rewrites every target; call after build().
+    template<typename F>
+    void mapTargets(F f) {
+       for (auto &entry: integers) entry.second = f(entry.second);
+       for (int &target: dense) {
+          if (target != NO_MATCH) target = f(target);
+       }
+       for (auto &entry: slots) {
+          if (entry.target != NO_MATCH) entry.target = f(entry.target);
+       }
+    }
+
+    // Visits every key with its target, integers in order then strings;
+    // call after build().
+    template<typename FInt, typename FString>
+    void forEachKey(FInt onInteger, FString onString) const {
+       for (size_t i = 0; i < dense.size(); ++i) {
+          if (dense[i] != NO_MATCH) onInteger(static_cast<std::int32_t>(low + static_cast<std::int64_t>(i)), dense[i]);
+       }
+       for (const auto &entry: integers) onInteger(entry.first, entry.second);
+       for (const auto &entry: slots) {
+          if (entry.target != NO_MATCH) onString(entry.key, entry.target);
+       }
+    }
+
+    [[nodiscard]] std::string describe() const;
+
+private:
+    struct StringEntry {
+        std::string key;
+        int target = NO_MATCH;
+    };
+
+    // Sorted by key after build(); dense is filled instead when the range allows.
+    std::vector<std::pair<std::int32_t, int>> integers;
+    std::int32_t low = 0;
+    std::vector<int> dense;
+
+    // Pending strings until build() moves them into slots: the key in bucket
+    // hash(key, 0) % seeds.size() lives at hash(key, seed of bucket) % slots.size().
+    std::vector<StringEntry> strings;
+    std::vector<std::uint32_t> seeds;
+    std::vector<StringEntry> slots;
+    size_t stringCount = 0;
+
+    [[nodiscard]] int lookupInteger(std::int32_t key) const;
+
+    [[nodiscard]] int lookupString(const std::string &key) const;
+
+    bool placeStrings(size_t bucketCount, size_t slotCount);
+};
+
+// One step of a lowered switch: a run of integer and string literal cases
+// resolved through `table`, or, when table is null, the single case
+// `firstCase` compared in order as before.
+struct SwitchStep {
+    size_t firstCase;
+    std::shared_ptr<SwitchTable> table;
+};
+
+// Runs shorter than this stay linear; a few comparisons beat a lookup.
+constexpr size_t MIN_SWITCH_TABLE_CASES = 4;
+
+// Splits the cases of stmt into steps; tried in order they select the same
+// case as comparing every case in turn. Table targets are case indices.
+std::vector<SwitchStep> planSwitch(const SwitchStatementExpr &stmt);
+
+#endif //COMPILER_SWITCH_TABLE_H
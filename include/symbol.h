@@ -23,14 +23,18 @@ enum class SymbolType {
 struct Symbol {
     std::string name;
     SymbolType type;
-    std::shared_ptr<Type> declaredType;
+    TypeRef declaredType;
 
     bool isMutable;
     int line;
     int column;
 
-    Symbol(std::string n, SymbolType k, std::shared_ptr<Type> t, bool mut, int ln, int col)
-            : name(std::move(n)), type(k), declaredType(std::move(t)), isMutable(mut), line(ln), column(col) {}
+    // Storage assigned by the Resolver: a global index at frame depth 0, else a frame slot.
+    int slot = -1;
+    int frameDepth = 0;
+
+    Symbol(std::string n, SymbolType k, TypeRef t, bool mut, int ln, int col)
+            : name(std::move(n)), type(k), declaredType(t), isMutable(mut), line(ln), column(col) {}
 };
 
 #endif //COMPILER_SYMBOL_H
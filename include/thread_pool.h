@@ -0,0 +1,60 @@
+#ifndef COMPILER_THREAD_POOL_H
+#define COMPILER_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker pops
+// from the back of its own deque and, when that is empty, steals from the
+// front of the others. The thread calling parallelFor works too, so a pool
+// of N threads starts N - 1 workers.
+class ThreadPool {
+public:
+    // 0 uses std::thread::hardware_concurrency().
+    explicit ThreadPool(int threads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] int threadCount() const { return static_cast<int>(queues.size()); }
+
+    // Runs body(0) .. body(count - 1) across the pool and returns once all have
+    // finished, rethrowing the first exception any of them threw.
+    void parallelFor(int count, const std::function<void(int)> &body);
+
+    // Pool shared by the runtime, created on first use.
+    static ThreadPool &shared();
+
+    // Replaces the shared pool. Must not race with work running on it.
+    static void setSharedThreadCount(int threads);
+
+private:
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // queues[0] belongs to callers
+    std::vector<std::thread> workers;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<int> pending{0};
+    bool stopping = false;
+
+    bool runOne(size_t self);
+
+    void workerLoop(size_t self);
+};
+
+#endif //COMPILER_THREAD_POOL_H
@@ -49,6 +49,7 @@ enum class TokenType : std::uint8_t {
 
     // Delimiters
     SEMICOLON,
+    COLON,
     COMMA,
     DOT,
 
@@ -0,0 +1,113 @@
+#ifndef COMPILER_TYPE_CHECKER_H
+#define COMPILER_TYPE_CHECKER_H
+
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+#include "scope_manager.h"
+#include "type_context.h"
+
+// Infers and checks types over a parsed program, Hindley-Milner style. Every
+// variable, parameter and return value starts as an inference variable and is
+// narrowed by unification; top-level functions are generalized with level-based
+// let-polymorphism, so the pass stays close to linear in program size. Each
+// node's `resolvedType` is filled in with the final type. `unknown` acts as the
+// dynamic type and unifies with anything.
+//
+// Numbers are ordered int ⊑ float rather than unified: arithmetic on an
+// inference variable and a number only constrains the variable to types the
+// operator accepts, and a variable that received an int, say a return type,
+// widens to float when a float flows into it later.
+class TypeChecker {
+public:
+    explicit TypeChecker(TypeContext &types = TypeContext::global());
+
+    // Makes a name defined outside the program (e.g. a host function) visible.
+    void declare(const std::string &name, TypeRef type);
+
+    // Returns true when no type errors were found.
+    bool check(Expr &program);
+
+    [[nodiscard]] const std::vector<TypeError> &errors() const { return diagnostics; }
+
+    // Follows inference bindings and rebuilds composite types from their parts.
+    TypeRef resolve(TypeRef type);
+
+private:
+    struct DeferredCheck {
+        std::string op;
+        TypeRef type;
+        bool allowString;
+    };
+
+    struct FunctionContext {
+        std::string name;
+        TypeRef returnType;
+        bool returnsValue = false;
+    };
+
+    TypeContext &types;
+    ScopeManager scopes;
+    std::vector<TypeRef> bindings;
+    std::vector<unsigned> levels;
+    std::vector<bool> widenable; // bound to int by a flow, not by a requirement
+    std::vector<int> accepts;    // -1, or the numbers plus these ACCEPTS_* kinds
+    unsigned currentLevel = 0;
+    std::vector<FunctionContext> functions;
+    std::vector<Expr *> annotated;
+    std::vector<DeferredCheck> deferred;
+    std::vector<TypeError> diagnostics;
+    TypeRef matrixTy;
+
+    TypeRef fresh();
+
+    TypeRef shallow(TypeRef type);
+
+    bool isVariable(TypeRef type) { return type->kind == TypeKind::Variable; }
+
+    bool unify(TypeRef a, TypeRef b);
+
+    TypeRef boundVariable(TypeRef type);
+
+    bool bind(TypeRef variable, TypeRef type);
+
+    void constrain(TypeRef variable, int kinds);
+
+    [[nodiscard]] bool admits(int kinds, TypeRef type) const;
+
+    bool occursAndAdjust(unsigned id, unsigned level, TypeRef type);
+
+    void generalize(TypeRef type);
+
+    TypeRef instantiate(TypeRef type);
+
+    TypeRef instantiate(TypeRef type, std::vector<std::pair<unsigned, TypeRef>> &mapping);
+
+    void expect(TypeRef expected, TypeRef actual, const std::string &context);
+
+    void error(const std::string &message);
+
+    TypeRef infer(Expr *expr);
+
+    TypeRef inferBinary(BinaryExpr *expr);
+
+    TypeRef inferArithmetic(const std::string &op, TypeRef left, TypeRef right, bool comparison);
+
+    TypeRef inferUnary(UnaryExpr *expr);
+
+    TypeRef inferCall(FunctionCallExpr *expr);
+
+    TypeRef inferFunction(FunctionDeclarationExpr *expr);
+
+    void inferBlock(const std::vector<std::unique_ptr<Expr>> &statements);
+
+    TypeRef lookup(const std::string &name);
+
+    void bindName(const std::string &name, TypeRef type, SymbolType kind);
+
+    [[nodiscard]] bool isNumeric(TypeRef type) const;
+};
+
+#endif //COMPILER_TYPE_CHECKER_H
@@ -0,0 +1,94 @@
+#ifndef COMPILER_TYPE_CONTEXT_H
+#define COMPILER_TYPE_CONTEXT_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+// Owns every Type and hands out canonical TypeRef handles. Primitive types are
+// created once up front; composite types are hash-consed on their structure, so
+// asking twice for fn(int) -> bool yields the same handle.
+class TypeContext {
+public:
+    TypeContext();
+
+    TypeContext(const TypeContext &) = delete;
+
+    TypeContext &operator=(const TypeContext &) = delete;
+
+    static TypeContext &global();
+
+    [[nodiscard]] TypeRef intType() const { return intTy; }
+
+    [[nodiscard]] TypeRef floatType() const { return floatTy; }
+
+    [[nodiscard]] TypeRef boolType() const { return boolTy; }
+
+    [[nodiscard]] TypeRef stringType() const { return stringTy; }
+
+    [[nodiscard]] TypeRef voidType() const { return voidTy; }
+
+    [[nodiscard]] TypeRef nullType() const { return nullTy; }
+
+    [[nodiscard]] TypeRef unknownType() const { return unknownTy; }
+
+    [[nodiscard]] TypeRef primitive(TypeKind kind) const;
+
+    TypeRef custom(const std::string &name);
+
+    TypeRef function(const std::vector<TypeRef> &params, TypeRef returnType);
+
+    TypeRef generic(const std::string &name, const std::vector<TypeRef> &params);
+
+    TypeRef structType(const std::string &name, const std::vector<StructField> &fields);
+
+    TypeRef classType(const std::string &name, const std::vector<StructField> &fields);
+
+    // Inference variable number `id`; what it stands for is tracked by the type checker.
+    TypeRef variable(unsigned id);
+
+    // Maps a source-level type name to its type, falling back to a custom type.
+    TypeRef fromName(const std::string &name);
+
+    [[nodiscard]] size_t size() const { return storage.size(); }
+
+private:
+    struct Key {
+        TypeKind kind;
+        std::string name;
+        std::vector<TypeRef> children;
+        std::vector<std::string> fieldNames;
+
+        bool operator==(const Key &other) const {
+           return kind == other.kind && name == other.name &&
+                  children == other.children && fieldNames == other.fieldNames;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const noexcept;
+    };
+
+    std::vector<std::unique_ptr<Type>> storage;
+    std::unordered_map<Key, const Type *, KeyHash> interned;
+    std::vector<TypeRef> variables;
+
+    TypeRef intTy;
+    TypeRef floatTy;
+    TypeRef boolTy;
+    TypeRef stringTy;
+    TypeRef voidTy;
+    TypeRef nullTy;
+    TypeRef unknownTy;
+
+    TypeRef create(TypeKind kind, std::string name = "");
+
+    TypeRef intern(Key key);
+
+    TypeRef internRecord(TypeKind kind, const std::string &name, const std::vector<StructField> &fields);
+};
+
+#endif //COMPILER_TYPE_CONTEXT_H
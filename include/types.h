@@ -1,11 +1,14 @@
 #ifndef COMPILER_TYPES_H
 #define COMPILER_TYPES_H
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <vector>
 #include <memory>
 #include <utility>
 #include <sstream>
+#include <type_traits>
 
 enum class TypeKind {
     Int,
@@ -19,12 +22,52 @@ enum class TypeKind {
     Struct,
     Class,
     Generic,
-    Custom
+    Custom,
+    Variable
 };
 
+struct Type;
+
+// Handle to a Type interned by a TypeContext. Two handles are equal exactly when
+// they name the same type, so comparisons never look inside the Type.
+class TypeRef {
+public:
+    TypeRef() = default;
+
+    explicit TypeRef(const Type *type) : type(type) {}
+
+    [[nodiscard]] const Type *get() const { return type; }
+
+    const Type *operator->() const { return type; }
+
+    const Type &operator*() const { return *type; }
+
+    explicit operator bool() const { return type != nullptr; }
+
+    bool operator==(TypeRef other) const { return type == other.type; }
+
+    bool operator!=(TypeRef other) const { return type != other.type; }
+
+    [[nodiscard]] std::string toString() const;
+
+private:
+    const Type *type = nullptr;
+};
+
+static_assert(std::is_trivially_copyable_v<TypeRef>, "TypeRef must stay a plain handle");
+
+namespace std {
+    template<>
+    struct hash<TypeRef> {
+        size_t operator()(TypeRef ref) const noexcept {
+           return hash<const Type *>()(ref.get());
+        }
+    };
+}
+
 struct StructField {
     std::string name;
-    std::shared_ptr<struct Type> type;
+    TypeRef type;
 };
 
 struct StructType {
@@ -32,42 +75,19 @@ struct StructType {
     std::vector<StructField> fields;
 };
 
+// Types are only created by TypeContext, which guarantees one instance per distinct type.
 struct Type {
     TypeKind kind;
     std::string name;
-    std::vector<std::shared_ptr<Type>> parameterTypes;
-    std::shared_ptr<Type> returnType;
-    std::vector<std::shared_ptr<Type>> parameters;
-    std::shared_ptr<StructType> structInfo;
-
-    explicit Type(TypeKind kind, std::string name = "")
-            : kind(kind), name(std::move(name)) {}
-
-    static std::shared_ptr<Type>
-    makeFunction(std::vector<std::shared_ptr<Type>> params, std::shared_ptr<Type> returnType) {
-       auto t = std::make_shared<Type>(TypeKind::Function, "function");
-       t->parameterTypes = std::move(params);
-       t->returnType = std::move(returnType);
-       return t;
-    }
+    std::vector<TypeRef> parameterTypes;
+    TypeRef returnType;
+    std::vector<TypeRef> parameters;
+    std::unique_ptr<StructType> structInfo;
+    unsigned variableId = 0;
 
-    static std::shared_ptr<Type> makeGeneric(std::string name, std::vector<std::shared_ptr<Type>> params) {
-       auto t = std::make_shared<Type>(TypeKind::Generic, std::move(name));
-       t->parameters = std::move(params);
-       return t;
-    }
-
-    static std::shared_ptr<Type> makeStruct(std::string name, std::vector<StructField> fields) {
-       auto t = std::make_shared<Type>(TypeKind::Struct, std::move(name));
-       t->structInfo = std::make_shared<StructType>(StructType{t->name, std::move(fields)});
-       return t;
-    }
+    Type(const Type &) = delete;
 
-    static std::shared_ptr<Type> makeClass(std::string name, std::vector<StructField> fields) {
-       auto t = std::make_shared<Type>(TypeKind::Class, std::move(name));
-       t->structInfo = std::make_shared<StructType>(StructType{t->name, std::move(fields)});
-       return t;
-    }
+    Type &operator=(const Type &) = delete;
 
     [[nodiscard]] std::string toString() const {
        switch (kind) {
@@ -86,16 +106,17 @@ struct Type {
           case TypeKind::Unknown:
              return "unknown";
           case TypeKind::Custom:
+          case TypeKind::Variable:
              return name;
 
           case TypeKind::Function: {
              std::stringstream ss;
              ss << "fn(";
              for (size_t i = 0; i < parameterTypes.size(); ++i) {
-                ss << parameterTypes[i]->toString();
+                ss << parameterTypes[i].toString();
                 if (i != parameterTypes.size() - 1) ss << ", ";
              }
-             ss << ") -> " << (returnType ? returnType->toString() : "void");
+             ss << ") -> " << (returnType ? returnType.toString() : "void");
              return ss.str();
           }
 
@@ -103,7 +124,7 @@ struct Type {
              std::stringstream ss;
              ss << name << "<";
              for (size_t i = 0; i < parameters.size(); ++i) {
-                ss << parameters[i]->toString();
+                ss << parameters[i].toString();
                 if (i != parameters.size() - 1) ss << ", ";
              }
              ss << ">";
@@ -116,7 +137,7 @@ struct Type {
              ss << (kind == TypeKind::Struct ? "struct " : "class ") << name << " { ";
              for (size_t i = 0; i < structInfo->fields.size(); ++i) {
                 const auto &field = structInfo->fields[i];
-                ss << field.type->toString() << " " << field.name;
+                ss << field.type.toString() << " " << field.name;
                 if (i != structInfo->fields.size() - 1) ss << "; ";
              }
              ss << " }";
@@ -127,18 +148,15 @@ struct Type {
        return "unknown";
     }
 
-    [[nodiscard]] bool equals(const std::shared_ptr<Type> &other) const {
-       if (!other || kind != other->kind || name != other->name) return false;
+private:
+    friend class TypeContext;
 
-       if (kind == TypeKind::Generic || kind == TypeKind::Function) {
-          if (parameters.size() != other->parameters.size()) return false;
-          for (size_t i = 0; i < parameters.size(); ++i) {
-             if (!parameters[i]->equals(other->parameters[i])) return false;
-          }
-       }
-
-       return true;
-    }
+    explicit Type(TypeKind kind, std::string name = "")
+            : kind(kind), name(std::move(name)) {}
 };
 
-#endif // COMPILER_TYPES_H
\ No newline at end of file
+inline std::string TypeRef::toString() const {
+   return type ? type->toString() : "unknown";
+}
+
+#endif // COMPILER_TYPES_H
@@ -0,0 +1,264 @@
+#ifndef COMPILER_VALUE_H
+#define COMPILER_VALUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "operators.h"
+
+enum class ValueType : std::uint8_t {
+    Null,
+    Bool,
+    Int,
+    Float,
+    Object
+};
+
+enum class ObjectKind : std::uint8_t {
+    String,
+    Matrix
+};
+
+// Reference-counted runtime object. Values own one reference each.
+struct HeapObject {
+    std::uint32_t refCount = 0;
+    ObjectKind kind;
+
+    explicit HeapObject(ObjectKind kind) : kind(kind) {}
+
+    virtual ~HeapObject() = default;
+};
+
+struct StringObject : HeapObject {
+    std::string chars;
+
+    explicit StringObject(std::string chars) : HeapObject(ObjectKind::String), chars(std::move(chars)) {}
+};
+
+// Runtime value, NaN-boxed into one 64-bit word. A double is stored as its own
+// bits (NaNs are canonicalized); every other value is a quiet NaN whose top 16
+// bits select the kind:
+//
+//   0x7FFC  null, false (2) and true (3) in the low bits
+//   0x7FFD  32-bit int in the low bits
+//   0xFFFC  HeapObject pointer in the low 48 bits
+//
+// Only objects are reference counted, so copying a scalar is one word move.
+// Ints are 32-bit and wrap on overflow.
+class Value {
+public:
+    Value() : bits(NULL_BITS) {}
+
+    Value(const Value &other) : bits(other.bits) {
+       if (isObject()) asObject()->refCount++;
+    }
+
+    Value(Value &&other) noexcept: bits(other.bits) {
+       other.bits = NULL_BITS;
+    }
+
+    Value &operator=(const Value &other) {
+       if (other.isObject()) other.asObject()->refCount++;
+       release();
+       bits = other.bits;
+       return *this;
+    }
+
+    Value &operator=(Value &&other) noexcept {
+       if (this != &other) {
+          release();
+          bits = other.bits;
+          other.bits = NULL_BITS;
+       }
+       return *this;
+    }
+
+    ~Value() { release(); }
+
+    static Value null() { return {}; }
+
+    static Value boolean(bool value) { return fromBits(value ? TRUE_BITS : FALSE_BITS); }
+
+    static Value integer(std::int32_t value) {
+       return fromBits(INT_TAG | static_cast<std::uint32_t>(value));
+    }
+
+    static Value number(double value) {
+       std::uint64_t raw;
+       std::memcpy(&raw, &value, sizeof(raw));
+       return fromBits(value != value ? CANONICAL_NAN : raw);
+    }
+
+    static Value object(HeapObject *object) {
+       object->refCount++;
+       return fromBits(OBJECT_TAG | reinterpret_cast<std::uintptr_t>(object));
+    }
+
+    static Value string(std::string chars) {
+       return object(new StringObject(std::move(chars)));
+    }
+
+    [[nodiscard]] ValueType type() const {
+       if (isFloat()) return ValueType::Float;
+       switch (bits & TAG_MASK) {
+          case INT_TAG:
+             return ValueType::Int;
+          case OBJECT_TAG:
+             return ValueType::Object;
+          default:
+             return bits == NULL_BITS ? ValueType::Null : ValueType::Bool;
+       }
+    }
+
+    [[nodiscard]] bool isNull() const { return bits == NULL_BITS; }
+
+    [[nodiscard]] bool isBool() const { return (bits | 1) == TRUE_BITS; }
+
+    [[nodiscard]] bool isInt() const { return (bits & TAG_MASK) == INT_TAG; }
+
+    [[nodiscard]] bool isFloat() const { return (bits & BOXED) != BOXED; }
+
+    [[nodiscard]] bool isNumber() const { return isFloat() || isInt(); }
+
+    [[nodiscard]] bool isObject() const { return (bits & TAG_MASK) == OBJECT_TAG; }
+
+    [[nodiscard]] bool isString() const { return isObject() && asObject()->kind == ObjectKind::String; }
+
+    [[nodiscard]] bool isMatrix() const { return isObject() && asObject()->kind == ObjectKind::Matrix; }
+
+    [[nodiscard]] bool asBool() const { return bits == TRUE_BITS; }
+
+    [[nodiscard]] std::int32_t asInt() const { return static_cast<std::int32_t>(static_cast<std::uint32_t>(bits)); }
+
+    [[nodiscard]] double asFloat() const {
+       double value;
+       std::memcpy(&value, &bits, sizeof(value));
+       return value;
+    }
+
+    [[nodiscard]] HeapObject *asObject() const {
+       return reinterpret_cast<HeapObject *>(static_cast<std::uintptr_t>(bits & POINTER_MASK));
+    }
+
+    [[nodiscard]] StringObject *asString() const { return static_cast<StringObject *>(asObject()); }
+
+    [[nodiscard]] double toNumber() const { return isInt() ? asInt() : asFloat(); }
+
+    // Both operands are ints: one AND and one compare, since no other kind
+    // keeps every bit of INT_TAG set.
+    static bool bothInt(const Value &a, const Value &b) { return (a.bits & b.bits & TAG_MASK) == INT_TAG; }
+
+    static bool bothFloat(const Value &a, const Value &b) { return a.isFloat() && b.isFloat(); }
+
+    // The boxed word. Equal words mean identical values; for objects, the same object.
+    [[nodiscard]] std::uint64_t raw() const { return bits; }
+
+    [[nodiscard]] bool truthy() const;
+
+    [[nodiscard]] bool equals(const Value &other) const;
+
+    [[nodiscard]] std::string toString() const;
+
+    [[nodiscard]] const char *typeName() const;
+
+private:
+    static constexpr std::uint64_t BOXED = 0x7FFC000000000000;
+    static constexpr std::uint64_t TAG_MASK = 0xFFFF000000000000;
+    static constexpr std::uint64_t INT_TAG = 0x7FFD000000000000;
+    static constexpr std::uint64_t OBJECT_TAG = 0xFFFC000000000000;
+    static constexpr std::uint64_t POINTER_MASK = 0x0000FFFFFFFFFFFF;
+    static constexpr std::uint64_t NULL_BITS = BOXED;
+    static constexpr std::uint64_t FALSE_BITS = BOXED | 2;
+    static constexpr std::uint64_t TRUE_BITS = BOXED | 3;
+    static constexpr std::uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+
+    std::uint64_t bits;
+
+    static Value fromBits(std::uint64_t raw) {
+       Value v;
+       v.bits = raw;
+       return v;
+    }
+
+    void release() {
+       if (isObject() && --asObject()->refCount == 0) delete asObject();
+    }
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay one machine word");
+
+// Runtime value of a LiteralExpr.
+Value literalValue(const std::variant<int, float, std::string, bool, std::nullptr_t> &literal);
+
+inline std::int32_t wrapInt(std::int64_t value) {
+   return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+}
+
+// Operator semantics shared by every execution engine. Throws RuntimeError on
+// operands the operator does not accept. And/Or are not handled here because
+// they short-circuit.
+Value applyBinarySlow(BinaryOperator op, const Value &left, const Value &right);
+
+Value applyUnary(UnaryOperator op, const Value &operand);
+
+inline Value applyBinary(BinaryOperator op, const Value &left, const Value &right) {
+   if (Value::bothInt(left, right)) {
+      std::int64_t a = left.asInt();
+      std::int64_t b = right.asInt();
+      switch (op) {
+         case BinaryOperator::Add:
+            return Value::integer(wrapInt(a + b));
+         case BinaryOperator::Subtract:
+            return Value::integer(wrapInt(a - b));
+         case BinaryOperator::Multiply:
+            return Value::integer(wrapInt(a * b));
+         case BinaryOperator::Less:
+            return Value::boolean(a < b);
+         case BinaryOperator::LessEqual:
+            return Value::boolean(a <= b);
+         case BinaryOperator::Greater:
+            return Value::boolean(a > b);
+         case BinaryOperator::GreaterEqual:
+            return Value::boolean(a >= b);
+         case BinaryOperator::Equal:
+            return Value::boolean(a == b);
+         case BinaryOperator::NotEqual:
+            return Value::boolean(a != b);
+         default:
+            break;
+      }
+   } else if (Value::bothFloat(left, right)) {
+      double a = left.asFloat();
+      double b = right.asFloat();
+      switch (op) {
+         case BinaryOperator::Add:
+            return Value::number(a + b);
+         case BinaryOperator::Subtract:
+            return Value::number(a - b);
+         case BinaryOperator::Multiply:
+            return Value::number(a * b);
+         case BinaryOperator::Divide:
+            return Value::number(a / b);
+         case BinaryOperator::Less:
+            return Value::boolean(a < b);
+         case BinaryOperator::LessEqual:
+            return Value::boolean(a <= b);
+         case BinaryOperator::Greater:
+            return Value::boolean(a > b);
+         case BinaryOperator::GreaterEqual:
+            return Value::boolean(a >= b);
+         case BinaryOperator::Equal:
+            return Value::boolean(a == b);
+         case BinaryOperator::NotEqual:
+            return Value::boolean(a != b);
+         default:
+            break;
+      }
+   }
+   return applyBinarySlow(op, left, right);
+}
+
+#endif //COMPILER_VALUE_H
@@ -0,0 +1,78 @@
+#ifndef COMPILER_VALUE_NUMBERING_H
+#define COMPILER_VALUE_NUMBERING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ir.h"
+
+struct ValueNumberingStats {
+    int expressions = 0; // binary, unary and truthy instructions computed earlier
+    int loads = 0;       // loadglobals of a value already loaded or stored
+    int phis = 0;        // phis merging the same values as another in the block
+
+    [[nodiscard]] int eliminated() const { return expressions + loads + phis; }
+
+    ValueNumberingStats &operator+=(const ValueNumberingStats &other);
+};
+
+// Global value numbering: an instruction computing what an instruction that
+// dominates it already computed is replaced by that one. Expressions are
+// hashed on their operator and operands, constants by value, with a scope
+// per node of the dominator tree, so a value is reused only where it is
+// available on every path.
+//
+// Locals are SSA values, so an assignment makes a new value and is respected
+// as is. A global is remembered from a load or store until a call, which may
+// write any of them, and only into blocks whose sole predecessor is the
+// dominator.
+//
+// Arithmetic on matrices makes a new matrix each time it runs. Those are
+// shared only when the module calls nothing that could change a matrix in
+// place (`put`, or a host function not known to leave its arguments alone);
+// otherwise, and for a function numbered on its own, arithmetic that might
+// see a matrix is left alone.
+class ValueNumbering {
+public:
+    ValueNumberingStats eliminate(IrFunction &function);
+
+    ValueNumberingStats eliminate(IrModule &module);
+
+private:
+    struct Key {
+        IrOp op;
+        std::uint8_t code; // the binary or unary operator
+        const IrInstr *left;
+        const IrInstr *right;
+
+        bool operator==(const Key &other) const {
+           return op == other.op && code == other.code && left == other.left && right == other.right;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    ValueNumberingStats stats;
+    bool matricesChange = true;
+    std::unordered_map<std::uint64_t, const IrInstr *> constants;
+    std::unordered_map<std::string, const IrInstr *> strings;
+    std::unordered_set<const IrInstr *> mayBeMatrix;
+    std::unordered_map<Key, IrInstr *, KeyHash> available;
+
+    // The first constant with the same value, or the value itself.
+    const IrInstr *canonical(const IrInstr *value);
+
+    void findMatrices(const IrFunction &function);
+
+    bool keyOf(const IrInstr *instr, Key &key);
+
+    void numberPhis(IrBlock *block);
+};
+
+#endif //COMPILER_VALUE_NUMBERING_H
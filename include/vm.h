@@ -0,0 +1,109 @@
+#ifndef COMPILER_VM_H
+#define COMPILER_VM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "host_registry.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "resolver.h"
+#include "value.h"
+
+// Register machine for programs produced by BytecodeCompiler. Each call frame
+// is a window into one shared register file, starting at the caller's argument
+// registers, so arguments are passed without copying. Frames live on the heap
+// and script calls never recurse on the native stack. The dispatch loop uses
+// computed goto on GCC and Clang unless COMPILER_SWITCH_DISPATCH is defined.
+// Generic arithmetic and compare-and-branch instructions quicken in place into
+// type-specialized variants, and call sites cache their resolved target, so the
+// VM owns and mutates the code it runs.
+//
+// With the JIT on, calls and loop backedges are counted per function, and a
+// function whose count reaches the threshold is compiled by the BaselineJit.
+// Its native code is entered on calls, at backedges and where a call returns
+// to it, and hands control back at the first instruction it does not handle.
+class VM {
+public:
+    explicit VM(std::ostream &out = std::cout);
+
+    HostRegistry &host() { return hostFunctions; }
+
+    void defineGlobal(const std::string &name, Value value);
+
+    // Parses, resolves, compiles and runs a program.
+    void run(const std::string &source);
+
+    // Resolves, compiles and runs an already parsed program.
+    void execute(Expr &program);
+
+    void setMaxCallDepth(int depth) { maxCallDepth = depth; }
+
+    // Compiles through the SSA IR and its optimizations (see Optimizer),
+    // falling back to the BytecodeCompiler for what that cannot handle.
+    // Each program is taken as a whole: calls it inlines keep their callee
+    // even if a later run() redefines it.
+    void setOptimize(bool enabled, const OptimizerOptions &options = {}) {
+       optimize = enabled;
+       optimizerOptions = options;
+    }
+
+    // The threshold counts calls plus loop backedges taken. The JIT stays off
+    // where BaselineJit is not supported.
+    void setJit(bool enabled, std::uint32_t threshold = 1000) {
+       jitEnabled = enabled && BaselineJit::supported();
+       jitThreshold = std::max<std::uint32_t>(threshold, 1);
+    }
+
+    [[nodiscard]] const BaselineJit &jit() const { return baselineJit; }
+
+    // The most recently compiled program, for disassembly.
+    [[nodiscard]] const Program *lastProgram() const { return programs.empty() ? nullptr : programs.back().get(); }
+
+private:
+    struct CallFrame {
+        FunctionProto *function;
+        Instruction *ip;
+        size_t base;
+    };
+
+    std::ostream &out;
+    HostRegistry hostFunctions;
+    Resolver resolver;
+    std::vector<std::string> hostGlobals;
+    std::vector<Value> globals;
+    std::vector<Value> registers;
+    std::vector<CallFrame> frames;
+    std::vector<std::exception_ptr> savedExceptions;
+    std::unordered_map<std::string, FunctionProto *> functions;
+    std::vector<std::unique_ptr<Program>> programs;
+    int maxCallDepth = 100000;
+    bool optimize = false;
+    OptimizerOptions optimizerOptions;
+    // Bumped whenever a script function name is bound to a different function,
+    // which invalidates every call site's cached target.
+    std::uint32_t bindingEpoch = 1;
+    BaselineJit baselineJit;
+    bool jitEnabled = false;
+    std::uint32_t jitThreshold = 1000;
+
+    void dispatch();
+
+    void bindCallSite(CallSite &site);
+
+    bool unwind(Value thrown);
+
+    void countHot(FunctionProto &function) {
+       if (!function.jitCode && ++function.hotness == jitThreshold) baselineJit.compile(function);
+    }
+};
+
+#endif //COMPILER_VM_H
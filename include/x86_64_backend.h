@@ -0,0 +1,163 @@
+#ifndef COMPILER_X86_64_BACKEND_H
+#define COMPILER_X86_64_BACKEND_H
+
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "c_runtime.h"
+#include "dataflow.h"
+#include "ir.h"
+
+// Linear-scan allocation of IR values to x86-64 registers. A Value is a tag
+// and a payload, so the allocator hands out units of two registers. As in
+// the RegisterAllocator a value keeps its place from definition to last
+// use; when every unit is taken the value among the active ones whose
+// interval ends last goes to a stack slot for its whole life. Values whose
+// interval crosses a call prefer callee-saved units. Constants are not
+// allocated: the code generator rematerializes them at each use.
+class X86RegisterAllocator {
+public:
+    struct Location {
+        int unit = -1; // a register unit, or
+        int slot = -1; // a stack slot; neither when the value is never used
+    };
+
+    // Values must be numbered (IrFunction::renumber) as for the liveness.
+    // Units outside allowedUnits are not used; calleeSavedUnits survive calls.
+    X86RegisterAllocator(const IrFunction &function, const Liveness &liveness, int unitCount,
+                         unsigned allowedUnits, unsigned calleeSavedUnits);
+
+    [[nodiscard]] Location location(const IrInstr *value) const {
+       return value->id >= 0 && static_cast<size_t>(value->id) < locations.size() ? locations[value->id] : Location{};
+    }
+
+    // Position of an instruction, numbered as in the RegisterAllocator.
+    [[nodiscard]] int position(const IrInstr *instr) const { return positions.at(instr); }
+
+    // Units of values live both before and after position.
+    [[nodiscard]] unsigned unitsLiveAcross(int position) const;
+
+    [[nodiscard]] unsigned usedUnits() const { return used; }
+
+    [[nodiscard]] int slotCount() const { return slots; }
+
+    [[nodiscard]] int spillCount() const { return spills; }
+
+private:
+    struct Interval {
+        const IrInstr *value = nullptr;
+        int start = 0;
+        int end = 0;
+    };
+
+    std::vector<Location> locations; // by value id
+    std::vector<Interval> intervals; // in order of start, allocated to units
+    std::unordered_map<const IrInstr *, int> positions;
+    unsigned used = 0;
+    int slots = 0;
+    int spills = 0;
+};
+
+// Native backend for x86-64 System V targets (Linux, the BSDs): translates an
+// optimized IR module into GNU assembler source, linked against the C
+// runtime with the system C compiler.
+//
+// Each IR function is a System V function taking and returning Values by
+// value, two registers apiece, so the C runtime calls it like any C
+// function. SSA values live in the units the X86RegisterAllocator picks or
+// in stack slots of an rbp-based frame. Integer arithmetic and comparisons
+// run inline, the latter fused into the branch that tests them, as do float
+// arithmetic and the truthiness of booleans and integers; other operand
+// types, strings, matrices, host functions and dynamic calls go to rtx_*
+// helpers in the runtime, with the caller-saved registers of values live
+// across the call saved around it. Exceptions use the runtime's setjmp
+// handlers: functions with protected blocks keep their values in callee-saved
+// registers and stack slots, which longjmp restores.
+class X86Emitter {
+public:
+    // The assembly for every function of module. Values are renumbered.
+    std::string emitAssembly(IrModule &module);
+
+    // The C half of the program: the runtime, module's constants and
+    // bindings, and the rtx_* helpers the assembly calls.
+    std::string emitRuntime(const IrModule &module, bool library);
+
+private:
+    struct Frame;
+
+    std::ostream *out = nullptr;
+    const IrModule *module = nullptr;
+    std::unordered_map<std::string, int> bindings;    // function name -> binding slot
+    std::unordered_map<std::string, int> strings;     // string constant -> K index
+    std::unordered_map<const IrFunction *, int> functionIds;
+    std::unordered_map<const IrInstr *, const IrFunction *> targets; // calls the CallGraph binds
+    std::vector<std::string> literals;                // names and messages, as .rodata labels
+    const IrFunction *function = nullptr;
+    const X86RegisterAllocator *allocator = nullptr;
+    const Frame *frame = nullptr;
+    int labelCount = 0;
+    std::vector<std::tuple<std::string, const IrBlock *, const IrBlock *>> stubs; // edges with copies, emitted last
+
+    void collect();
+
+    void emitFunction(const IrFunction &irFunction);
+
+    void emitInstruction(const IrInstr *instr);
+
+    void emitBinary(const IrInstr *instr, const IrBlock *block, const IrInstr *branch);
+
+    void emitUnary(const IrInstr *instr);
+
+    void emitCall(const IrInstr *instr);
+
+    void emitTerminator(const IrBlock *block, const IrInstr *terminator, const IrInstr *fused,
+                        const IrBlock *next);
+
+    void emitSwitch(const IrBlock *block, const IrInstr *terminator);
+
+    // Leaves 1 in eax when value is truthy, 0 otherwise.
+    void emitTruthy(const IrInstr *value, int position);
+
+    // A label to jump to for the edge from -> to: to's own, or a stub making
+    // the edge's phi copies first.
+    std::string edgeTarget(const IrBlock *from, const IrBlock *to);
+
+    // Phi copies for the edge from -> to, then the jump unless to is next.
+    void emitEdge(const IrBlock *from, const IrBlock *to, const IrBlock *next = nullptr);
+
+    // Calls a runtime helper whose arguments setArguments puts in place,
+    // saving the caller-saved registers of values live across position.
+    template<typename F>
+    void callRuntime(const char *helper, int position, F setArguments);
+
+    void loadTag(const IrInstr *value, int reg);
+
+    void loadPayload(const IrInstr *value, int reg);
+
+    // Copies value to the 16 bytes at offset(%rbp).
+    void stage(const IrInstr *value, int offset);
+
+    void define(const IrInstr *value, int tagReg, int payloadReg);
+
+    void defineTag(const IrInstr *value, int tag, int payloadReg);
+
+    void defineFrom(const IrInstr *value, int offset);
+
+    std::string label();
+
+    std::string blockLabel(const IrBlock *block) const;
+
+    std::string literal(const std::string &text);
+
+    void line(const std::string &text);
+};
+
+// Writes the assembly and its C runtime next to output (as output + ".s" and
+// output + ".rt.c") and builds them with the system C compiler. Throws a
+// CompilerError when the compiler fails.
+void buildX86Native(IrModule &module, const std::string &output, const NativeBuildOptions &options = {});
+
+#endif //COMPILER_X86_64_BACKEND_H
@@ -0,0 +1,116 @@
+#include "bytecode.h"
+
+const char *opcodeName(OpCode op) {
+   static const char *const names[] = {
+#define COMPILER_OPCODE_NAME(name) #name,
+           COMPILER_OPCODES(COMPILER_OPCODE_NAME)
+#undef COMPILER_OPCODE_NAME
+   };
+   return names[static_cast<int>(op)];
+}
+
+static std::string constantText(const Value &value) {
+   return value.isString() ? "\"" + value.toString() + "\"" : value.toString();
+}
+
+static std::string operandText(const FunctionProto &function, size_t pc) {
+   Instruction i = function.code[pc];
+   int a = argA(i);
+   auto reg = [](int r) { return "r" + std::to_string(r); };
+   auto target = [&]() { return "-> " + std::to_string(static_cast<int>(pc) + 1 + argSBx(i)); };
+
+   switch (opcodeOf(i)) {
+      case OpCode::MOVE:
+      case OpCode::NEG:
+      case OpCode::PLUS:
+      case OpCode::NOT:
+      case OpCode::BNOT:
+      case OpCode::TRUTHY:
+         return reg(a) + " " + reg(argB(i));
+      case OpCode::LOADK:
+         return reg(a) + " k" + std::to_string(argBx(i)) + " ; " + constantText(function.constants[argBx(i)]);
+      case OpCode::LOADINT:
+         return reg(a) + " " + std::to_string(argSBx(i));
+      case OpCode::LOADBOOL:
+         return reg(a) + (argB(i) ? " true" : " false");
+      case OpCode::LOADNULL:
+      case OpCode::RETURN:
+         return reg(a);
+      case OpCode::GETGLOBAL:
+      case OpCode::SETGLOBAL:
+         return reg(a) + " g" + std::to_string(argBx(i));
+      case OpCode::JMP:
+         return target();
+      case OpCode::JMPF:
+      case OpCode::JMPT:
+         return reg(a) + " " + target();
+      case OpCode::CALL:
+      case OpCode::TAILCALL: {
+         const CallSite &site = function.callSites[argBx(i)];
+         return reg(a) + " " + site.callee + "/" + std::to_string(site.argumentCount);
+      }
+      case OpCode::SWITCH:
+         return reg(a) + " t" + std::to_string(argBx(i)) + " ; " + function.switchTables[argBx(i)].describe();
+      case OpCode::MATCHAIN:
+         return reg(a) + " " + reg(argB(i)) + " .. " + reg(argB(i) + argC(i) - 1);
+      case OpCode::DEFFN:
+         return function.nestedFunctions[argBx(i)]->name;
+      case OpCode::ERROR:
+         return constantText(function.constants[argBx(i)]);
+      case OpCode::RETHROW:
+      case OpCode::DISCARD:
+         return "";
+      case OpCode::ADD_CONST:
+      case OpCode::SUB_CONST:
+      case OpCode::ADD_INT_CONST:
+      case OpCode::SUB_INT_CONST:
+         return reg(a) + " " + reg(argB(i)) + " #" + std::to_string(argSC(i));
+#define COMPILER_BRANCH_CASES(name) \
+      case OpCode::name: \
+      case OpCode::name##_INT_INT: \
+         return reg(a) + " " + reg(argB(i)); \
+      case OpCode::name##_CONST: \
+      case OpCode::name##_INT_CONST: \
+         return reg(a) + " #" + std::to_string(argSBx(i));
+      COMPILER_BRANCH_CASES(IFLT)
+      COMPILER_BRANCH_CASES(IFLE)
+      COMPILER_BRANCH_CASES(IFGT)
+      COMPILER_BRANCH_CASES(IFGE)
+      COMPILER_BRANCH_CASES(IFEQ)
+      COMPILER_BRANCH_CASES(IFNE)
+#undef COMPILER_BRANCH_CASES
+      default:
+         return reg(a) + " " + reg(argB(i)) + " " + reg(argC(i));
+   }
+}
+
+// At least four digits, zero-padded.
+static std::string codeOffset(size_t pc) {
+   std::string digits = std::to_string(pc);
+   return digits.size() < 4 ? std::string(4 - digits.size(), '0') + digits : digits;
+}
+
+std::string disassemble(const FunctionProto &function) {
+   std::string result = "function " + function.name + " (arity " + std::to_string(function.arity) +
+                        ", registers " + std::to_string(function.registerCount) + ")\n";
+   for (size_t pc = 0; pc < function.code.size(); ++pc) {
+      std::string name = opcodeName(opcodeOf(function.code[pc]));
+      if (name.size() < 15) name.resize(15, ' ');
+      result += "  " + codeOffset(pc) + "  " + name + " " + operandText(function, pc) + "\n";
+   }
+   for (const ExceptionHandler &handler: function.handlers) {
+      result += "  try   " + codeOffset(handler.start) + "-" + codeOffset(handler.end - 1) + " -> " +
+                codeOffset(handler.target) + " ";
+      result += (handler.reg >= 0 ? "catch r" + std::to_string(handler.reg) : std::string("finally")) + "\n";
+   }
+   return result;
+}
+
+std::string disassemble(const Program &program) {
+   std::string result;
+   for (const auto &function: program.functions) {
+      if (!result.empty()) result += "\n";
+      result += disassemble(*function);
+   }
+   return result;
+}
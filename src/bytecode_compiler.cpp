@@ -0,0 +1,734 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include <algorithm>
+
+#include "bytecode_compiler.h"
+#include "error.h"
+
+static OpCode binaryOpcode(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return OpCode::ADD;
+      case BinaryOperator::Subtract:
+         return OpCode::SUB;
+      case BinaryOperator::Multiply:
+         return OpCode::MUL;
+      case BinaryOperator::Divide:
+         return OpCode::DIV;
+      case BinaryOperator::Equal:
+         return OpCode::EQ;
+      case BinaryOperator::NotEqual:
+         return OpCode::NE;
+      case BinaryOperator::Less:
+         return OpCode::LT;
+      case BinaryOperator::LessEqual:
+         return OpCode::LE;
+      case BinaryOperator::Greater:
+         return OpCode::GT;
+      case BinaryOperator::GreaterEqual:
+         return OpCode::GE;
+      default:
+         throw CompilerError(std::string("Unsupported binary operator '") + operatorLexeme(op) + "'");
+   }
+}
+
+static OpCode unaryOpcode(UnaryOperator op) {
+   switch (op) {
+      case UnaryOperator::Plus:
+         return OpCode::PLUS;
+      case UnaryOperator::Negate:
+         return OpCode::NEG;
+      case UnaryOperator::Not:
+         return OpCode::NOT;
+      case UnaryOperator::BitwiseNot:
+         return OpCode::BNOT;
+      default:
+         throw CompilerError("Unsupported unary operator");
+   }
+}
+
+// Opcode of the compare-and-branch superinstruction for a comparison, or MOVE
+// when the operator is not a comparison.
+static OpCode branchOpcode(BinaryOperator op, bool constantOperand) {
+   switch (op) {
+      case BinaryOperator::Less:
+         return constantOperand ? OpCode::IFLT_CONST : OpCode::IFLT;
+      case BinaryOperator::LessEqual:
+         return constantOperand ? OpCode::IFLE_CONST : OpCode::IFLE;
+      case BinaryOperator::Greater:
+         return constantOperand ? OpCode::IFGT_CONST : OpCode::IFGT;
+      case BinaryOperator::GreaterEqual:
+         return constantOperand ? OpCode::IFGE_CONST : OpCode::IFGE;
+      case BinaryOperator::Equal:
+         return constantOperand ? OpCode::IFEQ_CONST : OpCode::IFEQ;
+      case BinaryOperator::NotEqual:
+         return constantOperand ? OpCode::IFNE_CONST : OpCode::IFNE;
+      default:
+         return OpCode::MOVE;
+   }
+}
+
+static bool intLiteral(const Expr *expr, int min, int max, int &value) {
+   if (expr->type != ExprType::Literal) return false;
+   auto *literal = std::get_if<int>(&static_cast<const LiteralExpr *>(expr)->value);
+   if (!literal || *literal < min || *literal > max) return false;
+   value = *literal;
+   return true;
+}
+
+// True when evaluating the expression may store to a variable. Operands that
+// are locals are read in place, which is only safe if a later operand cannot
+// overwrite them first.
+static bool hasAssignment(const Expr *expr) {
+   if (!expr) return false;
+   switch (expr->type) {
+      case ExprType::Assignment:
+         return true;
+      case ExprType::Binary: {
+         auto *binary = static_cast<const BinaryExpr *>(expr);
+         return hasAssignment(binary->left.get()) || hasAssignment(binary->right.get());
+      }
+      case ExprType::MatrixMultiplication: {
+         auto *mul = static_cast<const MatrixMultiplicationExpr *>(expr);
+         return hasAssignment(mul->left.get()) || hasAssignment(mul->right.get());
+      }
+      case ExprType::Unary:
+         return hasAssignment(static_cast<const UnaryExpr *>(expr)->right.get());
+      case ExprType::FunctionCall:
+         return std::any_of(static_cast<const FunctionCallExpr *>(expr)->arguments.begin(),
+                            static_cast<const FunctionCallExpr *>(expr)->arguments.end(),
+                            [](const auto &arg) { return hasAssignment(arg.get()); });
+      default:
+         return false;
+   }
+}
+
+std::unique_ptr<Program> BytecodeCompiler::compile(const Expr &root) {
+   auto result = std::make_unique<Program>();
+   program = result.get();
+
+   auto main = std::make_unique<FunctionProto>();
+   main->name = "<script>";
+   FunctionProto &proto = *main;
+   program->functions.push_back(std::move(main));
+   compileFunction(proto, &root, 0);
+
+   program = nullptr;
+   return result;
+}
+
+void BytecodeCompiler::compileFunction(FunctionProto &proto, const Expr *body, int frameSize) {
+   if (frameSize > MAX_REGISTERS) {
+      throw CompilerError("Function '" + proto.name + "' has too many local variables");
+   }
+
+   FunctionState state;
+   state.proto = &proto;
+   state.freeRegister = frameSize;
+   proto.registerCount = frameSize;
+
+   FunctionState *enclosing = current;
+   current = &state;
+
+   compileStatement(body);
+   int result = allocateRegister();
+   emit(encodeABC(OpCode::LOADNULL, result));
+   emit(encodeABC(OpCode::RETURN, result));
+
+   current = enclosing;
+}
+
+size_t BytecodeCompiler::emit(Instruction instruction) {
+   current->proto->code.push_back(instruction);
+   return current->proto->code.size() - 1;
+}
+
+size_t BytecodeCompiler::emitJump(OpCode op, int a) {
+   return emit(encodeAsBx(op, a, 0));
+}
+
+static Instruction withOffset(Instruction jump, std::ptrdiff_t offset, const std::string &function) {
+   if (offset < -SBX_BIAS || offset > MAX_BX - SBX_BIAS) {
+      throw CompilerError("Jump too large in function '" + function + "'");
+   }
+   return encodeAsBx(opcodeOf(jump), argA(jump), static_cast<int>(offset));
+}
+
+void BytecodeCompiler::patchJump(size_t at) {
+   auto &code = current->proto->code;
+   auto offset = static_cast<std::ptrdiff_t>(code.size()) - static_cast<std::ptrdiff_t>(at + 1);
+   code[at] = withOffset(code[at], offset, current->proto->name);
+}
+
+void BytecodeCompiler::emitJumpBack(size_t target, OpCode op, int a) {
+   auto &code = current->proto->code;
+   auto offset = static_cast<std::ptrdiff_t>(target) - static_cast<std::ptrdiff_t>(code.size() + 1);
+   emit(withOffset(encodeAsBx(op, a, 0), offset, current->proto->name));
+}
+
+int BytecodeCompiler::constant(const Value &value) {
+   std::string key = value.isString() ? "s" + value.toString() : std::to_string(value.raw());
+   auto it = current->constantIndex.find(key);
+   if (it != current->constantIndex.end()) return it->second;
+
+   auto &constants = current->proto->constants;
+   if (constants.size() > MAX_BX) {
+      throw CompilerError("Too many constants in function '" + current->proto->name + "'");
+   }
+   constants.push_back(value);
+   int index = static_cast<int>(constants.size() - 1);
+   current->constantIndex.emplace(std::move(key), index);
+   return index;
+}
+
+int BytecodeCompiler::allocateRegister() {
+   int reg = current->freeRegister++;
+   if (reg >= MAX_REGISTERS) {
+      throw CompilerError("Function '" + current->proto->name + "' needs more than " +
+                          std::to_string(MAX_REGISTERS) + " registers");
+   }
+   current->proto->registerCount = std::max(current->proto->registerCount, current->freeRegister);
+   return reg;
+}
+
+void BytecodeCompiler::compileStatement(const Expr *stmt) {
+   if (!stmt) return;
+
+   switch (stmt->type) {
+      case ExprType::ExpressionStatement:
+         compileEffect(static_cast<const ExpressionStatementExpr *>(stmt)->expression.get());
+         break;
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<const VarDeclarationExpr *>(stmt);
+         int mark = current->freeRegister;
+         int reg = decl->slot.kind == VariableSlot::Kind::Local ? decl->slot.index : allocateRegister();
+         if (decl->initializer) compileInto(decl->initializer.get(), reg);
+         else emit(encodeABC(OpCode::LOADNULL, reg));
+         storeVariable(decl->slot, decl->name, reg);
+         current->freeRegister = mark;
+         break;
+      }
+
+      case ExprType::BlockStatement:
+         for (const auto &statement: static_cast<const BlockStatementExpr *>(stmt)->statements) {
+            compileStatement(statement.get());
+         }
+         break;
+
+      case ExprType::IfStatement: {
+         auto *ifStmt = static_cast<const IfStatementExpr *>(stmt);
+         size_t skipThen = compileBranchIfFalse(ifStmt->condition.get());
+         compileStatement(ifStmt->thenBranch.get());
+         if (ifStmt->elseBranch) {
+            size_t skipElse = emitJump(OpCode::JMP);
+            patchJump(skipThen);
+            compileStatement(ifStmt->elseBranch.get());
+            patchJump(skipElse);
+         } else {
+            patchJump(skipThen);
+         }
+         break;
+      }
+
+      case ExprType::WhileStatement: {
+         auto *loop = static_cast<const WhileStatementExpr *>(stmt);
+         compileLoop(loop->condition.get(), loop->body.get(), loop->increment.get(), true);
+         break;
+      }
+
+      case ExprType::DoWhileStatement: {
+         auto *loop = static_cast<const DoWhileStatementExpr *>(stmt);
+         compileLoop(loop->condition.get(), loop->body.get(), nullptr, false);
+         break;
+      }
+
+      case ExprType::ForStatement: {
+         auto *loop = static_cast<const ForStatementExpr *>(stmt);
+         compileStatement(loop->initializer.get());
+         compileLoop(loop->condition.get(), loop->body.get(), loop->increment.get(), true);
+         break;
+      }
+
+      case ExprType::ReturnStatement: {
+         auto *ret = static_cast<const ReturnStatementExpr *>(stmt);
+         int mark = current->freeRegister;
+         if (current->proto == program->functions.front().get()) {
+            compileEffect(ret->value.get());
+            emit(encodeABx(OpCode::ERROR, 0, constant(Value::string("'return' outside of a function"))));
+            break;
+         }
+
+         // With no handler or finally body left to run, a returned call is a
+         // tail call and reuses this frame.
+         if (ret->value && ret->value->type == ExprType::FunctionCall && current->tries.empty()) {
+            compileCall(static_cast<const FunctionCallExpr *>(ret->value.get()), -1, OpCode::TAILCALL);
+            break;
+         }
+
+         int reg;
+         if (!ret->value) {
+            reg = allocateRegister();
+            emit(encodeABC(OpCode::LOADNULL, reg));
+         } else if (current->tries.empty()) {
+            reg = compileOperand(ret->value.get());
+         } else {
+            // A finally body may assign the variable being returned.
+            reg = allocateRegister();
+            compileInto(ret->value.get(), reg);
+         }
+         leaveTryRegions(0);
+         emit(encodeABC(OpCode::RETURN, reg));
+         reenterTryRegions(0);
+         current->freeRegister = mark;
+         break;
+      }
+
+      case ExprType::BreakStatement: {
+         if (current->loops.empty()) throw CompilerError("'break' outside of a loop or switch");
+         size_t loop = current->loops.size() - 1;
+         leaveTryRegions(current->loops[loop].tryDepth);
+         current->loops[loop].breakJumps.push_back(emitJump(OpCode::JMP));
+         reenterTryRegions(current->loops[loop].tryDepth);
+         break;
+      }
+
+      case ExprType::ContinueStatement: {
+         auto &loops = current->loops;
+         auto it = std::find_if(loops.rbegin(), loops.rend(), [](const Loop &l) { return l.acceptsContinue; });
+         if (it == loops.rend()) throw CompilerError("'continue' outside of a loop");
+         size_t loop = loops.rend() - it - 1;
+         leaveTryRegions(loops[loop].tryDepth);
+         current->loops[loop].continueJumps.push_back(emitJump(OpCode::JMP));
+         reenterTryRegions(loops[loop].tryDepth);
+         break;
+      }
+
+      case ExprType::FunctionDeclaration:
+         compileFunctionDeclaration(static_cast<const FunctionDeclarationExpr *>(stmt));
+         break;
+
+      case ExprType::SwitchStatement:
+         compileSwitch(static_cast<const SwitchStatementExpr *>(stmt));
+         break;
+
+      case ExprType::TryCatchFinallyStatement:
+         compileTry(static_cast<const TryCatchFinallyStatementExpr *>(stmt));
+         break;
+
+      default:
+         compileEffect(stmt);
+         break;
+   }
+}
+
+void BytecodeCompiler::compileEffect(const Expr *expr) {
+   if (!expr) return;
+   int mark = current->freeRegister;
+   if (expr->type == ExprType::Assignment) {
+      compileAssignment(static_cast<const AssignmentExpr *>(expr), -1);
+   } else if (expr->type == ExprType::FunctionCall) {
+      compileCall(static_cast<const FunctionCallExpr *>(expr), -1);
+   } else {
+      compileInto(expr, allocateRegister());
+   }
+   current->freeRegister = mark;
+}
+
+void BytecodeCompiler::compileInto(const Expr *expr, int target) {
+   switch (expr->type) {
+      case ExprType::Literal: {
+         Value value = literalValue(static_cast<const LiteralExpr *>(expr)->value);
+         if (value.isNull()) {
+            emit(encodeABC(OpCode::LOADNULL, target));
+         } else if (value.isBool()) {
+            emit(encodeABC(OpCode::LOADBOOL, target, value.asBool()));
+         } else if (value.isInt() && value.asInt() >= -SBX_BIAS && value.asInt() <= MAX_BX - SBX_BIAS) {
+            emit(encodeAsBx(OpCode::LOADINT, target, value.asInt()));
+         } else {
+            emit(encodeABx(OpCode::LOADK, target, constant(value)));
+         }
+         break;
+      }
+
+      case ExprType::Identifier: {
+         auto *identifier = static_cast<const IdentifierExpr *>(expr);
+         switch (identifier->slot.kind) {
+            case VariableSlot::Kind::Local:
+               if (identifier->slot.index != target) emit(encodeABC(OpCode::MOVE, target, identifier->slot.index));
+               break;
+            case VariableSlot::Kind::Global:
+               emit(encodeABx(OpCode::GETGLOBAL, target, identifier->slot.index));
+               break;
+            default:
+               emit(encodeABx(OpCode::ERROR, 0,
+                              constant(Value::string("Undefined variable '" + identifier->name + "'"))));
+               break;
+         }
+         break;
+      }
+
+      case ExprType::Binary: {
+         auto *binary = static_cast<const BinaryExpr *>(expr);
+         if (binary->operation == BinaryOperator::And || binary->operation == BinaryOperator::Or) {
+            compileLogical(binary, target);
+            break;
+         }
+         int mark = current->freeRegister;
+         int left = compileLeftOperand(binary);
+         int constant;
+         bool additive = binary->operation == BinaryOperator::Add || binary->operation == BinaryOperator::Subtract;
+         if (additive && intLiteral(binary->right.get(), -SC_BIAS, 0xff - SC_BIAS, constant)) {
+            OpCode op = binary->operation == BinaryOperator::Add ? OpCode::ADD_CONST : OpCode::SUB_CONST;
+            emit(encodeABC(op, target, left, constant + SC_BIAS));
+         } else {
+            int right = compileOperand(binary->right.get());
+            emit(encodeABC(binaryOpcode(binary->operation), target, left, right));
+         }
+         current->freeRegister = mark;
+         break;
+      }
+
+      case ExprType::MatrixMultiplication: {
+         auto *mul = static_cast<const MatrixMultiplicationExpr *>(expr);
+         std::vector<const Expr *> operands;
+         collectMatrixChain(mul, operands);
+         int mark = current->freeRegister;
+         if (operands.size() == 2) {
+            int left = allocateRegister();
+            compileInto(mul->left.get(), left);
+            int right = compileOperand(mul->right.get());
+            emit(encodeABC(OpCode::MATMUL, target, left, right));
+         } else {
+            // Longer chains go to the VM in one piece so it can pick the
+            // cheapest multiplication order once the shapes are known.
+            if (operands.size() > 0xff) throw CompilerError("Too many operands in '@' chain");
+            int base = current->freeRegister;
+            for (const Expr *operand: operands) compileInto(operand, allocateRegister());
+            emit(encodeABC(OpCode::MATCHAIN, target, base, static_cast<int>(operands.size())));
+         }
+         current->freeRegister = mark;
+         break;
+      }
+
+      case ExprType::Unary: {
+         auto *unary = static_cast<const UnaryExpr *>(expr);
+         int mark = current->freeRegister;
+         int operand = compileOperand(unary->right.get());
+         emit(encodeABC(unaryOpcode(unary->operation), target, operand));
+         current->freeRegister = mark;
+         break;
+      }
+
+      case ExprType::Assignment:
+         compileAssignment(static_cast<const AssignmentExpr *>(expr), target);
+         break;
+
+      case ExprType::FunctionCall:
+         compileCall(static_cast<const FunctionCallExpr *>(expr), target);
+         break;
+
+      default:
+         compileStatement(expr);
+         emit(encodeABC(OpCode::LOADNULL, target));
+         break;
+   }
+}
+
+int BytecodeCompiler::compileOperand(const Expr *expr) {
+   if (expr->type == ExprType::Identifier) {
+      auto *identifier = static_cast<const IdentifierExpr *>(expr);
+      if (identifier->slot.kind == VariableSlot::Kind::Local) return identifier->slot.index;
+   }
+   int reg = allocateRegister();
+   compileInto(expr, reg);
+   return reg;
+}
+
+int BytecodeCompiler::compileLeftOperand(const BinaryExpr *binary) {
+   if (!hasAssignment(binary->right.get())) return compileOperand(binary->left.get());
+   int reg = allocateRegister();
+   compileInto(binary->left.get(), reg);
+   return reg;
+}
+
+// Emits a jump taken when the condition is falsy and returns it for patching.
+// Comparisons become one compare-and-branch instruction.
+size_t BytecodeCompiler::compileBranchIfFalse(const Expr *condition) {
+   int mark = current->freeRegister;
+   size_t jump;
+   auto *binary = condition->type == ExprType::Binary ? static_cast<const BinaryExpr *>(condition) : nullptr;
+
+   if (binary && branchOpcode(binary->operation, false) != OpCode::MOVE) {
+      int left = compileLeftOperand(binary);
+      int constant;
+      if (intLiteral(binary->right.get(), -SBX_BIAS, MAX_BX - SBX_BIAS, constant)) {
+         emit(encodeAsBx(branchOpcode(binary->operation, true), left, constant));
+      } else {
+         emit(encodeABC(branchOpcode(binary->operation, false), left, compileOperand(binary->right.get())));
+      }
+      jump = emitJump(OpCode::JMP);
+   } else {
+      jump = emitJump(OpCode::JMPF, compileOperand(condition));
+   }
+
+   current->freeRegister = mark;
+   return jump;
+}
+
+void BytecodeCompiler::compileAssignment(const AssignmentExpr *assign, int target) {
+   int mark = current->freeRegister;
+   int reg;
+   if (assign->slot.kind == VariableSlot::Kind::Local) reg = assign->slot.index;
+   else reg = target >= 0 ? target : allocateRegister();
+
+   compileInto(assign->value.get(), reg);
+   storeVariable(assign->slot, assign->name, reg);
+   if (target >= 0 && target != reg) emit(encodeABC(OpCode::MOVE, target, reg));
+   current->freeRegister = mark;
+}
+
+void BytecodeCompiler::compileLogical(const BinaryExpr *binary, int target) {
+   // Evaluated in a scratch register: target may be a local the right operand reads.
+   int mark = current->freeRegister;
+   int reg = allocateRegister();
+   compileInto(binary->left.get(), reg);
+   emit(encodeABC(OpCode::TRUTHY, reg, reg));
+   size_t shortCircuit = emitJump(binary->operation == BinaryOperator::And ? OpCode::JMPF : OpCode::JMPT, reg);
+   compileInto(binary->right.get(), reg);
+   emit(encodeABC(OpCode::TRUTHY, reg, reg));
+   patchJump(shortCircuit);
+   emit(encodeABC(OpCode::MOVE, target, reg));
+   current->freeRegister = mark;
+}
+
+void BytecodeCompiler::compileCall(const FunctionCallExpr *call, int target, OpCode op) {
+   int mark = current->freeRegister;
+   int base = current->freeRegister;
+   for (const auto &arg: call->arguments) {
+      compileInto(arg.get(), allocateRegister());
+   }
+   if (call->arguments.empty()) allocateRegister();
+
+   auto &sites = current->proto->callSites;
+   if (sites.size() > MAX_BX) {
+      throw CompilerError("Too many call sites in function '" + current->proto->name + "'");
+   }
+   sites.push_back(CallSite{call->callee, static_cast<int>(call->arguments.size())});
+   emit(encodeABx(op, base, static_cast<int>(sites.size() - 1)));
+
+   if (target >= 0 && target != base) emit(encodeABC(OpCode::MOVE, target, base));
+   current->freeRegister = mark;
+}
+
+void BytecodeCompiler::storeVariable(const VariableSlot &slot, const std::string &name, int source) {
+   switch (slot.kind) {
+      case VariableSlot::Kind::Local:
+         if (slot.index != source) emit(encodeABC(OpCode::MOVE, slot.index, source));
+         break;
+      case VariableSlot::Kind::Global:
+         emit(encodeABx(OpCode::SETGLOBAL, source, slot.index));
+         break;
+      default:
+         emit(encodeABx(OpCode::ERROR, 0, constant(Value::string("Undefined variable '" + name + "'"))));
+         break;
+   }
+}
+
+void BytecodeCompiler::compileLoop(const Expr *condition, const Expr *body, const Expr *increment,
+                                   bool testFirst) {
+   current->loops.push_back(Loop{{}, {}, current->tries.size(), true});
+   size_t start = current->proto->code.size();
+   int mark = current->freeRegister;
+
+   std::vector<size_t> exits;
+   if (testFirst && condition) exits.push_back(compileBranchIfFalse(condition));
+
+   compileStatement(body);
+
+   for (size_t jump: current->loops.back().continueJumps) patchJump(jump);
+   if (testFirst) {
+      compileStatement(increment);
+      emitJumpBack(start);
+   } else {
+      emitJumpBack(start, OpCode::JMPT, compileOperand(condition));
+      current->freeRegister = mark;
+   }
+
+   for (size_t jump: exits) patchJump(jump);
+   for (size_t jump: current->loops.back().breakJumps) patchJump(jump);
+   current->loops.pop_back();
+}
+
+// Runs of literal cases dispatch through a SwitchTable; the remaining cases
+// are compared in order, as before.
+void BytecodeCompiler::compileSwitch(const SwitchStatementExpr *stmt) {
+   int mark = current->freeRegister;
+   int subject = allocateRegister();
+   compileInto(stmt->switchExpr.get(), subject);
+   int test = allocateRegister();
+
+   auto &code = current->proto->code;
+   auto &tables = current->proto->switchTables;
+   std::vector<std::pair<size_t, size_t>> caseJumps; // jump, case index
+   std::vector<std::pair<size_t, size_t>> tableSwitches; // SWITCH, table index
+   for (SwitchStep &step: planSwitch(*stmt)) {
+      if (step.table) {
+         if (tables.size() > MAX_BX) {
+            throw CompilerError("Too many switch tables in function '" + current->proto->name + "'");
+         }
+         tables.push_back(std::move(*step.table));
+         tableSwitches.emplace_back(code.size(), tables.size() - 1);
+         emit(encodeABx(OpCode::SWITCH, subject, static_cast<int>(tables.size() - 1)));
+         continue;
+      }
+      auto *caseClause = static_cast<const CaseClauseExpr *>(stmt->caseClauses[step.firstCase].get());
+      int caseMark = current->freeRegister;
+      int value = compileOperand(caseClause->caseExpr.get());
+      emit(encodeABC(OpCode::EQ, test, subject, value));
+      caseJumps.emplace_back(emitJump(OpCode::JMPT, test), step.firstCase);
+      current->freeRegister = caseMark;
+   }
+   size_t toDefault = emitJump(OpCode::JMP);
+
+   current->loops.push_back(Loop{{}, {}, current->tries.size(), false});
+   std::vector<size_t> bodyStarts;
+   std::vector<size_t> exits;
+   for (const auto &clause: stmt->caseClauses) {
+      bodyStarts.push_back(code.size());
+      compileStatement(static_cast<const CaseClauseExpr *>(clause.get())->body.get());
+      exits.push_back(emitJump(OpCode::JMP));
+   }
+   patchJump(toDefault);
+   compileStatement(stmt->defaultClause.get());
+
+   for (const auto &[jump, index]: caseJumps) {
+      auto offset = static_cast<std::ptrdiff_t>(bodyStarts[index]) - static_cast<std::ptrdiff_t>(jump + 1);
+      code[jump] = withOffset(code[jump], offset, current->proto->name);
+   }
+   for (const auto &[at, index]: tableSwitches) {
+      tables[index].mapTargets([&](int target) { return static_cast<int>(bodyStarts[target] - (at + 1)); });
+   }
+   for (size_t jump: exits) patchJump(jump);
+   for (size_t jump: current->loops.back().breakJumps) patchJump(jump);
+   current->loops.pop_back();
+   current->freeRegister = mark;
+}
+
+// Only the first catch clause is used; it receives thrown values and the
+// message of runtime errors.
+void BytecodeCompiler::compileTry(const TryCatchFinallyStatementExpr *stmt) {
+   int mark = current->freeRegister;
+   const Expr *finallyBlock = stmt->finallyBlock.get();
+   auto *clause = stmt->catches.empty() ? nullptr : static_cast<const CatchClauseExpr *>(stmt->catches.front().get());
+
+   int caught = clause ? allocateRegister() : 0;
+   int handler = openHandler(clause ? caught : -1);
+
+   current->tries.push_back(TryRegion{finallyBlock, handler, false});
+   compileStatement(stmt->tryBlock.get());
+   current->tries.pop_back();
+   closeHandler(handler);
+   std::vector<size_t> toFinally{emitJump(OpCode::JMP)};
+
+   setHandlerTarget(handler);
+   if (clause) {
+      int rethrowHandler = finallyBlock ? openHandler(-1) : -1;
+      if (finallyBlock) current->tries.push_back(TryRegion{finallyBlock, rethrowHandler, false});
+
+      storeVariable(clause->slot, clause->exceptionVarName, caught);
+      compileStatement(clause->block.get());
+
+      if (finallyBlock) {
+         current->tries.pop_back();
+         closeHandler(rethrowHandler);
+         toFinally.push_back(emitJump(OpCode::JMP));
+         setHandlerTarget(rethrowHandler);
+         compileRethrowingFinally(finallyBlock);
+      }
+   } else {
+      compileRethrowingFinally(finallyBlock);
+   }
+
+   for (size_t jump: toFinally) patchJump(jump);
+   compileStatement(finallyBlock);
+   current->freeRegister = mark;
+}
+
+void BytecodeCompiler::compileRethrowingFinally(const Expr *finallyBlock) {
+   current->tries.push_back(TryRegion{nullptr, -1, true});
+   compileStatement(finallyBlock);
+   current->tries.pop_back();
+   emit(encodeABC(OpCode::RETHROW, 0));
+}
+
+int BytecodeCompiler::openHandler(int reg) {
+   current->handlers.push_back(HandlerState{reg, current->proto->code.size(), true, {}});
+   return static_cast<int>(current->handlers.size() - 1);
+}
+
+// Ends the handler's current stretch of protected code. Inner handlers close
+// first, which keeps the table innermost first.
+void BytecodeCompiler::closeHandler(int handler) {
+   HandlerState &state = current->handlers[handler];
+   size_t end = current->proto->code.size();
+   if (state.open && state.start < end) {
+      auto &table = current->proto->handlers;
+      table.push_back(ExceptionHandler{static_cast<std::uint32_t>(state.start), static_cast<std::uint32_t>(end), 0,
+                                       state.reg});
+      state.entries.push_back(table.size() - 1);
+   }
+   state.open = false;
+}
+
+// The handler's code starts at the next instruction.
+void BytecodeCompiler::setHandlerTarget(int handler) {
+   auto target = static_cast<std::uint32_t>(current->proto->code.size());
+   for (size_t entry: current->handlers[handler].entries) current->proto->handlers[entry].target = target;
+}
+
+// Emits the exits of every try region above `depth`, innermost first, for a
+// jump that leaves them.
+void BytecodeCompiler::leaveTryRegions(size_t depth) {
+   std::vector<TryRegion> saved = current->tries;
+   for (size_t i = saved.size(); i-- > depth;) {
+      const TryRegion &region = saved[i];
+      if (region.handler >= 0) closeHandler(region.handler);
+      if (region.holdsException) emit(encodeABC(OpCode::DISCARD, 0));
+      if (region.finallyBlock) {
+         current->tries.resize(i);
+         compileStatement(region.finallyBlock);
+      }
+   }
+   current->tries = std::move(saved);
+}
+
+// After the jump leaving the regions above `depth`: code that follows is
+// protected again.
+void BytecodeCompiler::reenterTryRegions(size_t depth) {
+   for (size_t i = depth; i < current->tries.size(); ++i) {
+      if (int handler = current->tries[i].handler; handler >= 0) {
+         current->handlers[handler].start = current->proto->code.size();
+         current->handlers[handler].open = true;
+      }
+   }
+}
+
+void BytecodeCompiler::compileFunctionDeclaration(const FunctionDeclarationExpr *function) {
+   auto proto = std::make_unique<FunctionProto>();
+   proto->name = function->name;
+   proto->arity = static_cast<int>(function->params.size());
+   FunctionProto &compiled = *proto;
+   program->functions.push_back(std::move(proto));
+   compileFunction(compiled, function->body.get(), function->frameSize);
+
+   auto &nested = current->proto->nestedFunctions;
+   if (nested.size() > MAX_BX) {
+      throw CompilerError("Too many functions declared in '" + current->proto->name + "'");
+   }
+   nested.push_back(&compiled);
+   emit(encodeABx(OpCode::DEFFN, 0, static_cast<int>(nested.size() - 1)));
+}
+
+#pragma clang diagnostic pop
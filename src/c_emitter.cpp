@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "c_emitter.h"
+#include "inliner.h"
+#include "error.h"
+
+static std::string intLiteral(std::int32_t value) {
+   return value == INT32_MIN ? "(-2147483647 - 1)" : std::to_string(value);
+}
+
+static std::string floatLiteral(double value) {
+   if (std::isnan(value)) return "NAN";
+   if (std::isinf(value)) return value > 0 ? "HUGE_VAL" : "-HUGE_VAL";
+   char text[64];
+   std::snprintf(text, sizeof(text), "%a", value);
+   return text;
+}
+
+static const char *binaryFunction(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return "rt_add";
+      case BinaryOperator::Subtract:
+         return "rt_sub";
+      case BinaryOperator::Multiply:
+         return "rt_mul";
+      case BinaryOperator::Divide:
+         return "rt_div";
+      case BinaryOperator::Equal:
+         return "rt_eq";
+      case BinaryOperator::NotEqual:
+         return "rt_ne";
+      case BinaryOperator::Less:
+         return "rt_lt";
+      case BinaryOperator::LessEqual:
+         return "rt_le";
+      case BinaryOperator::Greater:
+         return "rt_gt";
+      case BinaryOperator::GreaterEqual:
+         return "rt_ge";
+      default:
+         throw CompilerError(std::string("Unsupported binary operator '") + operatorLexeme(op) + "'");
+   }
+}
+
+static const char *unaryFunction(UnaryOperator op) {
+   switch (op) {
+      case UnaryOperator::Plus:
+         return "rt_plus";
+      case UnaryOperator::Negate:
+         return "rt_negate";
+      case UnaryOperator::Not:
+         return "rt_not";
+      case UnaryOperator::BitwiseNot:
+         return "rt_bitnot";
+      default:
+         throw CompilerError("Unsupported unary operator");
+   }
+}
+
+static std::string functionName(int id) {
+   return "fn_" + std::to_string(id);
+}
+
+void CEmitter::collect() {
+   bindings.clear();
+   strings.clear();
+   functionIds.clear();
+   for (const auto &function: module->functions) {
+      functionIds.emplace(function.get(), static_cast<int>(functionIds.size()));
+   }
+   for (const auto &function: module->functions) {
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::DefineFunction) bindings.emplace(instr->name, static_cast<int>(bindings.size()));
+            if (instr->op == IrOp::Const && instr->constant.isString()) {
+               strings.emplace(instr->constant.asString()->chars, static_cast<int>(strings.size()));
+            }
+         }
+      }
+   }
+}
+
+std::string CEmitter::value(const IrInstr *instr) const {
+   return "v" + std::to_string(values.at(instr));
+}
+
+std::string CEmitter::arguments(const IrInstr *instr) const {
+   std::string result;
+   for (size_t i = 0; i < instr->operands.size(); ++i) {
+      if (i > 0) result += ", ";
+      result += value(instr->operands[i]);
+   }
+   return result;
+}
+
+std::string CEmitter::emit(const IrModule &irModule, bool library) {
+   module = &irModule;
+   collect();
+   CallGraph graph(irModule);
+   std::ostringstream text;
+   out = &text;
+
+   text << cRuntime();
+   int globals = 0;
+   for (const auto &function: irModule.functions) {
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::LoadGlobal || instr->op == IrOp::StoreGlobal) {
+               globals = std::max(globals, instr->index + 1);
+            }
+         }
+      }
+   }
+   text << "/* The program. */\n";
+   text << "static Value rt_globals[" << std::max(globals, 1) << "];\n";
+   text << "static RtBinding rt_bindings[" << std::max(static_cast<int>(bindings.size()), 1) << "];\n";
+   text << "static Value K[" << std::max(static_cast<int>(strings.size()), 1) << "];\n\n";
+
+   for (const auto &function: irModule.functions) {
+      text << "static Value " << functionName(functionIds.at(function.get())) << "(";
+      for (int i = 0; i < function->arity; ++i) text << (i > 0 ? ", " : "") << "Value p" << i;
+      text << (function->arity == 0 ? "void" : "") << ");\n";
+   }
+   text << "\n";
+   for (const auto &function: irModule.functions) {
+      if (function.get() == &irModule.main()) continue;
+      std::string name = functionName(functionIds.at(function.get()));
+      text << "static Value " << name << "_entry(const Value *a) {\n";
+      if (function->arity == 0) text << "   (void) a;\n";
+      text << "   return " << name << "(";
+      for (int i = 0; i < function->arity; ++i) text << (i > 0 ? ", " : "") << "a[" << i << "]";
+      text << ");\n}\n\n";
+   }
+
+   targets.clear();
+   for (const auto &function: irModule.functions) {
+      for (const IrInstr *call: graph.sites(function.get())) targets[call] = graph.target(call);
+   }
+   for (const auto &function: irModule.functions) emitFunction(*function);
+
+   std::vector<std::pair<int, std::string>> constants;
+   for (const auto &[chars, index]: strings) constants.emplace_back(index, chars);
+   std::sort(constants.begin(), constants.end());
+   text << "static void rt_init(void) {\n";
+   text << "   rt_handlers = NULL;\n   rt_depth = 0;\n";
+   text << "   memset(rt_globals, 0, sizeof rt_globals);\n";
+   text << "   memset(rt_bindings, 0, sizeof rt_bindings);\n";
+   text << "   rt_gc_roots(rt_globals, sizeof rt_globals / sizeof(Value), K, sizeof K / sizeof(Value));\n";
+   for (const auto &[index, chars]: constants) {
+      text << "   K[" << index << "] = rt_string(rt_new_str(" << cQuote(chars) << ", " << chars.size() << "));\n";
+   }
+   text << "}\n\n";
+
+   text << cRuntimeEntry(library);
+   out = nullptr;
+   module = nullptr;
+   return text.str();
+}
+
+void CEmitter::emitFunction(const IrFunction &function) {
+   values.clear();
+   labels.clear();
+   bool protects = false;
+   std::vector<const IrInstr *> catches;
+   for (const auto &block: function.blocks) {
+      labels.emplace(block.get(), static_cast<int>(labels.size()));
+      protects |= block->handler != nullptr;
+      for (const IrInstr *phi: block->phis) values.emplace(phi, static_cast<int>(values.size()));
+      for (const IrInstr *instr: block->instructions) {
+         if (producesValue(instr->op)) values.emplace(instr, static_cast<int>(values.size()));
+         if (instr->op == IrOp::Catch) catches.push_back(instr);
+      }
+   }
+
+   std::ostream &text = *out;
+   bool script = &function == &module->main();
+   text << "static Value " << functionName(functionIds.at(&function)) << "(";
+   for (int i = 0; i < function.arity; ++i) text << (i > 0 ? ", " : "") << "Value p" << i;
+   text << (function.arity == 0 ? "void" : "") << ") {\n";
+   text << "   /* " << function.name << " */\n";
+   if (!values.empty()) {
+      text << "   Value";
+      for (size_t i = 0; i < values.size(); ++i) text << (i > 0 ? ", v" : " v") << i;
+      text << ";\n";
+   }
+   for (const IrInstr *instr: catches) text << "   int c" << values.at(instr) << ";\n";
+   if (protects) text << "   RtHandler handler;\n";
+   if (!script) text << "   RT_ENTER(" << cQuote(function.name) << ");\n";
+
+   for (const auto &block: function.blocks) {
+      text << "b" << labels.at(block.get()) << ":\n";
+      const IrInstr *terminator = block->terminator();
+      const IrInstr *raising = nullptr;
+      if (block->handler && block->instructions.size() > 1) {
+         const IrInstr *last = block->instructions[block->instructions.size() - 2];
+         if (last->mayThrow()) raising = last;
+      }
+      for (const IrInstr *instr: block->instructions) {
+         if (instr == terminator) break;
+         if (instr == raising) {
+            text << "   rt_push(&handler);\n";
+            text << "   if (setjmp(handler.env)) {\n";
+            emitEdge(block.get(), block->handler, "      ");
+            text << "   }\n";
+            emitInstruction(function, instr);
+            text << "   rt_handlers = handler.prev;\n";
+            continue;
+         }
+         emitInstruction(function, instr);
+      }
+
+      switch (terminator->op) {
+         case IrOp::Jump:
+            emitEdge(block.get(), block->successors[0], "   ");
+            break;
+         case IrOp::Branch:
+            text << "   if (rt_truthy(" << value(terminator->operands[0]) << ")) {\n";
+            emitEdge(block.get(), block->successors[0], "      ");
+            text << "   }\n";
+            emitEdge(block.get(), block->successors[1], "   ");
+            break;
+         case IrOp::Switch: {
+            std::string subject = value(terminator->operands[0]);
+            std::ostringstream integers;
+            std::ostringstream strings;
+            std::ostream *saved = out;
+            terminator->table->forEachKey([&](std::int32_t key, int target) {
+                integers << "         case " << intLiteral(key) << ":\n";
+                out = &integers;
+                emitEdge(block.get(), block->successors[target], "            ");
+                out = saved;
+            }, [&](const std::string &key, int target) {
+                strings << "   if (" << subject << ".type == T_STRING && rt_string_is(" << subject << ", "
+                        << cQuote(key) << ", " << key.size() << ")) {\n";
+                out = &strings;
+                emitEdge(block.get(), block->successors[target], "      ");
+                out = saved;
+                strings << "   }\n";
+            });
+            if (!integers.str().empty()) {
+               text << "   {\n      int32_t key;\n      if (rt_switch_key(" << subject << ", &key)) switch (key) {\n"
+                    << integers.str() << "         default:\n            break;\n      }\n   }\n";
+            }
+            text << strings.str();
+            emitEdge(block.get(), block->successors[0], "   ");
+            break;
+         }
+         case IrOp::Return:
+            if (!script) text << "   rt_depth--;\n";
+            text << "   return " << value(terminator->operands[0]) << ";\n";
+            break;
+         case IrOp::Rethrow: {
+            const IrInstr *caught = terminator->operands[0];
+            if (caught->op != IrOp::Catch) throw CompilerError("Rethrow of a value that was not caught");
+            std::string kind = "c" + std::to_string(values.at(caught));
+            if (block->handler) {
+               text << "   rt_caught = " << value(caught) << ";\n   rt_caught_error = " << kind << ";\n";
+               emitEdge(block.get(), block->handler, "   ");
+            } else {
+               text << "   rt_raise(" << value(caught) << ", " << kind << ");\n";
+            }
+            break;
+         }
+         default:
+            text << "   abort();\n";
+            break;
+      }
+   }
+   text << "}\n\n";
+}
+
+void CEmitter::emitEdge(const IrBlock *from, const IrBlock *to, const char *indent) {
+   std::ostream &text = *out;
+   size_t index = to->predecessorIndex(from);
+   if (to->phis.size() == 1) {
+      text << indent << value(to->phis[0]) << " = " << value(to->phis[0]->operands[index]) << ";\n";
+   } else if (!to->phis.empty()) {
+      // The phis take their values in parallel: one may read another.
+      text << indent << "{\n";
+      for (size_t i = 0; i < to->phis.size(); ++i) {
+         text << indent << "   Value t" << i << " = " << value(to->phis[i]->operands[index]) << ";\n";
+      }
+      for (size_t i = 0; i < to->phis.size(); ++i) {
+         text << indent << "   " << value(to->phis[i]) << " = t" << i << ";\n";
+      }
+      text << indent << "}\n";
+   }
+   text << indent << "goto b" << labels.at(to) << ";\n";
+}
+
+void CEmitter::emitInstruction(const IrFunction &function, const IrInstr *instr) {
+   std::ostream &text = *out;
+   switch (instr->op) {
+      case IrOp::Const: {
+         const Value &constant = instr->constant;
+         text << "   " << value(instr) << " = ";
+         if (constant.isNull()) text << "rt_null()";
+         else if (constant.isBool()) text << "rt_bool(" << constant.asBool() << ")";
+         else if (constant.isInt()) text << "rt_int(" << intLiteral(constant.asInt()) << ")";
+         else if (constant.isFloat()) text << "rt_float(" << floatLiteral(constant.asFloat()) << ")";
+         else if (constant.isString()) text << "K[" << strings.at(constant.asString()->chars) << "]";
+         else throw CompilerError(std::string("Cannot emit a ") + constant.typeName() + " constant as C");
+         text << ";\n";
+         break;
+      }
+      case IrOp::Param:
+         text << "   " << value(instr) << " = p" << instr->index << ";\n";
+         break;
+      case IrOp::Catch:
+         text << "   " << value(instr) << " = rt_caught;\n";
+         text << "   c" << values.at(instr) << " = rt_caught_error;\n";
+         break;
+      case IrOp::LoadGlobal:
+         text << "   " << value(instr) << " = rt_globals[" << instr->index << "];\n";
+         break;
+      case IrOp::StoreGlobal:
+         text << "   rt_globals[" << instr->index << "] = " << value(instr->operands[0]) << ";\n";
+         break;
+      case IrOp::Binary:
+         text << "   " << value(instr) << " = " << binaryFunction(instr->binary) << "(" << arguments(instr) << ");\n";
+         break;
+      case IrOp::Unary:
+         text << "   " << value(instr) << " = " << unaryFunction(instr->unary) << "(" << arguments(instr) << ");\n";
+         break;
+      case IrOp::Truthy:
+         text << "   " << value(instr) << " = rt_bool(rt_truthy(" << value(instr->operands[0]) << "));\n";
+         break;
+      case IrOp::MatMul:
+         text << "   " << value(instr) << " = rt_matmul(" << arguments(instr) << ");\n";
+         break;
+      case IrOp::MatChain:
+         text << "   {\n      Value a[] = {" << arguments(instr) << "};\n";
+         text << "      " << value(instr) << " = rt_matchain(a, " << instr->operands.size() << ");\n   }\n";
+         break;
+      case IrOp::Call:
+         emitCall(instr);
+         break;
+      case IrOp::DefineFunction: {
+         int slot = bindings.at(instr->name);
+         text << "   rt_bindings[" << slot << "].entry = " << functionName(functionIds.at(instr->function))
+              << "_entry;\n";
+         text << "   rt_bindings[" << slot << "].arity = " << instr->function->arity << ";\n";
+         break;
+      }
+      case IrOp::Error:
+         text << "   rt_error(\"%s\", " << cQuote(instr->name) << ");\n";
+         break;
+      default:
+         throw CompilerError(std::string("Unexpected ") + irOpName(instr->op) + " in " + function.name);
+   }
+}
+
+void CEmitter::emitCall(const IrInstr *instr) {
+   std::ostream &text = *out;
+   auto target = targets.find(instr);
+   if (target != targets.end()) {
+      text << "   " << value(instr) << " = " << functionName(functionIds.at(target->second)) << "("
+           << arguments(instr) << ");\n";
+      return;
+   }
+
+   int count = static_cast<int>(instr->operands.size());
+   std::string name = cQuote(instr->name);
+   std::string fallback;
+   if (const CHostFunction *host = findCHostFunction(instr->name)) {
+      fallback = host->arity >= 0 && host->arity != count
+                 ? "rt_arity_error(" + name + ", " + std::to_string(host->arity) + ", " + std::to_string(count) + ")"
+                 : std::string("rt_host_") + host->name + "(a, " + std::to_string(count) + ")";
+   } else {
+      fallback = "rt_undefined(" + name + ")";
+   }
+   text << "   {\n      Value a[] = {" << (count > 0 ? arguments(instr) : "{0}") << "};\n";
+   text << "      (void) a;\n";
+   auto slot = bindings.find(instr->name);
+   if (slot != bindings.end()) {
+      std::string binding = "rt_bindings[" + std::to_string(slot->second) + "]";
+      text << "      " << value(instr) << " = " << binding << ".entry ? rt_invoke(&" << binding << ", " << name
+           << ", a, " << count << ") : " << fallback << ";\n";
+   } else {
+      text << "      " << value(instr) << " = " << fallback << ";\n";
+   }
+   text << "   }\n";
+}
+
+void buildNative(const IrModule &module, const std::string &output, const NativeBuildOptions &options) {
+   std::string source = output + ".c";
+   {
+      std::ofstream file(source);
+      if (!file) throw CompilerError("Cannot write " + source);
+      file << CEmitter().emit(module, options.library);
+   }
+   runCCompiler({source}, output, options);
+}
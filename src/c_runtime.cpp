@@ -0,0 +1,850 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "c_runtime.h"
+#include "error.h"
+
+static const char *const RUNTIME_VALUES = R"(#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__)
+#define RT_NORETURN __attribute__((noreturn))
+#define RT_NOINLINE __attribute__((noinline))
+#else
+#define RT_NORETURN
+#define RT_NOINLINE
+#endif
+
+#define RT_MAX_DEPTH 100000
+#define RT_MAX_MATRIX_ELEMENTS (1LL << 26)
+#define RT_STACK_SIZE ((size_t) 1 << 30)
+
+enum { T_NULL, T_BOOL, T_INT, T_FLOAT, T_STRING, T_MATRIX };
+
+typedef struct {
+   size_t len;
+   char chars[];
+} Str;
+
+typedef struct {
+   int rows, cols;
+   double *data;
+} Mat;
+
+typedef struct {
+   int type;
+   union {
+      int b;
+      int32_t i;
+      double f;
+      Str *s;
+      Mat *m;
+   } as;
+} Value;
+
+static inline Value rt_null(void) { Value v; v.type = T_NULL; v.as.i = 0; return v; }
+static inline Value rt_bool(int b) { Value v; v.type = T_BOOL; v.as.b = b != 0; return v; }
+static inline Value rt_int(int32_t i) { Value v; v.type = T_INT; v.as.i = i; return v; }
+static inline Value rt_float(double f) { Value v; v.type = T_FLOAT; v.as.f = f; return v; }
+static inline Value rt_string(Str *s) { Value v; v.type = T_STRING; v.as.s = s; return v; }
+static inline Value rt_matrix(Mat *m) { Value v; v.type = T_MATRIX; v.as.m = m; return v; }
+
+static inline int rt_is_number(Value v) { return v.type == T_INT || v.type == T_FLOAT; }
+static inline double rt_number(Value v) { return v.type == T_INT ? (double) v.as.i : v.as.f; }
+static inline int32_t rt_wrap(int64_t v) { return (int32_t) (uint32_t) v; }
+
+static const char *rt_type_name(Value v) {
+   static const char *const names[] = {"null", "bool", "int", "float", "string", "matrix"};
+   return names[v.type];
+}
+
+static void *rt_alloc(size_t size) {
+   void *p = malloc(size ? size : 1);
+   if (!p) {
+      fputs("Out of memory\n", stderr);
+      abort();
+   }
+   return p;
+}
+
+/* Exceptions. A handler is pushed around each raising instruction of a
+ * protected block; raising longjmps to the innermost one with the value in
+ * rt_caught. Runtime errors carry their message as a string. */
+typedef struct RtHandler {
+   jmp_buf env;
+   struct RtHandler *prev;
+   long depth;
+} RtHandler;
+
+#ifndef RT_STATE
+#define RT_STATE static
+#endif
+
+RT_STATE RtHandler *rt_handlers;
+RT_STATE long rt_depth;
+RT_STATE Value rt_caught;
+RT_STATE int rt_caught_error;
+
+/* Memory. Strings and matrices are reclaimed by a conservative mark and
+ * sweep: an object stays while a word on the script's stack or in its
+ * registers, globals, constants or rt_caught points into it. Neither kind
+ * refers to other objects, so marking is one lookup per word. */
+#define RT_GC_MIN_BYTES ((size_t) 16 << 20)
+
+typedef struct {
+   char *start;
+   size_t size;
+} RtObject;
+
+static RtObject *rt_objects;
+static size_t rt_object_count, rt_object_cap;
+static size_t rt_allocated, rt_live; /* bytes since the last collection, and bytes it kept */
+static const char *rt_stack_top;
+static Value *rt_root_values[2];
+static size_t rt_root_counts[2];
+
+static void rt_gc_roots(Value *globals, size_t global_count, Value *constants, size_t constant_count) {
+   rt_root_values[0] = globals;
+   rt_root_counts[0] = global_count;
+   rt_root_values[1] = constants;
+   rt_root_counts[1] = constant_count;
+}
+
+static int rt_object_order(const void *a, const void *b) {
+   const char *x = ((const RtObject *) a)->start, *y = ((const RtObject *) b)->start;
+   return x < y ? -1 : x > y;
+}
+
+/* Marks the objects the aligned words in [from, to) point into. */
+static void rt_mark(const char *from, const char *to, unsigned char *marks) {
+   uintptr_t low = (uintptr_t) rt_objects[0].start;
+   uintptr_t high = (uintptr_t) rt_objects[rt_object_count - 1].start + rt_objects[rt_object_count - 1].size;
+   from += (sizeof(void *) - (uintptr_t) from % sizeof(void *)) % sizeof(void *);
+   for (; from + sizeof(void *) <= to; from += sizeof(void *)) {
+      uintptr_t word;
+      memcpy(&word, from, sizeof word);
+      if (word < low || word >= high) continue;
+      size_t lo = 0, hi = rt_object_count;
+      while (lo < hi) {
+         size_t mid = lo + (hi - lo) / 2;
+         if ((uintptr_t) rt_objects[mid].start <= word) lo = mid + 1;
+         else hi = mid;
+      }
+      if (lo > 0 && word - (uintptr_t) rt_objects[lo - 1].start < rt_objects[lo - 1].size) marks[lo - 1] = 1;
+   }
+}
+
+/* Its frame lies below the collector's, which holds the spilled registers. */
+static RT_NOINLINE void rt_mark_stack(unsigned char *marks) {
+   volatile char bottom = 0;
+   const char *here = (const char *) &bottom;
+   if (here < rt_stack_top) rt_mark(here, rt_stack_top, marks);
+   else rt_mark(rt_stack_top, here, marks);
+}
+
+static RT_NOINLINE void rt_collect(void) {
+   jmp_buf registers;
+#if defined(__GNUC__)
+   __builtin_unwind_init();
+#endif
+   setjmp(registers);
+   unsigned char *marks = (unsigned char *) calloc(rt_object_count, 1);
+   if (!rt_stack_top || rt_object_count == 0 || !marks) {
+      free(marks);
+      return;
+   }
+   qsort(rt_objects, rt_object_count, sizeof(RtObject), rt_object_order);
+   rt_mark_stack(marks);
+   for (int i = 0; i < 2; ++i) {
+      rt_mark((const char *) rt_root_values[i], (const char *) (rt_root_values[i] + rt_root_counts[i]), marks);
+   }
+   rt_mark((const char *) &rt_caught, (const char *) (&rt_caught + 1), marks);
+   size_t kept = 0;
+   rt_live = 0;
+   for (size_t i = 0; i < rt_object_count; ++i) {
+      if (marks[i]) {
+         rt_objects[kept++] = rt_objects[i];
+         rt_live += rt_objects[i].size;
+      } else {
+         free(rt_objects[i].start);
+      }
+   }
+   rt_object_count = kept;
+   rt_allocated = 0;
+   free(marks);
+}
+
+/* A zeroed object, collecting first once as many bytes were allocated as
+ * the last collection kept. */
+static void *rt_new_object(size_t size) {
+   if (rt_allocated >= (rt_live > RT_GC_MIN_BYTES ? rt_live : RT_GC_MIN_BYTES)) rt_collect();
+   if (rt_object_count == rt_object_cap) {
+      size_t cap = rt_object_cap ? rt_object_cap * 2 : 256;
+      RtObject *objects = (RtObject *) realloc(rt_objects, cap * sizeof(RtObject));
+      if (!objects) {
+         fputs("Out of memory\n", stderr);
+         abort();
+      }
+      rt_objects = objects;
+      rt_object_cap = cap;
+   }
+   char *p = (char *) calloc(1, size);
+   if (!p) {
+      fputs("Out of memory\n", stderr);
+      abort();
+   }
+   rt_objects[rt_object_count].start = p;
+   rt_objects[rt_object_count].size = size;
+   rt_object_count++;
+   rt_allocated += size + sizeof(RtObject);
+   return p;
+}
+
+static Str *rt_new_str(const char *chars, size_t len) {
+   Str *s = (Str *) rt_new_object(sizeof(Str) + len + 1);
+   s->len = len;
+   memcpy(s->chars, chars, len);
+   s->chars[len] = '\0';
+   return s;
+}
+
+typedef struct {
+   char *data;
+   size_t len, cap;
+} RtBuf;
+
+static void rt_buf_add(RtBuf *b, const char *s, size_t n) {
+   if (b->len + n + 1 > b->cap) {
+      size_t cap = b->cap ? b->cap * 2 : 64;
+      while (cap < b->len + n + 1) cap *= 2;
+      char *data = (char *) realloc(b->data, cap);
+      if (!data) {
+         fputs("Out of memory\n", stderr);
+         abort();
+      }
+      b->data = data;
+      b->cap = cap;
+   }
+   memcpy(b->data + b->len, s, n);
+   b->len += n;
+}
+
+static void rt_buf_number(RtBuf *b, const char *format, double x) {
+   char text[32];
+   if (isnan(x)) x = fabs(x); /* the VM prints every NaN as "nan" */
+   int n = snprintf(text, sizeof text, format, x);
+   rt_buf_add(b, text, (size_t) n);
+}
+
+static void rt_buf_value(RtBuf *b, Value v) {
+   char text[32];
+   switch (v.type) {
+      case T_NULL:
+         rt_buf_add(b, "null", 4);
+         break;
+      case T_BOOL:
+         if (v.as.b) rt_buf_add(b, "true", 4);
+         else rt_buf_add(b, "false", 5);
+         break;
+      case T_INT:
+         rt_buf_add(b, text, (size_t) snprintf(text, sizeof text, "%d", (int) v.as.i));
+         break;
+      case T_FLOAT:
+         rt_buf_number(b, "%.15g", v.as.f);
+         break;
+      case T_STRING:
+         rt_buf_add(b, v.as.s->chars, v.as.s->len);
+         break;
+      default: {
+         const Mat *m = v.as.m;
+         rt_buf_add(b, "[", 1);
+         for (int i = 0; i < m->rows; ++i) {
+            rt_buf_add(b, i > 0 ? ", [" : "[", i > 0 ? 3 : 1);
+            for (int j = 0; j < m->cols; ++j) {
+               rt_buf_number(b, j > 0 ? ", %.15g" : "%.15g", m->data[(size_t) i * m->cols + j]);
+            }
+            rt_buf_add(b, "]", 1);
+         }
+         rt_buf_add(b, "]", 1);
+      }
+   }
+}
+
+static Str *rt_buf_finish(RtBuf *b) {
+   Str *s = rt_new_str(b->data ? b->data : "", b->len);
+   free(b->data);
+   return s;
+}
+
+static Str *rt_to_str(Value v) {
+   if (v.type == T_STRING) return v.as.s;
+   RtBuf b = {0, 0, 0};
+   rt_buf_value(&b, v);
+   return rt_buf_finish(&b);
+}
+
+static inline void rt_push(RtHandler *h) {
+   h->prev = rt_handlers;
+   h->depth = rt_depth;
+   rt_handlers = h;
+}
+
+static RT_NORETURN void rt_raise(Value value, int error) {
+   RtHandler *h = rt_handlers;
+   rt_handlers = h->prev;
+   rt_depth = h->depth;
+   rt_caught = value;
+   rt_caught_error = error;
+   longjmp(h->env, 1);
+}
+
+static RT_NORETURN void rt_error(const char *format, ...) {
+   va_list args;
+   va_start(args, format);
+   int n = vsnprintf(NULL, 0, format, args);
+   va_end(args);
+   Str *s = (Str *) rt_new_object(sizeof(Str) + (size_t) n + 1);
+   va_start(args, format);
+   vsnprintf(s->chars, (size_t) n + 1, format, args);
+   va_end(args);
+   s->len = (size_t) n;
+   rt_raise(rt_string(s), 1);
+}
+
+static RT_NORETURN Value rt_undefined(const char *name) {
+   rt_error("Undefined function '%s'", name);
+}
+
+static RT_NORETURN Value rt_arity_error(const char *name, int arity, int count) {
+   rt_error("Function '%s' expects %d argument(s) but got %d", name, arity, count);
+}
+
+#define RT_ENTER(name) \
+   do { \
+      if (rt_depth >= RT_MAX_DEPTH) rt_error("Stack overflow in '%s'", name); \
+      rt_depth++; \
+   } while (0)
+
+)";
+
+static const char *const RUNTIME_OPERATORS = R"(
+/* Operators. */
+static int rt_truthy(Value v) {
+   switch (v.type) {
+      case T_NULL:
+         return 0;
+      case T_BOOL:
+         return v.as.b;
+      case T_INT:
+         return v.as.i != 0;
+      case T_FLOAT:
+         return v.as.f != 0.0;
+      case T_STRING:
+         return v.as.s->len != 0;
+      default:
+         return 1;
+   }
+}
+
+static int rt_equals(Value a, Value b) {
+   if (rt_is_number(a) && rt_is_number(b)) {
+      if (a.type == T_INT && b.type == T_INT) return a.as.i == b.as.i;
+      return rt_number(a) == rt_number(b);
+   }
+   if (a.type != b.type) return 0;
+   switch (a.type) {
+      case T_NULL:
+         return 1;
+      case T_BOOL:
+         return a.as.b == b.as.b;
+      case T_STRING:
+         return a.as.s->len == b.as.s->len && memcmp(a.as.s->chars, b.as.s->chars, a.as.s->len) == 0;
+      default:
+         return a.as.m == b.as.m;
+   }
+}
+
+enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_LT, OP_LE, OP_GT, OP_GE };
+
+static const char *const rt_operator_names[] = {"+", "-", "*", "/", "<", "<=", ">", ">="};
+
+static RT_NORETURN Value rt_operand_error(int op, Value a, Value b) {
+   rt_error("Operator '%s' cannot be applied to %s and %s", rt_operator_names[op], rt_type_name(a), rt_type_name(b));
+}
+
+static Mat *rt_new_matrix(int rows, int cols) {
+   if (rows < 0 || cols < 0 || (long long) rows * cols > RT_MAX_MATRIX_ELEMENTS) {
+      rt_error("Invalid matrix dimensions %dx%d", rows, cols);
+   }
+   Mat *m = (Mat *) rt_new_object(sizeof(Mat) + (size_t) rows * cols * sizeof(double));
+   m->rows = rows;
+   m->cols = cols;
+   m->data = (double *) (m + 1);
+   return m;
+}
+
+static Value rt_elementwise(int op, Value a, Value b) {
+   Mat *m = a.type == T_MATRIX ? a.as.m : b.as.m;
+   Mat *r = rt_new_matrix(m->rows, m->cols);
+   size_t n = (size_t) m->rows * m->cols;
+   if (a.type == T_MATRIX && b.type == T_MATRIX) {
+      if (a.as.m->rows != b.as.m->rows || a.as.m->cols != b.as.m->cols) {
+         rt_error("Operator '%s' needs matrices of the same shape, got %dx%d and %dx%d", rt_operator_names[op],
+                  a.as.m->rows, a.as.m->cols, b.as.m->rows, b.as.m->cols);
+      }
+      const double *x = a.as.m->data, *y = b.as.m->data;
+      for (size_t i = 0; i < n; ++i) r->data[i] = op == OP_ADD ? x[i] + y[i] : op == OP_SUB ? x[i] - y[i] : x[i] * y[i];
+   } else {
+      /* scale * x + offset, as matrixAffine computes it: a zero offset
+       * turns -0 into 0. */
+      const double *x = m->data;
+      double s = rt_number(a.type == T_MATRIX ? b : a);
+      double scale = op == OP_MUL ? s : op == OP_SUB && b.type == T_MATRIX ? -1.0 : 1.0;
+      double offset = op == OP_MUL ? 0.0 : op == OP_SUB && a.type == T_MATRIX ? -s : s;
+      for (size_t i = 0; i < n; ++i) r->data[i] = scale * x[i] + offset;
+   }
+   return rt_matrix(r);
+}
+
+static int rt_compare_strings(const Str *a, const Str *b) {
+   size_t n = a->len < b->len ? a->len : b->len;
+   int order = memcmp(a->chars, b->chars, n);
+   if (order != 0) return order;
+   return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static Value rt_binary(int op, Value a, Value b) {
+   if (op == OP_ADD && (a.type == T_STRING || b.type == T_STRING)) {
+      RtBuf buf = {0, 0, 0};
+      rt_buf_value(&buf, a);
+      rt_buf_value(&buf, b);
+      return rt_string(rt_buf_finish(&buf));
+   }
+   if ((a.type == T_MATRIX || b.type == T_MATRIX) && (a.type == T_MATRIX || rt_is_number(a)) &&
+       (b.type == T_MATRIX || rt_is_number(b))) {
+      if (op == OP_ADD || op == OP_SUB || op == OP_MUL) return rt_elementwise(op, a, b);
+      rt_operand_error(op, a, b);
+   }
+   if (a.type == T_INT && b.type == T_INT) {
+      int64_t x = a.as.i, y = b.as.i;
+      switch (op) {
+         case OP_ADD: return rt_int(rt_wrap(x + y));
+         case OP_SUB: return rt_int(rt_wrap(x - y));
+         case OP_MUL: return rt_int(rt_wrap(x * y));
+         case OP_DIV:
+            if (y == 0) rt_error("Division by zero");
+            return rt_int(rt_wrap(x / y));
+         case OP_LT: return rt_bool(x < y);
+         case OP_LE: return rt_bool(x <= y);
+         case OP_GT: return rt_bool(x > y);
+         default: return rt_bool(x >= y);
+      }
+   }
+   if (rt_is_number(a) && rt_is_number(b)) {
+      double x = rt_number(a), y = rt_number(b);
+      switch (op) {
+         case OP_ADD: return rt_float(x + y);
+         case OP_SUB: return rt_float(x - y);
+         case OP_MUL: return rt_float(x * y);
+         case OP_DIV: return rt_float(x / y);
+         case OP_LT: return rt_bool(x < y);
+         case OP_LE: return rt_bool(x <= y);
+         case OP_GT: return rt_bool(x > y);
+         default: return rt_bool(x >= y);
+      }
+   }
+   if (a.type == T_STRING && b.type == T_STRING && op >= OP_LT) {
+      int order = rt_compare_strings(a.as.s, b.as.s);
+      switch (op) {
+         case OP_LT: return rt_bool(order < 0);
+         case OP_LE: return rt_bool(order <= 0);
+         case OP_GT: return rt_bool(order > 0);
+         default: return rt_bool(order >= 0);
+      }
+   }
+   rt_operand_error(op, a, b);
+}
+
+/* Integer and float operands take the inline path; the rest rt_binary. */
+#define RT_ARITHMETIC(name, op, symbol) \
+   static inline Value name(Value a, Value b) { \
+      if (a.type == T_INT && b.type == T_INT) return rt_int(rt_wrap((int64_t) a.as.i symbol (int64_t) b.as.i)); \
+      if (a.type == T_FLOAT && b.type == T_FLOAT) return rt_float(a.as.f symbol b.as.f); \
+      return rt_binary(op, a, b); \
+   }
+#define RT_COMPARISON(name, op, symbol) \
+   static inline Value name(Value a, Value b) { \
+      if (a.type == T_INT && b.type == T_INT) return rt_bool(a.as.i symbol b.as.i); \
+      if (a.type == T_FLOAT && b.type == T_FLOAT) return rt_bool(a.as.f symbol b.as.f); \
+      return rt_binary(op, a, b); \
+   }
+
+RT_ARITHMETIC(rt_add, OP_ADD, +)
+RT_ARITHMETIC(rt_sub, OP_SUB, -)
+RT_ARITHMETIC(rt_mul, OP_MUL, *)
+RT_COMPARISON(rt_lt, OP_LT, <)
+RT_COMPARISON(rt_le, OP_LE, <=)
+RT_COMPARISON(rt_gt, OP_GT, >)
+RT_COMPARISON(rt_ge, OP_GE, >=)
+
+static inline Value rt_div(Value a, Value b) { return rt_binary(OP_DIV, a, b); }
+
+static inline Value rt_eq(Value a, Value b) { return rt_bool(rt_equals(a, b)); }
+
+static inline Value rt_ne(Value a, Value b) { return rt_bool(!rt_equals(a, b)); }
+
+static RT_NORETURN Value rt_unary_error(Value v) {
+   rt_error("Unary operator cannot be applied to %s", rt_type_name(v));
+}
+
+static Value rt_matrix_copy(Value v, int negate) {
+   Mat *r = rt_new_matrix(v.as.m->rows, v.as.m->cols);
+   size_t n = (size_t) r->rows * r->cols;
+   for (size_t i = 0; i < n; ++i) r->data[i] = negate ? -1.0 * v.as.m->data[i] + 0.0 : v.as.m->data[i];
+   return rt_matrix(r);
+}
+
+static inline Value rt_plus(Value v) {
+   if (rt_is_number(v)) return v;
+   if (v.type == T_MATRIX) return rt_matrix_copy(v, 0);
+   return rt_unary_error(v);
+}
+
+static inline Value rt_negate(Value v) {
+   if (v.type == T_INT) return rt_int(rt_wrap(-(int64_t) v.as.i));
+   if (v.type == T_FLOAT) return rt_float(-v.as.f);
+   if (v.type == T_MATRIX) return rt_matrix_copy(v, 1);
+   return rt_unary_error(v);
+}
+
+static inline Value rt_not(Value v) { return rt_bool(!rt_truthy(v)); }
+
+static inline Value rt_bitnot(Value v) {
+   if (v.type == T_INT) return rt_int(~v.as.i);
+   return rt_unary_error(v);
+}
+
+/* A switch subject as an integer key, as SwitchTable::lookup reads it. */
+static inline int rt_switch_key(Value v, int32_t *key) {
+   if (v.type == T_INT) {
+      *key = v.as.i;
+      return 1;
+   }
+   if (v.type == T_FLOAT && v.as.f >= INT32_MIN && v.as.f <= INT32_MAX && v.as.f == floor(v.as.f)) {
+      *key = (int32_t) v.as.f;
+      return 1;
+   }
+   return 0;
+}
+
+static inline int rt_string_is(Value v, const char *chars, size_t len) {
+   return v.as.s->len == len && memcmp(v.as.s->chars, chars, len) == 0;
+}
+
+)";
+
+static const char *const RUNTIME_MATRICES = R"(
+/* Matrix products: C += A * B, blocked so that a panel of B stays in cache. */
+static void rt_gemm(int m, int n, int k, const double *a, const double *b, double *c) {
+   enum { BLOCK = 64 };
+   for (int i0 = 0; i0 < m; i0 += BLOCK) {
+      int i1 = i0 + BLOCK < m ? i0 + BLOCK : m;
+      for (int p0 = 0; p0 < k; p0 += BLOCK) {
+         int p1 = p0 + BLOCK < k ? p0 + BLOCK : k;
+         for (int j0 = 0; j0 < n; j0 += BLOCK) {
+            int j1 = j0 + BLOCK < n ? j0 + BLOCK : n;
+            for (int i = i0; i < i1; ++i) {
+               double *row = c + (size_t) i * n;
+               for (int p = p0; p < p1; ++p) {
+                  double x = a[(size_t) i * k + p];
+                  const double *from = b + (size_t) p * n;
+                  for (int j = j0; j < j1; ++j) row[j] += x * from[j];
+               }
+            }
+         }
+      }
+   }
+}
+
+static Mat *rt_matrix_operand(Value v) {
+   if (v.type != T_MATRIX) rt_error("Operator '@' expects matrices, got %s", rt_type_name(v));
+   return v.as.m;
+}
+
+static void rt_check_inner(const Mat *a, const Mat *b) {
+   if (a->cols != b->rows) rt_error("Cannot multiply %dx%d by %dx%d matrix", a->rows, a->cols, b->rows, b->cols);
+}
+
+static Value rt_matmul(Value left, Value right) {
+   Mat *a = rt_matrix_operand(left);
+   Mat *b = rt_matrix_operand(right);
+   rt_check_inner(a, b);
+   Mat *r = rt_new_matrix(a->rows, b->cols);
+   rt_gemm(a->rows, b->cols, a->cols, a->data, b->data, r->data);
+   return rt_matrix(r);
+}
+
+/* Product of mats[i..j] in the order split[][] gives, into out when set. */
+static double *rt_chain(Mat **mats, const int *split, int count, int i, int j, double *out) {
+   if (i == j) return mats[i]->data;
+   int s = split[i * count + j];
+   double *left = rt_chain(mats, split, count, i, s, NULL);
+   double *right = rt_chain(mats, split, count, s + 1, j, NULL);
+   int rows = mats[i]->rows, inner = mats[s]->cols, cols = mats[j]->cols;
+   if (!out) {
+      out = (double *) calloc((size_t) rows * cols + 1, sizeof(double));
+      if (!out) abort();
+   }
+   rt_gemm(rows, cols, inner, left, right, out);
+   if (i != s) free(left);
+   if (s + 1 != j) free(right);
+   return out;
+}
+
+/* Multiplies the chain in the order planMatrixChain picks. */
+static Value rt_matchain(const Value *operands, int count) {
+   if (count == 2) return rt_matmul(operands[0], operands[1]);
+   Mat **mats = (Mat **) rt_alloc(sizeof(Mat *) * (size_t) count);
+   for (int i = 0; i < count; ++i) {
+      mats[i] = rt_matrix_operand(operands[i]);
+      if (i > 0) rt_check_inner(mats[i - 1], mats[i]);
+   }
+   double *cost = (double *) calloc((size_t) count * count, sizeof(double));
+   int *split = (int *) calloc((size_t) count * count, sizeof(int));
+   if (!cost || !split) abort();
+   for (int length = 2; length <= count; ++length) {
+      for (int i = 0; i + length - 1 < count; ++i) {
+         int j = i + length - 1;
+         cost[i * count + j] = -1.0;
+         for (int s = i; s < j; ++s) {
+            double candidate = cost[i * count + s] + cost[(s + 1) * count + j] +
+                               (double) mats[i]->rows * mats[s]->cols * mats[j]->cols;
+            if (cost[i * count + j] < 0.0 || candidate < cost[i * count + j]) {
+               cost[i * count + j] = candidate;
+               split[i * count + j] = s;
+            }
+         }
+      }
+   }
+   Mat *r = rt_new_matrix(mats[0]->rows, mats[count - 1]->cols);
+   rt_chain(mats, split, count, 0, count - 1, r->data);
+   free(cost);
+   free(split);
+   free(mats);
+   return rt_matrix(r);
+}
+
+/* Host functions. */
+static Value rt_host_print(const Value *args, int count) {
+   RtBuf b = {0, 0, 0};
+   for (int i = 0; i < count; ++i) {
+      if (i > 0) rt_buf_add(&b, " ", 1);
+      rt_buf_value(&b, args[i]);
+   }
+   rt_buf_add(&b, "\n", 1);
+   fwrite(b.data, 1, b.len, stdout);
+   free(b.data);
+   return rt_null();
+}
+
+static Value rt_host_throw(const Value *args, int count) {
+   (void) count;
+   rt_raise(args[0], 0);
+}
+
+static Value rt_host_str(const Value *args, int count) {
+   (void) count;
+   return rt_string(rt_to_str(args[0]));
+}
+
+static Value rt_host_len(const Value *args, int count) {
+   (void) count;
+   if (args[0].type != T_STRING) rt_error("len() expects a string, got %s", rt_type_name(args[0]));
+   return rt_int((int32_t) args[0].as.s->len);
+}
+
+static Value rt_host_clock(const Value *args, int count) {
+   (void) args;
+   (void) count;
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return rt_float((double) now.tv_sec + (double) now.tv_nsec * 1e-9);
+}
+
+static int rt_int_argument(Value v, const char *function) {
+   if (v.type != T_INT) rt_error("%s() expects int arguments, got %s", function, rt_type_name(v));
+   return v.as.i;
+}
+
+static Mat *rt_matrix_argument(Value v, const char *function) {
+   if (v.type != T_MATRIX) rt_error("%s() expects a matrix, got %s", function, rt_type_name(v));
+   return v.as.m;
+}
+
+static size_t rt_matrix_index(const Mat *m, const Value *args, const char *function) {
+   int row = rt_int_argument(args[1], function);
+   int col = rt_int_argument(args[2], function);
+   if (row < 0 || row >= m->rows || col < 0 || col >= m->cols) {
+      rt_error("%s(): index (%d, %d) out of range for %dx%d matrix", function, row, col, m->rows, m->cols);
+   }
+   return (size_t) row * m->cols + col;
+}
+
+static Value rt_host_matrix(const Value *args, int count) {
+   (void) count;
+   int rows = rt_int_argument(args[0], "matrix");
+   return rt_matrix(rt_new_matrix(rows, rt_int_argument(args[1], "matrix")));
+}
+
+static Value rt_host_rows(const Value *args, int count) {
+   (void) count;
+   return rt_int(rt_matrix_argument(args[0], "rows")->rows);
+}
+
+static Value rt_host_cols(const Value *args, int count) {
+   (void) count;
+   return rt_int(rt_matrix_argument(args[0], "cols")->cols);
+}
+
+static Value rt_host_at(const Value *args, int count) {
+   (void) count;
+   Mat *m = rt_matrix_argument(args[0], "at");
+   return rt_float(m->data[rt_matrix_index(m, args, "at")]);
+}
+
+static Value rt_host_put(const Value *args, int count) {
+   (void) count;
+   if (!rt_is_number(args[3])) rt_error("put() expects a number, got %s", rt_type_name(args[3]));
+   Mat *m = rt_matrix_argument(args[0], "put");
+   m->data[rt_matrix_index(m, args, "put")] = rt_number(args[3]);
+   return rt_null();
+}
+
+/* Script functions bound by name, as `define` leaves them. */
+typedef Value (*RtEntry)(const Value *args);
+
+typedef struct {
+   RtEntry entry;
+   int arity;
+} RtBinding;
+
+static inline Value rt_invoke(const RtBinding *binding, const char *name, const Value *args, int count) {
+   if (binding->arity != count) rt_arity_error(name, binding->arity, count);
+   return binding->entry(args);
+}
+
+)";
+
+static const char *const RUNTIME_ENTRY = R"(static int rt_status;
+
+/* Runs the script under a root handler that reports what nothing caught,
+ * in the words the Compiler uses. */
+static void *rt_run(void *unused) {
+   (void) unused;
+   RtHandler root;
+   rt_stack_top = (const char *) &root;
+   rt_init();
+   rt_push(&root);
+   if (setjmp(root.env)) {
+      Str *message = rt_to_str(rt_caught);
+      fflush(stdout);
+      fputs(rt_caught_error ? "[CompilerError] [RuntimeError] " : "Uncaught exception: ", stderr);
+      fwrite(message->chars, 1, message->len, stderr);
+      fputc('\n', stderr);
+      rt_status = 1;
+      return NULL;
+   }
+   fn_0();
+   rt_handlers = NULL;
+   rt_status = 0;
+   return NULL;
+}
+
+/* The script runs on a thread of its own, with a stack deep enough for
+ * RT_MAX_DEPTH calls. */
+int run_script(void) {
+   pthread_attr_t attributes;
+   pthread_t thread;
+   pthread_attr_init(&attributes);
+   if (pthread_attr_setstacksize(&attributes, RT_STACK_SIZE) != 0 ||
+       pthread_create(&thread, &attributes, rt_run, NULL) != 0) {
+      rt_run(NULL);
+   } else {
+      pthread_join(thread, NULL);
+   }
+   pthread_attr_destroy(&attributes);
+   fflush(stdout);
+   return rt_status;
+}
+)";
+
+std::string cRuntime() {
+   return std::string(RUNTIME_VALUES) + RUNTIME_OPERATORS + RUNTIME_MATRICES;
+}
+
+std::string cRuntimeEntry(bool library) {
+   std::string text = RUNTIME_ENTRY;
+   if (!library) text += "\nint main(void) {\n   return run_script();\n}\n";
+   return text;
+}
+
+const std::vector<CHostFunction> &cHostFunctions() {
+   static const std::vector<CHostFunction> hosts = {
+           {"print", -1}, {"throw", 1}, {"str", 1}, {"len", 1}, {"clock", 0},
+           {"matrix", 2}, {"rows", 1}, {"cols", 1}, {"at", 3}, {"put", 4},
+   };
+   return hosts;
+}
+
+const CHostFunction *findCHostFunction(const std::string &name) {
+   for (const CHostFunction &host: cHostFunctions()) {
+      if (name == host.name) return &host;
+   }
+   return nullptr;
+}
+
+std::string cQuote(const std::string &text) {
+   std::string result = "\"";
+   for (unsigned char c: text) {
+      if (c == '"' || c == '\\') {
+         result += '\\';
+         result += static_cast<char>(c);
+      } else if (c < 0x20 || c >= 0x7f || c == '?') {
+         char escape[8];
+         std::snprintf(escape, sizeof(escape), "\\%03o", c);
+         result += escape;
+      } else {
+         result += static_cast<char>(c);
+      }
+   }
+   return result + "\"";
+}
+
+static std::string shellQuote(const std::string &text) {
+   std::string result = "'";
+   for (char c: text) {
+      if (c == '\'') result += "'\\''";
+      else result += c;
+   }
+   return result + "'";
+}
+
+void runCCompiler(const std::vector<std::string> &sources, const std::string &output,
+                  const NativeBuildOptions &options) {
+   const char *cc = std::getenv("CC");
+   std::string command = (cc && *cc ? std::string(cc) : options.compiler) + " " + options.flags;
+   if (options.library) command += " -shared -fPIC";
+   command += " -o " + shellQuote(output);
+   for (const std::string &source: sources) command += " " + shellQuote(source);
+   command += " -lm -pthread";
+   if (std::system(command.c_str()) != 0) throw CompilerError("C compiler failed: " + command);
+}
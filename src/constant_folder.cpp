@@ -0,0 +1,198 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include <cfloat>
+#include <cmath>
+
+#include "constant_folder.h"
+#include "error.h"
+#include "value.h"
+
+static const LiteralExpr *asLiteral(const std::unique_ptr<Expr> &expr) {
+   return expr->type == ExprType::Literal ? static_cast<const LiteralExpr *>(expr.get()) : nullptr;
+}
+
+// The literal that evaluates to value, or null if no literal does.
+static std::unique_ptr<Expr> literalFor(const Value &value) {
+   if (value.isInt()) return std::make_unique<LiteralExpr>(static_cast<int>(value.asInt()));
+   if (value.isBool()) return std::make_unique<LiteralExpr>(value.asBool());
+   if (value.isNull()) return std::make_unique<LiteralExpr>(nullptr);
+   if (value.isString()) return std::make_unique<LiteralExpr>(value.asString()->chars);
+   if (value.isFloat()) {
+      double number = value.asFloat();
+      if (std::isnan(number) || (std::fabs(number) > FLT_MAX && !std::isinf(number))) return nullptr;
+      auto single = static_cast<float>(number);
+      if (static_cast<double>(single) == number) return std::make_unique<LiteralExpr>(single);
+   }
+   return nullptr;
+}
+
+void ConstantFolder::fold(Expr &program) {
+   collectAssignments(&program);
+   visit(&program);
+   bindings.clear();
+   scopeMarks.clear();
+   assigned.clear();
+}
+
+void ConstantFolder::collectAssignments(const Expr *expr) {
+   if (expr->type == ExprType::Assignment) assigned.insert(static_cast<const AssignmentExpr *>(expr)->name);
+   forEachChild(const_cast<Expr *>(expr), [&](std::unique_ptr<Expr> &child) { collectAssignments(child.get()); });
+}
+
+void ConstantFolder::beginScope() {
+   scopeMarks.push_back(bindings.size());
+}
+
+void ConstantFolder::endScope() {
+   bindings.resize(scopeMarks.back());
+   scopeMarks.pop_back();
+}
+
+void ConstantFolder::bind(const std::string &name, const Expr *initializer) {
+   const LiteralExpr *value = nullptr;
+   if (initializer && initializer->type == ExprType::Literal && !assigned.count(name)) {
+      value = static_cast<const LiteralExpr *>(initializer);
+   }
+   bindings.push_back(Binding{name, value, functionDepth});
+}
+
+// Functions see their own locals and globals; a local of an enclosing
+// function is left for the Resolver to reject.
+const LiteralExpr *ConstantFolder::constant(const std::string &name) const {
+   for (size_t i = bindings.size(); i > 0; --i) {
+      const Binding &binding = bindings[i - 1];
+      if (binding.name != name) continue;
+      return binding.functionDepth == functionDepth || binding.functionDepth == 0 ? binding.value : nullptr;
+   }
+   return nullptr;
+}
+
+void ConstantFolder::fold(std::unique_ptr<Expr> &expr) {
+   visit(expr.get());
+   switch (expr->type) {
+      case ExprType::Identifier:
+         if (const LiteralExpr *value = constant(static_cast<IdentifierExpr *>(expr.get())->name)) {
+            expr = std::make_unique<LiteralExpr>(value->value);
+         }
+         break;
+      case ExprType::Binary:
+         foldBinary(expr);
+         break;
+      case ExprType::Unary:
+         foldUnary(expr);
+         break;
+      default:
+         break;
+   }
+}
+
+// Folds the children of expr, tracking the scopes the Resolver will see.
+void ConstantFolder::visit(Expr *expr) {
+   switch (expr->type) {
+      case ExprType::BlockStatement:
+      case ExprType::ForStatement:
+         beginScope();
+         forEachChild(expr, [&](std::unique_ptr<Expr> &child) { fold(child); });
+         endScope();
+         break;
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<VarDeclarationExpr *>(expr);
+         if (decl->initializer) fold(decl->initializer);
+         bind(decl->name, decl->initializer.get());
+         break;
+      }
+
+      case ExprType::FunctionDeclaration: {
+         auto *function = static_cast<FunctionDeclarationExpr *>(expr);
+         beginScope();
+         ++functionDepth;
+         for (const auto &param: function->params) bind(param, nullptr);
+         fold(function->body);
+         --functionDepth;
+         endScope();
+         break;
+      }
+
+      case ExprType::CaseClause: {
+         auto *clause = static_cast<CaseClauseExpr *>(expr);
+         fold(clause->caseExpr);
+         beginScope();
+         fold(clause->body);
+         endScope();
+         break;
+      }
+
+      case ExprType::CatchClause: {
+         auto *clause = static_cast<CatchClauseExpr *>(expr);
+         beginScope();
+         bind(clause->exceptionVarName, nullptr);
+         fold(clause->block);
+         endScope();
+         break;
+      }
+
+      default:
+         forEachChild(expr, [&](std::unique_ptr<Expr> &child) { fold(child); });
+         break;
+   }
+}
+
+void ConstantFolder::foldBinary(std::unique_ptr<Expr> &expr) {
+   auto *binary = static_cast<BinaryExpr *>(expr.get());
+   const LiteralExpr *left = asLiteral(binary->left);
+   const LiteralExpr *right = asLiteral(binary->right);
+   if (!left) return;
+
+   if (binary->operation == BinaryOperator::And || binary->operation == BinaryOperator::Or) {
+      bool truthy = literalValue(left->value).truthy();
+      bool isAnd = binary->operation == BinaryOperator::And;
+      if (truthy != isAnd) {
+         expr = std::make_unique<LiteralExpr>(truthy);
+      } else if (right) {
+         expr = std::make_unique<LiteralExpr>(literalValue(right->value).truthy());
+      }
+      return;
+   }
+   if (!right) return;
+
+   try {
+      Value result = applyBinary(binary->operation, literalValue(left->value), literalValue(right->value));
+      if (auto folded = literalFor(result)) expr = std::move(folded);
+   } catch (const RuntimeError &) {
+      // Left in place so the program still raises it when the expression runs.
+   }
+}
+
+void ConstantFolder::foldUnary(std::unique_ptr<Expr> &expr) {
+   auto *unary = static_cast<UnaryExpr *>(expr.get());
+   if (const LiteralExpr *operand = asLiteral(unary->right)) {
+      try {
+         if (auto folded = literalFor(applyUnary(unary->operation, literalValue(operand->value)))) {
+            expr = std::move(folded);
+         }
+      } catch (const RuntimeError &) {
+      }
+      return;
+   }
+
+   // Two signs collapse into one: `-(-x)` and `+(+x)` are `+x`, `-(+x)` and
+   // `+(-x)` are `-x`. Both ops accept exactly numbers and matrices, and unary
+   // plus returns its operand, so the result and any error are unchanged.
+   // `!!!x` is `!x` since `!` always produces a bool.
+   if (unary->right->type != ExprType::Unary) return;
+   auto *inner = static_cast<UnaryExpr *>(unary->right.get());
+   bool sign = unary->operation == UnaryOperator::Negate || unary->operation == UnaryOperator::Plus;
+   bool innerSign = inner->operation == UnaryOperator::Negate || inner->operation == UnaryOperator::Plus;
+   if (sign && innerSign) {
+      bool negate = (unary->operation == UnaryOperator::Negate) != (inner->operation == UnaryOperator::Negate);
+      expr = std::make_unique<UnaryExpr>(negate ? "-" : "+", std::move(inner->right));
+   } else if (unary->operation == UnaryOperator::Not && inner->operation == UnaryOperator::Not &&
+              inner->right->type == ExprType::Unary &&
+              static_cast<UnaryExpr *>(inner->right.get())->operation == UnaryOperator::Not) {
+      expr = std::move(inner->right);
+   }
+}
+
+#pragma clang diagnostic pop
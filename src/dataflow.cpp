@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+#include "dataflow.h"
+
+BitVector::BitVector(size_t size, bool value)
+        : bits(size), words((size + 63) / 64, value ? ~std::uint64_t(0) : 0) {
+   clearPadding();
+}
+
+void BitVector::setAll() {
+   std::fill(words.begin(), words.end(), ~std::uint64_t(0));
+   clearPadding();
+}
+
+bool BitVector::unionWith(const BitVector &other) {
+   std::uint64_t changed = 0;
+   for (size_t i = 0; i < words.size(); ++i) {
+      std::uint64_t merged = words[i] | other.words[i];
+      changed |= merged ^ words[i];
+      words[i] = merged;
+   }
+   return changed != 0;
+}
+
+bool BitVector::intersectWith(const BitVector &other) {
+   std::uint64_t changed = 0;
+   for (size_t i = 0; i < words.size(); ++i) {
+      std::uint64_t merged = words[i] & other.words[i];
+      changed |= merged ^ words[i];
+      words[i] = merged;
+   }
+   return changed != 0;
+}
+
+void BitVector::subtract(const BitVector &other) {
+   for (size_t i = 0; i < words.size(); ++i) words[i] &= ~other.words[i];
+}
+
+size_t BitVector::count() const {
+   size_t total = 0;
+   for (std::uint64_t word: words) total += static_cast<size_t>(__builtin_popcountll(word));
+   return total;
+}
+
+bool BitVector::any() const {
+   return std::any_of(words.begin(), words.end(), [](std::uint64_t word) { return word != 0; });
+}
+
+// Bits past size in the last word stay zero, so count and == need no mask.
+void BitVector::clearPadding() {
+   if (bits % 64) words.back() &= (std::uint64_t(1) << (bits % 64)) - 1;
+}
+
+DataflowResult solveDataflow(const IrFunction &function, const DataflowProblem &problem) {
+   bool forward = problem.direction == DataflowDirection::Forward;
+   bool intersect = problem.meet == DataflowMeet::Intersection;
+   size_t blockCount = function.blocks.size();
+
+   DataflowResult result;
+   result.in.assign(blockCount, BitVector(problem.size));
+   result.out.assign(blockCount, BitVector(problem.size));
+   // The side each block's transfer reads from, and the side it writes.
+   std::vector<BitVector> &input = forward ? result.in : result.out;
+   std::vector<BitVector> &output = forward ? result.out : result.in;
+
+   std::vector<IrBlock *> order = reversePostorder(function);
+   if (!forward) std::reverse(order.begin(), order.end());
+   std::vector<int> position(blockCount, -1);
+   for (size_t i = 0; i < order.size(); ++i) position[order[i]->id] = static_cast<int>(i);
+
+   // Intersection starts from the top of the lattice, so that a loop body
+   // not yet visited does not empty its header.
+   if (intersect) {
+      for (IrBlock *block: order) output[block->id].setAll();
+   }
+
+   BitVector pending(order.size(), true);
+   BitVector meet(problem.size);
+   BitVector next(problem.size);
+   bool again = true;
+   while (again) {
+      again = false;
+      for (size_t i = 0; i < order.size(); ++i) {
+         if (!pending.test(i)) continue;
+         pending.reset(i);
+         IrBlock *block = order[i];
+
+         bool first = true;
+         auto merge = [&](const BitVector &value) {
+             if (first) meet = value;
+             else if (intersect) meet.intersectWith(value);
+             else meet.unionWith(value);
+             first = false;
+         };
+         if (forward) {
+            if (block == function.entry()) merge(problem.boundary);
+            for (IrBlock *pred: block->predecessors) {
+               if (position[pred->id] >= 0) merge(output[pred->id]);
+            }
+         } else {
+            if (block->successors.empty() && !block->handler) merge(problem.boundary);
+            block->forEachSuccessor([&](IrBlock *successor) { merge(output[successor->id]); });
+         }
+         if (first) meet = BitVector(problem.size);
+         input[block->id] = meet;
+
+         next = meet;
+         next.subtract(problem.kill[block->id]);
+         next.unionWith(problem.gen[block->id]);
+         ++result.visits;
+         if (next == output[block->id]) continue;
+         std::swap(output[block->id], next);
+
+         auto revisit = [&](IrBlock *dependent) {
+             int at = position[dependent->id];
+             if (at < 0) return;
+             pending.set(static_cast<size_t>(at));
+             if (static_cast<size_t>(at) <= i) again = true;
+         };
+         if (forward) block->forEachSuccessor(revisit);
+         else std::for_each(block->predecessors.begin(), block->predecessors.end(), revisit);
+      }
+   }
+   return result;
+}
+
+Liveness::Liveness(const IrFunction &function) {
+   size_t blockCount = function.blocks.size();
+   size_t valueCount = 0;
+   for (const auto &block: function.blocks) {
+      for (IrInstr *phi: block->phis) valueCount = std::max(valueCount, static_cast<size_t>(phi->id) + 1);
+      for (IrInstr *instr: block->instructions) {
+         if (instr->id >= 0) valueCount = std::max(valueCount, static_cast<size_t>(instr->id) + 1);
+      }
+   }
+
+   DataflowProblem problem;
+   problem.direction = DataflowDirection::Backward;
+   problem.meet = DataflowMeet::Union;
+   problem.size = valueCount;
+   problem.gen.assign(blockCount, BitVector(valueCount));
+   problem.kill.assign(blockCount, BitVector(valueCount));
+   problem.boundary = BitVector(valueCount);
+
+   // Values each block feeds to the phis of its successors.
+   std::vector<BitVector> phiUses(blockCount, BitVector(valueCount));
+   for (const auto &block: function.blocks) {
+      for (size_t i = 0; i < block->predecessors.size(); ++i) {
+         for (IrInstr *phi: block->phis) {
+            phiUses[block->predecessors[i]->id].set(static_cast<size_t>(phi->operands[i]->id));
+         }
+      }
+   }
+
+   for (const auto &block: function.blocks) {
+      BitVector &gen = problem.gen[block->id];
+      BitVector &kill = problem.kill[block->id];
+      for (IrInstr *phi: block->phis) kill.set(static_cast<size_t>(phi->id));
+      for (IrInstr *instr: block->instructions) {
+         for (IrInstr *operand: instr->operands) {
+            if (!kill.test(static_cast<size_t>(operand->id))) gen.set(static_cast<size_t>(operand->id));
+         }
+         if (instr->id >= 0) kill.set(static_cast<size_t>(instr->id));
+      }
+      BitVector fromOutside = phiUses[block->id];
+      fromOutside.subtract(kill);
+      gen.unionWith(fromOutside);
+   }
+
+   DataflowResult result = solveDataflow(function, problem);
+   in = std::move(result.in);
+   out = std::move(result.out);
+   for (size_t i = 0; i < blockCount; ++i) out[i].unionWith(phiUses[i]);
+}
+
+ReachingDefinitions::ReachingDefinitions(const IrFunction &function) {
+   auto slotOf = [&](const IrInstr *instr) {
+       return slots.emplace(instr->index, slots.size()).first->second;
+   };
+   for (const auto &block: function.blocks) {
+      for (IrInstr *instr: block->instructions) {
+         if (instr->op == IrOp::LoadGlobal) slotOf(instr);
+         if (instr->op != IrOp::StoreGlobal) continue;
+         slotOf(instr);
+         definition[instr] = stores.size();
+         stores.push_back(instr);
+      }
+   }
+
+   size_t size = stores.size() + slots.size();
+   slotDefinitions.assign(slots.size(), BitVector(size));
+   externals = BitVector(size);
+   for (size_t slot = 0; slot < slots.size(); ++slot) {
+      slotDefinitions[slot].set(externalDefinition(slot));
+      externals.set(externalDefinition(slot));
+   }
+   for (const IrInstr *store: stores) slotDefinitions[slots.at(store->index)].set(definition.at(store));
+
+   size_t blockCount = function.blocks.size();
+   DataflowProblem problem;
+   problem.direction = DataflowDirection::Forward;
+   problem.meet = DataflowMeet::Union;
+   problem.size = size;
+   problem.gen.assign(blockCount, BitVector(size));
+   problem.kill.assign(blockCount, BitVector(size));
+   problem.boundary = externals;
+   for (const auto &block: function.blocks) {
+      for (IrInstr *instr: block->instructions) {
+         transfer(instr, problem.gen[block->id], &problem.kill[block->id]);
+      }
+   }
+   in = solveDataflow(function, problem).in;
+}
+
+// Applies instr to a gen set, or to a running state when kill is null.
+void ReachingDefinitions::transfer(const IrInstr *instr, BitVector &gen, BitVector *kill) const {
+   if (instr->op == IrOp::StoreGlobal) {
+      const BitVector &overwritten = slotDefinitions[slots.at(instr->index)];
+      gen.subtract(overwritten);
+      gen.set(definition.at(instr));
+      if (kill) kill->unionWith(overwritten);
+   } else if (instr->op == IrOp::Call) {
+      // The callee may or may not write each global, so nothing is killed.
+      gen.unionWith(externals);
+   }
+}
+
+std::vector<const IrInstr *> ReachingDefinitions::reachingStores(const IrInstr *load, bool *external) const {
+   BitVector state = in[load->block->id];
+   for (const IrInstr *instr: load->block->instructions) {
+      if (instr == load) break;
+      transfer(instr, state, nullptr);
+   }
+
+   size_t slot = slots.at(load->index);
+   if (external) *external = state.test(externalDefinition(slot));
+   std::vector<const IrInstr *> result;
+   state.intersectWith(slotDefinitions[slot]);
+   state.forEach([&](size_t i) {
+       if (i < stores.size()) result.push_back(stores[i]);
+   });
+   return result;
+}
+
+static bool isUnassigned(const IrInstr *value) {
+   return value->op == IrOp::Const && !value->name.empty();
+}
+
+// `var x;` at the top level stores the unassigned marker into x's slot.
+static bool declaresUnassigned(const IrInstr *store) {
+   return store->op == IrOp::StoreGlobal && isUnassigned(store->operands[0]) &&
+          store->operands[0]->name == store->name;
+}
+
+static void findUninitializedLocals(const IrFunction &function, std::vector<UninitializedRead> &reads) {
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *marker: block->instructions) {
+         if (!isUnassigned(marker)) continue;
+         std::unordered_set<const IrInstr *> seen{marker};
+         std::vector<const IrInstr *> worklist{marker};
+         while (!worklist.empty()) {
+            const IrInstr *value = worklist.back();
+            worklist.pop_back();
+            for (const IrInstr *user: value->users) {
+               if (!seen.insert(user).second || declaresUnassigned(user)) continue;
+               if (user->op == IrOp::Phi) worklist.push_back(user);
+               else reads.push_back({&function, user, marker->name});
+            }
+         }
+      }
+   }
+}
+
+static void findUninitializedGlobals(const IrModule &module, std::vector<UninitializedRead> &reads) {
+   const IrFunction &script = module.main();
+   std::unordered_map<int, size_t> slots; // declared without an initializer
+   for (const auto &block: script.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         if (declaresUnassigned(instr)) slots.emplace(instr->index, slots.size());
+      }
+   }
+   if (slots.empty()) return;
+
+   // What each function assigns, directly or through the functions it calls.
+   std::unordered_map<std::string, const IrFunction *> byName;
+   for (const auto &function: module.functions) byName[function->name] = function.get();
+   std::unordered_map<const IrFunction *, BitVector> assigns;
+   for (const auto &function: module.functions) {
+      BitVector &set = assigns.emplace(function.get(), BitVector(slots.size())).first->second;
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op != IrOp::StoreGlobal || declaresUnassigned(instr)) continue;
+            auto slot = slots.find(instr->index);
+            if (slot != slots.end()) set.set(slot->second);
+         }
+      }
+   }
+   auto callee = [&](const IrInstr *call) -> const BitVector * {
+       auto found = byName.find(call->name);
+       return found == byName.end() || found->second == &script ? nullptr : &assigns.at(found->second);
+   };
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (const auto &function: module.functions) {
+         BitVector &set = assigns.at(function.get());
+         for (const auto &block: function->blocks) {
+            for (const IrInstr *instr: block->instructions) {
+               const BitVector *called = instr->op == IrOp::Call ? callee(instr) : nullptr;
+               if (called && called != &set) changed |= set.unionWith(*called);
+            }
+         }
+      }
+   }
+
+   auto transfer = [&](const IrInstr *instr, BitVector &gen, BitVector *kill) {
+       if (instr->op == IrOp::StoreGlobal) {
+          auto slot = slots.find(instr->index);
+          if (slot == slots.end()) return;
+          if (declaresUnassigned(instr)) {
+             gen.reset(slot->second);
+             if (kill) kill->set(slot->second);
+          } else {
+             gen.set(slot->second);
+             if (kill) kill->reset(slot->second);
+          }
+       } else if (const BitVector *called = instr->op == IrOp::Call ? callee(instr) : nullptr) {
+          gen.unionWith(*called);
+          if (kill) kill->subtract(*called);
+       }
+   };
+
+   // What is assigned on entry to each block of a function, counting from
+   // its own entry.
+   auto assignedOnEntry = [&](const IrFunction &function) {
+       size_t blockCount = function.blocks.size();
+       DataflowProblem problem;
+       problem.direction = DataflowDirection::Forward;
+       problem.meet = DataflowMeet::Intersection;
+       problem.size = slots.size();
+       problem.gen.assign(blockCount, BitVector(slots.size()));
+       problem.kill.assign(blockCount, BitVector(slots.size()));
+       problem.boundary = BitVector(slots.size());
+       for (const auto &block: function.blocks) {
+          for (const IrInstr *instr: block->instructions) {
+             transfer(instr, problem.gen[block->id], &problem.kill[block->id]);
+          }
+       }
+       return solveDataflow(function, problem).in;
+   };
+   std::unordered_map<const IrFunction *, std::vector<BitVector>> entries;
+   for (const auto &function: module.functions) entries.emplace(function.get(), assignedOnEntry(*function));
+
+   // Calls read for each read of a slot the function has not assigned by
+   // then, counting what its callees may read as read at the call.
+   std::unordered_map<const IrFunction *, BitVector> exposed;
+   for (const auto &function: module.functions) exposed.emplace(function.get(), BitVector(slots.size()));
+   auto exposedReads = [&](const IrFunction &function, const std::function<void(const IrInstr *, size_t)> &read) {
+       const std::vector<BitVector> &in = entries.at(&function);
+       for (const auto &block: function.blocks) {
+          BitVector assigned = in[block->id];
+          for (const IrInstr *instr: block->instructions) {
+             if (instr->op == IrOp::LoadGlobal) {
+                auto slot = slots.find(instr->index);
+                if (slot != slots.end() && !assigned.test(slot->second)) read(instr, slot->second);
+             } else if (instr->op == IrOp::Call && callee(instr)) {
+                BitVector unassigned = exposed.at(byName.at(instr->name));
+                unassigned.subtract(assigned);
+                unassigned.forEach([&](size_t slot) { read(instr, slot); });
+             }
+             transfer(instr, assigned, nullptr);
+          }
+       }
+   };
+
+   // What each function may read before assigning, directly or through the
+   // functions it calls.
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (const auto &function: module.functions) {
+         if (function.get() == &script) continue;
+         BitVector &set = exposed.at(function.get());
+         exposedReads(*function, [&](const IrInstr *, size_t slot) {
+             if (!set.test(slot)) {
+                set.set(slot);
+                changed = true;
+             }
+         });
+      }
+   }
+
+   std::vector<std::string> names(slots.size());
+   for (const auto &block: script.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         if (declaresUnassigned(instr)) names[slots.at(instr->index)] = instr->name;
+      }
+   }
+   exposedReads(script, [&](const IrInstr *instr, size_t slot) { reads.push_back({&script, instr, names[slot]}); });
+}
+
+std::vector<UninitializedRead> findUninitializedReads(const IrModule &module) {
+   std::vector<UninitializedRead> reads;
+   findUninitializedGlobals(module, reads);
+   for (const auto &function: module.functions) findUninitializedLocals(*function, reads);
+   return reads;
+}
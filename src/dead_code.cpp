@@ -0,0 +1,214 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include "dead_code.h"
+#include "value.h"
+
+static int countNodes(Expr *expr) {
+   int count = 1;
+   forEachChild(expr, [&](std::unique_ptr<Expr> &child) { count += countNodes(child.get()); });
+   return count;
+}
+
+// True when control never continues past stmt.
+static bool terminates(const Expr *stmt) {
+   switch (stmt->type) {
+      case ExprType::ReturnStatement:
+      case ExprType::BreakStatement:
+      case ExprType::ContinueStatement:
+         return true;
+      case ExprType::BlockStatement: {
+         auto &statements = static_cast<const BlockStatementExpr *>(stmt)->statements;
+         return !statements.empty() && terminates(statements.back().get());
+      }
+      case ExprType::IfStatement: {
+         auto *ifStmt = static_cast<const IfStatementExpr *>(stmt);
+         return ifStmt->elseBranch && terminates(ifStmt->thenBranch.get()) && terminates(ifStmt->elseBranch.get());
+      }
+      default:
+         return false;
+   }
+}
+
+static const LiteralExpr *literalCondition(const std::unique_ptr<Expr> &condition) {
+   return condition && condition->type == ExprType::Literal ? static_cast<const LiteralExpr *>(condition.get())
+                                                             : nullptr;
+}
+
+static bool literalTruthy(const LiteralExpr *literal) {
+   return literalValue(literal->value).truthy();
+}
+
+int DeadCodeEliminator::eliminate(Expr &program) {
+   removed = 0;
+   simplifyChildren(&program);
+
+   collectDeclarations(&program);
+   markCalls(&program);
+   removeDeadFunctions(&program);
+
+   declarations.clear();
+   liveFunctions.clear();
+   return removed;
+}
+
+void DeadCodeEliminator::simplifyChildren(Expr *expr) {
+   if (expr->type == ExprType::BlockStatement) {
+      simplifyBlock(static_cast<BlockStatementExpr *>(expr));
+      return;
+   }
+   forEachChild(expr, [&](std::unique_ptr<Expr> &child) {
+       simplify(child);
+       // A statement slot outside a block cannot be empty.
+       if (!child) {
+          child = std::make_unique<BlockStatementExpr>(std::vector<std::unique_ptr<Expr>>{});
+          --removed;
+       }
+   });
+}
+
+void DeadCodeEliminator::discard(std::unique_ptr<Expr> &stmt) {
+   removed += countNodes(stmt.get());
+   stmt.reset();
+}
+
+// A branch that is a bare declaration still declares its variable in the
+// enclosing scope; the declaration stays, without its initializer.
+static std::unique_ptr<Expr> declarationOf(const std::unique_ptr<Expr> &branch) {
+   if (!branch || branch->type != ExprType::VarDeclaration) return nullptr;
+   return std::make_unique<VarDeclarationExpr>(static_cast<VarDeclarationExpr *>(branch.get())->name, nullptr);
+}
+
+// Simplifies stmt in place; leaves it null when nothing of it remains.
+void DeadCodeEliminator::simplify(std::unique_ptr<Expr> &stmt) {
+   switch (stmt->type) {
+      case ExprType::IfStatement: {
+         auto *ifStmt = static_cast<IfStatementExpr *>(stmt.get());
+         const LiteralExpr *condition = literalCondition(ifStmt->condition);
+         if (!condition) break;
+         bool truthy = literalTruthy(condition);
+         std::unique_ptr<Expr> taken = std::move(truthy ? ifStmt->thenBranch : ifStmt->elseBranch);
+         if (!taken && (taken = declarationOf(truthy ? ifStmt->elseBranch : ifStmt->thenBranch))) --removed;
+         discard(stmt);
+         if (taken) {
+            stmt = std::move(taken);
+            simplify(stmt);
+         }
+         return;
+      }
+
+      case ExprType::WhileStatement: {
+         auto *whileStmt = static_cast<WhileStatementExpr *>(stmt.get());
+         const LiteralExpr *condition = literalCondition(whileStmt->condition);
+         if (condition && !literalTruthy(condition)) {
+            std::unique_ptr<Expr> declaration = declarationOf(whileStmt->body);
+            if (declaration) --removed;
+            discard(stmt);
+            stmt = std::move(declaration);
+            return;
+         }
+         break;
+      }
+
+      case ExprType::ForStatement: {
+         auto *forStmt = static_cast<ForStatementExpr *>(stmt.get());
+         const LiteralExpr *condition = literalCondition(forStmt->condition);
+         if (condition && !literalTruthy(condition)) {
+            // The initializer still runs, in the loop's own scope.
+            std::unique_ptr<Expr> initializer = std::move(forStmt->initializer);
+            discard(stmt);
+            if (initializer) {
+               --removed;
+               std::vector<std::unique_ptr<Expr>> statements;
+               statements.push_back(std::move(initializer));
+               stmt = std::make_unique<BlockStatementExpr>(std::move(statements));
+            }
+            return;
+         }
+         break;
+      }
+
+      case ExprType::ExpressionStatement:
+         if (static_cast<ExpressionStatementExpr *>(stmt.get())->expression->type == ExprType::Literal) {
+            discard(stmt);
+            return;
+         }
+         break;
+
+      default:
+         break;
+   }
+   simplifyChildren(stmt.get());
+}
+
+void DeadCodeEliminator::simplifyBlock(BlockStatementExpr *block) {
+   std::vector<std::unique_ptr<Expr>> kept;
+   bool reachable = true;
+   for (auto &stmt: block->statements) {
+      if (!reachable) {
+         discard(stmt);
+         continue;
+      }
+      simplify(stmt);
+      if (!stmt) continue;
+      if (terminates(stmt.get())) reachable = false;
+      kept.push_back(std::move(stmt));
+   }
+   block->statements = std::move(kept);
+}
+
+void DeadCodeEliminator::collectDeclarations(Expr *expr) {
+   if (expr->type == ExprType::FunctionDeclaration) {
+      auto *function = static_cast<FunctionDeclarationExpr *>(expr);
+      declarations[function->name].push_back(function);
+   }
+   forEachChild(expr, [&](std::unique_ptr<Expr> &child) { collectDeclarations(child.get()); });
+}
+
+// Marks every function called from expr, and transitively from their bodies.
+// Bodies of nested declarations are only scanned once their name is live.
+void DeadCodeEliminator::markCalls(Expr *expr) {
+   if (expr->type == ExprType::FunctionDeclaration) return;
+   if (expr->type == ExprType::FunctionCall) {
+      const std::string &callee = static_cast<FunctionCallExpr *>(expr)->callee;
+      if (liveFunctions.insert(callee).second) {
+         auto found = declarations.find(callee);
+         if (found != declarations.end()) {
+            for (FunctionDeclarationExpr *function: found->second) markCalls(function->body.get());
+         }
+      }
+   }
+   forEachChild(expr, [&](std::unique_ptr<Expr> &child) { markCalls(child.get()); });
+}
+
+void DeadCodeEliminator::removeDeadFunctions(Expr *expr) {
+   auto dead = [&](const std::unique_ptr<Expr> &stmt) {
+       return stmt->type == ExprType::FunctionDeclaration &&
+              !liveFunctions.count(static_cast<FunctionDeclarationExpr *>(stmt.get())->name);
+   };
+   if (expr->type == ExprType::BlockStatement) {
+      auto &statements = static_cast<BlockStatementExpr *>(expr)->statements;
+      std::vector<std::unique_ptr<Expr>> kept;
+      for (auto &stmt: statements) {
+         if (dead(stmt)) {
+            discard(stmt);
+            continue;
+         }
+         removeDeadFunctions(stmt.get());
+         kept.push_back(std::move(stmt));
+      }
+      statements = std::move(kept);
+      return;
+   }
+   forEachChild(expr, [&](std::unique_ptr<Expr> &child) {
+       if (dead(child)) {
+          discard(child);
+          child = std::make_unique<BlockStatementExpr>(std::vector<std::unique_ptr<Expr>>{});
+          --removed;
+          return;
+       }
+       removeDeadFunctions(child.get());
+   });
+}
+
+#pragma clang diagnostic pop
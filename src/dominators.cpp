@@ -0,0 +1,96 @@
+#include <algorithm>
+
+#include "dominators.h"
+
+// Lengauer-Tarjan with path compression. Vertices are numbered in DFS
+// preorder; semi, label, ancestor and dom hold such numbers.
+DominatorTree::DominatorTree(const IrFunction &function) {
+   size_t blockCount = function.blocks.size();
+   idoms.assign(blockCount, nullptr);
+   tree.assign(blockCount, {});
+   enter.assign(blockCount, -1);
+   leave.assign(blockCount, -1);
+
+   std::vector<int> number(blockCount, -1);
+   std::vector<IrBlock *> vertex;
+   std::vector<int> parent;
+   std::vector<std::pair<IrBlock *, int>> stack{{function.entry(), -1}};
+   while (!stack.empty()) {
+      auto [block, from] = stack.back();
+      stack.pop_back();
+      if (number[block->id] >= 0) continue;
+      number[block->id] = static_cast<int>(vertex.size());
+      vertex.push_back(block);
+      parent.push_back(from);
+      int self = number[block->id];
+      // Pushed in reverse so successors are numbered in their listed order.
+      std::vector<IrBlock *> successors;
+      block->forEachSuccessor([&](IrBlock *successor) { successors.push_back(successor); });
+      for (size_t i = successors.size(); i-- > 0;) {
+         if (number[successors[i]->id] < 0) stack.emplace_back(successors[i], self);
+      }
+   }
+
+   auto count = static_cast<int>(vertex.size());
+   std::vector<int> semi(count), label(count), ancestor(count, -1), dom(count, 0);
+   std::vector<std::vector<int>> bucket(count);
+   for (int v = 0; v < count; ++v) semi[v] = label[v] = v;
+
+   std::vector<int> path;
+   auto eval = [&](int v) {
+       if (ancestor[v] < 0) return v;
+       path.clear();
+       for (int u = v; ancestor[ancestor[u]] >= 0; u = ancestor[u]) path.push_back(u);
+       for (size_t i = path.size(); i-- > 0;) {
+          int u = path[i];
+          int a = ancestor[u];
+          if (semi[label[a]] < semi[label[u]]) label[u] = label[a];
+          ancestor[u] = ancestor[a];
+       }
+       return label[v];
+   };
+
+   for (int w = count - 1; w > 0; --w) {
+      for (IrBlock *pred: vertex[w]->predecessors) {
+         int v = number[pred->id];
+         if (v < 0) continue;
+         int u = eval(v);
+         if (semi[u] < semi[w]) semi[w] = semi[u];
+      }
+      bucket[semi[w]].push_back(w);
+      ancestor[w] = parent[w];
+      for (int v: bucket[parent[w]]) {
+         int u = eval(v);
+         dom[v] = semi[u] < semi[v] ? u : parent[w];
+      }
+      bucket[parent[w]].clear();
+   }
+   for (int w = 1; w < count; ++w) {
+      if (dom[w] != semi[w]) dom[w] = dom[dom[w]];
+      idoms[vertex[w]->id] = vertex[dom[w]];
+      tree[vertex[dom[w]]->id].push_back(vertex[w]);
+   }
+
+   // Preorder entry and exit times make dominance queries O(1).
+   int clock = 0;
+   std::vector<std::pair<IrBlock *, size_t>> walk{{function.entry(), 0}};
+   enter[function.entry()->id] = clock++;
+   order.push_back(function.entry());
+   while (!walk.empty()) {
+      auto &[block, next] = walk.back();
+      if (next == tree[block->id].size()) {
+         leave[block->id] = clock++;
+         walk.pop_back();
+         continue;
+      }
+      IrBlock *child = tree[block->id][next++];
+      enter[child->id] = clock++;
+      order.push_back(child);
+      walk.emplace_back(child, 0);
+   }
+}
+
+bool DominatorTree::dominates(const IrBlock *a, const IrBlock *b) const {
+   if (enter[a->id] < 0 || enter[b->id] < 0) return false;
+   return enter[a->id] <= enter[b->id] && leave[b->id] <= leave[a->id];
+}
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstring>
+
+#include "gemm.h"
+#include "thread_pool.h"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define COMPILER_GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Block sizes: a KC x NR panel of B stays in L1 while the MC x KC block of A
+// streams from L2. MC and NC are multiples of every kernel's MR and NR.
+constexpr int KC = 256;
+constexpr int MC = 96;
+constexpr int NC = 2048;
+constexpr int MAX_MR = 6;
+constexpr int MAX_NR = 8;
+// Output tile of C handed to one task by gemmParallel.
+constexpr int PARALLEL_ROWS = MC;
+constexpr int PARALLEL_COLS = 512;
+// Products with fewer multiply-adds than this (about 160^3) stay on the calling
+// thread in gemmAutoParallel, where the pool's hand-off would cost more than it saves.
+constexpr long long PARALLEL_GEMM_THRESHOLD = 1LL << 22;
+
+// Adds alpha times the product of a packed MR x kc panel of A and a packed
+// kc x NR panel of B to an MR x NR tile of C with row stride ldc.
+using MicroKernel = void (*)(int kc, const double *a, const double *b, double *c, int ldc, double alpha);
+
+struct KernelShape {
+    int mr;
+    int nr;
+    MicroKernel run;
+};
+
+void genericKernel(int kc, const double *a, const double *b, double *c, int ldc, double alpha) {
+   double acc[4][4] = {};
+   for (int p = 0; p < kc; ++p, a += 4, b += 4) {
+      for (int i = 0; i < 4; ++i) {
+         for (int j = 0; j < 4; ++j) acc[i][j] += a[i] * b[j];
+      }
+   }
+   for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) c[i * ldc + j] += alpha * acc[i][j];
+   }
+}
+
+#ifdef COMPILER_GEMM_X86
+
+// 4 x 4 tile in eight xmm accumulators; SSE2 is part of the x86-64 baseline.
+void sse2Kernel(int kc, const double *a, const double *b, double *c, int ldc, double alpha) {
+   __m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+   __m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+   __m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+   __m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+
+   for (int p = 0; p < kc; ++p, a += 4, b += 4) {
+      __m128d b0 = _mm_load_pd(b);
+      __m128d b1 = _mm_load_pd(b + 2);
+      __m128d ai = _mm_set1_pd(a[0]);
+      c00 = _mm_add_pd(c00, _mm_mul_pd(ai, b0));
+      c01 = _mm_add_pd(c01, _mm_mul_pd(ai, b1));
+      ai = _mm_set1_pd(a[1]);
+      c10 = _mm_add_pd(c10, _mm_mul_pd(ai, b0));
+      c11 = _mm_add_pd(c11, _mm_mul_pd(ai, b1));
+      ai = _mm_set1_pd(a[2]);
+      c20 = _mm_add_pd(c20, _mm_mul_pd(ai, b0));
+      c21 = _mm_add_pd(c21, _mm_mul_pd(ai, b1));
+      ai = _mm_set1_pd(a[3]);
+      c30 = _mm_add_pd(c30, _mm_mul_pd(ai, b0));
+      c31 = _mm_add_pd(c31, _mm_mul_pd(ai, b1));
+   }
+
+   __m128d scale = _mm_set1_pd(alpha);
+   double *row = c;
+   _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), _mm_mul_pd(scale, c00)));
+   _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), _mm_mul_pd(scale, c01)));
+   row += ldc;
+   _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), _mm_mul_pd(scale, c10)));
+   _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), _mm_mul_pd(scale, c11)));
+   row += ldc;
+   _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), _mm_mul_pd(scale, c20)));
+   _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), _mm_mul_pd(scale, c21)));
+   row += ldc;
+   _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), _mm_mul_pd(scale, c30)));
+   _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), _mm_mul_pd(scale, c31)));
+}
+
+// 6 x 8 tile in twelve ymm accumulators, leaving room for two B vectors and
+// one broadcast of A.
+__attribute__((target("avx2,fma")))
+void avx2Kernel(int kc, const double *a, const double *b, double *c, int ldc, double alpha) {
+   __m256d acc[6][2];
+   for (auto &row: acc) row[0] = row[1] = _mm256_setzero_pd();
+
+   for (int p = 0; p < kc; ++p, a += 6, b += 8) {
+      __m256d b0 = _mm256_load_pd(b);
+      __m256d b1 = _mm256_load_pd(b + 4);
+      for (int i = 0; i < 6; ++i) {
+         __m256d ai = _mm256_broadcast_sd(a + i);
+         acc[i][0] = _mm256_fmadd_pd(ai, b0, acc[i][0]);
+         acc[i][1] = _mm256_fmadd_pd(ai, b1, acc[i][1]);
+      }
+   }
+
+   __m256d scale = _mm256_set1_pd(alpha);
+   for (int i = 0; i < 6; ++i, c += ldc) {
+      _mm256_storeu_pd(c, _mm256_fmadd_pd(scale, acc[i][0], _mm256_loadu_pd(c)));
+      _mm256_storeu_pd(c + 4, _mm256_fmadd_pd(scale, acc[i][1], _mm256_loadu_pd(c + 4)));
+   }
+}
+
+#endif
+
+KernelShape shapeOf(GemmKernel kernel) {
+   switch (kernel) {
+#ifdef COMPILER_GEMM_X86
+      case GemmKernel::SSE2:
+         return {4, 4, sse2Kernel};
+      case GemmKernel::AVX2:
+         return {6, 8, avx2Kernel};
+#endif
+      default:
+         return {4, 4, genericKernel};
+   }
+}
+
+// Copies an mc x kc block of A into MR-row panels, each stored k-major so the
+// kernel reads MR consecutive values per step. Short panels are zero-padded.
+void packA(int mc, int kc, const double *a, int lda, int mr, double *out) {
+   for (int i0 = 0; i0 < mc; i0 += mr) {
+      int rows = std::min(mr, mc - i0);
+      for (int p = 0; p < kc; ++p) {
+         for (int i = 0; i < mr; ++i) *out++ = i < rows ? a[(i0 + i) * lda + p] : 0.0;
+      }
+   }
+}
+
+// Copies a kc x nc block of B into NR-column panels, each stored row by row.
+void packB(int kc, int nc, const double *b, int ldb, int nr, double *out) {
+   for (int j0 = 0; j0 < nc; j0 += nr) {
+      int cols = std::min(nr, nc - j0);
+      for (int p = 0; p < kc; ++p) {
+         const double *row = b + p * ldb + j0;
+         for (int j = 0; j < nr; ++j) *out++ = j < cols ? row[j] : 0.0;
+      }
+   }
+}
+
+}
+
+AlignedDoubles allocateAligned(std::size_t count) {
+   auto *data = static_cast<double *>(::operator new[](std::max<std::size_t>(count, 1) * sizeof(double),
+                                                       std::align_val_t{MATRIX_ALIGNMENT}));
+   std::fill(data, data + count, 0.0);
+   return AlignedDoubles(data);
+}
+
+const char *gemmKernelName(GemmKernel kernel) {
+   switch (kernel) {
+      case GemmKernel::Generic:
+         return "generic";
+      case GemmKernel::SSE2:
+         return "sse2";
+      case GemmKernel::AVX2:
+         return "avx2";
+   }
+   return "unknown";
+}
+
+bool gemmKernelSupported(GemmKernel kernel) {
+   switch (kernel) {
+      case GemmKernel::Generic:
+         return true;
+#ifdef COMPILER_GEMM_X86
+      case GemmKernel::SSE2:
+         return true;
+      case GemmKernel::AVX2:
+         return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+      default:
+         return false;
+   }
+}
+
+GemmKernel bestGemmKernel() {
+   static const GemmKernel best = gemmKernelSupported(GemmKernel::AVX2) ? GemmKernel::AVX2
+                                  : gemmKernelSupported(GemmKernel::SSE2) ? GemmKernel::SSE2
+                                  : GemmKernel::Generic;
+   return best;
+}
+
+// Packing buffers are reused across calls on the same thread.
+static double *scratch(AlignedDoubles &buffer, std::size_t &capacity, std::size_t count) {
+   if (capacity < count) {
+      buffer = allocateAligned(count);
+      capacity = count;
+   }
+   return buffer.get();
+}
+
+// C = alpha * A * B + beta * C on an m x n block of C with leading dimensions
+// lda, ldb and ldc.
+static void gemmBlock(int m, int n, int k, const double *a, int lda, const double *b, int ldb, double *c, int ldc,
+                      const KernelShape &shape, double alpha, double beta) {
+   if (beta != 1.0) {
+      for (int i = 0; i < m; ++i) {
+         double *row = c + static_cast<std::size_t>(i) * ldc;
+         if (beta == 0.0) std::fill(row, row + n, 0.0);
+         else for (int j = 0; j < n; ++j) row[j] *= beta;
+      }
+   }
+   if (m == 0 || n == 0 || k == 0 || alpha == 0.0) return;
+
+   thread_local AlignedDoubles bufferA, bufferB;
+   thread_local std::size_t capacityA = 0, capacityB = 0;
+   int mr = shape.mr;
+   int nr = shape.nr;
+   int kcMax = std::min(k, KC);
+   double *packedA = scratch(bufferA, capacityA, static_cast<std::size_t>(std::min(m, MC) + mr) * kcMax);
+   double *packedB = scratch(bufferB, capacityB, static_cast<std::size_t>(std::min(n, NC) + nr) * kcMax);
+   alignas(MATRIX_ALIGNMENT) double edge[MAX_MR * MAX_NR];
+
+   for (int jc = 0; jc < n; jc += NC) {
+      int nc = std::min(NC, n - jc);
+      for (int pc = 0; pc < k; pc += KC) {
+         int kc = std::min(KC, k - pc);
+         packB(kc, nc, b + static_cast<std::size_t>(pc) * ldb + jc, ldb, nr, packedB);
+
+         for (int ic = 0; ic < m; ic += MC) {
+            int mc = std::min(MC, m - ic);
+            packA(mc, kc, a + static_cast<std::size_t>(ic) * lda + pc, lda, mr, packedA);
+
+            for (int jr = 0; jr < nc; jr += nr) {
+               int cols = std::min(nr, nc - jr);
+               for (int ir = 0; ir < mc; ir += mr) {
+                  int rows = std::min(mr, mc - ir);
+                  const double *panelA = packedA + static_cast<std::size_t>(ir) * kc;
+                  const double *panelB = packedB + static_cast<std::size_t>(jr) * kc;
+                  double *tile = c + static_cast<std::size_t>(ic + ir) * ldc + jc + jr;
+
+                  if (rows == mr && cols == nr) {
+                     shape.run(kc, panelA, panelB, tile, ldc, alpha);
+                     continue;
+                  }
+                  // Edge tile: run the full kernel into scratch and add back the valid part.
+                  std::memset(edge, 0, sizeof(edge));
+                  shape.run(kc, panelA, panelB, edge, nr, alpha);
+                  for (int i = 0; i < rows; ++i) {
+                     for (int j = 0; j < cols; ++j) tile[i * ldc + j] += edge[i * nr + j];
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+
+static KernelShape usableShape(GemmKernel kernel) {
+   return shapeOf(gemmKernelSupported(kernel) ? kernel : GemmKernel::Generic);
+}
+
+void gemm(int m, int n, int k, const double *a, const double *b, double *c, GemmKernel kernel, double alpha,
+          double beta) {
+   gemmBlock(m, n, k, a, k, b, n, c, n, usableShape(kernel), alpha, beta);
+}
+
+void gemmParallel(int m, int n, int k, const double *a, const double *b, double *c, ThreadPool &pool,
+                  GemmKernel kernel, double alpha, double beta) {
+   KernelShape shape = usableShape(kernel);
+   int rowBlocks = (m + PARALLEL_ROWS - 1) / PARALLEL_ROWS;
+   int colBlocks = (n + PARALLEL_COLS - 1) / PARALLEL_COLS;
+   pool.parallelFor(rowBlocks * colBlocks, [&](int task) {
+       int i0 = task / colBlocks * PARALLEL_ROWS;
+       int j0 = task % colBlocks * PARALLEL_COLS;
+       gemmBlock(std::min(PARALLEL_ROWS, m - i0), std::min(PARALLEL_COLS, n - j0), k,
+                 a + static_cast<std::size_t>(i0) * k, k, b + j0, n, c + static_cast<std::size_t>(i0) * n + j0, n,
+                 shape, alpha, beta);
+   });
+}
+
+void gemmAutoParallel(int m, int n, int k, const double *a, const double *b, double *c, double alpha, double beta) {
+   long long work = static_cast<long long>(m) * n * k;
+   if (work >= PARALLEL_GEMM_THRESHOLD && ThreadPool::shared().threadCount() > 1) {
+      gemmParallel(m, n, k, a, b, c, ThreadPool::shared(), bestGemmKernel(), alpha, beta);
+   } else {
+      gemm(m, n, k, a, b, c, bestGemmKernel(), alpha, beta);
+   }
+}
+
+void gemmNaive(int m, int n, int k, const double *a, const double *b, double *c) {
+   for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+         double sum = 0.0;
+         for (int p = 0; p < k; ++p) sum += a[i * k + p] * b[p * n + j];
+         c[i * n + j] = sum;
+      }
+   }
+}
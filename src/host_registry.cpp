@@ -0,0 +1,98 @@
+#include <chrono>
+#include <ostream>
+
+#include "host_registry.h"
+#include "type_context.h"
+#include "error.h"
+#include "matrix.h"
+
+static int intArgument(const Value &value, const char *function) {
+   if (!value.isInt()) throw RuntimeError(std::string(function) + "() expects int arguments, got " + value.typeName());
+   return value.asInt();
+}
+
+static MatrixObject *matrixArgument(const Value &value, const char *function) {
+   if (!value.isMatrix()) throw RuntimeError(std::string(function) + "() expects a matrix, got " + value.typeName());
+   return asMatrix(value);
+}
+
+// Offset of element (args[1], args[2]) of matrix args[0].
+static std::size_t matrixIndex(MatrixObject *matrix, const Value *args, const char *function) {
+   int row = intArgument(args[1], function);
+   int col = intArgument(args[2], function);
+   if (row < 0 || row >= matrix->rows || col < 0 || col >= matrix->cols) {
+      throw RuntimeError(std::string(function) + "(): index (" + std::to_string(row) + ", " + std::to_string(col) +
+                         ") out of range for " + std::to_string(matrix->rows) + "x" +
+                         std::to_string(matrix->cols) + " matrix");
+   }
+   return static_cast<std::size_t>(row) * matrix->cols + col;
+}
+
+void HostRegistry::define(const std::string &name, int arity, HostCallback callback) {
+   functions[name] = HostFunction{name, arity, std::move(callback)};
+}
+
+const HostFunction *HostRegistry::find(const std::string &name) const {
+   auto it = functions.find(name);
+   return it == functions.end() ? nullptr : &it->second;
+}
+
+void HostRegistry::declareIn(ScopeManager &scopes) const {
+   for (const auto &[name, function]: functions) {
+      scopes.declare(Symbol(name, SymbolType::Function, TypeContext::global().unknownType(), false, 0, 0));
+   }
+}
+
+void HostRegistry::defineBuiltins(std::ostream &out) {
+   define("print", -1, [&out](const Value *args, int count) {
+       for (int i = 0; i < count; ++i) {
+          if (i > 0) out << ' ';
+          out << args[i].toString();
+       }
+       out << '\n';
+       return Value::null();
+   });
+
+   define("throw", 1, [](const Value *args, int) -> Value {
+       throw ScriptException{args[0]};
+   });
+
+   define("str", 1, [](const Value *args, int) {
+       return args[0].isString() ? args[0] : Value::string(args[0].toString());
+   });
+
+   define("len", 1, [](const Value *args, int) {
+       if (!args[0].isString()) throw RuntimeError(std::string("len() expects a string, got ") + args[0].typeName());
+       return Value::integer(static_cast<std::int32_t>(args[0].asString()->chars.size()));
+   });
+
+   define("clock", 0, [](const Value *, int) {
+       auto now = std::chrono::steady_clock::now().time_since_epoch();
+       return Value::number(std::chrono::duration<double>(now).count());
+   });
+
+   define("matrix", 2, [](const Value *args, int) {
+       return Value::object(new MatrixObject(intArgument(args[0], "matrix"), intArgument(args[1], "matrix")));
+   });
+
+   define("rows", 1, [](const Value *args, int) {
+       return Value::integer(matrixArgument(args[0], "rows")->rows);
+   });
+
+   define("cols", 1, [](const Value *args, int) {
+       return Value::integer(matrixArgument(args[0], "cols")->cols);
+   });
+
+   define("at", 3, [](const Value *args, int) {
+       MatrixObject *matrix = matrixArgument(args[0], "at");
+       return Value::number(matrix->elements()[matrixIndex(matrix, args, "at")]);
+   });
+
+   define("put", 4, [](const Value *args, int) {
+       if (!args[3].isNumber()) throw RuntimeError(std::string("put() expects a number, got ") + args[3].typeName());
+       MatrixObject *matrix = matrixArgument(args[0], "put");
+       std::size_t index = matrixIndex(matrix, args, "put");
+       matrix->mutableElements()[index] = args[3].toNumber();
+       return Value::null();
+   });
+}
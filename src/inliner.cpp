@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cmath>
+
+#include "inliner.h"
+#include "dominators.h"
+#include "ir_simplifier.h"
+#include "loops.h"
+
+// A point in the script: the instruction at index in block, or the end of
+// the block when index is past its last one. A null block is never reached.
+struct ProgramPoint {
+    const IrBlock *block;
+    size_t index;
+};
+
+// Whether a runs before b on every path to b.
+static bool runsBefore(const DominatorTree &dominators, const ProgramPoint &a, const ProgramPoint &b) {
+   if (!a.block || !b.block) return false;
+   if (a.block != b.block) return dominators.dominates(a.block, b.block);
+   return a.index < b.index;
+}
+
+// A point that runs before exactly what runs before both a and b.
+static ProgramPoint earliest(const DominatorTree &dominators, const ProgramPoint &a, const ProgramPoint &b) {
+   if (!a.block || !b.block || !dominators.dominates(a.block, a.block) || !dominators.dominates(b.block, b.block)) {
+      return {nullptr, 0};
+   }
+   if (a.block == b.block) return a.index < b.index ? a : b;
+   const IrBlock *common = a.block;
+   while (!dominators.dominates(common, b.block)) common = dominators.idom(common);
+   if (common == a.block) return a;
+   if (common == b.block) return b;
+   return {common, common->instructions.size()};
+}
+
+CallGraph::CallGraph(const IrModule &module) {
+   IrFunction &script = module.main();
+   std::unordered_map<std::string, std::vector<const IrInstr *>> defines;
+   for (const auto &function: module.functions) {
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::DefineFunction) defines[instr->name].push_back(instr);
+         }
+      }
+   }
+   std::unordered_set<const IrBlock *> scriptBlocks;
+   for (const auto &block: script.blocks) scriptBlocks.insert(block.get());
+   auto defineOf = [&](const std::string &name) -> const IrInstr * {
+       auto it = defines.find(name);
+       if (it == defines.end() || it->second.size() != 1 || it->second.front()->block == nullptr) return nullptr;
+       const IrInstr *define = it->second.front();
+       return scriptBlocks.count(define->block) ? define : nullptr;
+   };
+
+   // Every call to a function defined once in the script, arity checked.
+   std::unordered_map<const IrInstr *, std::pair<IrFunction *, const IrInstr *>> candidates;
+   std::unordered_map<const IrFunction *, std::vector<IrFunction *>> edges;
+   for (const auto &function: module.functions) {
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op != IrOp::Call) continue;
+            const IrInstr *define = defineOf(instr->name);
+            if (!define || static_cast<int>(instr->operands.size()) != define->function->arity) continue;
+            candidates[instr] = {define->function, define};
+            edges[function.get()].push_back(define->function);
+         }
+      }
+   }
+
+   auto reachable = [&](IrFunction *from) {
+       std::unordered_set<const IrFunction *> seen{from};
+       std::vector<IrFunction *> work{from};
+       while (!work.empty()) {
+          IrFunction *function = work.back();
+          work.pop_back();
+          for (IrFunction *callee: edges[function]) {
+             if (callee == from) recursive.insert(from);
+             if (seen.insert(callee).second) work.push_back(callee);
+          }
+       }
+       return seen;
+   };
+   std::unordered_map<const IrFunction *, std::unordered_set<const IrFunction *>> reaches;
+   for (const auto &function: module.functions) reaches[function.get()] = reachable(function.get());
+
+   // Where each script instruction is, and for each function the latest
+   // point running before every call from the script that may enter it.
+   DominatorTree dominators(script);
+   std::unordered_map<const IrInstr *, ProgramPoint> points;
+   std::unordered_map<const IrFunction *, ProgramPoint> entries;
+   for (const auto &block: script.blocks) {
+      for (size_t i = 0; i < block->instructions.size(); ++i) {
+         const IrInstr *instr = block->instructions[i];
+         points[instr] = {block.get(), i};
+         auto candidate = candidates.find(instr);
+         if (candidate == candidates.end()) continue;
+         for (const IrFunction *function: reaches[candidate->second.first]) {
+            auto [entry, first] = entries.try_emplace(function, points[instr]);
+            if (!first) entry->second = earliest(dominators, entry->second, points[instr]);
+         }
+      }
+   }
+
+   for (const auto &function: module.functions) {
+      for (const auto &block: function->blocks) {
+         for (IrInstr *instr: block->instructions) {
+            auto candidate = candidates.find(instr);
+            if (candidate == candidates.end()) continue;
+            const IrInstr *define = candidate->second.second;
+            bool bound;
+            if (function.get() == &script) {
+               bound = runsBefore(dominators, points[define], points[instr]);
+            } else {
+               auto entry = entries.find(function.get());
+               bound = entry != entries.end() && runsBefore(dominators, points[define], entry->second);
+            }
+            if (!bound) continue;
+            targets[instr] = candidate->second.first;
+            calls[function.get()].push_back(instr);
+         }
+      }
+   }
+
+   // Postorder over the call edges, the script last.
+   std::unordered_set<const IrFunction *> visited;
+   auto visit = [&](IrFunction *root) {
+       if (!visited.insert(root).second) return;
+       std::vector<std::pair<IrFunction *, size_t>> stack{{root, 0}};
+       while (!stack.empty()) {
+          auto &[function, next] = stack.back();
+          std::vector<IrFunction *> &callees = edges[function];
+          if (next == callees.size()) {
+             order.push_back(function);
+             stack.pop_back();
+             continue;
+          }
+          IrFunction *callee = callees[next++];
+          if (visited.insert(callee).second) stack.emplace_back(callee, 0);
+       }
+   };
+   for (size_t i = module.functions.size(); i-- > 1;) visit(module.functions[i].get());
+   visit(&script);
+   std::stable_partition(order.begin(), order.end(), [&](const IrFunction *function) { return function != &script; });
+}
+
+IrFunction *CallGraph::target(const IrInstr *call) const {
+   auto it = targets.find(call);
+   return it == targets.end() ? nullptr : it->second;
+}
+
+const std::vector<IrInstr *> &CallGraph::sites(const IrFunction *function) const {
+   static const std::vector<IrInstr *> none;
+   auto it = calls.find(function);
+   return it == calls.end() ? none : it->second;
+}
+
+static int sizeOf(const IrFunction &function) {
+   int size = 0;
+   for (const auto &block: function.blocks) {
+      size += static_cast<int>(block->phis.size());
+      for (const IrInstr *instr: block->instructions) size += instr->op != IrOp::Param;
+   }
+   return size;
+}
+
+bool Inliner::canInline(const IrFunction &callee) const {
+   if (!callee.entry()->predecessors.empty()) return false;
+   for (const auto &block: callee.blocks) {
+      if (block->handler) return false;
+      for (const IrInstr *instr: block->instructions) {
+         if (instr->op == IrOp::DefineFunction || instr->op == IrOp::Catch) return false;
+      }
+   }
+   return true;
+}
+
+double Inliner::frequency(const IrFunction &caller, const IrFunction &callee, int loopDepth) const {
+   if (options.profile) {
+      auto ran = [&](const IrFunction &function) {
+          auto it = options.profile->find(function.name);
+          return it == options.profile->end() ? -1L : it->second;
+      };
+      long callerRuns = ran(caller);
+      long calleeRuns = ran(callee);
+      if (callerRuns > 0 && calleeRuns >= 0) return static_cast<double>(calleeRuns) / static_cast<double>(callerRuns);
+   }
+   return std::pow(static_cast<double>(options.loopWeight), loopDepth);
+}
+
+InlineStats Inliner::inlineCalls(IrModule &module) {
+   stats = InlineStats();
+   CallGraph graph(module);
+   for (IrFunction *caller: graph.bottomUp()) {
+      struct Site {
+          IrInstr *call;
+          const IrFunction *callee;
+          int size;
+          double benefit;
+          size_t order; // in the caller's block order
+      };
+      std::vector<Site> chosen;
+      {
+         DominatorTree dominators(*caller);
+         LoopInfo loops(*caller, dominators);
+         const std::vector<IrInstr *> &sites = graph.sites(caller);
+         for (size_t i = 0; i < sites.size(); ++i) {
+            IrInstr *call = sites[i];
+            IrFunction *callee = graph.target(call);
+            if (callee == caller || graph.isRecursive(callee) || call->block->handler || !canInline(*callee)) continue;
+            int size = sizeOf(*callee);
+            if (size > options.maxSize) continue;
+            auto constants = std::count_if(call->operands.begin(), call->operands.end(),
+                                           [](const IrInstr *operand) { return operand->op == IrOp::Const; });
+            // Argument moves, the call and the return.
+            double overhead = static_cast<double>(call->operands.size()) + 3.0;
+            const NaturalLoop *loop = loops.loopFor(call->block);
+            double benefit = frequency(*caller, *callee, loop ? loop->depth : 0) *
+                             (overhead + static_cast<double>(options.constantBonus * constants));
+            if (size <= options.alwaysSize || benefit >= size) chosen.push_back({call, callee, size, benefit, i});
+         }
+      }
+      std::stable_sort(chosen.begin(), chosen.end(), [](const Site &a, const Site &b) {
+          return a.benefit * b.size > b.benefit * a.size;
+      });
+
+      int size = sizeOf(*caller);
+      int limit = std::max(static_cast<int>(size * options.growth), size + options.maxSize);
+      std::vector<Site> accepted;
+      for (const Site &site: chosen) {
+         if (site.size > options.alwaysSize && size + site.size > limit) continue;
+         accepted.push_back(site);
+         size += site.size;
+         stats.inlined++;
+         stats.grown += site.size;
+      }
+      // From the last call back, so each split moves only what follows the
+      // call up to the one inlined before it.
+      std::sort(accepted.begin(), accepted.end(), [](const Site &a, const Site &b) { return a.order > b.order; });
+      for (const Site &site: accepted) inlineCall(*caller, site.call, *site.callee);
+      if (!accepted.empty()) IrSimplifier().simplify(*caller);
+   }
+   return stats;
+}
+
+// Splits the call's block after the call, copies the callee's blocks in
+// between and merges its returns into a phi at the top of the second half.
+void Inliner::inlineCall(IrFunction &caller, IrInstr *call, const IrFunction &callee) {
+   IrBlock *block = call->block;
+   IrBlock *rest = caller.newBlock();
+   // Later calls in the block were inlined first, so the call is near the end.
+   auto at = std::find(block->instructions.rbegin(), block->instructions.rend(), call).base() - 1;
+   rest->instructions.assign(at + 1, block->instructions.end());
+   block->instructions.erase(at, block->instructions.end());
+   for (IrInstr *instr: rest->instructions) instr->block = rest;
+   rest->successors = std::move(block->successors);
+   block->successors.clear();
+   for (IrBlock *successor: rest->successors) {
+      std::replace(successor->predecessors.begin(), successor->predecessors.end(), block, rest);
+   }
+
+   std::unordered_map<const IrBlock *, IrBlock *> blocks;
+   std::unordered_map<const IrInstr *, IrInstr *> values;
+   for (const auto &from: callee.blocks) {
+      IrBlock *to = caller.newBlock();
+      blocks[from.get()] = to;
+      for (IrInstr *phi: from->phis) {
+         IrInstr *copy = caller.cloneInstr(*phi);
+         copy->block = to;
+         to->phis.push_back(copy);
+         values[phi] = copy;
+      }
+      for (IrInstr *instr: from->instructions) {
+         if (instr->op == IrOp::Param) {
+            values[instr] = call->operands[instr->index];
+            continue;
+         }
+         IrInstr *copy = caller.cloneInstr(*instr);
+         copy->block = to;
+         to->instructions.push_back(copy);
+         values[instr] = copy;
+      }
+   }
+
+   auto jump = [&](IrBlock *from, IrBlock *to) {
+       IrInstr *instr = caller.newInstr(IrOp::Jump);
+       instr->block = from;
+       from->instructions.push_back(instr);
+       from->successors.push_back(to);
+       to->predecessors.push_back(from);
+   };
+   std::vector<IrInstr *> results;
+   for (const auto &from: callee.blocks) {
+      IrBlock *to = blocks[from.get()];
+      for (IrBlock *predecessor: from->predecessors) to->predecessors.push_back(blocks[predecessor]);
+      for (IrBlock *successor: from->successors) to->successors.push_back(blocks[successor]);
+      for (IrInstr *phi: from->phis) {
+         for (IrInstr *operand: phi->operands) values[phi]->addOperand(values[operand]);
+      }
+      for (IrInstr *instr: from->instructions) {
+         if (instr->op == IrOp::Param) continue;
+         for (IrInstr *operand: instr->operands) values[instr]->addOperand(values[operand]);
+      }
+      IrInstr *terminator = to->terminator();
+      if (terminator && terminator->op == IrOp::Return) {
+         results.push_back(terminator->operands[0]);
+         terminator->clearOperands();
+         terminator->block = nullptr;
+         to->instructions.pop_back();
+         jump(to, rest);
+      }
+   }
+   jump(block, blocks[callee.entry()]);
+
+   IrInstr *result;
+   if (results.size() == 1) {
+      result = results.front();
+   } else if (!results.empty()) {
+      result = caller.newInstr(IrOp::Phi);
+      result->block = rest;
+      rest->phis.push_back(result);
+      for (IrInstr *value: results) result->addOperand(value);
+   } else {
+      // The callee never returns, so nothing after the call runs.
+      result = caller.newInstr(IrOp::Const);
+      result->block = block;
+      block->instructions.insert(block->instructions.end() - 1, result);
+   }
+   call->replaceAllUsesWith(result);
+   call->clearOperands();
+   call->block = nullptr;
+}
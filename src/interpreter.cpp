@@ -0,0 +1,347 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include "interpreter.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "error.h"
+#include "matrix.h"
+
+Interpreter::Interpreter(std::ostream &out) : out(out) {
+   hostFunctions.defineBuiltins(out);
+}
+
+void Interpreter::defineGlobal(const std::string &name, Value value) {
+   int index = resolver.declareGlobal(name);
+   if (globals.size() <= static_cast<size_t>(index)) globals.resize(index + 1);
+   globals[index] = std::move(value);
+   hostGlobals.push_back(name);
+}
+
+void Interpreter::run(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+
+   Parser parser(tokens);
+   hostFunctions.declareIn(parser.scopeManager);
+   for (const auto &name: hostGlobals) {
+      parser.scopeManager.declare(Symbol(name, SymbolType::Variable, TypeContext::global().unknownType(),
+                                         true, 0, 0));
+   }
+
+   programs.push_back(parser.parse());
+   execute(*programs.back());
+}
+
+void Interpreter::execute(Expr &program) {
+   ConstantFolder().fold(program);
+   DeadCodeEliminator().eliminate(program);
+   resolver.resolve(program);
+   globals.resize(resolver.globalCount());
+   stack.clear();
+   frameBase = 0;
+   callDepth = 0;
+
+   if (exec(&program) == Completion::Return) {
+      throw RuntimeError("'return' outside of a function");
+   }
+}
+
+Value &Interpreter::variable(const VariableSlot &slot, const std::string &name) {
+   switch (slot.kind) {
+      case VariableSlot::Kind::Local:
+         return stack[frameBase + slot.index];
+      case VariableSlot::Kind::Global:
+         return globals[slot.index];
+      default:
+         throw RuntimeError("Undefined variable '" + name + "'");
+   }
+}
+
+Value Interpreter::eval(const Expr *expr) {
+   switch (expr->type) {
+      case ExprType::Literal:
+         return literalValue(static_cast<const LiteralExpr *>(expr)->value);
+
+      case ExprType::Identifier: {
+         auto *identifier = static_cast<const IdentifierExpr *>(expr);
+         return variable(identifier->slot, identifier->name);
+      }
+
+      case ExprType::Binary: {
+         auto *binary = static_cast<const BinaryExpr *>(expr);
+         if (binary->operation == BinaryOperator::And) {
+            return Value::boolean(eval(binary->left.get()).truthy() && eval(binary->right.get()).truthy());
+         }
+         if (binary->operation == BinaryOperator::Or) {
+            return Value::boolean(eval(binary->left.get()).truthy() || eval(binary->right.get()).truthy());
+         }
+         Value left = eval(binary->left.get());
+         Value right = eval(binary->right.get());
+         return applyBinary(binary->operation, left, right);
+      }
+
+      case ExprType::Unary: {
+         auto *unary = static_cast<const UnaryExpr *>(expr);
+         return applyUnary(unary->operation, eval(unary->right.get()));
+      }
+
+      case ExprType::Assignment: {
+         auto *assign = static_cast<const AssignmentExpr *>(expr);
+         Value value = eval(assign->value.get());
+         variable(assign->slot, assign->name) = value;
+         return value;
+      }
+
+      case ExprType::FunctionCall:
+         return evalCall(static_cast<const FunctionCallExpr *>(expr));
+
+      case ExprType::MatrixMultiplication: {
+         std::vector<const Expr *> operands;
+         collectMatrixChain(expr, operands);
+         std::vector<Value> values;
+         values.reserve(operands.size());
+         for (const Expr *operand: operands) values.push_back(eval(operand));
+         return matrixChainMultiply(values.data(), static_cast<int>(values.size()));
+      }
+
+      default:
+         exec(expr);
+         return Value::null();
+   }
+}
+
+Value Interpreter::evalCall(const FunctionCallExpr *call) {
+   auto it = functions.find(call->callee);
+   if (it != functions.end()) {
+      return callFunction(it->second, call);
+   }
+
+   const HostFunction *host = hostFunctions.find(call->callee);
+   if (!host) {
+      throw RuntimeError("Undefined function '" + call->callee + "'");
+   }
+
+   int count = static_cast<int>(call->arguments.size());
+   if (host->arity >= 0 && host->arity != count) {
+      throw RuntimeError("Function '" + call->callee + "' expects " + std::to_string(host->arity) +
+                         " argument(s) but got " + std::to_string(count));
+   }
+
+   size_t base = stack.size();
+   for (const auto &arg: call->arguments) {
+      Value value = eval(arg.get());
+      stack.push_back(std::move(value));
+   }
+   Value result = host->callback(stack.data() + base, count);
+   stack.resize(base);
+   return result;
+}
+
+Value Interpreter::callFunction(const FunctionDeclarationExpr *function, const FunctionCallExpr *call) {
+   if (function->params.size() != call->arguments.size()) {
+      throw RuntimeError("Function '" + function->name + "' expects " + std::to_string(function->params.size()) +
+                         " argument(s) but got " + std::to_string(call->arguments.size()));
+   }
+   if (callDepth >= maxCallDepth) {
+      throw RuntimeError("Stack overflow in '" + function->name + "'");
+   }
+
+   size_t base = stack.size();
+   for (const auto &arg: call->arguments) {
+      Value value = eval(arg.get());
+      stack.push_back(std::move(value));
+   }
+   stack.resize(base + function->frameSize);
+
+   size_t savedBase = frameBase;
+   frameBase = base;
+   callDepth++;
+
+   struct FrameGuard {
+       Interpreter &self;
+       size_t base;
+       size_t savedBase;
+
+       ~FrameGuard() {
+          self.stack.resize(base);
+          self.frameBase = savedBase;
+          self.callDepth--;
+       }
+   } guard{*this, base, savedBase};
+
+   if (exec(function->body.get()) == Completion::Return) {
+      return std::move(returnValue);
+   }
+   return Value::null();
+}
+
+Interpreter::Completion Interpreter::exec(const Expr *stmt) {
+   if (!stmt) return Completion::Normal;
+
+   switch (stmt->type) {
+      case ExprType::ExpressionStatement:
+         eval(static_cast<const ExpressionStatementExpr *>(stmt)->expression.get());
+         return Completion::Normal;
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<const VarDeclarationExpr *>(stmt);
+         Value value = decl->initializer ? eval(decl->initializer.get()) : Value::null();
+         variable(decl->slot, decl->name) = std::move(value);
+         return Completion::Normal;
+      }
+
+      case ExprType::BlockStatement:
+         return execBlock(static_cast<const BlockStatementExpr *>(stmt)->statements);
+
+      case ExprType::IfStatement: {
+         auto *ifStmt = static_cast<const IfStatementExpr *>(stmt);
+         if (eval(ifStmt->condition.get()).truthy()) return exec(ifStmt->thenBranch.get());
+         return exec(ifStmt->elseBranch.get());
+      }
+
+      case ExprType::WhileStatement: {
+         auto *loop = static_cast<const WhileStatementExpr *>(stmt);
+         while (eval(loop->condition.get()).truthy()) {
+            Completion completion = exec(loop->body.get());
+            if (completion == Completion::Break) break;
+            if (completion == Completion::Return) return completion;
+            exec(loop->increment.get());
+         }
+         return Completion::Normal;
+      }
+
+      case ExprType::DoWhileStatement: {
+         auto *loop = static_cast<const DoWhileStatementExpr *>(stmt);
+         do {
+            Completion completion = exec(loop->body.get());
+            if (completion == Completion::Break) break;
+            if (completion == Completion::Return) return completion;
+         } while (eval(loop->condition.get()).truthy());
+         return Completion::Normal;
+      }
+
+      case ExprType::ForStatement: {
+         auto *loop = static_cast<const ForStatementExpr *>(stmt);
+         exec(loop->initializer.get());
+         while (!loop->condition || eval(loop->condition.get()).truthy()) {
+            Completion completion = exec(loop->body.get());
+            if (completion == Completion::Break) break;
+            if (completion == Completion::Return) return completion;
+            if (loop->increment) eval(loop->increment.get());
+         }
+         return Completion::Normal;
+      }
+
+      case ExprType::ReturnStatement: {
+         auto *ret = static_cast<const ReturnStatementExpr *>(stmt);
+         returnValue = ret->value ? eval(ret->value.get()) : Value::null();
+         return Completion::Return;
+      }
+
+      case ExprType::BreakStatement:
+         return Completion::Break;
+
+      case ExprType::ContinueStatement:
+         return Completion::Continue;
+
+      case ExprType::FunctionDeclaration: {
+         auto *function = static_cast<const FunctionDeclarationExpr *>(stmt);
+         functions[function->name] = function;
+         return Completion::Normal;
+      }
+
+      case ExprType::SwitchStatement:
+         return execSwitch(static_cast<const SwitchStatementExpr *>(stmt));
+
+      case ExprType::TryCatchFinallyStatement:
+         return execTry(static_cast<const TryCatchFinallyStatementExpr *>(stmt));
+
+      default:
+         eval(stmt);
+         return Completion::Normal;
+   }
+}
+
+Interpreter::Completion Interpreter::execBlock(const std::vector<std::unique_ptr<Expr>> &statements) {
+   for (const auto &statement: statements) {
+      Completion completion = exec(statement.get());
+      if (completion != Completion::Normal) return completion;
+   }
+   return Completion::Normal;
+}
+
+Interpreter::Completion Interpreter::execSwitch(const SwitchStatementExpr *stmt) {
+   Value subject = eval(stmt->switchExpr.get());
+
+   auto plan = switchPlans.find(stmt);
+   if (plan == switchPlans.end()) plan = switchPlans.emplace(stmt, planSwitch(*stmt)).first;
+
+   auto clause = [&](size_t index) { return static_cast<const CaseClauseExpr *>(stmt->caseClauses[index].get()); };
+   const Expr *body = stmt->defaultClause.get();
+   for (const SwitchStep &step: plan->second) {
+      size_t matched = step.firstCase;
+      if (step.table) {
+         int target = step.table->lookup(subject);
+         if (target == SwitchTable::NO_MATCH) continue;
+         matched = static_cast<size_t>(target);
+      } else if (!subject.equals(eval(clause(matched)->caseExpr.get()))) {
+         continue;
+      }
+      body = clause(matched)->body.get();
+      break;
+   }
+
+   Completion completion = exec(body);
+   return completion == Completion::Break ? Completion::Normal : completion;
+}
+
+Interpreter::Completion Interpreter::execTry(const TryCatchFinallyStatementExpr *stmt) {
+   Completion completion = Completion::Normal;
+   std::exception_ptr pending;
+   size_t savedStack = stack.size();
+   size_t savedBase = frameBase;
+   int savedDepth = callDepth;
+
+   auto runCatch = [&](Value thrown) {
+       stack.resize(savedStack);
+       frameBase = savedBase;
+       callDepth = savedDepth;
+       auto *clause = static_cast<const CatchClauseExpr *>(stmt->catches.front().get());
+       variable(clause->slot, clause->exceptionVarName) = std::move(thrown);
+       completion = exec(clause->block.get());
+   };
+
+   try {
+      try {
+         completion = exec(stmt->tryBlock.get());
+      } catch (ScriptException &e) {
+         if (stmt->catches.empty()) throw;
+         runCatch(std::move(e.value));
+      } catch (RuntimeError &e) {
+         if (stmt->catches.empty()) throw;
+         runCatch(Value::string(e.reason()));
+      }
+   } catch (...) {
+      if (!stmt->finallyBlock) throw;
+      pending = std::current_exception();
+   }
+
+   if (stmt->finallyBlock) {
+      stack.resize(savedStack);
+      frameBase = savedBase;
+      callDepth = savedDepth;
+
+      Value savedReturn = returnValue;
+      Completion finallyCompletion = exec(stmt->finallyBlock.get());
+      if (finallyCompletion != Completion::Normal) return finallyCompletion;
+      returnValue = std::move(savedReturn);
+      if (pending) std::rethrow_exception(pending);
+   }
+
+   return completion;
+}
+
+#pragma clang diagnostic pop
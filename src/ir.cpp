@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include "ir.h"
+#include "dominators.h"
+#include "error.h"
+
+const char *irOpName(IrOp op) {
+   static const char *const names[] = {
+#define COMPILER_IR_OP_NAME(name, text) text,
+           COMPILER_IR_OPS(COMPILER_IR_OP_NAME)
+#undef COMPILER_IR_OP_NAME
+   };
+   return names[static_cast<int>(op)];
+}
+
+bool isTerminator(IrOp op) {
+   switch (op) {
+      case IrOp::Jump:
+      case IrOp::Branch:
+      case IrOp::Switch:
+      case IrOp::Return:
+      case IrOp::Rethrow:
+      case IrOp::Unreachable:
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool producesValue(IrOp op) {
+   return op != IrOp::StoreGlobal && op != IrOp::DefineFunction && !isTerminator(op);
+}
+
+// Records operand i of user as a use of that operand.
+static void attachUse(IrInstr *user, size_t i) {
+   IrInstr *value = user->operands[i];
+   user->useIndex[i] = value->users.size();
+   value->users.push_back(user);
+   value->userOperand.push_back(i);
+}
+
+// Drops the record of operand i of user, moving the operand's last use into
+// its place.
+static void detachUse(IrInstr *user, size_t i) {
+   IrInstr *value = user->operands[i];
+   size_t at = user->useIndex[i];
+   size_t last = value->users.size() - 1;
+   if (at != last) {
+      IrInstr *moved = value->users[last];
+      size_t operand = value->userOperand[last];
+      value->users[at] = moved;
+      value->userOperand[at] = operand;
+      moved->useIndex[operand] = at;
+   }
+   value->users.pop_back();
+   value->userOperand.pop_back();
+}
+
+void IrInstr::addOperand(IrInstr *value) {
+   operands.push_back(value);
+   useIndex.push_back(0);
+   attachUse(this, operands.size() - 1);
+}
+
+void IrInstr::setOperand(size_t i, IrInstr *value) {
+   detachUse(this, i);
+   operands[i] = value;
+   attachUse(this, i);
+}
+
+void IrInstr::clearOperands() {
+   for (size_t i = operands.size(); i-- > 0;) detachUse(this, i);
+   operands.clear();
+   useIndex.clear();
+}
+
+void IrInstr::replaceAllUsesWith(IrInstr *value) {
+   std::vector<IrInstr *> uses = std::move(users);
+   std::vector<size_t> slots = std::move(userOperand);
+   users.clear();
+   userOperand.clear();
+   for (size_t k = 0; k < uses.size(); ++k) {
+      uses[k]->operands[slots[k]] = value;
+      attachUse(uses[k], slots[k]);
+   }
+}
+
+bool IrInstr::mayThrow() const {
+   switch (op) {
+      case IrOp::Binary:
+         return binary != BinaryOperator::Equal && binary != BinaryOperator::NotEqual;
+      case IrOp::Unary:
+         return unary != UnaryOperator::Not;
+      case IrOp::MatMul:
+      case IrOp::MatChain:
+      case IrOp::Call:
+      case IrOp::Error:
+      case IrOp::Rethrow:
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool IrInstr::hasSideEffects() const {
+   switch (op) {
+      case IrOp::StoreGlobal:
+      case IrOp::DefineFunction:
+      case IrOp::Catch:
+         return true;
+      default:
+         return isTerminator(op) || mayThrow();
+   }
+}
+
+size_t IrBlock::predecessorIndex(const IrBlock *pred) const {
+   return std::find(predecessors.begin(), predecessors.end(), pred) - predecessors.begin();
+}
+
+void IrBlock::removePredecessor(size_t i) {
+   for (IrInstr *phi: phis) {
+      detachUse(phi, i);
+      phi->operands.erase(phi->operands.begin() + static_cast<std::ptrdiff_t>(i));
+      phi->useIndex.erase(phi->useIndex.begin() + static_cast<std::ptrdiff_t>(i));
+      for (size_t j = i; j < phi->operands.size(); ++j) phi->operands[j]->userOperand[phi->useIndex[j]] = j;
+   }
+   predecessors.erase(predecessors.begin() + static_cast<std::ptrdiff_t>(i));
+}
+
+IrBlock *IrFunction::newBlock() {
+   blocks.push_back(std::make_unique<IrBlock>());
+   blocks.back()->id = static_cast<int>(blocks.size() - 1);
+   return blocks.back().get();
+}
+
+IrInstr *IrFunction::newInstr(IrOp op) {
+   values.push_back(std::make_unique<IrInstr>(op));
+   return values.back().get();
+}
+
+IrInstr *IrFunction::cloneInstr(const IrInstr &instr) {
+   IrInstr *copy = newInstr(instr.op);
+   copy->constant = instr.constant;
+   copy->index = instr.index;
+   copy->binary = instr.binary;
+   copy->unary = instr.unary;
+   copy->name = instr.name;
+   copy->function = instr.function;
+   copy->table = instr.table;
+   return copy;
+}
+
+static std::vector<bool> reachableBlocks(const IrFunction &function) {
+   std::vector<bool> reached(function.blocks.size(), false);
+   std::vector<IrBlock *> work{function.entry()};
+   reached[function.entry()->id] = true;
+   while (!work.empty()) {
+      IrBlock *block = work.back();
+      work.pop_back();
+      block->forEachSuccessor([&](IrBlock *successor) {
+          if (!reached[successor->id]) {
+             reached[successor->id] = true;
+             work.push_back(successor);
+          }
+      });
+   }
+   return reached;
+}
+
+void IrFunction::compactBlocks() {
+   renumber();
+   std::vector<bool> reached = reachableBlocks(*this);
+   for (auto &block: blocks) {
+      if (reached[block->id]) continue;
+      for (IrInstr *phi: block->phis) phi->clearOperands();
+      for (IrInstr *instr: block->instructions) instr->clearOperands();
+   }
+
+   std::vector<std::unique_ptr<IrBlock>> kept;
+   for (auto &block: blocks) {
+      if (!reached[block->id]) {
+         for (IrInstr *phi: block->phis) phi->block = nullptr;
+         for (IrInstr *instr: block->instructions) instr->block = nullptr;
+         continue;
+      }
+      for (size_t i = block->predecessors.size(); i-- > 0;) {
+         if (!reached[block->predecessors[i]->id]) block->removePredecessor(i);
+      }
+      kept.push_back(std::move(block));
+   }
+   blocks = std::move(kept);
+   renumber();
+
+   std::vector<IrBlock *> order = reversePostorder(*this);
+   std::vector<std::unique_ptr<IrBlock>> sorted(blocks.size());
+   for (size_t i = 0; i < order.size(); ++i) sorted[i] = std::move(blocks[order[i]->id]);
+   blocks = std::move(sorted);
+   renumber();
+}
+
+void IrFunction::renumber() {
+   int nextValue = 0;
+   for (size_t i = 0; i < blocks.size(); ++i) {
+      IrBlock &block = *blocks[i];
+      block.id = static_cast<int>(i);
+      for (IrInstr *phi: block.phis) phi->id = nextValue++;
+      for (IrInstr *instr: block.instructions) instr->id = producesValue(instr->op) ? nextValue++ : -1;
+   }
+}
+
+std::vector<IrBlock *> reversePostorder(const IrFunction &function) {
+   std::vector<IrBlock *> order;
+   std::vector<bool> visited(function.blocks.size(), false);
+   // Each entry is a block and the index of its next successor to visit.
+   std::vector<std::pair<IrBlock *, size_t>> stack{{function.entry(), 0}};
+   visited[function.entry()->id] = true;
+   while (!stack.empty()) {
+      auto &[block, next] = stack.back();
+      size_t count = block->successors.size() + (block->handler ? 1 : 0);
+      if (next == count) {
+         order.push_back(block);
+         stack.pop_back();
+         continue;
+      }
+      // Successors are visited last to first so the first one follows its
+      // block in the result.
+      IrBlock *successor = next == 0 && block->handler ? block->handler
+                                                       : block->successors[count - 1 - next];
+      ++next;
+      if (!visited[successor->id]) {
+         visited[successor->id] = true;
+         stack.emplace_back(successor, 0);
+      }
+   }
+   std::reverse(order.begin(), order.end());
+   return order;
+}
+
+static size_t successorCount(const IrInstr *terminator) {
+   switch (terminator->op) {
+      case IrOp::Jump:
+         return 1;
+      case IrOp::Branch:
+         return 2;
+      default:
+         return 0;
+   }
+}
+
+static size_t operandCount(const IrInstr *instr) {
+   switch (instr->op) {
+      case IrOp::Const:
+      case IrOp::Param:
+      case IrOp::Catch:
+      case IrOp::LoadGlobal:
+      case IrOp::DefineFunction:
+      case IrOp::Error:
+      case IrOp::Jump:
+      case IrOp::Unreachable:
+         return 0;
+      case IrOp::Binary:
+      case IrOp::MatMul:
+         return 2;
+      default:
+         return 1;
+   }
+}
+
+void verifyIr(const IrFunction &function) {
+   auto fail = [&](const IrBlock *block, const std::string &message) {
+       std::string where = block ? "b" + std::to_string(block->id) + ": " : "";
+       throw CompilerError("IR verification failed in function '" + function.name + "': " + where + message);
+   };
+
+   if (function.blocks.empty()) fail(nullptr, "no entry block");
+   std::unordered_map<const IrBlock *, size_t> position;
+   for (size_t i = 0; i < function.blocks.size(); ++i) {
+      if (function.blocks[i]->id != static_cast<int>(i)) fail(nullptr, "blocks are not numbered by position");
+      position.emplace(function.blocks[i].get(), i);
+   }
+   if (!function.entry()->predecessors.empty()) fail(function.entry(), "the entry block has predecessors");
+
+   std::map<std::pair<const IrBlock *, const IrBlock *>, int> edges;
+   for (const auto &owned: function.blocks) {
+      const IrBlock *block = owned.get();
+      const IrInstr *terminator = block->terminator();
+      if (!terminator) fail(block, "missing terminator");
+
+      size_t expected = successorCount(terminator);
+      if (terminator->op == IrOp::Switch) {
+         if (block->successors.empty()) fail(block, "switch without a default successor");
+      } else if (block->successors.size() != expected) {
+         fail(block, std::string("'") + irOpName(terminator->op) + "' with " +
+                     std::to_string(block->successors.size()) + " successor(s)");
+      }
+
+      // Every edge is listed once in its target's predecessors; parallel
+      // edges are listed once each.
+      block->forEachSuccessor([&](IrBlock *successor) {
+          if (!position.count(successor)) fail(block, "successor outside the function");
+          edges[{block, successor}]++;
+      });
+      for (const IrBlock *pred: block->predecessors) {
+         if (!position.count(pred)) fail(block, "predecessor outside the function");
+         edges[{pred, block}]--;
+      }
+
+      bool exceptional = std::any_of(block->predecessors.begin(), block->predecessors.end(),
+                                     [&](const IrBlock *pred) { return pred->handler == block; });
+      bool catches = !block->instructions.empty() && block->instructions.front()->op == IrOp::Catch;
+      if (exceptional != catches) fail(block, "a handler must begin with 'catch', and only a handler may");
+      if (exceptional) {
+         for (const IrBlock *pred: block->predecessors) {
+            if (pred->handler != block) fail(block, "handler also entered normally");
+         }
+      }
+
+      for (const IrInstr *phi: block->phis) {
+         if (phi->op != IrOp::Phi) fail(block, "non-phi in the phi list");
+         if (phi->block != block) fail(block, "phi owned by another block");
+         if (phi->operands.size() != block->predecessors.size()) {
+            fail(block, "phi %" + std::to_string(phi->id) + " has " + std::to_string(phi->operands.size()) +
+                        " operands for " + std::to_string(block->predecessors.size()) + " predecessors");
+         }
+      }
+      for (size_t i = 0; i < block->instructions.size(); ++i) {
+         const IrInstr *instr = block->instructions[i];
+         if (instr->block != block) fail(block, "instruction owned by another block");
+         if (instr->op == IrOp::Phi) fail(block, "phi among instructions");
+         if (isTerminator(instr->op) && i + 1 != block->instructions.size()) fail(block, "terminator mid-block");
+         if (instr->op == IrOp::Catch && i != 0) fail(block, "'catch' not first");
+         size_t count = operandCount(instr);
+         bool variadic = instr->op == IrOp::Call || instr->op == IrOp::MatChain;
+         if (!variadic && instr->operands.size() != count) {
+            fail(block, std::string("'") + irOpName(instr->op) + "' with " +
+                        std::to_string(instr->operands.size()) + " operand(s)");
+         }
+         if (instr->op == IrOp::Rethrow && instr->operands[0]->op != IrOp::Catch) {
+            fail(block, "'rethrow' of a value that is not a caught exception");
+         }
+         // The handler sees the values live at the end of the block, so only
+         // the last instruction may raise.
+         bool last = i + 2 == block->instructions.size() || isTerminator(instr->op);
+         if (block->handler && instr->mayThrow() && !last) {
+            fail(block, std::string("'") + irOpName(instr->op) + "' may raise before the end of a protected block");
+         }
+      }
+
+      auto checkOperands = [&](const IrInstr *instr) {
+          for (const IrInstr *operand: instr->operands) {
+             if (!operand->block || !position.count(operand->block)) {
+                fail(block, "operand of '" + std::string(irOpName(instr->op)) + "' is not in the function");
+             }
+             if (!producesValue(operand->op)) fail(block, "operand produces no value");
+          }
+      };
+      for (const IrInstr *phi: block->phis) checkOperands(phi);
+      for (const IrInstr *instr: block->instructions) checkOperands(instr);
+   }
+
+   for (const auto &[edge, count]: edges) {
+      if (count > 0) fail(edge.first, "edge to b" + std::to_string(edge.second->id) + " not in its predecessors");
+      if (count < 0) fail(edge.second, "b" + std::to_string(edge.first->id) + " is a predecessor without an edge here");
+   }
+
+   std::vector<bool> reached = reachableBlocks(function);
+   for (const auto &block: function.blocks) {
+      if (!reached[block->id]) fail(block.get(), "unreachable block");
+   }
+
+   // A value is available where it is defined earlier in the same block or
+   // in a dominating block; a phi uses its operand at the end of the
+   // corresponding predecessor.
+   DominatorTree dominators(function);
+   std::unordered_map<const IrInstr *, size_t> order;
+   for (const auto &block: function.blocks) {
+      for (size_t i = 0; i < block->instructions.size(); ++i) order[block->instructions[i]] = i;
+   }
+   auto available = [&](const IrInstr *def, const IrInstr *use, size_t operand) {
+       if (use->op == IrOp::Phi) return dominators.dominates(def->block, use->block->predecessors[operand]);
+       if (def->block != use->block) return dominators.dominates(def->block, use->block);
+       return def->op == IrOp::Phi || order.at(def) < order.at(use);
+   };
+   auto checkDominance = [&](const IrInstr *instr) {
+       for (size_t i = 0; i < instr->operands.size(); ++i) {
+          const IrInstr *operand = instr->operands[i];
+          if (!available(operand, instr, i)) {
+             fail(instr->block, "%" + std::to_string(operand->id) + " does not dominate its use in '" +
+                                irOpName(instr->op) + "'");
+          }
+       }
+       // Each use is recorded once, where both sides say it is.
+       bool recorded = instr->useIndex.size() == instr->operands.size() &&
+                       instr->userOperand.size() == instr->users.size();
+       for (size_t i = 0; recorded && i < instr->operands.size(); ++i) {
+          const IrInstr *operand = instr->operands[i];
+          size_t at = instr->useIndex[i];
+          recorded = at < operand->users.size() && operand->users[at] == instr && operand->userOperand[at] == i;
+       }
+       if (!recorded) fail(instr->block, "operands of %" + std::to_string(instr->id) + " missing from use lists");
+       for (size_t k = 0; k < instr->users.size(); ++k) {
+          const IrInstr *user = instr->users[k];
+          size_t operand = instr->userOperand[k];
+          if (!user->block || !position.count(user->block) || operand >= user->operands.size() ||
+              user->operands[operand] != instr || user->useIndex[operand] != k) {
+             fail(instr->block, "use list of %" + std::to_string(instr->id) + " names a non-user");
+          }
+       }
+   };
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *phi: block->phis) checkDominance(phi);
+      for (const IrInstr *instr: block->instructions) checkDominance(instr);
+   }
+}
+
+void verifyIr(const IrModule &module) {
+   for (const auto &function: module.functions) verifyIr(*function);
+}
+
+static const char *binaryMnemonic(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return "add";
+      case BinaryOperator::Subtract:
+         return "sub";
+      case BinaryOperator::Multiply:
+         return "mul";
+      case BinaryOperator::Divide:
+         return "div";
+      case BinaryOperator::Equal:
+         return "eq";
+      case BinaryOperator::NotEqual:
+         return "ne";
+      case BinaryOperator::Less:
+         return "lt";
+      case BinaryOperator::LessEqual:
+         return "le";
+      case BinaryOperator::Greater:
+         return "gt";
+      case BinaryOperator::GreaterEqual:
+         return "ge";
+      default:
+         return "?";
+   }
+}
+
+static const char *unaryMnemonic(UnaryOperator op) {
+   switch (op) {
+      case UnaryOperator::Plus:
+         return "plus";
+      case UnaryOperator::Negate:
+         return "neg";
+      case UnaryOperator::Not:
+         return "not";
+      case UnaryOperator::BitwiseNot:
+         return "bnot";
+      default:
+         return "?";
+   }
+}
+
+static std::string valueText(const IrInstr *value) {
+   return "%" + std::to_string(value->id);
+}
+
+static std::string blockText(const IrBlock *block) {
+   return "b" + std::to_string(block->id);
+}
+
+static std::string operandList(const IrInstr *instr) {
+   std::string result;
+   for (const IrInstr *operand: instr->operands) result += (result.empty() ? "" : ", ") + valueText(operand);
+   return result;
+}
+
+static std::string instructionText(const IrInstr *instr) {
+   const IrBlock *block = instr->block;
+   std::string result = producesValue(instr->op) ? valueText(instr) + " = " : "";
+   switch (instr->op) {
+      case IrOp::Const:
+         return result + "const " +
+                (instr->constant.isString() ? "\"" + instr->constant.toString() + "\"" : instr->constant.toString());
+      case IrOp::Param:
+         return result + "param " + std::to_string(instr->index);
+      case IrOp::LoadGlobal:
+         return result + "loadglobal g" + std::to_string(instr->index) + " (" + instr->name + ")";
+      case IrOp::StoreGlobal:
+         return "storeglobal g" + std::to_string(instr->index) + " (" + instr->name + "), " + operandList(instr);
+      case IrOp::Binary:
+         return result + binaryMnemonic(instr->binary) + " " + operandList(instr);
+      case IrOp::Unary:
+         return result + unaryMnemonic(instr->unary) + " " + operandList(instr);
+      case IrOp::Call:
+         return result + "call " + instr->name + "(" + operandList(instr) + ")";
+      case IrOp::DefineFunction:
+         return std::string("define ") + instr->name;
+      case IrOp::Error:
+         return result + "error \"" + instr->name + "\"";
+      case IrOp::Jump:
+         return "jump " + blockText(block->successors[0]);
+      case IrOp::Branch:
+         return "branch " + operandList(instr) + ", " + blockText(block->successors[0]) + ", " +
+                blockText(block->successors[1]);
+      case IrOp::Switch: {
+         result = "switch " + operandList(instr) + " [";
+         for (size_t i = 1; i < block->successors.size(); ++i) {
+            result += (i > 1 ? ", " : "") + blockText(block->successors[i]);
+         }
+         return result + "] else " + blockText(block->successors[0]) + " ; " + instr->table->describe();
+      }
+      default: {
+         std::string operands = operandList(instr);
+         return result + irOpName(instr->op) + (operands.empty() ? "" : " " + operands);
+      }
+   }
+}
+
+std::string dumpIr(const IrFunction &function) {
+   std::string result = "function " + function.name + " (arity " + std::to_string(function.arity) + ")\n";
+   for (const auto &block: function.blocks) {
+      result += blockText(block.get());
+      if (!block->predecessors.empty() || block->handler) {
+         std::string details;
+         for (const IrBlock *pred: block->predecessors) {
+            details += (details.empty() ? "preds " : ", ") + blockText(pred);
+         }
+         if (block->handler) details += (details.empty() ? "" : "; ") + std::string("handler ") + blockText(block->handler);
+         result += " (" + details + ")";
+      }
+      result += ":\n";
+      for (const IrInstr *phi: block->phis) result += "  " + instructionText(phi) + "\n";
+      for (const IrInstr *instr: block->instructions) result += "  " + instructionText(instr) + "\n";
+   }
+   return result;
+}
+
+std::string dumpIr(const IrModule &module) {
+   std::string result;
+   for (const auto &function: module.functions) {
+      if (!result.empty()) result += "\n";
+      result += dumpIr(*function);
+   }
+   return result;
+}
@@ -0,0 +1,699 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include <algorithm>
+
+#include "ir_builder.h"
+#include "error.h"
+
+std::unique_ptr<IrModule> IrBuilder::build(const Expr &root) {
+   auto result = std::make_unique<IrModule>();
+   module = result.get();
+
+   auto main = std::make_unique<IrFunction>();
+   main->name = "<script>";
+   IrFunction &function = *main;
+   module->functions.push_back(std::move(main));
+   buildFunction(function, &root, 0);
+
+   module = nullptr;
+   return result;
+}
+
+void IrBuilder::buildFunction(IrFunction &function, const Expr *body, int arity) {
+   FunctionState functionState;
+   functionState.function = &function;
+   function.arity = arity;
+
+   FunctionState *enclosing = state;
+   state = &functionState;
+
+   IrBlock *entry = newBlock();
+   sealBlock(entry);
+   state->current = entry;
+   for (int i = 0; i < arity; ++i) {
+      IrInstr *param = create(IrOp::Param);
+      param->index = i;
+      writeVariable(i, entry, append(param));
+   }
+
+   lowerStatement(body);
+   if (state->current) terminate(IrOp::Return, {emitConstant(Value::null())}, {});
+   function.compactBlocks();
+
+   state = enclosing;
+}
+
+IrBlock *IrBuilder::newBlock() {
+   state->blocks.emplace_back();
+   return state->function->newBlock();
+}
+
+void IrBuilder::sealBlock(IrBlock *block) {
+   // Reading a variable here may add incomplete phis while we iterate.
+   auto &pending = state->blocks[block->id].incompletePhis;
+   for (size_t i = 0; i < pending.size(); ++i) {
+      auto [slot, phi] = pending[i];
+      addPhiOperands(slot, phi);
+   }
+   pending.clear();
+   state->blocks[block->id].sealed = true;
+}
+
+void IrBuilder::startBlock(IrBlock *block) {
+   state->current = block->predecessors.empty() ? nullptr : block;
+}
+
+IrInstr *IrBuilder::create(IrOp op, const std::vector<IrInstr *> &operands) {
+   IrInstr *instr = state->function->newInstr(op);
+   for (IrInstr *operand: operands) instr->addOperand(operand);
+   return instr;
+}
+
+IrInstr *IrBuilder::append(IrInstr *instr) {
+   IrBlock *block = state->current;
+   instr->block = block;
+   block->instructions.push_back(instr);
+
+   IrBlock *handler = instr->mayThrow() ? currentHandler() : nullptr;
+   if (handler) {
+      block->handler = handler;
+      handler->predecessors.push_back(block);
+      IrBlock *next = newBlock();
+      terminate(IrOp::Jump, {}, {next});
+      sealBlock(next);
+      startBlock(next);
+   }
+   return instr;
+}
+
+IrInstr *IrBuilder::emitConstant(const Value &value) {
+   IrInstr *instr = create(IrOp::Const);
+   instr->constant = value;
+   return append(instr);
+}
+
+IrInstr *IrBuilder::terminate(IrOp op, const std::vector<IrInstr *> &operands, std::vector<IrBlock *> successors) {
+   IrBlock *block = state->current;
+   IrInstr *instr = create(op, operands);
+   instr->block = block;
+   block->instructions.push_back(instr);
+   for (IrBlock *successor: successors) successor->predecessors.push_back(block);
+   block->successors = std::move(successors);
+   if (instr->mayThrow()) {
+      if (IrBlock *handler = currentHandler()) {
+         block->handler = handler;
+         handler->predecessors.push_back(block);
+      }
+   }
+   state->current = nullptr;
+   return instr;
+}
+
+void IrBuilder::jumpTo(IrBlock *target) {
+   if (state->current) terminate(IrOp::Jump, {}, {target});
+}
+
+IrBlock *IrBuilder::currentHandler() const {
+   for (size_t i = state->tries.size(); i-- > 0;) {
+      if (state->tries[i].handler) return state->tries[i].handler;
+   }
+   return nullptr;
+}
+
+// The value of a local read before any assignment: null, as in a fresh frame.
+IrInstr *IrBuilder::undefinedValue() {
+   if (!state->undefined) {
+      IrBlock *entry = state->function->entry();
+      IrInstr *instr = create(IrOp::Const);
+      instr->block = entry;
+      entry->instructions.insert(entry->instructions.begin() + state->function->arity, instr);
+      state->undefined = instr;
+   }
+   return state->undefined;
+}
+
+IrInstr *IrBuilder::newPhi(IrBlock *block) {
+   IrInstr *phi = create(IrOp::Phi);
+   phi->block = block;
+   block->phis.push_back(phi);
+   return phi;
+}
+
+void IrBuilder::writeVariable(int slot, IrBlock *block, IrInstr *value) {
+   state->blocks[block->id].definitions[slot] = value;
+}
+
+// Walks up chains of single-predecessor blocks iteratively; only joins recurse.
+IrInstr *IrBuilder::readVariable(int slot, IrBlock *block) {
+   std::vector<IrBlock *> chain;
+   IrInstr *value;
+   for (;;) {
+      BlockState &blockState = state->blocks[block->id];
+      auto found = blockState.definitions.find(slot);
+      if (found != blockState.definitions.end()) {
+         value = resolveReplaced(found->second);
+         break;
+      }
+      if (!blockState.sealed) {
+         value = newPhi(block);
+         blockState.incompletePhis.emplace_back(slot, value);
+         break;
+      }
+      if (block->predecessors.size() == 1) {
+         chain.push_back(block);
+         block = block->predecessors.front();
+         continue;
+      }
+      value = readVariableAtJoin(slot, block);
+      break;
+   }
+   writeVariable(slot, block, value);
+   for (IrBlock *visited: chain) writeVariable(slot, visited, value);
+   return value;
+}
+
+IrInstr *IrBuilder::readVariableAtJoin(int slot, IrBlock *block) {
+   if (block->predecessors.empty()) return undefinedValue();
+   IrInstr *phi = newPhi(block);
+   writeVariable(slot, block, phi);
+   return addPhiOperands(slot, phi);
+}
+
+IrInstr *IrBuilder::addPhiOperands(int slot, IrInstr *phi) {
+   IrBlock *block = phi->block;
+   for (size_t i = 0; i < block->predecessors.size(); ++i) {
+      phi->addOperand(readVariable(slot, block->predecessors[i]));
+   }
+   return tryRemoveTrivialPhi(phi);
+}
+
+// A phi whose operands are all one value (or itself) is that value.
+IrInstr *IrBuilder::tryRemoveTrivialPhi(IrInstr *phi) {
+   IrInstr *same = nullptr;
+   for (IrInstr *operand: phi->operands) {
+      if (operand == same || operand == phi) continue;
+      if (same) return phi;
+      same = operand;
+   }
+   if (!same) same = undefinedValue();
+
+   std::vector<IrInstr *> users;
+   for (IrInstr *user: phi->users) {
+      if (user != phi) users.push_back(user);
+   }
+   phi->replaceAllUsesWith(same);
+   phi->clearOperands();
+   auto &phis = phi->block->phis;
+   phis.erase(std::find(phis.begin(), phis.end(), phi));
+   phi->block = nullptr;
+   state->replaced[phi] = same;
+
+   // Removing this phi may make phis that used it trivial. A phi still being
+   // filled in is checked once its operands are complete.
+   for (IrInstr *user: users) {
+      if (user->op != IrOp::Phi || !user->block) continue;
+      if (!state->blocks[user->block->id].sealed || user->operands.size() != user->block->predecessors.size()) {
+         continue;
+      }
+      tryRemoveTrivialPhi(user);
+   }
+   return resolveReplaced(same);
+}
+
+IrInstr *IrBuilder::resolveReplaced(IrInstr *value) {
+   auto found = state->replaced.find(value);
+   while (found != state->replaced.end()) {
+      value = found->second;
+      found = state->replaced.find(value);
+   }
+   return value;
+}
+
+// A phi in join taking each value from its predecessor block, or the value
+// itself when all agree.
+IrInstr *IrBuilder::joinValues(IrBlock *join, const std::vector<std::pair<IrBlock *, IrInstr *>> &incoming) {
+   auto valueFrom = [&](IrBlock *pred) {
+       return std::find_if(incoming.begin(), incoming.end(),
+                           [&](const auto &entry) { return entry.first == pred; })->second;
+   };
+   IrInstr *first = valueFrom(join->predecessors.front());
+   bool same = std::all_of(join->predecessors.begin(), join->predecessors.end(),
+                           [&](IrBlock *pred) { return valueFrom(pred) == first; });
+   if (same) return first;
+
+   IrInstr *phi = newPhi(join);
+   for (IrBlock *pred: join->predecessors) phi->addOperand(valueFrom(pred));
+   return phi;
+}
+
+void IrBuilder::lowerStatement(const Expr *stmt) {
+   if (!stmt || !state->current) return;
+
+   switch (stmt->type) {
+      case ExprType::ExpressionStatement:
+         lowerExpression(static_cast<const ExpressionStatementExpr *>(stmt)->expression.get());
+         break;
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<const VarDeclarationExpr *>(stmt);
+         IrInstr *value;
+         if (decl->initializer) {
+            value = lowerExpression(decl->initializer.get());
+         } else {
+            // Named, so definite assignment can tell it from an explicit null.
+            value = emitConstant(Value::null());
+            value->name = decl->name;
+         }
+         storeVariable(decl->slot, decl->name, value);
+         break;
+      }
+
+      case ExprType::BlockStatement:
+         for (const auto &statement: static_cast<const BlockStatementExpr *>(stmt)->statements) {
+            lowerStatement(statement.get());
+         }
+         break;
+
+      case ExprType::IfStatement: {
+         auto *ifStmt = static_cast<const IfStatementExpr *>(stmt);
+         IrBlock *thenBlock = newBlock();
+         IrBlock *elseBlock = ifStmt->elseBranch ? newBlock() : nullptr;
+         IrBlock *join = newBlock();
+         lowerBranch(ifStmt->condition.get(), thenBlock, elseBlock ? elseBlock : join);
+
+         sealBlock(thenBlock);
+         startBlock(thenBlock);
+         lowerStatement(ifStmt->thenBranch.get());
+         jumpTo(join);
+         if (elseBlock) {
+            sealBlock(elseBlock);
+            startBlock(elseBlock);
+            lowerStatement(ifStmt->elseBranch.get());
+            jumpTo(join);
+         }
+         sealBlock(join);
+         startBlock(join);
+         break;
+      }
+
+      case ExprType::WhileStatement: {
+         auto *loop = static_cast<const WhileStatementExpr *>(stmt);
+         lowerLoop(loop->condition.get(), loop->body.get(), loop->increment.get(), true);
+         break;
+      }
+
+      case ExprType::DoWhileStatement: {
+         auto *loop = static_cast<const DoWhileStatementExpr *>(stmt);
+         lowerLoop(loop->condition.get(), loop->body.get(), nullptr, false);
+         break;
+      }
+
+      case ExprType::ForStatement: {
+         auto *loop = static_cast<const ForStatementExpr *>(stmt);
+         lowerStatement(loop->initializer.get());
+         lowerLoop(loop->condition.get(), loop->body.get(), loop->increment.get(), true);
+         break;
+      }
+
+      case ExprType::ReturnStatement: {
+         auto *ret = static_cast<const ReturnStatementExpr *>(stmt);
+         if (state->function == &module->main()) {
+            if (ret->value) lowerExpression(ret->value.get());
+            IrInstr *error = create(IrOp::Error);
+            error->name = "'return' outside of a function";
+            append(error);
+            terminate(IrOp::Unreachable, {}, {});
+            break;
+         }
+         IrInstr *value = ret->value ? lowerExpression(ret->value.get()) : emitConstant(Value::null());
+         leaveTryRegions(0);
+         if (state->current) terminate(IrOp::Return, {value}, {});
+         break;
+      }
+
+      case ExprType::BreakStatement: {
+         if (state->loops.empty()) throw CompilerError("'break' outside of a loop or switch");
+         Loop loop = state->loops.back();
+         leaveTryRegions(loop.tryDepth);
+         jumpTo(loop.breakTarget);
+         break;
+      }
+
+      case ExprType::ContinueStatement: {
+         auto &loops = state->loops;
+         auto it = std::find_if(loops.rbegin(), loops.rend(), [](const Loop &l) { return l.continueTarget; });
+         if (it == loops.rend()) throw CompilerError("'continue' outside of a loop");
+         Loop loop = *it;
+         leaveTryRegions(loop.tryDepth);
+         jumpTo(loop.continueTarget);
+         break;
+      }
+
+      case ExprType::FunctionDeclaration:
+         lowerFunctionDeclaration(static_cast<const FunctionDeclarationExpr *>(stmt));
+         break;
+
+      case ExprType::SwitchStatement:
+         lowerSwitch(static_cast<const SwitchStatementExpr *>(stmt));
+         break;
+
+      case ExprType::TryCatchFinallyStatement:
+         lowerTry(static_cast<const TryCatchFinallyStatementExpr *>(stmt));
+         break;
+
+      default:
+         lowerExpression(stmt);
+         break;
+   }
+}
+
+IrInstr *IrBuilder::lowerExpression(const Expr *expr) {
+   switch (expr->type) {
+      case ExprType::Literal:
+         return emitConstant(literalValue(static_cast<const LiteralExpr *>(expr)->value));
+
+      case ExprType::Identifier: {
+         auto *identifier = static_cast<const IdentifierExpr *>(expr);
+         return loadVariable(identifier->slot, identifier->name);
+      }
+
+      case ExprType::Binary: {
+         auto *binary = static_cast<const BinaryExpr *>(expr);
+         if (binary->operation == BinaryOperator::And || binary->operation == BinaryOperator::Or) {
+            return lowerLogical(binary);
+         }
+         IrInstr *left = lowerExpression(binary->left.get());
+         IrInstr *right = lowerExpression(binary->right.get());
+         IrInstr *instr = create(IrOp::Binary, {left, right});
+         instr->binary = binary->operation;
+         return append(instr);
+      }
+
+      case ExprType::MatrixMultiplication: {
+         std::vector<const Expr *> chain;
+         collectMatrixChain(expr, chain);
+         std::vector<IrInstr *> operands;
+         for (const Expr *operand: chain) operands.push_back(lowerExpression(operand));
+         return append(create(operands.size() == 2 ? IrOp::MatMul : IrOp::MatChain, operands));
+      }
+
+      case ExprType::Unary: {
+         auto *unary = static_cast<const UnaryExpr *>(expr);
+         IrInstr *instr = create(IrOp::Unary, {lowerExpression(unary->right.get())});
+         instr->unary = unary->operation;
+         return append(instr);
+      }
+
+      case ExprType::Assignment: {
+         auto *assign = static_cast<const AssignmentExpr *>(expr);
+         IrInstr *value = lowerExpression(assign->value.get());
+         storeVariable(assign->slot, assign->name, value);
+         return value;
+      }
+
+      case ExprType::FunctionCall: {
+         auto *call = static_cast<const FunctionCallExpr *>(expr);
+         std::vector<IrInstr *> arguments;
+         for (const auto &arg: call->arguments) arguments.push_back(lowerExpression(arg.get()));
+         IrInstr *instr = create(IrOp::Call, arguments);
+         instr->name = call->callee;
+         return append(instr);
+      }
+
+      default:
+         lowerStatement(expr);
+         return undefinedValue();
+   }
+}
+
+// Branches to ifTrue or ifFalse on the truthiness of condition, without
+// materializing the results of &&, || and !.
+void IrBuilder::lowerBranch(const Expr *condition, IrBlock *ifTrue, IrBlock *ifFalse) {
+   if (!state->current) return;
+
+   if (condition->type == ExprType::Literal) {
+      bool truthy = literalValue(static_cast<const LiteralExpr *>(condition)->value).truthy();
+      jumpTo(truthy ? ifTrue : ifFalse);
+      return;
+   }
+   if (condition->type == ExprType::Unary) {
+      auto *unary = static_cast<const UnaryExpr *>(condition);
+      if (unary->operation == UnaryOperator::Not) {
+         lowerBranch(unary->right.get(), ifFalse, ifTrue);
+         return;
+      }
+   }
+   if (condition->type == ExprType::Binary) {
+      auto *binary = static_cast<const BinaryExpr *>(condition);
+      bool isAnd = binary->operation == BinaryOperator::And;
+      if (isAnd || binary->operation == BinaryOperator::Or) {
+         IrBlock *right = newBlock();
+         lowerBranch(binary->left.get(), isAnd ? right : ifTrue, isAnd ? ifFalse : right);
+         sealBlock(right);
+         startBlock(right);
+         lowerBranch(binary->right.get(), ifTrue, ifFalse);
+         return;
+      }
+   }
+   terminate(IrOp::Branch, {lowerExpression(condition)}, {ifTrue, ifFalse});
+}
+
+IrInstr *IrBuilder::lowerLogical(const BinaryExpr *binary) {
+   bool isAnd = binary->operation == BinaryOperator::And;
+   IrInstr *left = append(create(IrOp::Truthy, {lowerExpression(binary->left.get())}));
+   IrBlock *leftEnd = state->current;
+   IrBlock *rightBlock = newBlock();
+   IrBlock *join = newBlock();
+   terminate(IrOp::Branch, {left}, {isAnd ? rightBlock : join, isAnd ? join : rightBlock});
+
+   sealBlock(rightBlock);
+   startBlock(rightBlock);
+   IrInstr *right = append(create(IrOp::Truthy, {lowerExpression(binary->right.get())}));
+   IrBlock *rightEnd = state->current;
+   jumpTo(join);
+
+   sealBlock(join);
+   startBlock(join);
+   return joinValues(join, {{leftEnd, left}, {rightEnd, right}});
+}
+
+IrInstr *IrBuilder::loadVariable(const VariableSlot &slot, const std::string &name) {
+   switch (slot.kind) {
+      case VariableSlot::Kind::Local:
+         return readVariable(slot.index, state->current);
+      case VariableSlot::Kind::Global: {
+         IrInstr *load = create(IrOp::LoadGlobal);
+         load->index = slot.index;
+         load->name = name;
+         return append(load);
+      }
+      default: {
+         IrInstr *error = create(IrOp::Error);
+         error->name = "Undefined variable '" + name + "'";
+         return append(error);
+      }
+   }
+}
+
+void IrBuilder::storeVariable(const VariableSlot &slot, const std::string &name, IrInstr *value) {
+   switch (slot.kind) {
+      case VariableSlot::Kind::Local:
+         writeVariable(slot.index, state->current, value);
+         break;
+      case VariableSlot::Kind::Global: {
+         IrInstr *store = create(IrOp::StoreGlobal, {value});
+         store->index = slot.index;
+         store->name = name;
+         append(store);
+         break;
+      }
+      default: {
+         IrInstr *error = create(IrOp::Error);
+         error->name = "Undefined variable '" + name + "'";
+         append(error);
+         break;
+      }
+   }
+}
+
+// A while or for loop is rotated: a guard tests the condition once, and the
+// test is repeated at the bottom, so the body is the loop header and runs at
+// least once whenever the preheader is reached.
+void IrBuilder::lowerLoop(const Expr *condition, const Expr *body, const Expr *increment, bool testFirst) {
+   IrBlock *bodyBlock = newBlock();
+   IrBlock *exit = newBlock();
+
+   if (testFirst) {
+      IrBlock *preheader = newBlock();
+      IrBlock *continueTarget = newBlock();
+      if (condition) lowerBranch(condition, preheader, exit);
+      else jumpTo(preheader);
+      sealBlock(preheader);
+      startBlock(preheader);
+      jumpTo(bodyBlock);
+
+      state->loops.push_back(Loop{exit, continueTarget, state->tries.size()});
+      startBlock(bodyBlock);
+      lowerStatement(body);
+      jumpTo(continueTarget);
+      state->loops.pop_back();
+
+      sealBlock(continueTarget);
+      startBlock(continueTarget);
+      lowerStatement(increment);
+      if (condition) lowerBranch(condition, bodyBlock, exit);
+      else jumpTo(bodyBlock);
+      sealBlock(bodyBlock);
+   } else {
+      IrBlock *conditionBlock = newBlock();
+      jumpTo(bodyBlock);
+
+      state->loops.push_back(Loop{exit, conditionBlock, state->tries.size()});
+      startBlock(bodyBlock);
+      lowerStatement(body);
+      jumpTo(conditionBlock);
+      state->loops.pop_back();
+
+      sealBlock(conditionBlock);
+      startBlock(conditionBlock);
+      lowerBranch(condition, bodyBlock, exit);
+      sealBlock(bodyBlock);
+   }
+
+   sealBlock(exit);
+   startBlock(exit);
+}
+
+// Runs of literal cases become one Switch terminator; the remaining cases are
+// compared in order. Case bodies do not fall through.
+void IrBuilder::lowerSwitch(const SwitchStatementExpr *stmt) {
+   IrInstr *subject = lowerExpression(stmt->switchExpr.get());
+   size_t count = stmt->caseClauses.size();
+   std::vector<IrBlock *> bodies;
+   for (size_t i = 0; i < count; ++i) bodies.push_back(newBlock());
+   IrBlock *defaultBlock = newBlock();
+   IrBlock *exit = newBlock();
+
+   std::vector<SwitchStep> steps = planSwitch(*stmt);
+   for (size_t k = 0; k < steps.size(); ++k) {
+      SwitchStep &step = steps[k];
+      IrBlock *next = newBlock();
+      if (step.table) {
+         size_t end = k + 1 < steps.size() ? steps[k + 1].firstCase : count;
+         std::vector<IrBlock *> successors{next};
+         for (size_t i = step.firstCase; i < end; ++i) successors.push_back(bodies[i]);
+         auto first = static_cast<int>(step.firstCase);
+         step.table->mapTargets([&](int target) { return target - first + 1; });
+         IrInstr *dispatch = terminate(IrOp::Switch, {resolveReplaced(subject)}, std::move(successors));
+         dispatch->table = std::move(step.table);
+      } else {
+         auto *clause = static_cast<const CaseClauseExpr *>(stmt->caseClauses[step.firstCase].get());
+         IrInstr *value = lowerExpression(clause->caseExpr.get());
+         IrInstr *equal = create(IrOp::Binary, {resolveReplaced(subject), value});
+         equal->binary = BinaryOperator::Equal;
+         terminate(IrOp::Branch, {append(equal)}, {bodies[step.firstCase], next});
+      }
+      sealBlock(next);
+      startBlock(next);
+   }
+   jumpTo(defaultBlock);
+
+   state->loops.push_back(Loop{exit, nullptr, state->tries.size()});
+   for (size_t i = 0; i < count; ++i) {
+      sealBlock(bodies[i]);
+      startBlock(bodies[i]);
+      lowerStatement(static_cast<const CaseClauseExpr *>(stmt->caseClauses[i].get())->body.get());
+      jumpTo(exit);
+   }
+   sealBlock(defaultBlock);
+   startBlock(defaultBlock);
+   lowerStatement(stmt->defaultClause.get());
+   jumpTo(exit);
+   state->loops.pop_back();
+
+   sealBlock(exit);
+   startBlock(exit);
+}
+
+// Only the first catch clause is used, as in the BytecodeCompiler.
+void IrBuilder::lowerTry(const TryCatchFinallyStatementExpr *stmt) {
+   const Expr *finallyBlock = stmt->finallyBlock.get();
+   auto *clause = stmt->catches.empty() ? nullptr : static_cast<const CatchClauseExpr *>(stmt->catches.front().get());
+   IrBlock *handler = newBlock();
+   IrBlock *after = newBlock();
+
+   // Code before the try may raise without reaching the handler, so the
+   // protected code starts a block of its own.
+   if (state->current && std::any_of(state->current->instructions.begin(), state->current->instructions.end(),
+                                     [](const IrInstr *instr) { return instr->mayThrow(); })) {
+      IrBlock *body = newBlock();
+      jumpTo(body);
+      sealBlock(body);
+      startBlock(body);
+   }
+   state->tries.push_back(TryRegion{finallyBlock, handler});
+   lowerStatement(stmt->tryBlock.get());
+   state->tries.pop_back();
+   jumpTo(after);
+
+   sealBlock(handler);
+   startBlock(handler);
+   if (state->current) {
+      IrInstr *exception = append(create(IrOp::Catch));
+      if (clause) {
+         IrBlock *rethrow = finallyBlock ? newBlock() : nullptr;
+         if (rethrow) state->tries.push_back(TryRegion{finallyBlock, rethrow});
+         storeVariable(clause->slot, clause->exceptionVarName, exception);
+         lowerStatement(clause->block.get());
+         if (rethrow) state->tries.pop_back();
+         jumpTo(after);
+
+         if (rethrow) {
+            sealBlock(rethrow);
+            startBlock(rethrow);
+            if (state->current) lowerRethrowingFinally(finallyBlock, append(create(IrOp::Catch)));
+         }
+      } else {
+         lowerRethrowingFinally(finallyBlock, exception);
+      }
+   }
+
+   sealBlock(after);
+   startBlock(after);
+   lowerStatement(finallyBlock);
+}
+
+void IrBuilder::lowerRethrowingFinally(const Expr *finallyBlock, IrInstr *exception) {
+   state->tries.push_back(TryRegion{nullptr, nullptr});
+   lowerStatement(finallyBlock);
+   state->tries.pop_back();
+   if (state->current) terminate(IrOp::Rethrow, {exception}, {});
+}
+
+// Lowers the finally bodies of every try region above `depth`, innermost
+// first, for a jump that leaves them.
+void IrBuilder::leaveTryRegions(size_t depth) {
+   std::vector<TryRegion> saved = state->tries;
+   for (size_t i = saved.size(); i-- > depth && state->current;) {
+      if (!saved[i].finallyBlock) continue;
+      state->tries.resize(i);
+      lowerStatement(saved[i].finallyBlock);
+   }
+   state->tries = std::move(saved);
+}
+
+void IrBuilder::lowerFunctionDeclaration(const FunctionDeclarationExpr *function) {
+   auto built = std::make_unique<IrFunction>();
+   built->name = function->name;
+   IrFunction &nested = *built;
+   module->functions.push_back(std::move(built));
+   buildFunction(nested, function->body.get(), static_cast<int>(function->params.size()));
+
+   IrInstr *define = create(IrOp::DefineFunction);
+   define->name = function->name;
+   define->function = &nested;
+   append(define);
+}
+
+#pragma clang diagnostic pop
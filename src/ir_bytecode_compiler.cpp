@@ -0,0 +1,489 @@
+#include <algorithm>
+
+#include "ir_bytecode_compiler.h"
+#include "error.h"
+
+static OpCode binaryOpcode(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return OpCode::ADD;
+      case BinaryOperator::Subtract:
+         return OpCode::SUB;
+      case BinaryOperator::Multiply:
+         return OpCode::MUL;
+      case BinaryOperator::Divide:
+         return OpCode::DIV;
+      case BinaryOperator::Equal:
+         return OpCode::EQ;
+      case BinaryOperator::NotEqual:
+         return OpCode::NE;
+      case BinaryOperator::Less:
+         return OpCode::LT;
+      case BinaryOperator::LessEqual:
+         return OpCode::LE;
+      case BinaryOperator::Greater:
+         return OpCode::GT;
+      case BinaryOperator::GreaterEqual:
+         return OpCode::GE;
+      default:
+         throw CompilerError(std::string("Unsupported binary operator '") + operatorLexeme(op) + "'");
+   }
+}
+
+static OpCode unaryOpcode(UnaryOperator op) {
+   switch (op) {
+      case UnaryOperator::Plus:
+         return OpCode::PLUS;
+      case UnaryOperator::Negate:
+         return OpCode::NEG;
+      case UnaryOperator::Not:
+         return OpCode::NOT;
+      case UnaryOperator::BitwiseNot:
+         return OpCode::BNOT;
+      default:
+         throw CompilerError("Unsupported unary operator");
+   }
+}
+
+// Opcode of the compare-and-branch superinstruction for a comparison, or MOVE
+// when the operator is not a comparison.
+static OpCode branchOpcode(BinaryOperator op, bool constantOperand) {
+   switch (op) {
+      case BinaryOperator::Less:
+         return constantOperand ? OpCode::IFLT_CONST : OpCode::IFLT;
+      case BinaryOperator::LessEqual:
+         return constantOperand ? OpCode::IFLE_CONST : OpCode::IFLE;
+      case BinaryOperator::Greater:
+         return constantOperand ? OpCode::IFGT_CONST : OpCode::IFGT;
+      case BinaryOperator::GreaterEqual:
+         return constantOperand ? OpCode::IFGE_CONST : OpCode::IFGE;
+      case BinaryOperator::Equal:
+         return constantOperand ? OpCode::IFEQ_CONST : OpCode::IFEQ;
+      case BinaryOperator::NotEqual:
+         return constantOperand ? OpCode::IFNE_CONST : OpCode::IFNE;
+      default:
+         return OpCode::MOVE;
+   }
+}
+
+static bool fitsSC(const Value &value) {
+   return value.isInt() && value.asInt() >= -SC_BIAS && value.asInt() <= 0xff - SC_BIAS;
+}
+
+static bool fitsSBx(const Value &value) {
+   return value.isInt() && value.asInt() >= -SBX_BIAS && value.asInt() <= MAX_BX - SBX_BIAS;
+}
+
+// A comparison whose only use is the branch right after it, which then
+// compares by itself.
+static bool fusesWithBranch(const IrInstr *instr) {
+   if (instr->op != IrOp::Binary || branchOpcode(instr->binary, false) == OpCode::MOVE ||
+       instr->users.size() != 1) {
+      return false;
+   }
+   const IrInstr *user = instr->users.front();
+   const auto &code = instr->block->instructions;
+   return user->op == IrOp::Branch && user->block == instr->block && code[code.size() - 2] == instr;
+}
+
+// Whether user takes its operand i, a constant, without a register: as an
+// instruction operand, or loaded straight into a phi or an argument.
+static bool immediateOperand(const IrInstr *user, size_t i) {
+   const IrInstr *operand = user->operands[i];
+   if (operand->op != IrOp::Const) return false;
+   switch (user->op) {
+      case IrOp::Phi:
+      case IrOp::Call:
+      case IrOp::MatChain:
+         return true;
+      case IrOp::Binary:
+         if (i != 1) return false;
+         if (user->binary == BinaryOperator::Add || user->binary == BinaryOperator::Subtract) {
+            return fitsSC(operand->constant);
+         }
+         return fusesWithBranch(user) && fitsSBx(operand->constant);
+      default:
+         return false;
+   }
+}
+
+static Instruction withOffset(Instruction jump, std::ptrdiff_t offset, const std::string &function) {
+   if (offset < -SBX_BIAS || offset > MAX_BX - SBX_BIAS) {
+      throw CompilerError("Jump too large in function '" + function + "'");
+   }
+   return encodeAsBx(opcodeOf(jump), argA(jump), static_cast<int>(offset));
+}
+
+std::unique_ptr<Program> IrBytecodeCompiler::compile(IrModule &module) {
+   auto result = std::make_unique<Program>();
+   for (const auto &function: module.functions) {
+      auto proto = std::make_unique<FunctionProto>();
+      proto->name = function->name;
+      proto->arity = function->arity;
+      protos[function.get()] = proto.get();
+      result->functions.push_back(std::move(proto));
+   }
+   script = &module.main();
+   for (const auto &function: module.functions) compileFunction(*function, *protos[function.get()]);
+   protos.clear();
+   script = nullptr;
+   return result;
+}
+
+void IrBytecodeCompiler::compileFunction(IrFunction &function, FunctionProto &proto) {
+   FunctionState state;
+   state.function = &function;
+   state.proto = &proto;
+   current = &state;
+
+   function.renumber();
+   int window = 1;
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         if (instr->op == IrOp::Catch) {
+            throw CompilerError("Function '" + function.name + "' handles exceptions, which the IR bytecode "
+                                "compiler does not support");
+         }
+         if (instr->op == IrOp::Call || instr->op == IrOp::MatChain) {
+            window = std::max(window, static_cast<int>(instr->operands.size()));
+         }
+         if (instr->id >= 0) {
+            if (state.values.size() <= static_cast<size_t>(instr->id)) state.values.resize(instr->id + 1);
+            state.values[instr->id] = instr;
+         }
+      }
+      for (const IrInstr *phi: block->phis) {
+         if (state.values.size() <= static_cast<size_t>(phi->id)) state.values.resize(phi->id + 1);
+         state.values[phi->id] = phi;
+      }
+   }
+   if (window >= MAX_REGISTERS || function.arity > MAX_REGISTERS) {
+      throw CompilerError("Function '" + function.name + "' needs more than " + std::to_string(MAX_REGISTERS) +
+                          " registers");
+   }
+
+   state.liveness = std::make_unique<Liveness>(function);
+   state.allocator = std::make_unique<RegisterAllocator>(
+           function, *state.liveness, [this](const IrInstr *value) { return needsRegister(value); },
+           MAX_REGISTERS - window);
+   state.window = state.allocator->count();
+   proto.registerCount = std::max(function.arity, state.window + window);
+
+   state.labels.assign(function.blocks.size(), 0);
+   for (size_t i = 0; i < function.blocks.size(); ++i) {
+      const IrBlock *block = function.blocks[i].get();
+      const IrBlock *next = i + 1 < function.blocks.size() ? function.blocks[i + 1].get() : nullptr;
+      state.labels[i] = proto.code.size();
+      const auto &code = block->instructions;
+      for (size_t k = 0; k + 1 < code.size(); ++k) emitInstruction(code[k]);
+      emitTerminator(block, next);
+   }
+   for (const EdgeStub &stub: state.stubs) {
+      state.labels[stub.label] = proto.code.size();
+      emitMoves(edgeMoves(stub.from, stub.to));
+      emitJump(stub.to->id);
+   }
+   patch();
+   current = nullptr;
+}
+
+bool IrBytecodeCompiler::needsRegister(const IrInstr *value) const {
+   if (!producesValue(value->op) || value->users.empty() || fusesWithBranch(value)) return false;
+   if (value->op != IrOp::Const) return true;
+   for (const IrInstr *user: value->users) {
+      for (size_t i = 0; i < user->operands.size(); ++i) {
+         if (user->operands[i] == value && !immediateOperand(user, i)) return true;
+      }
+   }
+   return false;
+}
+
+int IrBytecodeCompiler::reg(const IrInstr *value) const {
+   return current->allocator->registerOf(value);
+}
+
+size_t IrBytecodeCompiler::emit(Instruction instruction) {
+   current->proto->code.push_back(instruction);
+   return current->proto->code.size() - 1;
+}
+
+void IrBytecodeCompiler::emitJump(int label, OpCode op, int a) {
+   current->jumps.emplace_back(emit(encodeAsBx(op, a, 0)), label);
+}
+
+int IrBytecodeCompiler::constant(const Value &value) {
+   std::string key = value.isString() ? "s" + value.toString() : std::to_string(value.raw());
+   auto it = current->constantIndex.find(key);
+   if (it != current->constantIndex.end()) return it->second;
+
+   auto &constants = current->proto->constants;
+   if (constants.size() > MAX_BX) {
+      throw CompilerError("Too many constants in function '" + current->proto->name + "'");
+   }
+   constants.push_back(value);
+   int index = static_cast<int>(constants.size() - 1);
+   current->constantIndex.emplace(std::move(key), index);
+   return index;
+}
+
+void IrBytecodeCompiler::emitLoad(int target, const Value &value) {
+   if (fitsSBx(value)) emit(encodeAsBx(OpCode::LOADINT, target, value.asInt()));
+   else if (value.isBool()) emit(encodeABC(OpCode::LOADBOOL, target, value.asBool() ? 1 : 0));
+   else if (value.isNull()) emit(encodeABC(OpCode::LOADNULL, target));
+   else emit(encodeABx(OpCode::LOADK, target, constant(value)));
+}
+
+// A call whose result the function returns right away reuses the frame.
+bool IrBytecodeCompiler::isTailCall(const IrInstr *instr) const {
+   if (instr->op != IrOp::Call || current->function == script || instr->users.size() != 1) return false;
+   const IrInstr *user = instr->users.front();
+   const auto &code = instr->block->instructions;
+   return user->op == IrOp::Return && user->block == instr->block && code[code.size() - 2] == instr;
+}
+
+void IrBytecodeCompiler::emitArguments(const IrInstr *instr) {
+   for (size_t k = 0; k < instr->operands.size(); ++k) {
+      const IrInstr *operand = instr->operands[k];
+      int target = current->window + static_cast<int>(k);
+      if (reg(operand) >= 0) emit(encodeABC(OpCode::MOVE, target, reg(operand)));
+      else emitLoad(target, operand->constant);
+   }
+}
+
+void IrBytecodeCompiler::emitInstruction(const IrInstr *instr) {
+   int target = reg(instr);
+   // A result nobody reads still has to be computed if computing it may raise.
+   int result = target >= 0 ? target : current->window;
+   switch (instr->op) {
+      case IrOp::Const:
+         if (target >= 0) emitLoad(target, instr->constant);
+         break;
+      case IrOp::Param:
+      case IrOp::Phi:
+         break;
+      case IrOp::LoadGlobal:
+         if (target >= 0) emit(encodeABx(OpCode::GETGLOBAL, target, instr->index));
+         break;
+      case IrOp::StoreGlobal:
+         emit(encodeABx(OpCode::SETGLOBAL, reg(instr->operands[0]), instr->index));
+         break;
+      case IrOp::Binary: {
+         if (fusesWithBranch(instr) || (target < 0 && !instr->mayThrow())) break;
+         BinaryOperator op = instr->binary;
+         int left = reg(instr->operands[0]);
+         if ((op == BinaryOperator::Add || op == BinaryOperator::Subtract) && immediateOperand(instr, 1)) {
+            emit(encodeABC(op == BinaryOperator::Add ? OpCode::ADD_CONST : OpCode::SUB_CONST, result, left,
+                           instr->operands[1]->constant.asInt() + SC_BIAS));
+         } else {
+            emit(encodeABC(binaryOpcode(op), result, left, reg(instr->operands[1])));
+         }
+         break;
+      }
+      case IrOp::Unary:
+         if (target >= 0 || instr->mayThrow()) {
+            emit(encodeABC(unaryOpcode(instr->unary), result, reg(instr->operands[0])));
+         }
+         break;
+      case IrOp::Truthy:
+         if (target >= 0) emit(encodeABC(OpCode::TRUTHY, target, reg(instr->operands[0])));
+         break;
+      case IrOp::MatMul:
+         emit(encodeABC(OpCode::MATMUL, result, reg(instr->operands[0]), reg(instr->operands[1])));
+         break;
+      case IrOp::MatChain:
+         emitArguments(instr);
+         emit(encodeABC(OpCode::MATCHAIN, result, current->window, static_cast<int>(instr->operands.size())));
+         break;
+      case IrOp::Call: {
+         emitArguments(instr);
+         auto &sites = current->proto->callSites;
+         if (sites.size() > MAX_BX) {
+            throw CompilerError("Too many call sites in function '" + current->proto->name + "'");
+         }
+         sites.push_back(CallSite{instr->name, static_cast<int>(instr->operands.size())});
+         bool tail = isTailCall(instr);
+         emit(encodeABx(tail ? OpCode::TAILCALL : OpCode::CALL, current->window, static_cast<int>(sites.size() - 1)));
+         if (!tail && target >= 0) emit(encodeABC(OpCode::MOVE, target, current->window));
+         break;
+      }
+      case IrOp::DefineFunction: {
+         FunctionProto *nested = protos.at(instr->function);
+         auto &functions = current->proto->nestedFunctions;
+         auto [it, added] = current->nestedIndex.emplace(nested, static_cast<int>(functions.size()));
+         if (added) {
+            if (functions.size() > MAX_BX) {
+               throw CompilerError("Too many functions declared in '" + current->proto->name + "'");
+            }
+            functions.push_back(nested);
+         }
+         emit(encodeABx(OpCode::DEFFN, 0, it->second));
+         break;
+      }
+      case IrOp::Error:
+         emit(encodeABx(OpCode::ERROR, 0, constant(Value::string(instr->name))));
+         break;
+      default:
+         throw CompilerError(std::string("The IR bytecode compiler does not support '") + irOpName(instr->op) + "'");
+   }
+}
+
+std::vector<IrBytecodeCompiler::Move> IrBytecodeCompiler::edgeMoves(const IrBlock *from, const IrBlock *to) const {
+   std::vector<Move> moves;
+   size_t index = to->predecessorIndex(from);
+   for (const IrInstr *phi: to->phis) {
+      int target = reg(phi);
+      const IrInstr *operand = phi->operands[index];
+      int source = reg(operand);
+      if (target < 0 || source == target) continue;
+      moves.push_back(Move{target, source, source < 0 ? operand : nullptr});
+   }
+   return moves;
+}
+
+// Sequentializes a parallel copy. Registers are moved first, each once
+// nothing still needs its old value, breaking cycles through the scratch
+// register; constants are loaded last since they read no register.
+void IrBytecodeCompiler::emitMoves(std::vector<Move> moves) {
+   std::vector<Move> pending;
+   std::vector<Move> loads;
+   for (const Move &move: moves) (move.source < 0 ? loads : pending).push_back(move);
+
+   int scratch = current->window;
+   while (!pending.empty()) {
+      auto ready = std::find_if(pending.begin(), pending.end(), [&](const Move &move) {
+          return std::none_of(pending.begin(), pending.end(), [&](const Move &other) {
+              return other.source == move.target;
+          });
+      });
+      if (ready == pending.end()) {
+         int saved = pending.front().target;
+         emit(encodeABC(OpCode::MOVE, scratch, saved));
+         for (Move &move: pending) {
+            if (move.source == saved) move.source = scratch;
+         }
+         continue;
+      }
+      emit(encodeABC(OpCode::MOVE, ready->target, ready->source));
+      pending.erase(ready);
+   }
+   for (const Move &move: loads) emitLoad(move.target, move.constant->constant);
+}
+
+int IrBytecodeCompiler::edgeLabel(const IrBlock *from, const IrBlock *to) {
+   for (const EdgeStub &stub: current->stubs) {
+      if (stub.from == from && stub.to == to) return stub.label;
+   }
+   int label = static_cast<int>(current->labels.size());
+   current->labels.push_back(0);
+   current->stubs.push_back(EdgeStub{label, from, to});
+   return label;
+}
+
+void IrBytecodeCompiler::emitTerminator(const IrBlock *block, const IrBlock *next) {
+   const IrInstr *terminator = block->terminator();
+   switch (terminator->op) {
+      case IrOp::Return:
+         if (!isTailCall(terminator->operands[0])) emit(encodeABC(OpCode::RETURN, reg(terminator->operands[0])));
+         break;
+      case IrOp::Unreachable:
+         break;
+      case IrOp::Jump:
+         emitMoves(edgeMoves(block, block->successors[0]));
+         if (block->successors[0] != next) emitJump(block->successors[0]->id);
+         break;
+      case IrOp::Branch:
+      case IrOp::Switch: {
+         const auto &successors = block->successors;
+         std::vector<std::vector<Move>> moves;
+         for (const IrBlock *successor: successors) moves.push_back(edgeMoves(block, successor));
+
+         // The copies into one successor can run before a branch when they
+         // overwrite nothing the branch reads or the other successor needs.
+         int early = -1;
+         if (terminator->op == IrOp::Branch && moves[0].empty() != moves[1].empty()) {
+            int taken = moves[0].empty() ? 1 : 0;
+            const IrBlock *other = successors[1 - taken];
+            std::vector<int> kept;
+            const IrInstr *condition = terminator->operands[0];
+            if (fusesWithBranch(condition)) {
+               for (const IrInstr *operand: condition->operands) kept.push_back(reg(operand));
+            } else {
+               kept.push_back(reg(condition));
+            }
+            current->liveness->liveIn(other).forEach([&](size_t id) { kept.push_back(reg(current->values[id])); });
+            size_t index = other->predecessorIndex(block);
+            for (const IrInstr *phi: other->phis) kept.push_back(reg(phi->operands[index]));
+            bool safe = std::none_of(moves[taken].begin(), moves[taken].end(), [&](const Move &move) {
+                return std::find(kept.begin(), kept.end(), move.target) != kept.end();
+            });
+            if (safe) {
+               early = taken;
+               emitMoves(moves[taken]);
+            }
+         }
+
+         std::vector<int> targets;
+         for (size_t i = 0; i < successors.size(); ++i) {
+            bool direct = moves[i].empty() || static_cast<int>(i) == early;
+            targets.push_back(direct ? successors[i]->id : edgeLabel(block, successors[i]));
+         }
+         int fallthrough = next ? next->id : -1;
+         if (terminator->op == IrOp::Branch) {
+            emitBranch(terminator, targets, fallthrough);
+            break;
+         }
+         auto &tables = current->proto->switchTables;
+         if (tables.size() > MAX_BX) {
+            throw CompilerError("Too many switch tables in function '" + current->proto->name + "'");
+         }
+         tables.push_back(*terminator->table);
+         size_t at = emit(encodeABx(OpCode::SWITCH, reg(terminator->operands[0]), static_cast<int>(tables.size() - 1)));
+         current->switches.emplace_back(at, targets);
+         if (targets[0] != fallthrough) emitJump(targets[0]);
+         break;
+      }
+      default:
+         throw CompilerError(std::string("The IR bytecode compiler does not support '") +
+                             irOpName(terminator->op) + "'");
+   }
+}
+
+void IrBytecodeCompiler::emitBranch(const IrInstr *branch, const std::vector<int> &targets, int fallthrough) {
+   const IrInstr *condition = branch->operands[0];
+   if (fusesWithBranch(condition)) {
+      bool immediate = immediateOperand(condition, 1);
+      OpCode op = branchOpcode(condition->binary, immediate);
+      int left = reg(condition->operands[0]);
+      emit(immediate ? encodeAsBx(op, left, condition->operands[1]->constant.asInt())
+                     : encodeABC(op, left, reg(condition->operands[1])));
+      emitJump(targets[1]);
+      if (targets[0] != fallthrough) emitJump(targets[0]);
+      return;
+   }
+   int tested = reg(condition);
+   if (targets[0] == fallthrough) {
+      emitJump(targets[1], OpCode::JMPF, tested);
+   } else if (targets[1] == fallthrough) {
+      emitJump(targets[0], OpCode::JMPT, tested);
+   } else {
+      emitJump(targets[1], OpCode::JMPF, tested);
+      emitJump(targets[0]);
+   }
+}
+
+void IrBytecodeCompiler::patch() {
+   auto &code = current->proto->code;
+   for (const auto &[at, label]: current->jumps) {
+      auto offset = static_cast<std::ptrdiff_t>(current->labels[label]) - static_cast<std::ptrdiff_t>(at + 1);
+      code[at] = withOffset(code[at], offset, current->proto->name);
+   }
+   for (const auto &[at, targets]: current->switches) {
+      SwitchTable &table = current->proto->switchTables[argBx(code[at])];
+      table.mapTargets([&](int successor) {
+          auto offset = static_cast<std::ptrdiff_t>(current->labels[targets[successor]]) -
+                        static_cast<std::ptrdiff_t>(at + 1);
+          if (offset > MAX_BX - SBX_BIAS) throw CompilerError("Jump too large in function '" + current->proto->name + "'");
+          return static_cast<int>(offset);
+      });
+   }
+}
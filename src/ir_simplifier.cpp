@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "ir_simplifier.h"
+#include "error.h"
+
+int IrSimplifier::simplify(IrFunction &function) {
+   int before = changes;
+   for (bool changed = true; changed;) {
+      changed = foldConstants(function);
+      changed |= foldBranches(function);
+      changed |= removeTrivialPhis(function);
+      changed |= removeDeadCode(function);
+      changed |= mergeBlocks(function);
+      function.compactBlocks();
+   }
+   return changes - before;
+}
+
+int IrSimplifier::simplify(IrModule &module) {
+   int total = 0;
+   for (const auto &function: module.functions) total += simplify(*function);
+   return total;
+}
+
+static void makeConstant(IrInstr *instr, Value value) {
+   instr->clearOperands();
+   instr->op = IrOp::Const;
+   instr->constant = std::move(value);
+   instr->binary = BinaryOperator::Unknown;
+   instr->unary = UnaryOperator::Unknown;
+}
+
+bool IrSimplifier::foldConstants(IrFunction &function) {
+   bool changed = false;
+   for (const auto &block: function.blocks) {
+      for (IrInstr *instr: block->instructions) {
+         bool folds = instr->op == IrOp::Binary || instr->op == IrOp::Unary || instr->op == IrOp::Truthy;
+         if (!folds || !std::all_of(instr->operands.begin(), instr->operands.end(),
+                                    [](const IrInstr *operand) { return operand->op == IrOp::Const; })) {
+            continue;
+         }
+         try {
+            const Value &first = instr->operands[0]->constant;
+            switch (instr->op) {
+               case IrOp::Binary:
+                  makeConstant(instr, applyBinary(instr->binary, first, instr->operands[1]->constant));
+                  break;
+               case IrOp::Unary:
+                  makeConstant(instr, applyUnary(instr->unary, first));
+                  break;
+               default:
+                  makeConstant(instr, Value::boolean(first.truthy()));
+                  break;
+            }
+            changed = true;
+            changes++;
+         } catch (const RuntimeError &) {
+            // Left to raise when it runs.
+         }
+      }
+   }
+   return changed;
+}
+
+// Replaces block's terminator with a jump to successor `keep`, dropping the
+// other edges.
+static void jumpToSuccessor(IrBlock *block, size_t keep) {
+   IrBlock *target = block->successors[keep];
+   for (size_t i = 0; i < block->successors.size(); ++i) {
+      if (i == keep) continue;
+      IrBlock *dropped = block->successors[i];
+      dropped->removePredecessor(dropped->predecessorIndex(block));
+   }
+   IrInstr *terminator = block->terminator();
+   terminator->clearOperands();
+   terminator->op = IrOp::Jump;
+   terminator->table.reset();
+   block->successors = {target};
+}
+
+bool IrSimplifier::foldBranches(IrFunction &function) {
+   bool changed = false;
+   for (const auto &block: function.blocks) {
+      IrInstr *terminator = block->terminator();
+      if (terminator->op == IrOp::Branch) {
+         const IrInstr *condition = terminator->operands[0];
+         if (condition->op == IrOp::Const) {
+            jumpToSuccessor(block.get(), condition->constant.truthy() ? 0 : 1);
+         } else if (block->successors[0] == block->successors[1]) {
+            jumpToSuccessor(block.get(), 0);
+         } else {
+            continue;
+         }
+      } else if (terminator->op == IrOp::Switch && terminator->operands[0]->op == IrOp::Const) {
+         int target = terminator->table->lookup(terminator->operands[0]->constant);
+         jumpToSuccessor(block.get(), target == SwitchTable::NO_MATCH ? 0 : static_cast<size_t>(target));
+      } else {
+         continue;
+      }
+      changed = true;
+      changes++;
+   }
+   return changed;
+}
+
+bool IrSimplifier::removeTrivialPhis(IrFunction &function) {
+   bool changed = false;
+   for (bool again = true; again;) {
+      again = false;
+      for (const auto &block: function.blocks) {
+         auto &phis = block->phis;
+         for (size_t i = 0; i < phis.size();) {
+            IrInstr *phi = phis[i];
+            IrInstr *same = nullptr;
+            bool trivial = true;
+            for (IrInstr *operand: phi->operands) {
+               if (operand == phi || operand == same) continue;
+               if (same) trivial = false;
+               same = operand;
+            }
+            if (!trivial || !same) {
+               ++i;
+               continue;
+            }
+            phi->clearOperands();
+            phi->replaceAllUsesWith(same);
+            phi->block = nullptr;
+            phis.erase(phis.begin() + static_cast<std::ptrdiff_t>(i));
+            again = changed = true;
+            changes++;
+         }
+      }
+   }
+   return changed;
+}
+
+// Mark and sweep from the instructions kept for their effects, so dead
+// cycles of phis go too.
+bool IrSimplifier::removeDeadCode(IrFunction &function) {
+   std::vector<IrInstr *> work;
+   std::vector<bool> live(function.values.size(), false);
+   std::unordered_map<const IrInstr *, size_t> index;
+   for (size_t i = 0; i < function.values.size(); ++i) index.emplace(function.values[i].get(), i);
+   auto mark = [&](IrInstr *instr) {
+       size_t i = index.at(instr);
+       if (!live[i]) {
+          live[i] = true;
+          work.push_back(instr);
+       }
+   };
+   for (const auto &block: function.blocks) {
+      for (IrInstr *instr: block->instructions) {
+         if (instr->hasSideEffects()) mark(instr);
+      }
+   }
+   while (!work.empty()) {
+      IrInstr *instr = work.back();
+      work.pop_back();
+      for (IrInstr *operand: instr->operands) mark(operand);
+   }
+
+   bool changed = false;
+   auto dead = [&](IrInstr *instr) { return !live[index.at(instr)]; };
+   for (const auto &block: function.blocks) {
+      for (IrInstr *phi: block->phis) {
+         if (dead(phi)) phi->clearOperands();
+      }
+      for (IrInstr *instr: block->instructions) {
+         if (dead(instr)) instr->clearOperands();
+      }
+   }
+   for (const auto &block: function.blocks) {
+      auto sweep = [&](std::vector<IrInstr *> &list) {
+          auto end = std::remove_if(list.begin(), list.end(), [&](IrInstr *instr) {
+              if (!dead(instr)) return false;
+              instr->block = nullptr;
+              changed = true;
+              changes++;
+              return true;
+          });
+          list.erase(end, list.end());
+      };
+      sweep(block->phis);
+      sweep(block->instructions);
+   }
+   return changed;
+}
+
+bool IrSimplifier::mergeBlocks(IrFunction &function) {
+   bool changed = false;
+   for (const auto &owned: function.blocks) {
+      IrBlock *block = owned.get();
+      for (;;) {
+         IrInstr *terminator = block->terminator();
+         if (!terminator || terminator->op != IrOp::Jump || block->handler) break;
+         IrBlock *next = block->successors[0];
+         if (next == block || next == function.entry() || next->predecessors.size() != 1) break;
+
+         for (IrInstr *phi: next->phis) {
+            IrInstr *value = phi->operands[0];
+            phi->clearOperands();
+            phi->replaceAllUsesWith(value);
+            phi->block = nullptr;
+         }
+         next->phis.clear();
+         terminator->block = nullptr;
+         block->instructions.pop_back();
+         for (IrInstr *instr: next->instructions) {
+            instr->block = block;
+            block->instructions.push_back(instr);
+         }
+         next->instructions.clear();
+         block->successors = std::move(next->successors);
+         block->handler = next->handler;
+         block->forEachSuccessor([&](IrBlock *successor) {
+             std::replace(successor->predecessors.begin(), successor->predecessors.end(), next, block);
+         });
+         next->successors.clear();
+         next->handler = nullptr;
+         next->predecessors.clear();
+         changed = true;
+      }
+   }
+   return changed;
+}
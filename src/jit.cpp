@@ -0,0 +1,801 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef COMPILER_JIT_AVAILABLE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Value's NaN-boxing (see value.h), which the templates test and build.
+constexpr std::uint64_t BOXED = 0x7FFC000000000000;
+constexpr std::uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+constexpr std::uint64_t SIGN_BIT = 0x8000000000000000;
+constexpr std::int32_t INT_TAG16 = 0x7FFD;    // top 16 bits of an int
+constexpr std::int32_t OBJECT_TAG16 = 0xFFFC; // top 16 bits of an object
+
+std::uint64_t bitsOf(const Value &value) {
+   std::uint64_t bits;
+   std::memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+enum Cond { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_P = 0xa, CC_NP = 0xb,
+            CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf };
+
+// Opcodes of the two-operand ALU instructions, r/m <- r/m op reg.
+enum Alu { ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, XOR = 0x31, CMP = 0x39, TEST = 0x85 };
+
+// The /digit of the ALU instructions taking an immediate.
+enum AluImm { ADD_IMM = 0, OR_IMM = 1, SUB_IMM = 5, XOR_IMM = 6, CMP_IMM = 7 };
+
+// Registers the generated code keeps for its whole run. They are callee-saved,
+// pushed by the entry sequence.
+constexpr int REGS = RBX;       // the frame's register window
+constexpr int TRUE_BITS = R12;  // Value::boolean(true)
+constexpr int GLOBALS = R13;
+constexpr int NULL_BITS = R14;  // BOXED, which is also null
+constexpr int INT_TAG = R15;
+
+bool fitsByte(std::int64_t value) { return value >= -128 && value <= 127; }
+
+// Just enough of an x86-64 encoder for the templates below, with rel32
+// labels patched once the code is complete.
+class Assembler {
+public:
+    std::vector<std::uint8_t> bytes;
+
+    int newLabel() {
+       labels.push_back(-1);
+       return static_cast<int>(labels.size() - 1);
+    }
+
+    void bind(int label) { labels[label] = static_cast<std::int64_t>(bytes.size()); }
+
+    void finish() {
+       for (const auto &[at, label]: fixups) {
+          auto rel = static_cast<std::int32_t>(labels[label] - static_cast<std::int64_t>(at + 4));
+          std::memcpy(&bytes[at], &rel, 4);
+       }
+       fixups.clear();
+    }
+
+    void load(int reg, int base, int disp) {
+       rex(true, reg, base);
+       byte(0x8b);
+       memory(reg, base, disp);
+    }
+
+    void store(int base, int disp, int reg) {
+       rex(true, reg, base);
+       byte(0x89);
+       memory(reg, base, disp);
+    }
+
+    void move(int dst, int src) { alu(0x89, dst, src); }
+
+    void moveImm(int reg, std::uint64_t imm) {
+       if (imm <= 0xffffffffu) {
+          rex(false, 0, reg);
+          byte(0xb8 + (reg & 7));
+          dword(static_cast<std::uint32_t>(imm));
+       } else {
+          rex(true, 0, reg);
+          byte(0xb8 + (reg & 7));
+          dword(static_cast<std::uint32_t>(imm));
+          dword(static_cast<std::uint32_t>(imm >> 32));
+       }
+    }
+
+    void alu(int op, int dst, int src, bool wide = true) {
+       rex(wide, src, dst);
+       byte(op);
+       direct(src, dst);
+    }
+
+    // The byte form, on al, cl, dl or bl only.
+    void aluByte(int op, int dst, int src) {
+       byte(op - 1);
+       direct(src, dst);
+    }
+
+    void aluImm(int digit, int reg, std::int32_t imm, bool wide = false) {
+       rex(wide, 0, reg);
+       if (fitsByte(imm)) {
+          byte(0x83);
+          direct(digit, reg);
+          byte(static_cast<std::uint8_t>(imm));
+       } else {
+          byte(0x81);
+          direct(digit, reg);
+          dword(static_cast<std::uint32_t>(imm));
+       }
+    }
+
+    void imul(int dst, int src) {
+       rex(false, dst, src);
+       byte(0x0f);
+       byte(0xaf);
+       direct(dst, src);
+    }
+
+    void signExtend(int dst, int src) {
+       rex(true, dst, src);
+       byte(0x63);
+       direct(dst, src);
+    }
+
+    // rdx:rax / reg, after cqo.
+    void divide(int reg) {
+       byte(0x48);
+       byte(0x99);
+       rex(true, 0, reg);
+       byte(0xf7);
+       direct(7, reg);
+    }
+
+    void neg(int reg) {
+       rex(false, 0, reg);
+       byte(0xf7);
+       direct(3, reg);
+    }
+
+    void shr(int reg, int count) {
+       rex(true, 0, reg);
+       byte(0xc1);
+       direct(5, reg);
+       byte(static_cast<std::uint8_t>(count));
+    }
+
+    // On al, cl, dl or bl only.
+    void setIf(int cond, int reg) {
+       byte(0x0f);
+       byte(0x90 + cond);
+       direct(0, reg);
+    }
+
+    void zeroExtendByte(int dst, int src) {
+       rex(false, dst, src);
+       byte(0x0f);
+       byte(0xb6);
+       direct(dst, src);
+    }
+
+    void toXmm(int xmm, int reg) {
+       byte(0x66);
+       rex(true, xmm, reg);
+       byte(0x0f);
+       byte(0x6e);
+       direct(xmm, reg);
+    }
+
+    void fromXmm(int reg, int xmm) {
+       byte(0x66);
+       rex(true, xmm, reg);
+       byte(0x0f);
+       byte(0x7e);
+       direct(xmm, reg);
+    }
+
+    // cvtsi2sd from a 32-bit register.
+    void intToDouble(int xmm, int reg) {
+       byte(0xf2);
+       rex(false, xmm, reg);
+       byte(0x0f);
+       byte(0x2a);
+       direct(xmm, reg);
+    }
+
+    // addsd (0x58), mulsd (0x59), subsd (0x5c) or divsd (0x5e) on xmm0-7.
+    void scalarDouble(int op, int dst, int src) {
+       byte(0xf2);
+       byte(0x0f);
+       byte(op);
+       direct(dst, src);
+    }
+
+    void compareDouble(int left, int right) {
+       byte(0x66);
+       byte(0x0f);
+       byte(0x2e);
+       direct(left, right);
+    }
+
+    void jump(int label) {
+       byte(0xe9);
+       fixup(label);
+    }
+
+    void jumpIf(int cond, int label) {
+       byte(0x0f);
+       byte(0x80 + cond);
+       fixup(label);
+    }
+
+    void jumpTo(int reg) {
+       rex(false, 0, reg);
+       byte(0xff);
+       direct(4, reg);
+    }
+
+    void push(int reg) {
+       rex(false, 0, reg);
+       byte(0x50 + (reg & 7));
+    }
+
+    void pop(int reg) {
+       rex(false, 0, reg);
+       byte(0x58 + (reg & 7));
+    }
+
+    void ret() { byte(0xc3); }
+
+private:
+    std::vector<std::int64_t> labels;
+    std::vector<std::pair<size_t, int>> fixups;
+
+    void byte(int value) { bytes.push_back(static_cast<std::uint8_t>(value)); }
+
+    void dword(std::uint32_t value) {
+       for (int k = 0; k < 4; ++k) byte(static_cast<int>(value >> (8 * k)) & 0xff);
+    }
+
+    void fixup(int label) {
+       fixups.emplace_back(bytes.size(), label);
+       dword(0);
+    }
+
+    void rex(bool wide, int reg, int rm) {
+       int prefix = 0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 | (rm >> 3);
+       if (prefix != 0x40) byte(prefix);
+    }
+
+    void direct(int reg, int rm) { byte(0xc0 | (reg & 7) << 3 | (rm & 7)); }
+
+    // [base + disp]; base is never rsp or r12, which would need a SIB byte.
+    void memory(int reg, int base, int disp) {
+       if (fitsByte(disp)) {
+          byte(0x40 | (reg & 7) << 3 | (base & 7));
+          byte(disp);
+       } else {
+          byte(0x80 | (reg & 7) << 3 | (base & 7));
+          dword(static_cast<std::uint32_t>(disp));
+       }
+    }
+};
+
+// Comparisons as the integer and the float templates test them. Floats are
+// compared with ucomisd and unsigned conditions, with the operands ordered so
+// that an unordered result (a NaN) makes the comparison false.
+struct Comparison {
+    int intCond;
+    int floatCond;
+    bool swap; // ucomisd right, left
+};
+
+Comparison comparison(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Less:
+         return {CC_L, CC_A, true};
+      case BinaryOperator::LessEqual:
+         return {CC_LE, CC_AE, true};
+      case BinaryOperator::Greater:
+         return {CC_G, CC_A, false};
+      case BinaryOperator::GreaterEqual:
+         return {CC_GE, CC_AE, false};
+      case BinaryOperator::Equal:
+         return {CC_E, CC_E, false};
+      default:
+         return {CC_NE, CC_NE, false};
+   }
+}
+
+class Translator {
+public:
+    static constexpr int MIN_RUN = 4;
+
+    explicit Translator(const FunctionProto &function) : function(function), code(function.code) {}
+
+    // Emits the function; offsets receives each instruction's native offset
+    // and entries whether entering there pays off.
+    std::vector<std::uint8_t> translate(std::vector<std::uint32_t> &offsets, std::vector<bool> &entries) {
+       for (size_t pc = 0; pc < code.size(); ++pc) starts.push_back(a.newLabel());
+       exits.assign(code.size(), -1);
+
+       // Entry: (registers, globals, target) in rdi, rsi, rdx.
+       for (int reg: {RBX, R12, R13, R14, R15}) a.push(reg);
+       a.move(REGS, RDI);
+       a.move(GLOBALS, RSI);
+       a.moveImm(NULL_BITS, BOXED);
+       a.moveImm(TRUE_BITS, bitsOf(Value::boolean(true)));
+       a.moveImm(INT_TAG, bitsOf(Value::integer(0)));
+       a.jumpTo(RDX);
+       leave = a.newLabel();
+       a.bind(leave);
+       for (int reg: {R15, R14, R13, R12, RBX}) a.pop(reg);
+       a.ret();
+
+       std::vector<bool> inlined;
+       for (size_t pc = 0; pc < code.size(); ++pc) {
+          a.bind(starts[pc]);
+          offsets.push_back(static_cast<std::uint32_t>(a.bytes.size()));
+          inlined.push_back(instruction(pc));
+       }
+
+       // Entering costs about as much as interpreting a few instructions, so
+       // it takes a loop backedge or MIN_RUN instructions before the next exit.
+       entries.assign(code.size(), false);
+       int run = 0;
+       for (size_t pc = code.size(); pc-- > 0;) {
+          OpCode op = opcodeOf(code[pc]);
+          bool backedge = (op == OpCode::JMP || op == OpCode::JMPF || op == OpCode::JMPT) && argSBx(code[pc]) < 0;
+          if (!inlined[pc]) run = 0;
+          else run = backedge ? MIN_RUN : std::min(run + 1, MIN_RUN);
+          entries[pc] = run >= MIN_RUN;
+       }
+
+       for (size_t pc = 0; pc < code.size(); ++pc) {
+          if (exits[pc] < 0) continue;
+          a.bind(exits[pc]);
+          a.moveImm(RAX, pc);
+          a.jump(leave);
+       }
+       a.finish();
+       return std::move(a.bytes);
+    }
+
+private:
+    const FunctionProto &function;
+    const std::vector<Instruction> &code;
+    Assembler a;
+    std::vector<int> starts; // label of each instruction
+    std::vector<int> exits;  // exit stub of each instruction, made on demand
+    int leave = -1;
+    int exitLabel = -1; // of the instruction being translated, for loadNumber
+
+    int exitAt(size_t pc) {
+       if (exits[pc] < 0) exits[pc] = a.newLabel();
+       return exits[pc];
+    }
+
+    static int slot(int reg) { return reg * static_cast<int>(sizeof(Value)); }
+
+    // The label of instruction target, or the exit of pc when the target is
+    // not an instruction of the function.
+    int target(size_t pc, std::int64_t target) {
+       if (target < 0 || target >= static_cast<std::int64_t>(code.size())) return exitAt(pc);
+       return starts[target];
+    }
+
+    // Returns false when the instruction always exits.
+    bool instruction(size_t pc) {
+       Instruction i = code[pc];
+       switch (opcodeOf(i)) {
+          case OpCode::MOVE:
+             if (argA(i) == argB(i)) return true;
+             a.load(RAX, REGS, slot(argB(i)));
+             rejectObject(RAX, exitAt(pc));
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::LOADK: {
+             const Value &constant = function.constants[argBx(i)];
+             if (constant.isObject()) break;
+             a.moveImm(RAX, bitsOf(constant));
+             storeScalar(pc, argA(i));
+             return true;
+          }
+          case OpCode::LOADINT:
+             a.moveImm(RAX, bitsOf(Value::integer(argSBx(i))));
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::LOADBOOL:
+             a.moveImm(RAX, bitsOf(Value::boolean(argB(i) != 0)));
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::LOADNULL:
+             a.move(RAX, NULL_BITS);
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::GETGLOBAL:
+             a.load(RAX, GLOBALS, slot(argBx(i)));
+             rejectObject(RAX, exitAt(pc));
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::SETGLOBAL:
+             a.load(RAX, REGS, slot(argA(i)));
+             rejectObject(RAX, exitAt(pc));
+             a.load(RCX, GLOBALS, slot(argBx(i)));
+             rejectObject(RCX, exitAt(pc));
+             a.store(GLOBALS, slot(argBx(i)), RAX);
+             return true;
+          case OpCode::ADD:
+          case OpCode::ADD_INT_INT:
+          case OpCode::ADD_FLOAT_FLOAT:
+             arithmetic(pc, ADD, 0x58);
+             return true;
+          case OpCode::SUB:
+          case OpCode::SUB_INT_INT:
+          case OpCode::SUB_FLOAT_FLOAT:
+             arithmetic(pc, SUB, 0x5c);
+             return true;
+          case OpCode::MUL:
+          case OpCode::MUL_INT_INT:
+          case OpCode::MUL_FLOAT_FLOAT:
+             arithmetic(pc, -1, 0x59);
+             return true;
+          case OpCode::DIV:
+          case OpCode::DIV_FLOAT_FLOAT:
+             arithmetic(pc, 0, 0x5e);
+             return true;
+          case OpCode::EQ:
+          case OpCode::EQ_INT_INT:
+             compare(pc, BinaryOperator::Equal);
+             return true;
+          case OpCode::NE:
+          case OpCode::NE_INT_INT:
+             compare(pc, BinaryOperator::NotEqual);
+             return true;
+          case OpCode::LT:
+          case OpCode::LT_INT_INT:
+             compare(pc, BinaryOperator::Less);
+             return true;
+          case OpCode::LE:
+          case OpCode::LE_INT_INT:
+             compare(pc, BinaryOperator::LessEqual);
+             return true;
+          case OpCode::GT:
+          case OpCode::GT_INT_INT:
+             compare(pc, BinaryOperator::Greater);
+             return true;
+          case OpCode::GE:
+          case OpCode::GE_INT_INT:
+             compare(pc, BinaryOperator::GreaterEqual);
+             return true;
+          case OpCode::ADD_CONST:
+          case OpCode::ADD_INT_CONST:
+             constantArithmetic(pc, ADD_IMM);
+             return true;
+          case OpCode::SUB_CONST:
+          case OpCode::SUB_INT_CONST:
+             constantArithmetic(pc, SUB_IMM);
+             return true;
+          case OpCode::NEG:
+             negate(pc);
+             return true;
+          case OpCode::NOT:
+          case OpCode::TRUTHY:
+             a.load(RAX, REGS, slot(argB(i)));
+             truthy(exitAt(pc));
+             if (opcodeOf(i) == OpCode::NOT) a.aluImm(XOR_IMM, RAX, 1);
+             boxBool();
+             storeScalar(pc, argA(i));
+             return true;
+          case OpCode::JMP:
+             a.jump(target(pc, static_cast<std::int64_t>(pc) + 1 + argSBx(i)));
+             return true;
+          case OpCode::JMPF:
+          case OpCode::JMPT:
+             a.load(RAX, REGS, slot(argA(i)));
+             truthy(exitAt(pc));
+             a.alu(TEST, RAX, RAX, false);
+             a.jumpIf(opcodeOf(i) == OpCode::JMPF ? CC_E : CC_NE,
+                      target(pc, static_cast<std::int64_t>(pc) + 1 + argSBx(i)));
+             return true;
+#define COMPILER_JIT_BRANCH(name, op) \
+          case OpCode::name: \
+          case OpCode::name##_INT_INT: \
+             return branch(pc, BinaryOperator::op, false); \
+          case OpCode::name##_CONST: \
+          case OpCode::name##_INT_CONST: \
+             return branch(pc, BinaryOperator::op, true);
+          COMPILER_JIT_BRANCH(IFLT, Less)
+          COMPILER_JIT_BRANCH(IFLE, LessEqual)
+          COMPILER_JIT_BRANCH(IFGT, Greater)
+          COMPILER_JIT_BRANCH(IFGE, GreaterEqual)
+          COMPILER_JIT_BRANCH(IFEQ, Equal)
+          COMPILER_JIT_BRANCH(IFNE, NotEqual)
+#undef COMPILER_JIT_BRANCH
+          default:
+             break;
+       }
+       a.jump(exitAt(pc));
+       return false;
+    }
+
+    // Jumps to otherwise when the top 16 bits of reg are (or are not) tag16.
+    void testTag(int reg, std::int32_t tag16, int cond, int otherwise) {
+       a.move(RCX, reg);
+       a.shr(RCX, 48);
+       a.aluImm(CMP_IMM, RCX, tag16);
+       a.jumpIf(cond, otherwise);
+    }
+
+    void rejectObject(int reg, int otherwise) { testTag(reg, OBJECT_TAG16, CC_E, otherwise); }
+
+    void requireInt(int reg, int otherwise) { testTag(reg, INT_TAG16, CC_NE, otherwise); }
+
+    // Value::bothInt on rax and rdx.
+    void requireBothInt(int otherwise) {
+       a.move(RCX, RAX);
+       a.alu(AND, RCX, RDX);
+       a.shr(RCX, 48);
+       a.aluImm(CMP_IMM, RCX, INT_TAG16);
+       a.jumpIf(CC_NE, otherwise);
+    }
+
+    void requireFloat(int reg, int otherwise) {
+       a.move(RCX, reg);
+       a.alu(AND, RCX, NULL_BITS);
+       a.alu(CMP, RCX, NULL_BITS);
+       a.jumpIf(CC_E, otherwise);
+    }
+
+    // Stores rax to R[reg] unless that would overwrite an object, whose
+    // reference only the interpreter may drop.
+    void storeScalar(size_t pc, int reg) {
+       a.load(RCX, REGS, slot(reg));
+       rejectObject(RCX, exitAt(pc));
+       a.store(REGS, slot(reg), RAX);
+    }
+
+    void boxInt() { a.alu(OR, RAX, INT_TAG); }
+
+    // 0 or 1 in eax to a boolean.
+    void boxBool() {
+       a.aluImm(OR_IMM, RAX, 2);
+       a.alu(OR, RAX, NULL_BITS);
+    }
+
+    // The double in xmm0 to rax, as Value::number.
+    void boxFloat() {
+       int ordered = a.newLabel();
+       a.fromXmm(RAX, 0);
+       a.compareDouble(0, 0);
+       a.jumpIf(CC_NP, ordered);
+       a.moveImm(RAX, CANONICAL_NAN);
+       a.bind(ordered);
+    }
+
+    // rax as a double in xmm, converting an integer as mixed arithmetic does.
+    void loadNumber(int reg, int xmm) {
+       int isFloat = a.newLabel();
+       int done = a.newLabel();
+       requireInt(reg, isFloat);
+       a.intToDouble(xmm, reg);
+       a.jump(done);
+       a.bind(isFloat);
+       requireFloat(reg, exitLabel);
+       a.toXmm(xmm, reg);
+       a.bind(done);
+    }
+
+    void loadNumbers() {
+       loadNumber(RAX, 0);
+       loadNumber(RDX, 1);
+    }
+
+    // An int immediate as a double in xmm1.
+    void loadImmediate(std::int32_t value) {
+       a.moveImm(RCX, static_cast<std::uint32_t>(value));
+       a.intToDouble(1, RCX);
+    }
+
+    // intOp is an Alu opcode, -1 for imul or 0 for division.
+    void arithmetic(size_t pc, int intOp, int floatOp) {
+       Instruction i = code[pc];
+       exitLabel = exitAt(pc);
+       int floats = a.newLabel();
+       int done = a.newLabel();
+       a.load(RAX, REGS, slot(argB(i)));
+       a.load(RDX, REGS, slot(argC(i)));
+       requireBothInt(floats);
+       if (intOp < 0) {
+          a.imul(RAX, RDX);
+       } else if (intOp > 0) {
+          a.alu(intOp, RAX, RDX, false);
+       } else {
+          // In 64 bits, where INT_MIN / -1 does not trap; zero divisors exit
+          // for the interpreter to raise the error.
+          a.alu(TEST, RDX, RDX, false);
+          a.jumpIf(CC_E, exitLabel);
+          a.signExtend(RAX, RAX);
+          a.signExtend(RCX, RDX);
+          a.divide(RCX);
+          a.alu(0x89, RAX, RAX, false);
+       }
+       boxInt();
+       a.jump(done);
+       a.bind(floats);
+       loadNumbers();
+       a.scalarDouble(floatOp, 0, 1);
+       boxFloat();
+       a.bind(done);
+       storeScalar(pc, argA(i));
+    }
+
+    // Sets al to the comparison of xmm0 with xmm1.
+    void compareFloats(BinaryOperator op) {
+       Comparison cmp = comparison(op);
+       if (cmp.swap) a.compareDouble(1, 0);
+       else a.compareDouble(0, 1);
+       a.setIf(cmp.floatCond, RAX);
+       if (op == BinaryOperator::Equal || op == BinaryOperator::NotEqual) {
+          // A NaN is equal to nothing.
+          a.setIf(op == BinaryOperator::Equal ? CC_NP : CC_P, RCX);
+          a.aluByte(op == BinaryOperator::Equal ? AND : OR, RAX, RCX);
+       }
+    }
+
+    void compare(size_t pc, BinaryOperator op) {
+       Instruction i = code[pc];
+       exitLabel = exitAt(pc);
+       int floats = a.newLabel();
+       int done = a.newLabel();
+       a.load(RAX, REGS, slot(argB(i)));
+       a.load(RDX, REGS, slot(argC(i)));
+       requireBothInt(floats);
+       a.alu(CMP, RAX, RDX, false);
+       a.setIf(comparison(op).intCond, RAX);
+       a.jump(done);
+       a.bind(floats);
+       loadNumbers();
+       compareFloats(op);
+       a.bind(done);
+       a.zeroExtendByte(RAX, RAX);
+       boxBool();
+       storeScalar(pc, argA(i));
+    }
+
+    // IFxx and the JMP after it, taken when the comparison is false.
+    bool branch(size_t pc, BinaryOperator op, bool immediate) {
+       Instruction i = code[pc];
+       if (pc + 1 >= code.size() || opcodeOf(code[pc + 1]) != OpCode::JMP) {
+          a.jump(exitAt(pc));
+          return false;
+       }
+       int taken = target(pc, static_cast<std::int64_t>(pc) + 2);
+       int notTaken = target(pc, static_cast<std::int64_t>(pc) + 2 + argSBx(code[pc + 1]));
+       exitLabel = exitAt(pc);
+       int floats = a.newLabel();
+       a.load(RAX, REGS, slot(argA(i)));
+       if (immediate) {
+          requireInt(RAX, floats);
+          a.aluImm(CMP_IMM, RAX, argSBx(i));
+       } else {
+          a.load(RDX, REGS, slot(argB(i)));
+          requireBothInt(floats);
+          a.alu(CMP, RAX, RDX, false);
+       }
+       a.jumpIf(comparison(op).intCond, taken);
+       a.jump(notTaken);
+
+       a.bind(floats);
+       if (immediate) {
+          loadNumber(RAX, 0);
+          loadImmediate(argSBx(i));
+       } else {
+          loadNumbers();
+       }
+       compareFloats(op);
+       a.aluByte(TEST, RAX, RAX);
+       a.jumpIf(CC_NE, taken);
+       a.jump(notTaken);
+       return true;
+    }
+
+    void constantArithmetic(size_t pc, int digit) {
+       Instruction i = code[pc];
+       exitLabel = exitAt(pc);
+       int floats = a.newLabel();
+       int done = a.newLabel();
+       a.load(RAX, REGS, slot(argB(i)));
+       requireInt(RAX, floats);
+       a.aluImm(digit, RAX, argSC(i));
+       boxInt();
+       a.jump(done);
+       a.bind(floats);
+       requireFloat(RAX, exitLabel);
+       a.toXmm(0, RAX);
+       loadImmediate(argSC(i));
+       a.scalarDouble(digit == ADD_IMM ? 0x58 : 0x5c, 0, 1);
+       boxFloat();
+       a.bind(done);
+       storeScalar(pc, argA(i));
+    }
+
+    void negate(size_t pc) {
+       Instruction i = code[pc];
+       int floats = a.newLabel();
+       int done = a.newLabel();
+       a.load(RAX, REGS, slot(argB(i)));
+       requireInt(RAX, floats);
+       a.neg(RAX);
+       boxInt();
+       a.jump(done);
+       a.bind(floats);
+       requireFloat(RAX, exitAt(pc));
+       a.moveImm(RCX, SIGN_BIT);
+       a.alu(XOR, RAX, RCX);
+       a.toXmm(0, RAX);
+       boxFloat();
+       a.bind(done);
+       storeScalar(pc, argA(i));
+    }
+
+    // Leaves Value::truthy of rax in eax as 0 or 1, for booleans, integers
+    // and null; jumps to otherwise for other values.
+    void truthy(int otherwise) {
+       int notBool = a.newLabel();
+       int notInt = a.newLabel();
+       int done = a.newLabel();
+       a.move(RCX, RAX);
+       a.aluImm(OR_IMM, RCX, 1, true);
+       a.alu(CMP, RCX, TRUE_BITS);
+       a.jumpIf(CC_NE, notBool);
+       a.alu(CMP, RAX, TRUE_BITS);
+       a.setIf(CC_E, RAX);
+       a.jump(done);
+       a.bind(notBool);
+       requireInt(RAX, notInt);
+       a.alu(TEST, RAX, RAX, false);
+       a.setIf(CC_NE, RAX);
+       a.jump(done);
+       a.bind(notInt);
+       a.alu(CMP, RAX, NULL_BITS);
+       a.jumpIf(CC_NE, otherwise);
+       a.alu(XOR, RAX, RAX, false);
+       a.bind(done);
+       a.zeroExtendByte(RAX, RAX);
+    }
+};
+
+} // namespace
+
+JitFunction::~JitFunction() {
+#ifdef COMPILER_JIT_AVAILABLE
+   munmap(code, mappedSize);
+#endif
+}
+
+bool BaselineJit::supported() {
+#ifdef COMPILER_JIT_AVAILABLE
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool BaselineJit::compile(FunctionProto &function) {
+#ifdef COMPILER_JIT_AVAILABLE
+   if (function.jitCode) return true;
+   if (function.code.empty()) return false;
+
+   std::vector<std::uint32_t> offsets;
+   std::vector<bool> entries;
+   std::vector<std::uint8_t> bytes = Translator(function).translate(offsets, entries);
+   if (std::find(entries.begin(), entries.end(), true) == entries.end()) return false;
+
+   auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+   size_t size = (bytes.size() + page - 1) / page * page;
+   void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (memory == MAP_FAILED) return false;
+   std::memcpy(memory, bytes.data(), bytes.size());
+   if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, size);
+      return false;
+   }
+
+   compiled.push_back(std::make_unique<JitFunction>(static_cast<std::uint8_t *>(memory), size, std::move(offsets),
+                                                 std::move(entries)));
+   function.jitCode = compiled.back().get();
+   return true;
+#else
+   (void) function;
+   return false;
+#endif
+}
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "loop_optimizer.h"
+#include "dataflow.h"
+#include "dominators.h"
+#include "ir_simplifier.h"
+#include "error.h"
+
+LoopStats &LoopStats::operator+=(const LoopStats &other) {
+   loops += other.loops;
+   hoisted += other.hoisted;
+   reduced += other.reduced;
+   unrolled += other.unrolled;
+   return *this;
+}
+
+LoopStats LoopOptimizer::optimize(IrFunction &function) {
+   stats = LoopStats();
+   // None of the transformations adds a block or an edge, so one analysis
+   // serves them all; unrolling tells it which loops are gone.
+   DominatorTree dominators(function);
+   LoopInfo info(function, dominators);
+   stats.loops = static_cast<int>(info.loops().size());
+   if (stats.loops == 0) return stats;
+
+   if (options.hoist) hoistInvariants(function, info);
+   if (options.unroll) unrollLoops(function, info);
+   if (options.strengthReduce) reduceStrength(function, info);
+   IrSimplifier().simplify(function);
+   return stats;
+}
+
+LoopStats LoopOptimizer::optimize(IrModule &module) {
+   LoopStats total;
+   for (const auto &function: module.functions) total += optimize(*function);
+   return total;
+}
+
+static bool isIntConstant(const IrInstr *instr) {
+   return instr->op == IrOp::Const && instr->constant.isInt();
+}
+
+static bool hasHandlers(const NaturalLoop &loop) {
+   return std::any_of(loop.blocks.begin(), loop.blocks.end(), [](const IrBlock *block) {
+       return block->handler || (!block->instructions.empty() && block->instructions.front()->op == IrOp::Catch);
+   });
+}
+
+// Only loops entered from a preheader and closed by one back edge are
+// considered, so the header's phis have an entry and a latch operand.
+std::vector<LoopOptimizer::InductionVariable> LoopOptimizer::inductionVariables(const NaturalLoop &loop) const {
+   std::vector<InductionVariable> result;
+   IrBlock *header = loop.header;
+   if (loop.latches.size() != 1 || header->predecessors.size() != 2) return result;
+   size_t latch = header->predecessorIndex(loop.latches.front());
+   for (IrInstr *phi: header->phis) {
+      IrInstr *init = phi->operands[1 - latch];
+      IrInstr *update = phi->operands[latch];
+      if (!isIntConstant(init) || update->op != IrOp::Binary || !loop.contains(update->block)) continue;
+      bool add = update->binary == BinaryOperator::Add;
+      if (!add && update->binary != BinaryOperator::Subtract) continue;
+      IrInstr *step = update->operands[0] == phi ? update->operands[1] : update->operands[0];
+      if (!isIntConstant(step) || (update->operands[0] != phi && (!add || update->operands[1] != phi))) continue;
+      std::int64_t amount = step->constant.asInt();
+      result.push_back(InductionVariable{phi, update, init->constant.asInt(), wrapInt(add ? amount : -amount)});
+   }
+   return result;
+}
+
+static void moveBeforeTerminator(IrInstr *instr, IrBlock *target) {
+   auto &from = instr->block->instructions;
+   from.erase(std::find(from.begin(), from.end(), instr));
+   instr->block = target;
+   target->instructions.insert(target->instructions.end() - 1, instr);
+}
+
+void LoopOptimizer::hoistInvariants(IrFunction &function, const LoopInfo &info) {
+   Liveness liveness(function);
+   for (const auto &loop: info.loops()) {
+      IrBlock *preheader = loop->preheader();
+      if (!preheader || hasHandlers(*loop)) continue;
+
+      // Globals the loop may write; a call may write any of them.
+      bool calls = false;
+      std::unordered_set<int> stored;
+      for (const IrBlock *block: loop->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::Call) calls = true;
+            if (instr->op == IrOp::StoreGlobal) stored.insert(instr->index);
+         }
+      }
+      auto hoistable = [&](const IrInstr *instr) {
+          switch (instr->op) {
+             case IrOp::Const:
+                return true;
+             case IrOp::LoadGlobal:
+                return !calls && !stored.count(instr->index);
+             case IrOp::Binary:
+             case IrOp::Unary:
+             case IrOp::Truthy:
+                return std::none_of(instr->operands.begin(), instr->operands.end(), [&](const IrInstr *operand) {
+                    return loop->contains(operand->block);
+                });
+             default:
+                return false;
+          }
+      };
+
+      // Each hoisted value holds a register for the whole loop.
+      auto pressure = static_cast<int>(liveness.liveIn(loop->header).count());
+      for (IrBlock *block: loop->blocks) {
+         // Whether everything so far in the header has run without effects.
+         bool entry = block == loop->header;
+         for (size_t i = 0; i < block->instructions.size();) {
+            IrInstr *instr = block->instructions[i];
+            if (pressure < options.costs.registerBudget && hoistable(instr) && (entry || !instr->mayThrow())) {
+               moveBeforeTerminator(instr, preheader);
+               pressure++;
+               stats.hoisted++;
+               continue;
+            }
+            if (instr->hasSideEffects()) entry = false;
+            ++i;
+         }
+      }
+   }
+}
+
+int LoopOptimizer::tripCount(const InductionVariable &iv, const IrInstr *compare, bool continueWhenTrue) const {
+   bool testsUpdate = compare->operands[0] == iv.update || compare->operands[1] == iv.update;
+   bool left = compare->operands[0] == iv.phi || compare->operands[0] == iv.update;
+   const Value &bound = compare->operands[left ? 1 : 0]->constant;
+   Value current = Value::integer(iv.init);
+   for (int trips = 1; trips <= options.costs.maxUnrollTrip; ++trips) {
+      Value next = Value::integer(wrapInt(static_cast<std::int64_t>(current.asInt()) + iv.step));
+      const Value &tested = testsUpdate ? next : current;
+      try {
+         Value result = left ? applyBinary(compare->binary, tested, bound) : applyBinary(compare->binary, bound, tested);
+         if (result.truthy() != continueWhenTrue) return trips;
+      } catch (const RuntimeError &) {
+         return -1;
+      }
+      current = next;
+   }
+   return -1;
+}
+
+// Unrolls innermost single-block loops whose exit test compares an induction
+// variable with a constant.
+void LoopOptimizer::unrollLoops(IrFunction &function, LoopInfo &info) {
+   std::vector<NaturalLoop *> unrolled;
+   for (const auto &loop: info.loops()) {
+      IrBlock *header = loop->header;
+      IrInstr *branch = header->terminator();
+      if (loop->blocks.size() != 1 || header->handler || branch->op != IrOp::Branch) continue;
+      bool continueWhenTrue = header->successors[0] == header;
+      IrBlock *exit = header->successors[continueWhenTrue ? 1 : 0];
+      IrInstr *compare = branch->operands[0];
+      if (exit == header || compare->op != IrOp::Binary || compare->block != header) continue;
+
+      int trips = -1;
+      for (const InductionVariable &iv: inductionVariables(*loop)) {
+         auto tested = [&](const IrInstr *operand) { return operand == iv.phi || operand == iv.update; };
+         const IrInstr *left = compare->operands[0];
+         const IrInstr *right = compare->operands[1];
+         if ((tested(left) && right->op == IrOp::Const) || (tested(right) && left->op == IrOp::Const)) {
+            trips = tripCount(iv, compare, continueWhenTrue);
+            break;
+         }
+      }
+      auto size = static_cast<int>(header->phis.size() + header->instructions.size());
+      if (trips < 0 || trips * size > options.costs.unrollBudget) continue;
+      unroll(function, header, exit, trips);
+      unrolled.push_back(loop.get());
+      stats.unrolled++;
+   }
+   for (NaturalLoop *loop: unrolled) info.remove(loop);
+}
+
+// Replaces the loop with `trips` copies of its body, each reading the values
+// the previous one left for the phis, followed by a jump to the exit.
+void LoopOptimizer::unroll(IrFunction &function, IrBlock *header, IrBlock *exit, int trips) {
+   size_t latch = header->predecessorIndex(header);
+   std::vector<IrInstr *> body(header->instructions.begin(), header->instructions.end() - 1);
+   std::unordered_map<const IrInstr *, IrInstr *> current;
+   for (IrInstr *phi: header->phis) current[phi] = phi->operands[1 - latch];
+   auto lookup = [&](IrInstr *value) {
+       auto it = current.find(value);
+       return it == current.end() ? value : it->second;
+   };
+
+   std::vector<IrInstr *> unrolled;
+   std::unordered_map<const IrInstr *, IrInstr *> lastPhis;
+   for (int trip = 0; trip < trips; ++trip) {
+      for (IrInstr *phi: header->phis) lastPhis[phi] = current[phi];
+      for (IrInstr *instr: body) {
+         IrInstr *copy = function.cloneInstr(*instr);
+         for (IrInstr *operand: instr->operands) copy->addOperand(lookup(operand));
+         copy->block = header;
+         unrolled.push_back(copy);
+         current[instr] = copy;
+      }
+      std::vector<IrInstr *> next;
+      for (IrInstr *phi: header->phis) next.push_back(lookup(phi->operands[latch]));
+      for (size_t i = 0; i < header->phis.size(); ++i) current[header->phis[i]] = next[i];
+   }
+
+   // Code after the loop sees the values of the last trip.
+   IrInstr *branch = header->instructions.back();
+   for (IrInstr *phi: header->phis) phi->clearOperands();
+   for (IrInstr *instr: header->instructions) instr->clearOperands();
+   for (IrInstr *phi: header->phis) {
+      phi->replaceAllUsesWith(lastPhis[phi]);
+      phi->block = nullptr;
+   }
+   for (IrInstr *instr: body) {
+      instr->replaceAllUsesWith(current[instr]);
+      instr->block = nullptr;
+   }
+
+   header->phis.clear();
+   header->predecessors.erase(header->predecessors.begin() + static_cast<std::ptrdiff_t>(latch));
+   branch->op = IrOp::Jump;
+   unrolled.push_back(branch);
+   header->instructions = std::move(unrolled);
+   header->successors = {exit};
+}
+
+static void erase(IrInstr *instr) {
+   auto &list = instr->block->instructions;
+   list.erase(std::find(list.begin(), list.end(), instr));
+   instr->clearOperands();
+   instr->block = nullptr;
+}
+
+void LoopOptimizer::reduceStrength(IrFunction &function, const LoopInfo &info) {
+   const LoopCostModel &costs = options.costs;
+   for (const auto &loop: info.loops()) {
+      IrBlock *preheader = loop->preheader();
+      if (!preheader || hasHandlers(*loop)) continue;
+      IrBlock *header = loop->header;
+      size_t latch = header->predecessorIndex(loop->latches.front());
+
+      for (const InductionVariable &iv: inductionVariables(*loop)) {
+         std::vector<IrInstr *> users = iv.phi->users;
+         for (IrInstr *product: users) {
+            if (product->op != IrOp::Binary || product->binary != BinaryOperator::Multiply ||
+                !loop->contains(product->block) || product->operands[0] == product->operands[1]) {
+               continue;
+            }
+            IrInstr *factor = product->operands[0] == iv.phi ? product->operands[1] : product->operands[0];
+            if (!isIntConstant(factor)) continue;
+            std::int64_t k = factor->constant.asInt();
+
+            // iv * k + b folds the add into the new variable's start.
+            IrInstr *replaced = product;
+            std::int64_t offset = 0;
+            if (product->users.size() == 1) {
+               IrInstr *sum = product->users.front();
+               bool add = sum->binary == BinaryOperator::Add;
+               if (sum->op == IrOp::Binary && (add || sum->binary == BinaryOperator::Subtract) &&
+                   loop->contains(sum->block) && sum->operands[0] != sum->operands[1]) {
+                  IrInstr *term = sum->operands[0] == product ? sum->operands[1] : sum->operands[0];
+                  if (isIntConstant(term) && (add || sum->operands[0] == product)) {
+                     replaced = sum;
+                     offset = add ? term->constant.asInt() : -static_cast<std::int64_t>(term->constant.asInt());
+                  }
+               }
+            }
+            int saved = costs.multiplyCost + (replaced != product ? costs.addCost : 0);
+            if (saved <= costs.addCost) continue;
+
+            auto constant = [&](std::int64_t value) {
+                IrInstr *instr = function.newInstr(IrOp::Const);
+                instr->constant = Value::integer(wrapInt(value));
+                instr->block = preheader;
+                preheader->instructions.insert(preheader->instructions.end() - 1, instr);
+                return instr;
+            };
+            IrInstr *start = constant(wrapInt(iv.init * k) + offset);
+            IrInstr *step = constant(wrapInt(iv.step * k));
+
+            IrInstr *phi = function.newInstr(IrOp::Phi);
+            phi->block = header;
+            header->phis.push_back(phi);
+            IrInstr *next = function.newInstr(IrOp::Binary);
+            next->binary = BinaryOperator::Add;
+            next->addOperand(phi);
+            next->addOperand(step);
+            IrBlock *block = iv.update->block;
+            next->block = block;
+            block->instructions.insert(std::find(block->instructions.begin(), block->instructions.end(), iv.update) + 1,
+                                       next);
+            phi->addOperand(latch == 0 ? next : start);
+            phi->addOperand(latch == 0 ? start : next);
+
+            // The induction variable is always an int, so neither the
+            // multiply nor the add can raise, and they go with their uses.
+            replaced->replaceAllUsesWith(phi);
+            erase(replaced);
+            if (replaced != product) erase(product);
+            stats.reduced++;
+         }
+      }
+   }
+}
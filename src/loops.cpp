@@ -0,0 +1,109 @@
+#include <algorithm>
+
+#include "loops.h"
+
+IrBlock *NaturalLoop::preheader() const {
+   IrBlock *outside = nullptr;
+   for (IrBlock *pred: header->predecessors) {
+      if (contains(pred)) continue;
+      if (outside) return nullptr;
+      outside = pred;
+   }
+   if (!outside || outside->handler || outside->successors.size() != 1) return nullptr;
+   IrInstr *terminator = outside->terminator();
+   return terminator && terminator->op == IrOp::Jump ? outside : nullptr;
+}
+
+bool NaturalLoop::contains(const IrBlock *block) const {
+   for (const NaturalLoop *loop = info->loopFor(block); loop && loop->depth >= depth; loop = loop->parent) {
+      if (loop == this) return true;
+   }
+   return false;
+}
+
+LoopInfo::LoopInfo(const IrFunction &function, const DominatorTree &dominators)
+        : innermost(function.blocks.size(), nullptr) {
+   std::vector<size_t> position(function.blocks.size());
+   for (size_t i = 0; i < function.blocks.size(); ++i) position[function.blocks[i]->id] = i;
+   // The header whose loop last reached each block.
+   std::vector<const IrBlock *> seen(function.blocks.size(), nullptr);
+   std::vector<IrBlock *> work;
+   for (const auto &owned: function.blocks) {
+      IrBlock *header = owned.get();
+      std::vector<IrBlock *> latches;
+      for (IrBlock *pred: header->predecessors) {
+         if (dominators.dominates(header, pred) &&
+             std::find(latches.begin(), latches.end(), pred) == latches.end()) {
+            latches.push_back(pred);
+         }
+      }
+      if (latches.empty()) continue;
+
+      auto loop = std::make_unique<NaturalLoop>();
+      loop->header = header;
+      loop->latches = latches;
+      loop->info = this;
+      seen[header->id] = header;
+      loop->blocks.push_back(header);
+      for (IrBlock *latch: latches) {
+         if (seen[latch->id] != header) {
+            seen[latch->id] = header;
+            loop->blocks.push_back(latch);
+            work.push_back(latch);
+         }
+      }
+      while (!work.empty()) {
+         IrBlock *block = work.back();
+         work.pop_back();
+         for (IrBlock *pred: block->predecessors) {
+            if (seen[pred->id] != header) {
+               seen[pred->id] = header;
+               loop->blocks.push_back(pred);
+               work.push_back(pred);
+            }
+         }
+      }
+      std::sort(loop->blocks.begin(), loop->blocks.end(), [&](const IrBlock *a, const IrBlock *b) {
+          return position[a->id] < position[b->id];
+      });
+      all.push_back(std::move(loop));
+   }
+
+   // Natural loops with distinct headers are nested or disjoint, and a loop
+   // is larger than those it contains. Going from the largest, the innermost
+   // loop already recorded for a header is its loop's parent.
+   std::stable_sort(all.begin(), all.end(), [](const auto &a, const auto &b) {
+       return a->blocks.size() < b->blocks.size();
+   });
+   for (auto it = all.rbegin(); it != all.rend(); ++it) {
+      NaturalLoop &loop = **it;
+      loop.parent = innermost[loop.header->id];
+      if (loop.parent) loop.depth = loop.parent->depth + 1;
+      for (IrBlock *block: loop.blocks) innermost[block->id] = &loop;
+   }
+   for (const auto &loop: all) {
+      if (loop->parent) loop->parent->children.push_back(loop.get());
+   }
+}
+
+static void setDepth(NaturalLoop *loop, int depth) {
+   loop->depth = depth;
+   for (NaturalLoop *child: loop->children) setDepth(child, depth + 1);
+}
+
+void LoopInfo::remove(NaturalLoop *loop) {
+   NaturalLoop *parent = loop->parent;
+   if (parent) {
+      auto &siblings = parent->children;
+      siblings.erase(std::find(siblings.begin(), siblings.end(), loop));
+   }
+   for (NaturalLoop *child: loop->children) {
+      child->parent = parent;
+      if (parent) parent->children.push_back(child);
+      setDepth(child, parent ? parent->depth + 1 : 1);
+   }
+   for (IrBlock *block: loop->blocks) {
+      if (innermost[block->id] == loop) innermost[block->id] = parent;
+   }
+   all.erase(std::find_if(all.begin(), all.end(), [&](const auto &owned) { return owned.get() == loop; }));
+}
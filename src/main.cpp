@@ -1,8 +1,23 @@
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "tokenizer.h"
 #include "token_type.h"
 #include "parser.h"
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "resolver.h"
+#include "ir_builder.h"
+#include "dataflow.h"
+#include "optimizer.h"
+#include "c_emitter.h"
+#include "x86_64_backend.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "thread_pool.h"
+#include "error.h"
 
 void printExpr(const Expr *expr) {
    if (!expr) {
@@ -13,40 +28,168 @@ void printExpr(const Expr *expr) {
    std::cout << expr->toString() << "\n";
 }
 
-int main() {
-   std::string sourceCode = R"(
-if (x > 0) { return x; }
-)";
-
-   Tokenizer tokenizer(sourceCode);
-   std::vector<Token> tokens = tokenizer.tokenize();
-
-   Parser parser(tokens);
-
-   parser.scopeManager.declare(Symbol(
-           "x",
-           SymbolType::Variable,
-           std::make_shared<Type>(TypeKind::Int),
-           true,
-           0,
-           0
-   ));
-
-   parser.scopeManager.declare(Symbol(
-           "print",
-           SymbolType::Function,
-           std::make_shared<Type>(TypeKind::Void),
-           false,
-           0,
-           0
-   ));
-
-   std::unique_ptr<Expr> ast = parser.parse();
-
-   if (ast) {
-      std::cout << "=== AST ===\n";
-      printExpr(ast.get());
-   } else std::cerr << "Parsing failed.";
+int main(int argc, char **argv) {
+   bool printAst = false;
+   bool printBytecode = false;
+   bool printIr = false;
+   bool warn = false;
+   bool optimize = false;
+   bool treeWalker = false;
+   bool jit = false;
+   int threads = 0;
+   std::string emitC;
+   std::string emitAsm;
+   std::string native;
+   bool shared = false;
+   bool x86 = false;
+   std::string path;
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--ast") printAst = true;
+      else if (arg == "--disassemble") printBytecode = true;
+      else if (arg == "--ir") printIr = true;
+      else if (arg == "--warn") warn = true;
+      else if (arg == "-O" || arg == "--optimize") optimize = true;
+      else if (arg == "--tree-walker") treeWalker = true;
+      else if (arg == "--jit") jit = true;
+      else if (arg == "--threads" && i + 1 < argc) threads = std::atoi(argv[++i]);
+      else if (arg == "--emit-c" && i + 1 < argc) emitC = argv[++i];
+      else if (arg == "--emit-asm" && i + 1 < argc) emitAsm = argv[++i];
+      else if (arg == "--native" && i + 1 < argc) native = argv[++i];
+      else if (arg == "--shared") shared = true;
+      else if (arg == "--x86-64") x86 = true;
+      else path = arg;
+   }
+
+   if (path.empty() || threads < 0) {
+      std::cerr << "Usage: " << argv[0] << " [--ast] [--disassemble] [--ir] [--warn] [-O] [--tree-walker] [--jit] "
+                   "[--threads N] [--emit-c out.c] [--emit-asm out.s] [--native out [--shared] [--x86-64]] <file>\n";
+      return 1;
+   }
+   if (threads > 0) ThreadPool::setSharedThreadCount(threads);
+
+   std::ifstream file(path);
+   if (!file) {
+      std::cerr << "Cannot open " << path << "\n";
+      return 1;
+   }
+   std::stringstream buffer;
+   buffer << file.rdbuf();
+   std::string sourceCode = buffer.str();
+
+   try {
+      Interpreter interpreter;
+
+      if (warn) {
+         Tokenizer tokenizer(sourceCode);
+         std::vector<Token> tokens = tokenizer.tokenize();
+         Parser parser(tokens);
+         interpreter.host().declareIn(parser.scopeManager);
+         std::unique_ptr<Expr> ast = parser.parse();
+         Resolver().resolve(*ast);
+         std::unique_ptr<IrModule> ir = IrBuilder().build(*ast);
+         for (const UninitializedRead &read: findUninitializedReads(*ir)) {
+            std::cerr << "Warning: '" << read.name << "' may be read before it is assigned";
+            if (read.function != &ir->main()) std::cerr << " in function " << read.function->name;
+            if (read.use->op == IrOp::Call) std::cerr << " through the call to " << read.use->name;
+            std::cerr << "\n";
+         }
+      }
+
+      if (!emitC.empty() || !emitAsm.empty() || !native.empty()) {
+         Tokenizer tokenizer(sourceCode);
+         std::vector<Token> tokens = tokenizer.tokenize();
+         Parser parser(tokens);
+         interpreter.host().declareIn(parser.scopeManager);
+         std::unique_ptr<Expr> ast = parser.parse();
+         ConstantFolder().fold(*ast);
+         DeadCodeEliminator().eliminate(*ast);
+         Resolver().resolve(*ast);
+         std::unique_ptr<IrModule> ir = Optimizer(OptimizerOptions::native()).optimize(*ast);
+         if (!emitC.empty()) {
+            std::ofstream out(emitC);
+            if (!out) {
+               std::cerr << "Cannot write " << emitC << "\n";
+               return 1;
+            }
+            out << CEmitter().emit(*ir, shared);
+         }
+         if (!emitAsm.empty()) {
+            X86Emitter emitter;
+            std::ofstream out(emitAsm);
+            std::ofstream runtime(emitAsm + ".rt.c");
+            if (!out || !runtime) {
+               std::cerr << "Cannot write " << emitAsm << "\n";
+               return 1;
+            }
+            out << emitter.emitAssembly(*ir);
+            runtime << emitter.emitRuntime(*ir, shared);
+         }
+         if (!native.empty()) {
+            NativeBuildOptions options;
+            options.library = shared;
+            if (x86) buildX86Native(*ir, native, options);
+            else buildNative(*ir, native, options);
+         }
+         return 0;
+      }
+
+      if (printAst || printIr) {
+         Tokenizer tokenizer(sourceCode);
+         std::vector<Token> tokens = tokenizer.tokenize();
+
+         Parser parser(tokens);
+         interpreter.host().declareIn(parser.scopeManager);
+
+         std::unique_ptr<Expr> ast = parser.parse();
+         if (printAst) {
+            std::cout << "=== AST ===\n";
+            printExpr(ast.get());
+         }
+         ConstantFolder().fold(*ast);
+         int removed = DeadCodeEliminator().eliminate(*ast);
+         if (printAst) {
+            std::cout << "=== Optimized AST (" << removed << " dead nodes removed) ===\n";
+            printExpr(ast.get());
+         }
+         if (printIr) {
+            Resolver().resolve(*ast);
+            if (optimize) {
+               Optimizer optimizer;
+               std::unique_ptr<IrModule> ir = optimizer.optimize(*ast);
+               verifyIr(*ir);
+               const LoopStats &loops = optimizer.report().loops;
+               std::cout << "=== Optimized IR (" << optimizer.report().inlining.inlined << " calls inlined; "
+                         << optimizer.report().valueNumbering.eliminated()
+                         << " redundant removed; " << loops.loops << " loops: " << loops.hoisted << " hoisted, "
+                         << loops.reduced << " reduced, " << loops.unrolled << " unrolled) ===\n"
+                         << dumpIr(*ir);
+               return 0;
+            }
+            std::unique_ptr<IrModule> ir = IrBuilder().build(*ast);
+            verifyIr(*ir);
+            std::cout << "=== IR ===\n" << dumpIr(*ir);
+         }
+         return 0;
+      }
+
+      if (treeWalker) {
+         interpreter.run(sourceCode);
+      } else {
+         VM vm;
+         vm.setOptimize(optimize);
+         vm.setJit(jit);
+         vm.run(sourceCode);
+         if (printBytecode) std::cout << "=== Bytecode ===\n" << disassemble(*vm.lastProgram());
+      }
+   } catch (const ScriptException &e) {
+      std::cerr << "Uncaught exception: " << e.value.toString() << "\n";
+      return 1;
+   } catch (const CompilerError &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+   }
 
    return 0;
-}
\ No newline at end of file
+}
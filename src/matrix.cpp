@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "matrix.h"
+#include "error.h"
+
+// Largest element count a script may allocate (512 MiB of doubles).
+constexpr long long MAX_MATRIX_ELEMENTS = 1LL << 26;
+
+// Pending expressions deeper than this are evaluated as they are built, which
+// bounds the recursion when a loop keeps extending an unobserved value.
+constexpr int MAX_PENDING_HEIGHT = 32;
+
+MatrixObject::MatrixObject(int rows, int cols) : HeapObject(ObjectKind::Matrix), rows(rows), cols(cols) {
+   if (rows < 0 || cols < 0 || static_cast<long long>(rows) * cols > MAX_MATRIX_ELEMENTS) {
+      throw RuntimeError("Invalid matrix dimensions " + std::to_string(rows) + "x" + std::to_string(cols));
+   }
+   data = MatrixStorage(allocateAligned(static_cast<std::size_t>(rows) * cols));
+}
+
+MatrixObject::MatrixObject(MatrixExprRef expression)
+        : HeapObject(ObjectKind::Matrix), rows(expression->rows), cols(expression->cols),
+          pending(std::move(expression)) {
+   if (pending->height > MAX_PENDING_HEIGHT) elements();
+}
+
+const double *MatrixObject::elements() {
+   if (pending) {
+      data = evaluateMatrixExpr(pending);
+      pending.reset();
+   }
+   return data.get();
+}
+
+double *MatrixObject::mutableElements() {
+   elements();
+   if (data.use_count() > 1) {
+      std::size_t count = static_cast<std::size_t>(rows) * cols;
+      MatrixStorage copy(allocateAligned(count));
+      std::copy(data.get(), data.get() + count, copy.get());
+      data = std::move(copy);
+   }
+   return data.get();
+}
+
+MatrixExprRef MatrixObject::expression() const {
+   return pending ? pending : matrixLeaf(data, rows, cols);
+}
+
+std::string MatrixObject::toString() {
+   const double *values = elements();
+   std::string result = "[";
+   for (int i = 0; i < rows; ++i) {
+      result += i > 0 ? ", [" : "[";
+      for (int j = 0; j < cols; ++j) {
+         char buffer[32];
+         std::snprintf(buffer, sizeof(buffer), j > 0 ? ", %.15g" : "%.15g", values[static_cast<std::size_t>(i) * cols + j]);
+         result += buffer;
+      }
+      result += "]";
+   }
+   return result + "]";
+}
+
+static MatrixObject *matrixOperand(const Value &value) {
+   if (!value.isMatrix()) throw RuntimeError(std::string("Operator '@' expects matrices, got ") + value.typeName());
+   return asMatrix(value);
+}
+
+static void checkInnerDimensions(const MatrixObject *a, const MatrixObject *b) {
+   if (a->cols != b->rows) {
+      throw RuntimeError("Cannot multiply " + std::to_string(a->rows) + "x" + std::to_string(a->cols) + " by " +
+                         std::to_string(b->rows) + "x" + std::to_string(b->cols) + " matrix");
+   }
+}
+
+Value matrixMultiply(const Value &left, const Value &right) {
+   MatrixObject *a = matrixOperand(left);
+   MatrixObject *b = matrixOperand(right);
+   checkInnerDimensions(a, b);
+   return Value::object(new MatrixObject(matrixBinary(MatrixExprNode::Kind::Product, a->expression(),
+                                                      b->expression())));
+}
+
+Value matrixElementwise(BinaryOperator op, const Value &left, const Value &right) {
+   using Kind = MatrixExprNode::Kind;
+   if (left.isMatrix() && right.isMatrix()) {
+      MatrixObject *a = asMatrix(left);
+      MatrixObject *b = asMatrix(right);
+      if (a->rows != b->rows || a->cols != b->cols) {
+         throw RuntimeError(std::string("Operator '") + operatorLexeme(op) + "' needs matrices of the same shape, got " +
+                            std::to_string(a->rows) + "x" + std::to_string(a->cols) + " and " +
+                            std::to_string(b->rows) + "x" + std::to_string(b->cols));
+      }
+      Kind kind = op == BinaryOperator::Add ? Kind::Add : op == BinaryOperator::Subtract ? Kind::Subtract
+                                                                                          : Kind::Multiply;
+      return Value::object(new MatrixObject(matrixBinary(kind, a->expression(), b->expression())));
+   }
+
+   bool matrixLeft = left.isMatrix();
+   MatrixExprRef matrix = asMatrix(matrixLeft ? left : right)->expression();
+   double scalar = (matrixLeft ? right : left).toNumber();
+   switch (op) {
+      case BinaryOperator::Add:
+         return Value::object(new MatrixObject(matrixAffine(matrix, 1.0, scalar)));
+      case BinaryOperator::Subtract:
+         return Value::object(new MatrixObject(matrixLeft ? matrixAffine(matrix, 1.0, -scalar)
+                                                          : matrixAffine(matrix, -1.0, scalar)));
+      default:
+         return Value::object(new MatrixObject(matrixAffine(matrix, scalar, 0.0)));
+   }
+}
+
+Value matrixUnary(UnaryOperator op, const Value &operand) {
+   MatrixExprRef matrix = asMatrix(operand)->expression();
+   return Value::object(new MatrixObject(op == UnaryOperator::Negate ? matrixAffine(matrix, -1.0, 0.0) : matrix));
+}
+
+MatrixChainPlan planMatrixChain(const std::vector<int> &dims) {
+   int n = static_cast<int>(dims.size()) - 1;
+   MatrixChainPlan plan{std::vector<std::vector<int>>(n, std::vector<int>(n, 0)), 0.0};
+   if (n <= 0) return plan;
+
+   std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0.0));
+   for (int length = 2; length <= n; ++length) {
+      for (int i = 0; i + length - 1 < n; ++i) {
+         int j = i + length - 1;
+         cost[i][j] = -1.0;
+         for (int s = i; s < j; ++s) {
+            double candidate = cost[i][s] + cost[s + 1][j] + static_cast<double>(dims[i]) * dims[s + 1] * dims[j + 1];
+            if (cost[i][j] < 0.0 || candidate < cost[i][j]) {
+               cost[i][j] = candidate;
+               plan.split[i][j] = s;
+            }
+         }
+      }
+   }
+   plan.cost = cost[0][n - 1];
+   return plan;
+}
+
+namespace {
+
+// Free list of aligned buffers for chain intermediates, kept per thread.
+class ScratchPool {
+public:
+    AlignedDoubles acquire(std::size_t count, std::size_t &capacity) {
+       auto best = buffers.end();
+       for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+          if (it->first >= count && (best == buffers.end() || it->first < best->first)) best = it;
+       }
+       if (best == buffers.end()) {
+          capacity = count;
+          return allocateAligned(count);
+       }
+       capacity = best->first;
+       AlignedDoubles buffer = std::move(best->second);
+       buffers.erase(best);
+       return buffer;
+    }
+
+    void release(AlignedDoubles buffer, std::size_t capacity) {
+       if (buffers.size() < MAX_BUFFERS) buffers.emplace_back(capacity, std::move(buffer));
+    }
+
+private:
+    static constexpr std::size_t MAX_BUFFERS = 8;
+    std::vector<std::pair<std::size_t, AlignedDoubles>> buffers;
+};
+
+// One factor of a chain product: an operand's storage or a pooled intermediate.
+struct ChainFactor {
+    int rows;
+    int cols;
+    const double *data;
+    AlignedDoubles owned;
+    std::size_t capacity;
+};
+
+class ChainEvaluator {
+public:
+    ChainEvaluator(const std::vector<MatrixObject *> &matrices, const MatrixChainPlan &plan)
+            : matrices(matrices), plan(plan) {}
+
+    // Multiplies the sub-chain i..j, into `out` when given, else into a pooled buffer.
+    ChainFactor evaluate(int i, int j, double *out) {
+       if (i == j) return {matrices[i]->rows, matrices[i]->cols, matrices[i]->elements(), nullptr, 0};
+
+       int s = plan.split[i][j];
+       ChainFactor left = evaluate(i, s, nullptr);
+       ChainFactor right = evaluate(s + 1, j, nullptr);
+       ChainFactor result{left.rows, right.cols, out, nullptr, 0};
+       if (!out) {
+          result.owned = scratch.acquire(static_cast<std::size_t>(result.rows) * result.cols, result.capacity);
+          out = result.owned.get();
+          result.data = out;
+       }
+       gemmAutoParallel(left.rows, right.cols, left.cols, left.data, right.data, out);
+       if (left.owned) scratch.release(std::move(left.owned), left.capacity);
+       if (right.owned) scratch.release(std::move(right.owned), right.capacity);
+       return result;
+    }
+
+private:
+    const std::vector<MatrixObject *> &matrices;
+    const MatrixChainPlan &plan;
+    static thread_local ScratchPool scratch;
+};
+
+thread_local ScratchPool ChainEvaluator::scratch;
+
+}
+
+Value matrixChainMultiply(const Value *operands, int count) {
+   if (count == 2) return matrixMultiply(operands[0], operands[1]);
+
+   std::vector<MatrixObject *> matrices;
+   std::vector<int> dims;
+   for (int i = 0; i < count; ++i) {
+      matrices.push_back(matrixOperand(operands[i]));
+      if (i > 0) checkInnerDimensions(matrices[i - 1], matrices[i]);
+      dims.push_back(matrices[i]->rows);
+   }
+   dims.push_back(matrices.back()->cols);
+
+   MatrixChainPlan plan = planMatrixChain(dims);
+   auto *product = new MatrixObject(dims.front(), dims.back());
+   Value result = Value::object(product);
+   ChainEvaluator(matrices, plan).evaluate(0, count - 1, product->mutableElements());
+   return result;
+}
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "matrix_expr.h"
+#include "gemm.h"
+
+using Kind = MatrixExprNode::Kind;
+
+// Elements per step of the fused elementwise pass; every intermediate of a
+// step fits in L1.
+constexpr std::size_t CHUNK = 256;
+
+static MatrixStorage allocateStorage(std::size_t count) {
+   return MatrixStorage(allocateAligned(count));
+}
+
+static std::shared_ptr<MatrixExprNode> makeNode(Kind kind, int rows, int cols) {
+   auto node = std::make_shared<MatrixExprNode>();
+   node->kind = kind;
+   node->rows = rows;
+   node->cols = cols;
+   return node;
+}
+
+static MatrixExprRef matrixConstant(double value, int rows, int cols) {
+   auto node = makeNode(Kind::Constant, rows, cols);
+   node->offset = value;
+   return node;
+}
+
+MatrixExprRef matrixLeaf(MatrixStorage storage, int rows, int cols) {
+   auto node = makeNode(Kind::Leaf, rows, cols);
+   node->leaf = std::move(storage);
+   return node;
+}
+
+MatrixExprRef matrixAffine(const MatrixExprRef &operand, double scale, double offset) {
+   if (scale == 1.0 && offset == 0.0) return operand;
+   if (operand->kind == Kind::Constant) {
+      return matrixConstant(scale * operand->offset + offset, operand->rows, operand->cols);
+   }
+   if (operand->kind == Kind::Affine) {
+      return matrixAffine(operand->left, operand->scale * scale, operand->offset * scale + offset);
+   }
+
+   auto node = makeNode(Kind::Affine, operand->rows, operand->cols);
+   node->left = operand;
+   node->scale = scale;
+   node->offset = offset;
+   node->height = operand->height + 1;
+   return node;
+}
+
+MatrixExprRef matrixBinary(Kind kind, const MatrixExprRef &left, const MatrixExprRef &right) {
+   bool leftConstant = left->kind == Kind::Constant;
+   bool rightConstant = right->kind == Kind::Constant;
+   switch (kind) {
+      case Kind::Add:
+         if (leftConstant) return matrixAffine(right, 1.0, left->offset);
+         if (rightConstant) return matrixAffine(left, 1.0, right->offset);
+         break;
+      case Kind::Subtract:
+         if (leftConstant) return matrixAffine(right, -1.0, left->offset);
+         if (rightConstant) return matrixAffine(left, 1.0, -right->offset);
+         break;
+      case Kind::Multiply:
+         if (leftConstant) return matrixAffine(right, left->offset, 0.0);
+         if (rightConstant) return matrixAffine(left, right->offset, 0.0);
+         break;
+      default:
+         break;
+   }
+
+   auto node = makeNode(kind, left->rows, kind == Kind::Product ? right->cols : left->cols);
+   node->left = left;
+   node->right = right;
+   node->height = std::max(left->height, right->height) + 1;
+   return node;
+}
+
+static const double *materialize(const MatrixExprRef &node, std::vector<MatrixStorage> &temps);
+
+static void computeProduct(const MatrixExprNode &product, double *out, double alpha, double beta,
+                           std::vector<MatrixStorage> &temps) {
+   const double *a = materialize(product.left, temps);
+   const double *b = materialize(product.right, temps);
+   gemmAutoParallel(product.rows, product.cols, product.left->cols, a, b, out, alpha, beta);
+}
+
+// Elements of a node as one contiguous array. Products are computed once and
+// kept on the node; other expressions are evaluated into temps.
+static const double *materialize(const MatrixExprRef &node, std::vector<MatrixStorage> &temps) {
+   if (node->kind == Kind::Leaf) return node->leaf.get();
+   if (node->computed) return node->computed.get();
+   if (node->kind == Kind::Product) {
+      MatrixStorage result = allocateStorage(static_cast<std::size_t>(node->rows) * node->cols);
+      computeProduct(*node, result.get(), 1.0, 0.0, temps);
+      node->computed = std::move(result);
+      return node->computed.get();
+   }
+   temps.push_back(evaluateMatrixExpr(node));
+   return temps.back().get();
+}
+
+// Computes every product the fused pass will read.
+static void prepareProducts(const MatrixExprRef &node, std::vector<MatrixStorage> &temps) {
+   if (!node || node->computed) return;
+   if (node->kind == Kind::Product) {
+      materialize(node, temps);
+      return;
+   }
+   prepareProducts(node->left, temps);
+   prepareProducts(node->right, temps);
+}
+
+// Evaluates elements [offset, offset + count) of an elementwise expression and
+// returns where they are: dst, or the node's own storage for leaves and
+// products. Children write to the first two slots and leave the ones after
+// them to their own children.
+static const double *evalChunk(const MatrixExprNode &node, std::size_t offset, std::size_t count, double *dst,
+                               double *slots) {
+   if (node.computed) return node.computed.get() + offset;
+   switch (node.kind) {
+      case Kind::Leaf:
+         return node.leaf.get() + offset;
+      case Kind::Constant:
+         std::fill(dst, dst + count, node.offset);
+         return dst;
+      case Kind::Affine: {
+         const double *x = evalChunk(*node.left, offset, count, slots, slots + 2 * CHUNK);
+         for (std::size_t i = 0; i < count; ++i) dst[i] = node.scale * x[i] + node.offset;
+         return dst;
+      }
+      default:
+         break;
+   }
+
+   const double *l = evalChunk(*node.left, offset, count, slots, slots + 2 * CHUNK);
+   const double *r = evalChunk(*node.right, offset, count, slots + CHUNK, slots + 2 * CHUNK);
+   switch (node.kind) {
+      case Kind::Add:
+         for (std::size_t i = 0; i < count; ++i) dst[i] = l[i] + r[i];
+         break;
+      case Kind::Subtract:
+         for (std::size_t i = 0; i < count; ++i) dst[i] = l[i] - r[i];
+         break;
+      default:
+         for (std::size_t i = 0; i < count; ++i) dst[i] = l[i] * r[i];
+         break;
+   }
+   return dst;
+}
+
+// Finds a product that node depends on only linearly (through Add, Subtract
+// and Affine) and rebuilds node with that occurrence replaced by zero, so that
+// node = rest + alpha * product.
+static bool extractLinearProduct(const MatrixExprRef &node, double coefficient, MatrixExprRef &rest,
+                                 const MatrixExprNode *&product, double &alpha) {
+   MatrixExprRef inner;
+   if (node->computed) return false;
+   switch (node->kind) {
+      case Kind::Product:
+         product = node.get();
+         alpha = coefficient;
+         rest = matrixConstant(0.0, node->rows, node->cols);
+         return true;
+      case Kind::Affine:
+         if (!extractLinearProduct(node->left, coefficient * node->scale, inner, product, alpha)) return false;
+         rest = matrixAffine(inner, node->scale, node->offset);
+         return true;
+      case Kind::Add:
+      case Kind::Subtract:
+         if (extractLinearProduct(node->left, coefficient, inner, product, alpha)) {
+            rest = matrixBinary(node->kind, inner, node->right);
+            return true;
+         }
+         if (extractLinearProduct(node->right, node->kind == Kind::Add ? coefficient : -coefficient, inner, product,
+                                  alpha)) {
+            rest = matrixBinary(node->kind, node->left, inner);
+            return true;
+         }
+         return false;
+      default:
+         return false;
+   }
+}
+
+// Computes, children first, every node below root that root reaches along more
+// than one path, so that what remains to evaluate is a tree. Without this a
+// value doubled n times would be evaluated 2^n times.
+static void computeSharedNodes(const MatrixExprRef &root) {
+   std::unordered_map<const MatrixExprNode *, int> uses;
+   std::vector<MatrixExprRef> postorder;
+   std::vector<std::pair<MatrixExprRef, bool>> stack{{root, false}};
+   while (!stack.empty()) {
+      auto [node, expanded] = stack.back();
+      stack.pop_back();
+      if (expanded) {
+         postorder.push_back(node);
+         continue;
+      }
+      if (++uses[node.get()] > 1 || node->computed || node->kind == Kind::Leaf) continue;
+      stack.emplace_back(node, true);
+      if (node->right) stack.emplace_back(node->right, false);
+      if (node->left) stack.emplace_back(node->left, false);
+   }
+   for (const MatrixExprRef &node: postorder) {
+      if (node != root && uses[node.get()] > 1 && node->kind != Kind::Constant) {
+         node->computed = evaluateMatrixExpr(node);
+      }
+   }
+}
+
+MatrixStorage evaluateMatrixExpr(const MatrixExprRef &node) {
+   if (node->kind == Kind::Leaf) return node->leaf;
+   if (node->computed) return node->computed;
+   computeSharedNodes(node);
+
+   std::size_t size = static_cast<std::size_t>(node->rows) * node->cols;
+   MatrixStorage out = allocateStorage(size);
+   std::vector<MatrixStorage> temps;
+
+   MatrixExprRef rest;
+   const MatrixExprNode *product = nullptr;
+   double alpha = 1.0;
+   if (!extractLinearProduct(node, 1.0, rest, product, alpha)) rest = node;
+
+   bool restIsZero = rest->kind == Kind::Constant && rest->offset == 0.0;
+   if (!restIsZero) {
+      prepareProducts(rest, temps);
+      std::vector<double> slots(2 * CHUNK * rest->height);
+      for (std::size_t offset = 0; offset < size; offset += CHUNK) {
+         std::size_t count = std::min(CHUNK, size - offset);
+         const double *chunk = evalChunk(*rest, offset, count, out.get() + offset, slots.data());
+         if (chunk != out.get() + offset) std::memcpy(out.get() + offset, chunk, count * sizeof(double));
+      }
+   }
+   if (product) computeProduct(*product, out.get(), alpha, restIsZero ? 0.0 : 1.0, temps);
+   return out;
+}
@@ -0,0 +1,43 @@
+#include <algorithm>
+
+#include "optimizer.h"
+#include "ir_builder.h"
+#include "ir_simplifier.h"
+#include "ir_bytecode_compiler.h"
+#include "error.h"
+
+std::unique_ptr<IrModule> Optimizer::optimize(const Expr &program) {
+   lastReport = OptimizerReport();
+   std::unique_ptr<IrModule> module = IrBuilder().build(program);
+   IrSimplifier simplifier;
+   lastReport.simplified = simplifier.simplify(*module);
+   if (options.inlining) lastReport.inlining = Inliner(options.inlinerOptions).inlineCalls(*module);
+   if (options.valueNumbering) {
+      lastReport.valueNumbering = ValueNumbering().eliminate(*module);
+      if (lastReport.valueNumbering.eliminated()) lastReport.simplified += simplifier.simplify(*module);
+   }
+   if (options.loops) lastReport.loops = LoopOptimizer(options.loopOptions).optimize(*module);
+   return module;
+}
+
+static bool handlesExceptions(const IrModule &module) {
+   return std::any_of(module.functions.begin(), module.functions.end(), [](const auto &function) {
+       return std::any_of(function->blocks.begin(), function->blocks.end(), [](const auto &block) {
+           return block->handler != nullptr;
+       });
+   });
+}
+
+std::unique_ptr<Program> Optimizer::compile(const Expr &program) {
+   std::unique_ptr<IrModule> module = optimize(program);
+   if (handlesExceptions(*module)) return nullptr;
+   std::unique_ptr<Program> result;
+   try {
+      result = IrBytecodeCompiler().compile(*module);
+   } catch (const CompilerError &) {
+      // Out of registers: the BytecodeCompiler reuses them more tightly.
+      return nullptr;
+   }
+   lastReport.compiled = true;
+   return result;
+}
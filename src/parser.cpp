@@ -5,12 +5,10 @@
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "misc-no-recursion"
 
-#include <iostream>
-
 #include "parser.h"
 #include "error.h"
 
-Parser::Parser(const std::vector<Token> &tokens) : tokens(tokens) {}
+Parser::Parser(const std::vector<Token> &tokens, TypeContext &types) : types(types), tokens(tokens) {}
 
 std::unique_ptr<Expr> Parser::parse() {
    scopeManager.pushScope();
@@ -59,8 +57,40 @@ bool Parser::match(TokenType type) {
    return false;
 }
 
+std::string Parser::unescapeString(const std::string &lexeme) {
+   std::string result;
+   result.reserve(lexeme.size());
+
+   for (size_t i = 1; i + 1 < lexeme.size(); ++i) {
+      char c = lexeme[i];
+      if (c == '\\' && i + 2 < lexeme.size()) {
+         char next = lexeme[++i];
+         switch (next) {
+            case 'n':
+               result += '\n';
+               break;
+            case 't':
+               result += '\t';
+               break;
+            case 'r':
+               result += '\r';
+               break;
+            default:
+               result += next;
+               break;
+         }
+      } else {
+         result += c;
+      }
+   }
+
+   return result;
+}
+
 int Parser::getPrecedence(TokenType type) {
    switch (type) {
+      case TokenType::ASSIGN:
+         return 0;
       case TokenType::OR:
          return 1;
       case TokenType::AND:
@@ -196,7 +226,7 @@ std::unique_ptr<Expr> Parser::parseUnary() {
    while (true) {
       TokenType t = peek().type;
       if (t == TokenType::PLUS || t == TokenType::MINUS ||
-          t == TokenType::BANG || t == TokenType::BITWISE_NOT ||
+          t == TokenType::BANG || t == TokenType::NOT || t == TokenType::BITWISE_NOT ||
           t == TokenType::INCREMENT || t == TokenType::DECREMENT) {
          unaryOperators.push_back(advance());
       } else {
@@ -240,7 +270,7 @@ std::unique_ptr<Expr> Parser::primary() {
 
    if (match(TokenType::STRING_LITERAL)) {
       const Token &token = tokens[current - 1];
-      return std::make_unique<LiteralExpr>(token.lexeme);
+      return std::make_unique<LiteralExpr>(unescapeString(token.lexeme));
    }
 
    if (match(TokenType::BOOLEAN_LITERAL)) {
@@ -270,7 +300,6 @@ std::unique_ptr<Expr> Parser::primary() {
 
 std::unique_ptr<Expr> Parser::declaration() {
    if (check(TokenType::END_OF_FILE)) {
-      std::cerr << "[DEBUG] EOF reached in declaration()\n";
       return nullptr;
    }
 
@@ -282,21 +311,16 @@ std::unique_ptr<Expr> Parser::declaration() {
       std::string name = tokens[current - 1].lexeme;
       const Token &token = tokens[current - 1];
 
-      std::shared_ptr<Type> declaredType = std::make_shared<Type>(TypeKind::Unknown);
+      TypeRef declaredType = types.unknownType();
+      TypeRef annotation;
 
-      if (match(TokenType::SEMICOLON)) {
-         if (!match(TokenType::IDENTIFIER)) {
+      if (match(TokenType::COLON)) {
+         if (!match(TokenType::IDENTIFIER) && !match(TokenType::INT) && !match(TokenType::FLOAT) &&
+             !match(TokenType::STRING) && !match(TokenType::BOOL) && !match(TokenType::NULL_LITERAL)) {
             throw CompilerError("Expected type name after ':'", peek().line, peek().column);
          }
 
-         std::string typeName = tokens[current - 1].lexeme;
-
-         if (typeName == "int") declaredType = std::make_shared<Type>(TypeKind::Int);
-         else if (typeName == "float")declaredType = std::make_shared<Type>(TypeKind::Float);
-         else if (typeName == "bool") declaredType = std::make_shared<Type>(TypeKind::Bool);
-         else if (typeName == "string")declaredType = std::make_shared<Type>(TypeKind::String);
-         else if (typeName == "null") declaredType = std::make_shared<Type>(TypeKind::Null);
-         else declaredType = std::make_shared<Type>(TypeKind::Custom, typeName);
+         declaredType = annotation = types.fromName(tokens[current - 1].lexeme);
       }
 
       std::unique_ptr<Expr> initializer = nullptr;
@@ -313,7 +337,7 @@ std::unique_ptr<Expr> Parser::declaration() {
          throw CompilerError("Variable '" + name + "' already declared in this scope", token.line, token.column);
       }
 
-      return std::make_unique<VarDeclarationExpr>(name, std::move(initializer));
+      return std::make_unique<VarDeclarationExpr>(name, std::move(initializer), annotation);
    }
 
    if (match(TokenType::FUNCTION)) {
@@ -349,7 +373,7 @@ std::unique_ptr<Expr> Parser::statement() {
       }
       return std::make_unique<ContinueStatementExpr>();
    }
-   if (match(TokenType::LEFT_BRACE)) return block();
+   if (check(TokenType::LEFT_BRACE)) return block();
 
    if (check(TokenType::CATCH) || check(TokenType::FINALLY)) {
       throw CompilerError("Unexpected 'catch' or 'finally' outside of 'try'", peek().line, peek().column);
@@ -398,10 +422,8 @@ std::unique_ptr<Expr> Parser::block() {
 
 std::unique_ptr<Expr> Parser::statementOrBlock() {
    if (check(TokenType::LEFT_BRACE)) {
-      std::cout << "[DEBUG] Block is called from statementOrBlock()\n";
       return block();
    }
-   std::cout << "[DEBUG] Statement is called from statementOrBlock()\n";
    return statement();
 }
 
@@ -447,8 +469,10 @@ std::unique_ptr<Expr> Parser::forStatement() {
       throw CompilerError("Expected '(' after 'for'", peek().line, peek().column);
    }
 
+   scopeManager.pushScope();
+
    std::unique_ptr<Expr> initializer = nullptr;
-   if (match(TokenType::VAR)) {
+   if (check(TokenType::VAR)) {
       initializer = declaration();
    } else if (!check(TokenType::SEMICOLON)) {
       initializer = expression();
@@ -478,17 +502,14 @@ std::unique_ptr<Expr> Parser::forStatement() {
 
    auto body = statement();
 
-   std::vector<std::unique_ptr<Expr>> loopBodyStatements;
-   loopBodyStatements.push_back(std::move(body));
-   if (increment) {
-      loopBodyStatements.push_back(std::make_unique<ExpressionStatementExpr>(std::move(increment)));
-   }
-
    auto loop = std::make_unique<WhileStatementExpr>(
            condition ? std::move(condition) : std::make_unique<LiteralExpr>(true),
-           std::make_unique<BlockStatementExpr>(std::move(loopBodyStatements))
+           std::move(body),
+           increment ? std::make_unique<ExpressionStatementExpr>(std::move(increment)) : nullptr
    );
 
+   scopeManager.popScope();
+
    if (initializer) {
       std::vector<std::unique_ptr<Expr>> full;
       full.push_back(std::move(initializer));
@@ -511,7 +532,8 @@ std::unique_ptr<Expr> Parser::functionDeclaration() {
    }
 
    std::vector<std::string> params;
-   std::vector<std::shared_ptr<Type>> paramTypes;
+   std::vector<TypeRef> paramTypes;
+   std::vector<Symbol> paramSymbols;
 
    if (!check(TokenType::RIGHT_PAREN)) {
       do {
@@ -521,18 +543,12 @@ std::unique_ptr<Expr> Parser::functionDeclaration() {
 
          std::string paramName = tokens[current - 1].lexeme;
 
-         auto paramType = std::make_shared<Type>(TypeKind::Unknown);
-
-         Symbol paramSym(paramName, SymbolType::Parameter, paramType, true,
-                         tokens[current - 1].line, tokens[current - 1].column);
-
-         if (!scopeManager.declare(paramSym)) {
-            throw CompilerError("Parameter '" + paramName + "' already declared",
-                                tokens[current - 1].line, tokens[current - 1].column);
-         }
+         TypeRef paramType = types.unknownType();
 
+         paramSymbols.emplace_back(paramName, SymbolType::Parameter, paramType, true,
+                                   tokens[current - 1].line, tokens[current - 1].column);
          params.push_back(paramName);
-         paramTypes.push_back(std::move(paramType));
+         paramTypes.push_back(paramType);
 
       } while (match(TokenType::COMMA));
    }
@@ -541,10 +557,8 @@ std::unique_ptr<Expr> Parser::functionDeclaration() {
       throw CompilerError("Expected ')' after function parameters", peek().line, peek().column);
    }
 
-   auto returnType = std::make_shared<Type>(TypeKind::Unknown);
-
    Symbol functionSym(name, SymbolType::Function,
-                      Type::makeFunction(paramTypes, returnType),
+                      types.function(paramTypes, types.unknownType()),
                       false,
                       tokens[current - 1].line,
                       tokens[current - 1].column);
@@ -555,6 +569,13 @@ std::unique_ptr<Expr> Parser::functionDeclaration() {
 
    scopeManager.pushScope();
 
+   for (const auto &paramSym: paramSymbols) {
+      if (!scopeManager.declare(paramSym)) {
+         throw CompilerError("Parameter '" + paramSym.name + "' already declared",
+                             paramSym.line, paramSym.column);
+      }
+   }
+
    auto body = block();
 
    scopeManager.popScope();
@@ -601,7 +622,7 @@ std::unique_ptr<Expr> Parser::switchStatement() {
    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
       if (match(TokenType::CASE)) {
          auto caseValue = expression();
-         if (!match(TokenType::SEMICOLON)) {
+         if (!match(TokenType::COLON)) {
             throw CompilerError("Expected ':' after case expression", peek().line, peek().column);
          }
          auto stmt = statement();
@@ -609,7 +630,7 @@ std::unique_ptr<Expr> Parser::switchStatement() {
                  std::make_unique<CaseClauseExpr>(std::move(caseValue), std::move(stmt))
          );
       } else if (match(TokenType::DEFAULT)) {
-         if (!match(TokenType::SEMICOLON)) {
+         if (!match(TokenType::COLON)) {
             throw CompilerError("Expected ':' after 'default'", peek().line, peek().column);
          }
          defaultClause = statement();
@@ -683,7 +704,7 @@ std::unique_ptr<Expr> Parser::tryStatement() {
       Symbol catchSym(
               exceptionVarName,
               SymbolType::Variable,
-              std::make_shared<Type>(TypeKind::Unknown),
+              types.unknownType(),
               true,
               tokens[current - 1].line,
               tokens[current - 1].column
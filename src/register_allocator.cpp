@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include "register_allocator.h"
+#include "error.h"
+
+namespace {
+
+struct Interval {
+    const IrInstr *value = nullptr;
+    int start = 0;
+    int end = 0;
+};
+
+}
+
+RegisterAllocator::RegisterAllocator(const IrFunction &function, const Liveness &liveness,
+                                     const std::function<bool(const IrInstr *)> &needsRegister, int limit) {
+   std::vector<const IrInstr *> byId;
+   auto number = [&](const IrInstr *value) {
+       if (value->id < 0) return;
+       if (byId.size() <= static_cast<size_t>(value->id)) byId.resize(value->id + 1, nullptr);
+       byId[value->id] = value;
+   };
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *phi: block->phis) number(phi);
+      for (const IrInstr *instr: block->instructions) number(instr);
+   }
+   registers.assign(byId.size(), -1);
+
+   // A block starts at an even position, where its phis are defined; its k-th
+   // instruction is at start + 2(k + 1), and the copies into its successors'
+   // phis run at its end, after the terminator.
+   std::vector<Interval> intervals(byId.size());
+   auto extend = [&](const IrInstr *value, int position) {
+       if (!needsRegister(value)) return;
+       Interval &interval = intervals[value->id];
+       if (!interval.value) {
+          interval = Interval{value, position, position};
+          return;
+       }
+       interval.start = std::min(interval.start, position);
+       interval.end = std::max(interval.end, position);
+   };
+   auto extendAll = [&](const BitVector &live, int position) {
+       live.forEach([&](size_t id) {
+           if (id < byId.size() && byId[id]) extend(byId[id], position);
+       });
+   };
+   int position = 0;
+   for (const auto &block: function.blocks) {
+      int start = position;
+      int end = start + 2 * static_cast<int>(block->instructions.size() + 1);
+      extendAll(liveness.liveIn(block.get()), start);
+      for (const IrInstr *phi: block->phis) extend(phi, start);
+      for (size_t k = 0; k < block->instructions.size(); ++k) {
+         const IrInstr *instr = block->instructions[k];
+         int at = start + 2 * static_cast<int>(k + 1);
+         if (instr->id >= 0) extend(instr, at);
+         for (const IrInstr *operand: instr->operands) extend(operand, at);
+      }
+      extendAll(liveness.liveOut(block.get()), end);
+      position = end + 2;
+   }
+
+   std::vector<Interval> order;
+   for (const Interval &interval: intervals) {
+      if (interval.value) order.push_back(interval);
+   }
+   std::sort(order.begin(), order.end(), [](const Interval &a, const Interval &b) {
+       return a.start != b.start ? a.start < b.start : a.value->id < b.value->id;
+   });
+
+   std::vector<bool> busy(limit, false);
+   std::vector<Interval> active;
+   auto available = [&](int reg) { return reg >= 0 && reg < limit && !busy[reg]; };
+   for (const Interval &interval: order) {
+      const IrInstr *value = interval.value;
+      auto expired = std::partition(active.begin(), active.end(), [&](const Interval &other) {
+          return other.end > interval.start;
+      });
+      for (auto it = expired; it != active.end(); ++it) busy[registers[it->value->id]] = false;
+      active.erase(expired, active.end());
+
+      int reg = -1;
+      if (value->op == IrOp::Param) {
+         reg = value->index;
+         if (!available(reg)) {
+            throw CompilerError("Parameter " + std::to_string(reg) + " of '" + function.name + "' has no register");
+         }
+      } else {
+         // Phis and their operands try for one register, so the copy
+         // between them is a no-op.
+         auto hinted = [&](const IrInstr *other) { return available(registerOf(other)) ? registerOf(other) : -1; };
+         if (value->op == IrOp::Phi) {
+            for (const IrInstr *operand: value->operands) {
+               if (reg < 0) reg = hinted(operand);
+            }
+         }
+         for (const IrInstr *user: value->users) {
+            if (reg < 0 && user->op == IrOp::Phi) reg = hinted(user);
+         }
+         for (int r = 0; reg < 0 && r < limit; ++r) {
+            if (!busy[r]) reg = r;
+         }
+         if (reg < 0) {
+            throw CompilerError("Function '" + function.name + "' needs more than " + std::to_string(limit) +
+                                " registers");
+         }
+      }
+      registers[value->id] = reg;
+      busy[reg] = true;
+      used = std::max(used, reg + 1);
+      active.push_back(interval);
+   }
+}
@@ -0,0 +1,240 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include "resolver.h"
+#include "error.h"
+#include "type_context.h"
+
+int Resolver::declareGlobal(const std::string &name) {
+   if (Symbol *existing = scopes.lookup(name)) {
+      if (existing->frameDepth == 0 && existing->slot >= 0) return existing->slot;
+   }
+   return declare(name, SymbolType::Variable).index;
+}
+
+void Resolver::resolve(Expr &program) {
+   visit(&program);
+}
+
+void Resolver::beginScope() {
+   scopes.pushScope();
+   scopeMarks.push_back(frames.empty() ? 0 : frames.back().nextSlot);
+}
+
+void Resolver::endScope() {
+   if (!frames.empty()) {
+      frames.back().nextSlot = scopeMarks.back();
+   }
+   scopeMarks.pop_back();
+   scopes.popScope();
+}
+
+VariableSlot Resolver::declare(const std::string &name, SymbolType kind) {
+   Symbol symbol(name, kind, TypeContext::global().unknownType(), true, 0, 0);
+   symbol.frameDepth = static_cast<int>(frames.size());
+
+   VariableSlot slot;
+   if (frames.empty()) {
+      slot.kind = VariableSlot::Kind::Global;
+      slot.index = static_cast<int>(globals.size());
+   } else {
+      Frame &frame = frames.back();
+      slot.kind = VariableSlot::Kind::Local;
+      slot.index = frame.nextSlot++;
+      if (frame.nextSlot > frame.maxSlot) frame.maxSlot = frame.nextSlot;
+   }
+   symbol.slot = slot.index;
+
+   if (!scopes.declare(symbol)) {
+      throw CompilerError("Variable '" + name + "' already declared in this scope");
+   }
+   if (slot.kind == VariableSlot::Kind::Global) {
+      globals.push_back(name);
+   }
+   return slot;
+}
+
+VariableSlot Resolver::reference(const std::string &name) {
+   VariableSlot slot;
+   Symbol *symbol = scopes.lookup(name);
+   if (!symbol || symbol->type == SymbolType::Function) return slot;
+
+   if (symbol->frameDepth == 0) {
+      slot.kind = VariableSlot::Kind::Global;
+   } else if (symbol->frameDepth == static_cast<int>(frames.size())) {
+      slot.kind = VariableSlot::Kind::Local;
+   } else {
+      throw CompilerError("Function '" + frames.back().function +
+                          "' cannot capture local variable '" + name + "' of an enclosing function");
+   }
+   slot.index = symbol->slot;
+   return slot;
+}
+
+void Resolver::visit(Expr *expr) {
+   if (!expr) return;
+
+   switch (expr->type) {
+      case ExprType::Literal:
+      case ExprType::BreakStatement:
+      case ExprType::ContinueStatement:
+         break;
+
+      case ExprType::Identifier: {
+         auto *identifier = static_cast<IdentifierExpr *>(expr);
+         identifier->slot = reference(identifier->name);
+         break;
+      }
+
+      case ExprType::Binary: {
+         auto *binary = static_cast<BinaryExpr *>(expr);
+         visit(binary->left.get());
+         visit(binary->right.get());
+         break;
+      }
+
+      case ExprType::Unary:
+         visit(static_cast<UnaryExpr *>(expr)->right.get());
+         break;
+
+      case ExprType::MatrixMultiplication: {
+         auto *mul = static_cast<MatrixMultiplicationExpr *>(expr);
+         visit(mul->left.get());
+         visit(mul->right.get());
+         break;
+      }
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<VarDeclarationExpr *>(expr);
+         visit(decl->initializer.get());
+         decl->slot = declare(decl->name, SymbolType::Variable);
+         break;
+      }
+
+      case ExprType::Assignment: {
+         auto *assign = static_cast<AssignmentExpr *>(expr);
+         visit(assign->value.get());
+         assign->slot = reference(assign->name);
+         break;
+      }
+
+      case ExprType::FunctionDeclaration:
+         visitFunction(static_cast<FunctionDeclarationExpr *>(expr));
+         break;
+
+      case ExprType::FunctionCall:
+         for (const auto &arg: static_cast<FunctionCallExpr *>(expr)->arguments) {
+            visit(arg.get());
+         }
+         break;
+
+      case ExprType::IfStatement: {
+         auto *stmt = static_cast<IfStatementExpr *>(expr);
+         visit(stmt->condition.get());
+         visit(stmt->thenBranch.get());
+         visit(stmt->elseBranch.get());
+         break;
+      }
+
+      case ExprType::WhileStatement: {
+         auto *stmt = static_cast<WhileStatementExpr *>(expr);
+         visit(stmt->condition.get());
+         visit(stmt->body.get());
+         visit(stmt->increment.get());
+         break;
+      }
+
+      case ExprType::DoWhileStatement: {
+         auto *stmt = static_cast<DoWhileStatementExpr *>(expr);
+         visit(stmt->body.get());
+         visit(stmt->condition.get());
+         break;
+      }
+
+      case ExprType::ForStatement: {
+         auto *stmt = static_cast<ForStatementExpr *>(expr);
+         beginScope();
+         visit(stmt->initializer.get());
+         visit(stmt->condition.get());
+         visit(stmt->increment.get());
+         visit(stmt->body.get());
+         endScope();
+         break;
+      }
+
+      case ExprType::ReturnStatement:
+         visit(static_cast<ReturnStatementExpr *>(expr)->value.get());
+         break;
+
+      case ExprType::BlockStatement:
+         beginScope();
+         for (const auto &statement: static_cast<BlockStatementExpr *>(expr)->statements) {
+            visit(statement.get());
+         }
+         endScope();
+         break;
+
+      case ExprType::ExpressionStatement:
+         visit(static_cast<ExpressionStatementExpr *>(expr)->expression.get());
+         break;
+
+      case ExprType::SwitchStatement: {
+         auto *stmt = static_cast<SwitchStatementExpr *>(expr);
+         visit(stmt->switchExpr.get());
+         for (const auto &clause: stmt->caseClauses) {
+            visit(clause.get());
+         }
+         visit(stmt->defaultClause.get());
+         break;
+      }
+
+      case ExprType::CaseClause: {
+         auto *clause = static_cast<CaseClauseExpr *>(expr);
+         visit(clause->caseExpr.get());
+         beginScope();
+         visit(clause->body.get());
+         endScope();
+         break;
+      }
+
+      case ExprType::TryCatchFinallyStatement: {
+         auto *stmt = static_cast<TryCatchFinallyStatementExpr *>(expr);
+         visit(stmt->tryBlock.get());
+         for (const auto &clause: stmt->catches) {
+            visit(clause.get());
+         }
+         visit(stmt->finallyBlock.get());
+         break;
+      }
+
+      case ExprType::CatchClause: {
+         auto *clause = static_cast<CatchClauseExpr *>(expr);
+         beginScope();
+         clause->slot = declare(clause->exceptionVarName, SymbolType::Variable);
+         visit(clause->block.get());
+         endScope();
+         break;
+      }
+   }
+}
+
+void Resolver::visitFunction(FunctionDeclarationExpr *function) {
+   Symbol symbol(function->name, SymbolType::Function, TypeContext::global().unknownType(), false, 0, 0);
+   symbol.frameDepth = static_cast<int>(frames.size());
+   if (!scopes.declare(symbol)) {
+      throw CompilerError("Function '" + function->name + "' already declared");
+   }
+
+   frames.push_back(Frame{function->name, 0, 0});
+   beginScope();
+   for (const auto &param: function->params) {
+      declare(param, SymbolType::Parameter);
+   }
+   visit(function->body.get());
+   endScope();
+
+   function->frameSize = frames.back().maxSlot;
+   frames.pop_back();
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+
+#include "switch_table.h"
+#include "ast.h"
+
+// Integer keys become a jump table when at most this many slots per key are
+// holes.
+constexpr std::int64_t MAX_DENSE_SLOTS_PER_KEY = 3;
+constexpr std::uint32_t MAX_BUCKET_SEEDS = 1u << 16;
+
+static std::uint32_t hashString(const std::string &key, std::uint32_t seed) {
+   std::uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+   for (unsigned char c: key) {
+      hash ^= c;
+      hash *= 16777619u;
+   }
+   hash ^= hash >> 15;
+   hash *= 0x2c1b3c6du;
+   return hash ^ (hash >> 12);
+}
+
+void SwitchTable::addInteger(std::int32_t key, int target) {
+   for (const auto &entry: integers) {
+      if (entry.first == key) return;
+   }
+   integers.emplace_back(key, target);
+}
+
+void SwitchTable::addString(const std::string &key, int target) {
+   for (const auto &entry: strings) {
+      if (entry.key == key) return;
+   }
+   strings.push_back(StringEntry{key, target});
+}
+
+void SwitchTable::build() {
+   std::sort(integers.begin(), integers.end());
+   if (!integers.empty()) {
+      std::int64_t span = static_cast<std::int64_t>(integers.back().first) - integers.front().first + 1;
+      if (span <= MAX_DENSE_SLOTS_PER_KEY * static_cast<std::int64_t>(integers.size())) {
+         low = integers.front().first;
+         dense.assign(static_cast<size_t>(span), NO_MATCH);
+         for (const auto &entry: integers) dense[static_cast<size_t>(entry.first - low)] = entry.second;
+         integers.clear();
+      }
+   }
+
+   stringCount = strings.size();
+   if (strings.empty()) return;
+   size_t bucketCount = (strings.size() + 3) / 4;
+   size_t slotCount = strings.size();
+   while (!placeStrings(bucketCount, slotCount)) slotCount += slotCount / 4 + 1;
+   strings.clear();
+}
+
+// Hash and displace: buckets are placed largest first, each trying seeds until
+// its keys land on distinct free slots.
+bool SwitchTable::placeStrings(size_t bucketCount, size_t slotCount) {
+   std::vector<std::vector<size_t>> buckets(bucketCount);
+   for (size_t i = 0; i < strings.size(); ++i) buckets[hashString(strings[i].key, 0) % bucketCount].push_back(i);
+   std::vector<size_t> order(bucketCount);
+   for (size_t b = 0; b < bucketCount; ++b) order[b] = b;
+   std::stable_sort(order.begin(), order.end(),
+                    [&](size_t x, size_t y) { return buckets[x].size() > buckets[y].size(); });
+
+   seeds.assign(bucketCount, 0);
+   slots.assign(slotCount, StringEntry{});
+   std::vector<bool> used(slotCount, false);
+   std::vector<size_t> chosen;
+   for (size_t b: order) {
+      if (buckets[b].empty()) break;
+      bool placed = false;
+      for (std::uint32_t seed = 1; seed < MAX_BUCKET_SEEDS && !placed; ++seed) {
+         chosen.clear();
+         for (size_t key: buckets[b]) {
+            size_t slot = hashString(strings[key].key, seed) % slotCount;
+            if (used[slot] || std::find(chosen.begin(), chosen.end(), slot) != chosen.end()) break;
+            chosen.push_back(slot);
+         }
+         if (chosen.size() != buckets[b].size()) continue;
+         for (size_t j = 0; j < chosen.size(); ++j) {
+            used[chosen[j]] = true;
+            slots[chosen[j]] = strings[buckets[b][j]];
+         }
+         seeds[b] = seed;
+         placed = true;
+      }
+      if (!placed) return false;
+   }
+   return true;
+}
+
+int SwitchTable::lookupInteger(std::int32_t key) const {
+   if (!dense.empty()) {
+      std::int64_t index = static_cast<std::int64_t>(key) - low;
+      return index >= 0 && index < static_cast<std::int64_t>(dense.size()) ? dense[static_cast<size_t>(index)]
+                                                                             : NO_MATCH;
+   }
+   auto it = std::lower_bound(integers.begin(), integers.end(), key,
+                              [](const std::pair<std::int32_t, int> &entry, std::int32_t k) { return entry.first < k; });
+   return it != integers.end() && it->first == key ? it->second : NO_MATCH;
+}
+
+int SwitchTable::lookupString(const std::string &key) const {
+   if (slots.empty()) return NO_MATCH;
+   std::uint32_t seed = seeds[hashString(key, 0) % seeds.size()];
+   const StringEntry &entry = slots[hashString(key, seed) % slots.size()];
+   return entry.target != NO_MATCH && entry.key == key ? entry.target : NO_MATCH;
+}
+
+int SwitchTable::lookup(const Value &subject) const {
+   if (subject.isInt()) return lookupInteger(subject.asInt());
+   if (subject.isFloat()) {
+      double number = subject.asFloat();
+      if (number >= INT32_MIN && number <= INT32_MAX && number == std::floor(number)) {
+         return lookupInteger(static_cast<std::int32_t>(number));
+      }
+      return NO_MATCH;
+   }
+   if (subject.isString()) return lookupString(subject.asString()->chars);
+   return NO_MATCH;
+}
+
+std::string SwitchTable::describe() const {
+   std::string result;
+   if (!dense.empty()) {
+      std::int64_t high = low + static_cast<std::int64_t>(dense.size()) - 1;
+      result = "jump table " + std::to_string(low) + ".." + std::to_string(high);
+   } else if (!integers.empty()) {
+      result = "binary search " + std::to_string(integers.size()) + " keys";
+   }
+   if (stringCount > 0) {
+      if (!result.empty()) result += ", ";
+      result += "perfect hash " + std::to_string(stringCount) + " keys";
+   }
+   return result;
+}
+
+// Literal case values a table can hold.
+static bool tableKey(const Expr *expr, SwitchTable &table, int target) {
+   bool negate = false;
+   if (expr->type == ExprType::Unary) {
+      auto *unary = static_cast<const UnaryExpr *>(expr);
+      if (unary->operation != UnaryOperator::Negate) return false;
+      negate = true;
+      expr = unary->right.get();
+   }
+   if (expr->type != ExprType::Literal) return false;
+   const auto &value = static_cast<const LiteralExpr *>(expr)->value;
+   if (const int *integer = std::get_if<int>(&value)) {
+      table.addInteger(negate ? -*integer : *integer, target);
+      return true;
+   }
+   if (const std::string *string = std::get_if<std::string>(&value)) {
+      if (negate) return false;
+      table.addString(*string, target);
+      return true;
+   }
+   return false;
+}
+
+std::vector<SwitchStep> planSwitch(const SwitchStatementExpr &stmt) {
+   std::vector<SwitchStep> steps;
+   size_t count = stmt.caseClauses.size();
+   size_t i = 0;
+   while (i < count) {
+      auto table = std::make_shared<SwitchTable>();
+      size_t end = i;
+      while (end < count) {
+         auto *clause = static_cast<const CaseClauseExpr *>(stmt.caseClauses[end].get());
+         if (!tableKey(clause->caseExpr.get(), *table, static_cast<int>(end))) break;
+         ++end;
+      }
+
+      if (end - i >= MIN_SWITCH_TABLE_CASES) {
+         table->build();
+         steps.push_back(SwitchStep{i, std::move(table)});
+         i = end;
+      } else {
+         // A short run, or a case that is not a literal: compare one case and
+         // try again after it.
+         steps.push_back(SwitchStep{i, nullptr});
+         ++i;
+      }
+   }
+   return steps;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <exception>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) {
+   if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+   for (int i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+   for (int i = 1; i < threads; ++i) workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> guard(sleepLock);
+      stopping = true;
+   }
+   wake.notify_all();
+   for (auto &worker: workers) worker.join();
+}
+
+bool ThreadPool::runOne(size_t self) {
+   Task task;
+   {
+      Queue &own = *queues[self];
+      std::lock_guard<std::mutex> guard(own.lock);
+      if (!own.tasks.empty()) {
+         task = std::move(own.tasks.back());
+         own.tasks.pop_back();
+      }
+   }
+   for (size_t k = 1; !task && k < queues.size(); ++k) {
+      Queue &victim = *queues[(self + k) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.tasks.empty()) {
+         task = std::move(victim.tasks.front());
+         victim.tasks.pop_front();
+      }
+   }
+   if (!task) return false;
+
+   pending--;
+   task();
+   return true;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+   for (;;) {
+      if (runOne(self)) continue;
+      std::unique_lock<std::mutex> guard(sleepLock);
+      wake.wait(guard, [this] { return stopping || pending.load() > 0; });
+      if (stopping) return;
+   }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &body) {
+   if (count <= 0) return;
+   if (queues.size() == 1 || count == 1) {
+      for (int i = 0; i < count; ++i) body(i);
+      return;
+   }
+
+   // Shared so a task finishing after the caller has seen remaining == 0 can
+   // still signal safely.
+   struct Batch {
+       std::atomic<int> remaining;
+       std::mutex lock;
+       std::condition_variable done;
+       std::exception_ptr error;
+   };
+   auto batch = std::make_shared<Batch>();
+   batch->remaining = count;
+
+   for (int i = 0; i < count; ++i) {
+      Queue &queue = *queues[i % queues.size()];
+      std::lock_guard<std::mutex> guard(queue.lock);
+      queue.tasks.emplace_back([batch, &body, i] {
+          try {
+             body(i);
+          } catch (...) {
+             std::lock_guard<std::mutex> errorGuard(batch->lock);
+             if (!batch->error) batch->error = std::current_exception();
+          }
+          if (--batch->remaining == 0) {
+             std::lock_guard<std::mutex> doneGuard(batch->lock);
+             batch->done.notify_all();
+          }
+      });
+   }
+   {
+      std::lock_guard<std::mutex> guard(sleepLock);
+      pending += count;
+   }
+   wake.notify_all();
+
+   while (batch->remaining > 0 && runOne(0)) {}
+   {
+      std::unique_lock<std::mutex> guard(batch->lock);
+      batch->done.wait(guard, [&] { return batch->remaining == 0; });
+   }
+   if (batch->error) std::rethrow_exception(batch->error);
+}
+
+static std::mutex sharedPoolLock;
+static std::unique_ptr<ThreadPool> sharedPool;
+
+ThreadPool &ThreadPool::shared() {
+   std::lock_guard<std::mutex> guard(sharedPoolLock);
+   if (!sharedPool) sharedPool = std::make_unique<ThreadPool>();
+   return *sharedPool;
+}
+
+void ThreadPool::setSharedThreadCount(int threads) {
+   std::lock_guard<std::mutex> guard(sharedPoolLock);
+   sharedPool = std::make_unique<ThreadPool>(threads);
+}
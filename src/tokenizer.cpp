@@ -58,6 +58,10 @@ std::vector<Token> Tokenizer::tokenize() {
             advance();
             tokens.push_back(makeToken(TokenType::SEMICOLON));
             continue;
+         case ':':
+            advance();
+            tokens.push_back(makeToken(TokenType::COLON));
+            continue;
          case ',':
             advance();
             tokens.push_back(makeToken(TokenType::COMMA));
@@ -82,6 +86,10 @@ std::vector<Token> Tokenizer::tokenize() {
             advance();
             tokens.push_back(makeToken(TokenType::MULTIPLY));
             continue;
+         case '@':
+            advance();
+            tokens.push_back(makeToken(TokenType::MATRIX_MULTIPLY));
+            continue;
          case '/':
             advance();
             if (peek() == '/') {
@@ -267,6 +275,15 @@ Token Tokenizer::number() {
    while (std::isdigit(peek())) {
       advance();
    }
+
+   if (peek() == '.' && std::isdigit(peekNext())) {
+      advance();
+      while (std::isdigit(peek())) {
+         advance();
+      }
+      return makeToken(TokenType::FLOAT_LITERAL);
+   }
+
    return makeToken(TokenType::INTEGER_LITERAL);
 }
 
@@ -0,0 +1,613 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include <climits>
+
+#include "type_checker.h"
+
+static constexpr unsigned GENERIC_LEVEL = UINT_MAX;
+static constexpr int ACCEPTS_STRING = 1;
+static constexpr int ACCEPTS_MATRIX = 2;
+
+TypeChecker::TypeChecker(TypeContext &types) : types(types) {
+   matrixTy = types.custom("matrix");
+   scopes.pushScope();
+}
+
+void TypeChecker::declare(const std::string &name, TypeRef type) {
+   bindName(name, type, SymbolType::Function);
+}
+
+bool TypeChecker::check(Expr &program) {
+   size_t errorsBefore = diagnostics.size();
+
+   if (auto *block = dynamic_cast<BlockStatementExpr *>(&program)) {
+      inferBlock(block->statements);
+      program.resolvedType = types.voidType();
+      annotated.push_back(&program);
+   } else {
+      infer(&program);
+   }
+
+   for (const auto &check: deferred) {
+      TypeRef type = resolve(check.type);
+      if (type->kind == TypeKind::Unknown || type->kind == TypeKind::Variable || isNumeric(type)) continue;
+      if (check.allowString && type == types.stringType()) continue;
+      if (type == matrixTy && (check.op == "+" || check.op == "-" || check.op == "*")) continue;
+      error("Operator '" + check.op + "' cannot be applied to " + type.toString());
+   }
+   deferred.clear();
+
+   for (Expr *expr: annotated) {
+      expr->resolvedType = resolve(expr->resolvedType);
+   }
+   annotated.clear();
+
+   return diagnostics.size() == errorsBefore;
+}
+
+TypeRef TypeChecker::fresh() {
+   auto id = static_cast<unsigned>(bindings.size());
+   bindings.emplace_back();
+   levels.push_back(currentLevel);
+   widenable.push_back(false);
+   accepts.push_back(-1);
+   return types.variable(id);
+}
+
+TypeRef TypeChecker::shallow(TypeRef type) {
+   if (!type) return types.unknownType();
+   if (!isVariable(type)) return type;
+
+   TypeRef root = type;
+   while (isVariable(root) && bindings[root->variableId]) {
+      root = bindings[root->variableId];
+   }
+
+   while (isVariable(type) && bindings[type->variableId] && bindings[type->variableId] != root) {
+      TypeRef next = bindings[type->variableId];
+      bindings[type->variableId] = root;
+      type = next;
+   }
+
+   return root;
+}
+
+TypeRef TypeChecker::resolve(TypeRef type) {
+   type = shallow(type);
+
+   if (type->kind == TypeKind::Function) {
+      std::vector<TypeRef> params;
+      params.reserve(type->parameterTypes.size());
+      for (TypeRef param: type->parameterTypes) params.push_back(resolve(param));
+      return types.function(params, resolve(type->returnType));
+   }
+
+   if (type->kind == TypeKind::Generic) {
+      std::vector<TypeRef> params;
+      params.reserve(type->parameters.size());
+      for (TypeRef param: type->parameters) params.push_back(resolve(param));
+      return types.generic(type->name, params);
+   }
+
+   return type;
+}
+
+bool TypeChecker::unify(TypeRef a, TypeRef b) {
+   a = shallow(a);
+   b = shallow(b);
+
+   if (a == b) return true;
+   if (a->kind == TypeKind::Unknown || b->kind == TypeKind::Unknown) return true;
+   if (isVariable(a)) return bind(a, b);
+   if (isVariable(b)) return bind(b, a);
+
+   if (a->kind == TypeKind::Function && b->kind == TypeKind::Function) {
+      if (a->parameterTypes.size() != b->parameterTypes.size()) return false;
+      for (size_t i = 0; i < a->parameterTypes.size(); ++i) {
+         if (!unify(a->parameterTypes[i], b->parameterTypes[i])) return false;
+      }
+      return unify(a->returnType, b->returnType);
+   }
+
+   if (a->kind == TypeKind::Generic && b->kind == TypeKind::Generic) {
+      if (a->name != b->name || a->parameters.size() != b->parameters.size()) return false;
+      for (size_t i = 0; i < a->parameters.size(); ++i) {
+         if (!unify(a->parameters[i], b->parameters[i])) return false;
+      }
+      return true;
+   }
+
+   return false;
+}
+
+// The variable a chain of bindings ends in before a concrete type, if any.
+TypeRef TypeChecker::boundVariable(TypeRef type) {
+   if (!type || !isVariable(type)) return TypeRef();
+   while (bindings[type->variableId] && isVariable(bindings[type->variableId])) type = bindings[type->variableId];
+   return bindings[type->variableId] ? type : TypeRef();
+}
+
+bool TypeChecker::bind(TypeRef variable, TypeRef type) {
+   unsigned id = variable->variableId;
+   if (!occursAndAdjust(id, levels[id], type)) return false;
+   if (accepts[id] >= 0) {
+      if (isVariable(type)) constrain(type, accepts[id]);
+      else if (!admits(accepts[id], type)) return false;
+   }
+   bindings[id] = type;
+   return true;
+}
+
+// Limits an unbound variable to numbers and the given kinds.
+void TypeChecker::constrain(TypeRef variable, int kinds) {
+   int &current = accepts[variable->variableId];
+   current = current < 0 ? kinds : current & kinds;
+}
+
+bool TypeChecker::admits(int kinds, TypeRef type) const {
+   if (type->kind == TypeKind::Unknown || isNumeric(type)) return true;
+   if (type == types.stringType()) return kinds & ACCEPTS_STRING;
+   return type == matrixTy && (kinds & ACCEPTS_MATRIX);
+}
+
+bool TypeChecker::occursAndAdjust(unsigned id, unsigned level, TypeRef type) {
+   type = shallow(type);
+
+   if (isVariable(type)) {
+      if (type->variableId == id) return false;
+      if (levels[type->variableId] > level) levels[type->variableId] = level;
+      return true;
+   }
+
+   for (TypeRef param: type->parameterTypes) {
+      if (!occursAndAdjust(id, level, param)) return false;
+   }
+   for (TypeRef param: type->parameters) {
+      if (!occursAndAdjust(id, level, param)) return false;
+   }
+   return !type->returnType || occursAndAdjust(id, level, type->returnType);
+}
+
+void TypeChecker::generalize(TypeRef type) {
+   type = shallow(type);
+
+   if (isVariable(type)) {
+      if (levels[type->variableId] > currentLevel) levels[type->variableId] = GENERIC_LEVEL;
+      return;
+   }
+
+   for (TypeRef param: type->parameterTypes) generalize(param);
+   for (TypeRef param: type->parameters) generalize(param);
+   if (type->returnType) generalize(type->returnType);
+}
+
+TypeRef TypeChecker::instantiate(TypeRef type) {
+   std::vector<std::pair<unsigned, TypeRef>> mapping;
+   return instantiate(type, mapping);
+}
+
+TypeRef TypeChecker::instantiate(TypeRef type, std::vector<std::pair<unsigned, TypeRef>> &mapping) {
+   type = shallow(type);
+
+   if (isVariable(type)) {
+      if (levels[type->variableId] != GENERIC_LEVEL) return type;
+      for (const auto &[id, replacement]: mapping) {
+         if (id == type->variableId) return replacement;
+      }
+      TypeRef replacement = fresh();
+      accepts[replacement->variableId] = accepts[type->variableId];
+      mapping.emplace_back(type->variableId, replacement);
+      return replacement;
+   }
+
+   if (type->kind == TypeKind::Function) {
+      std::vector<TypeRef> params;
+      params.reserve(type->parameterTypes.size());
+      for (TypeRef param: type->parameterTypes) params.push_back(instantiate(param, mapping));
+      return types.function(params, instantiate(type->returnType, mapping));
+   }
+
+   if (type->kind == TypeKind::Generic) {
+      std::vector<TypeRef> params;
+      params.reserve(type->parameters.size());
+      for (TypeRef param: type->parameters) params.push_back(instantiate(param, mapping));
+      return types.generic(type->name, params);
+   }
+
+   return type;
+}
+
+void TypeChecker::expect(TypeRef expected, TypeRef actual, const std::string &context) {
+   TypeRef target = shallow(expected);
+   if (unify(target, actual)) {
+      if (isVariable(target) && shallow(target) == types.intType()) {
+         widenable[target->variableId] = true;
+      } else if (target == types.intType()) {
+         if (TypeRef pinned = boundVariable(actual)) widenable[pinned->variableId] = false;
+      }
+      return;
+   }
+
+   TypeRef wanted = resolve(expected);
+   TypeRef found = resolve(actual);
+   if (wanted == types.floatType() && found == types.intType()) return;
+   if (wanted == types.intType() && found == types.floatType()) {
+      TypeRef variable = boundVariable(expected);
+      if (variable && widenable[variable->variableId]) {
+         bindings[variable->variableId] = types.floatType();
+         return;
+      }
+   }
+
+   error("Type mismatch " + context + ": expected " + wanted.toString() + " but found " + found.toString());
+}
+
+void TypeChecker::error(const std::string &message) {
+   std::string where = functions.empty() ? "" : " (in function '" + functions.back().name + "')";
+   diagnostics.emplace_back(message + where);
+}
+
+bool TypeChecker::isNumeric(TypeRef type) const {
+   return type == types.intType() || type == types.floatType();
+}
+
+TypeRef TypeChecker::lookup(const std::string &name) {
+   Symbol *symbol = scopes.lookup(name);
+   if (!symbol) return types.unknownType();
+   if (symbol->type == SymbolType::Function) return instantiate(symbol->declaredType);
+   return symbol->declaredType;
+}
+
+void TypeChecker::bindName(const std::string &name, TypeRef type, SymbolType kind) {
+   Symbol symbol(name, kind, type, kind != SymbolType::Function, 0, 0);
+   if (!scopes.declare(symbol)) {
+      Symbol *existing = scopes.lookup(name);
+      existing->type = kind;
+      existing->declaredType = type;
+   }
+}
+
+void TypeChecker::inferBlock(const std::vector<std::unique_ptr<Expr>> &statements) {
+   for (const auto &statement: statements) {
+      infer(statement.get());
+   }
+}
+
+TypeRef TypeChecker::infer(Expr *expr) {
+   if (!expr) return types.voidType();
+
+   TypeRef result = types.voidType();
+
+   switch (expr->type) {
+      case ExprType::Literal: {
+         const auto &value = static_cast<LiteralExpr *>(expr)->value;
+         if (std::holds_alternative<int>(value)) result = types.intType();
+         else if (std::holds_alternative<float>(value)) result = types.floatType();
+         else if (std::holds_alternative<std::string>(value)) result = types.stringType();
+         else if (std::holds_alternative<bool>(value)) result = types.boolType();
+         else result = fresh();
+         break;
+      }
+
+      case ExprType::Identifier:
+         result = lookup(static_cast<IdentifierExpr *>(expr)->name);
+         break;
+
+      case ExprType::Binary:
+         result = inferBinary(static_cast<BinaryExpr *>(expr));
+         break;
+
+      case ExprType::Unary:
+         result = inferUnary(static_cast<UnaryExpr *>(expr));
+         break;
+
+      case ExprType::VarDeclaration: {
+         auto *decl = static_cast<VarDeclarationExpr *>(expr);
+         TypeRef type = decl->declaredType ? decl->declaredType : fresh();
+         if (decl->initializer) {
+            expect(type, infer(decl->initializer.get()), "in initializer of '" + decl->name + "'");
+         }
+         bindName(decl->name, type, SymbolType::Variable);
+         break;
+      }
+
+      case ExprType::Assignment: {
+         auto *assign = static_cast<AssignmentExpr *>(expr);
+         TypeRef target = lookup(assign->name);
+         result = infer(assign->value.get());
+         expect(target, result, "in assignment to '" + assign->name + "'");
+         break;
+      }
+
+      case ExprType::FunctionDeclaration:
+         result = inferFunction(static_cast<FunctionDeclarationExpr *>(expr));
+         break;
+
+      case ExprType::FunctionCall:
+         result = inferCall(static_cast<FunctionCallExpr *>(expr));
+         break;
+
+      case ExprType::MatrixMultiplication: {
+         auto *mul = static_cast<MatrixMultiplicationExpr *>(expr);
+         expect(matrixTy, infer(mul->left.get()), "in left operand of '@'");
+         expect(matrixTy, infer(mul->right.get()), "in right operand of '@'");
+         result = matrixTy;
+         break;
+      }
+
+      case ExprType::IfStatement: {
+         auto *stmt = static_cast<IfStatementExpr *>(expr);
+         infer(stmt->condition.get());
+         scopes.pushScope();
+         infer(stmt->thenBranch.get());
+         scopes.popScope();
+         scopes.pushScope();
+         infer(stmt->elseBranch.get());
+         scopes.popScope();
+         break;
+      }
+
+      case ExprType::WhileStatement: {
+         auto *stmt = static_cast<WhileStatementExpr *>(expr);
+         infer(stmt->condition.get());
+         scopes.pushScope();
+         infer(stmt->body.get());
+         scopes.popScope();
+         infer(stmt->increment.get());
+         break;
+      }
+
+      case ExprType::DoWhileStatement: {
+         auto *stmt = static_cast<DoWhileStatementExpr *>(expr);
+         scopes.pushScope();
+         infer(stmt->body.get());
+         scopes.popScope();
+         infer(stmt->condition.get());
+         break;
+      }
+
+      case ExprType::ForStatement: {
+         auto *stmt = static_cast<ForStatementExpr *>(expr);
+         scopes.pushScope();
+         infer(stmt->initializer.get());
+         infer(stmt->condition.get());
+         infer(stmt->increment.get());
+         infer(stmt->body.get());
+         scopes.popScope();
+         break;
+      }
+
+      case ExprType::ReturnStatement: {
+         auto *stmt = static_cast<ReturnStatementExpr *>(expr);
+         TypeRef value = stmt->value ? infer(stmt->value.get()) : types.voidType();
+         if (functions.empty()) {
+            error("'return' outside of a function");
+            break;
+         }
+         auto &function = functions.back();
+         if (stmt->value) function.returnsValue = true;
+         expect(function.returnType, value, "in return value of '" + function.name + "'");
+         break;
+      }
+
+      case ExprType::BlockStatement:
+         scopes.pushScope();
+         inferBlock(static_cast<BlockStatementExpr *>(expr)->statements);
+         scopes.popScope();
+         break;
+
+      case ExprType::ExpressionStatement:
+         infer(static_cast<ExpressionStatementExpr *>(expr)->expression.get());
+         break;
+
+      case ExprType::SwitchStatement: {
+         auto *stmt = static_cast<SwitchStatementExpr *>(expr);
+         TypeRef subject = infer(stmt->switchExpr.get());
+         for (const auto &clause: stmt->caseClauses) {
+            auto *caseClause = static_cast<CaseClauseExpr *>(clause.get());
+            expect(subject, infer(caseClause->caseExpr.get()), "in switch case");
+            scopes.pushScope();
+            infer(caseClause->body.get());
+            scopes.popScope();
+            caseClause->resolvedType = types.voidType();
+            annotated.push_back(caseClause);
+         }
+         scopes.pushScope();
+         infer(stmt->defaultClause.get());
+         scopes.popScope();
+         break;
+      }
+
+      case ExprType::CaseClause: {
+         auto *clause = static_cast<CaseClauseExpr *>(expr);
+         infer(clause->caseExpr.get());
+         infer(clause->body.get());
+         break;
+      }
+
+      case ExprType::TryCatchFinallyStatement: {
+         auto *stmt = static_cast<TryCatchFinallyStatementExpr *>(expr);
+         infer(stmt->tryBlock.get());
+         for (const auto &clause: stmt->catches) {
+            infer(clause.get());
+         }
+         infer(stmt->finallyBlock.get());
+         break;
+      }
+
+      case ExprType::CatchClause: {
+         auto *clause = static_cast<CatchClauseExpr *>(expr);
+         scopes.pushScope();
+         bindName(clause->exceptionVarName, types.unknownType(), SymbolType::Variable);
+         infer(clause->block.get());
+         scopes.popScope();
+         break;
+      }
+
+      case ExprType::BreakStatement:
+      case ExprType::ContinueStatement:
+         break;
+   }
+
+   expr->resolvedType = result;
+   annotated.push_back(expr);
+   return result;
+}
+
+TypeRef TypeChecker::inferBinary(BinaryExpr *expr) {
+   TypeRef left = infer(expr->left.get());
+   TypeRef right = infer(expr->right.get());
+   const std::string &op = expr->op;
+
+   if (op == "==" || op == "!=" || op == "&&" || op == "||") {
+      return types.boolType();
+   }
+
+   bool comparison = op == "<" || op == "<=" || op == ">" || op == ">=";
+   return inferArithmetic(op, left, right, comparison);
+}
+
+TypeRef TypeChecker::inferArithmetic(const std::string &op, TypeRef left, TypeRef right, bool comparison) {
+   TypeRef resultIfOk = comparison ? types.boolType() : TypeRef();
+   bool allowString = op == "+" || comparison;
+
+   left = shallow(left);
+   right = shallow(right);
+
+   if (op == "+" && (left == types.stringType() || right == types.stringType())) {
+      return types.stringType();
+   }
+
+   if ((op == "+" || op == "-" || op == "*") && (left == matrixTy || right == matrixTy)) {
+      TypeRef other = left == matrixTy ? right : left;
+      if (isVariable(other)) {
+         deferred.push_back({op, other, false});
+         return matrixTy;
+      }
+      if (other == matrixTy || other->kind == TypeKind::Unknown || isNumeric(other)) return matrixTy;
+   }
+
+   if (left->kind == TypeKind::Unknown || right->kind == TypeKind::Unknown) {
+      TypeRef known = left->kind == TypeKind::Unknown ? right : left;
+      deferred.push_back({op, known, allowString});
+      return resultIfOk ? resultIfOk : types.unknownType();
+   }
+
+   // int ⊑ float: with an int the result has the variable's type, with a
+   // float it is a float, whichever number the variable turns out to be.
+   if (isVariable(left) != isVariable(right) && isNumeric(isVariable(left) ? right : left)) {
+      TypeRef variable = isVariable(left) ? left : right;
+      TypeRef number = isVariable(left) ? right : left;
+      bool matrixOp = op == "+" || op == "-" || op == "*";
+      constrain(variable, (allowString ? ACCEPTS_STRING : 0) | (matrixOp ? ACCEPTS_MATRIX : 0));
+      if (resultIfOk) return resultIfOk;
+      return number == types.floatType() ? number : variable;
+   }
+
+   if (isVariable(left) || isVariable(right)) {
+      if (!unify(left, right)) {
+         error("Operator '" + op + "' cannot combine " + resolve(left).toString() +
+               " and " + resolve(right).toString());
+      }
+      deferred.push_back({op, left, allowString});
+      return resultIfOk ? resultIfOk : left;
+   }
+
+   if (isNumeric(left) && isNumeric(right)) {
+      if (resultIfOk) return resultIfOk;
+      return left == right ? left : types.floatType();
+   }
+
+   if (allowString && left == types.stringType() && right == types.stringType()) {
+      return resultIfOk ? resultIfOk : types.stringType();
+   }
+
+   error("Operator '" + op + "' cannot be applied to " + left.toString() + " and " + right.toString());
+   return resultIfOk ? resultIfOk : types.unknownType();
+}
+
+TypeRef TypeChecker::inferUnary(UnaryExpr *expr) {
+   TypeRef operand = infer(expr->right.get());
+
+   if (expr->op == "!") return types.boolType();
+
+   if (expr->op == "~") {
+      expect(types.intType(), operand, "in operand of '~'");
+      return types.intType();
+   }
+
+   deferred.push_back({expr->op, operand, false});
+   return operand;
+}
+
+TypeRef TypeChecker::inferCall(FunctionCallExpr *expr) {
+   std::vector<TypeRef> args;
+   args.reserve(expr->arguments.size());
+   for (const auto &arg: expr->arguments) {
+      args.push_back(infer(arg.get()));
+   }
+
+   TypeRef callee = shallow(lookup(expr->callee));
+
+   if (callee->kind == TypeKind::Unknown) return types.unknownType();
+
+   if (isVariable(callee)) {
+      TypeRef result = fresh();
+      expect(callee, types.function(args, result), "in call to '" + expr->callee + "'");
+      return result;
+   }
+
+   if (callee->kind != TypeKind::Function) {
+      error("'" + expr->callee + "' of type " + callee.toString() + " is not callable");
+      return types.unknownType();
+   }
+
+   if (callee->parameterTypes.size() != args.size()) {
+      error("Function '" + expr->callee + "' expects " + std::to_string(callee->parameterTypes.size()) +
+            " argument(s) but got " + std::to_string(args.size()));
+      return callee->returnType;
+   }
+
+   for (size_t i = 0; i < args.size(); ++i) {
+      expect(callee->parameterTypes[i], args[i],
+             "in argument " + std::to_string(i + 1) + " of '" + expr->callee + "'");
+   }
+
+   return callee->returnType;
+}
+
+TypeRef TypeChecker::inferFunction(FunctionDeclarationExpr *expr) {
+   currentLevel++;
+
+   std::vector<TypeRef> params;
+   params.reserve(expr->params.size());
+   for (size_t i = 0; i < expr->params.size(); ++i) {
+      params.push_back(fresh());
+   }
+   TypeRef returnType = fresh();
+   TypeRef functionType = types.function(params, returnType);
+
+   bindName(expr->name, functionType, SymbolType::Variable);
+
+   scopes.pushScope();
+   for (size_t i = 0; i < params.size(); ++i) {
+      bindName(expr->params[i], params[i], SymbolType::Parameter);
+   }
+
+   functions.push_back({expr->name, returnType, false});
+   infer(expr->body.get());
+   if (!functions.back().returnsValue) {
+      expect(returnType, types.voidType(), "in return value of '" + expr->name + "'");
+   }
+   functions.pop_back();
+   scopes.popScope();
+
+   currentLevel--;
+   generalize(functionType);
+   bindName(expr->name, functionType, SymbolType::Function);
+
+   return functionType;
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,139 @@
+#include "type_context.h"
+
+TypeContext::TypeContext() {
+   intTy = create(TypeKind::Int);
+   floatTy = create(TypeKind::Float);
+   boolTy = create(TypeKind::Bool);
+   stringTy = create(TypeKind::String);
+   voidTy = create(TypeKind::Void);
+   nullTy = create(TypeKind::Null);
+   unknownTy = create(TypeKind::Unknown);
+}
+
+TypeContext &TypeContext::global() {
+   static TypeContext context;
+   return context;
+}
+
+TypeRef TypeContext::primitive(TypeKind kind) const {
+   switch (kind) {
+      case TypeKind::Int:
+         return intTy;
+      case TypeKind::Float:
+         return floatTy;
+      case TypeKind::Bool:
+         return boolTy;
+      case TypeKind::String:
+         return stringTy;
+      case TypeKind::Void:
+         return voidTy;
+      case TypeKind::Null:
+         return nullTy;
+      default:
+         return unknownTy;
+   }
+}
+
+TypeRef TypeContext::custom(const std::string &name) {
+   return intern(Key{TypeKind::Custom, name, {}, {}});
+}
+
+TypeRef TypeContext::function(const std::vector<TypeRef> &params, TypeRef returnType) {
+   std::vector<TypeRef> children(params);
+   children.push_back(returnType ? returnType : voidTy);
+   return intern(Key{TypeKind::Function, "function", std::move(children), {}});
+}
+
+TypeRef TypeContext::generic(const std::string &name, const std::vector<TypeRef> &params) {
+   return intern(Key{TypeKind::Generic, name, params, {}});
+}
+
+TypeRef TypeContext::structType(const std::string &name, const std::vector<StructField> &fields) {
+   return internRecord(TypeKind::Struct, name, fields);
+}
+
+TypeRef TypeContext::classType(const std::string &name, const std::vector<StructField> &fields) {
+   return internRecord(TypeKind::Class, name, fields);
+}
+
+TypeRef TypeContext::variable(unsigned id) {
+   if (id < variables.size()) return variables[id];
+
+   while (variables.size() <= id) {
+      TypeRef ref = create(TypeKind::Variable, "T" + std::to_string(variables.size()));
+      const_cast<Type *>(ref.get())->variableId = static_cast<unsigned>(variables.size());
+      variables.push_back(ref);
+   }
+   return variables[id];
+}
+
+TypeRef TypeContext::fromName(const std::string &name) {
+   if (name == "int") return intTy;
+   if (name == "float") return floatTy;
+   if (name == "bool") return boolTy;
+   if (name == "string") return stringTy;
+   if (name == "void") return voidTy;
+   if (name == "null") return nullTy;
+   return custom(name);
+}
+
+size_t TypeContext::KeyHash::operator()(const Key &key) const noexcept {
+   size_t seed = std::hash<int>()(static_cast<int>(key.kind));
+   auto combine = [&seed](size_t value) {
+       seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+   };
+
+   combine(std::hash<std::string>()(key.name));
+   for (TypeRef child: key.children) combine(std::hash<TypeRef>()(child));
+   for (const auto &field: key.fieldNames) combine(std::hash<std::string>()(field));
+   return seed;
+}
+
+TypeRef TypeContext::create(TypeKind kind, std::string name) {
+   storage.push_back(std::unique_ptr<Type>(new Type(kind, std::move(name))));
+   return TypeRef(storage.back().get());
+}
+
+TypeRef TypeContext::intern(Key key) {
+   auto it = interned.find(key);
+   if (it != interned.end()) {
+      return TypeRef(it->second);
+   }
+
+   TypeRef ref = create(key.kind, key.name);
+   auto *type = const_cast<Type *>(ref.get());
+
+   switch (key.kind) {
+      case TypeKind::Function:
+         type->parameterTypes.assign(key.children.begin(), key.children.end() - 1);
+         type->returnType = key.children.back();
+         break;
+      case TypeKind::Generic:
+         type->parameters = key.children;
+         break;
+      case TypeKind::Struct:
+      case TypeKind::Class: {
+         auto info = std::make_unique<StructType>();
+         info->name = key.name;
+         for (size_t i = 0; i < key.children.size(); ++i) {
+            info->fields.push_back(StructField{key.fieldNames[i], key.children[i]});
+         }
+         type->structInfo = std::move(info);
+         break;
+      }
+      default:
+         break;
+   }
+
+   interned.emplace(std::move(key), type);
+   return ref;
+}
+
+TypeRef TypeContext::internRecord(TypeKind kind, const std::string &name, const std::vector<StructField> &fields) {
+   Key key{kind, name, {}, {}};
+   for (const auto &field: fields) {
+      key.children.push_back(field.type ? field.type : unknownTy);
+      key.fieldNames.push_back(field.name);
+   }
+   return intern(std::move(key));
+}
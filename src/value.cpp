@@ -0,0 +1,232 @@
+#include <cstdio>
+
+#include "value.h"
+#include "matrix.h"
+#include "error.h"
+
+bool Value::truthy() const {
+   switch (type()) {
+      case ValueType::Null:
+         return false;
+      case ValueType::Bool:
+         return asBool();
+      case ValueType::Int:
+         return asInt() != 0;
+      case ValueType::Float:
+         return asFloat() != 0.0;
+      case ValueType::Object:
+         return !isString() || !asString()->chars.empty();
+   }
+   return false;
+}
+
+bool Value::equals(const Value &other) const {
+   if (isNumber() && other.isNumber()) {
+      if (isInt() && other.isInt()) return asInt() == other.asInt();
+      return toNumber() == other.toNumber();
+   }
+   if (type() != other.type()) return false;
+
+   switch (type()) {
+      case ValueType::Null:
+         return true;
+      case ValueType::Bool:
+         return asBool() == other.asBool();
+      case ValueType::Object:
+         if (isString() && other.isString()) return asString()->chars == other.asString()->chars;
+         return asObject() == other.asObject();
+      default:
+         return false;
+   }
+}
+
+std::string Value::toString() const {
+   switch (type()) {
+      case ValueType::Null:
+         return "null";
+      case ValueType::Bool:
+         return asBool() ? "true" : "false";
+      case ValueType::Int:
+         return std::to_string(asInt());
+      case ValueType::Float: {
+         char buffer[32];
+         std::snprintf(buffer, sizeof(buffer), "%.15g", asFloat());
+         return buffer;
+      }
+      case ValueType::Object:
+         if (isString()) return asString()->chars;
+         if (isMatrix()) return asMatrix(*this)->toString();
+         return "<object>";
+   }
+   return "null";
+}
+
+const char *Value::typeName() const {
+   switch (type()) {
+      case ValueType::Null:
+         return "null";
+      case ValueType::Bool:
+         return "bool";
+      case ValueType::Int:
+         return "int";
+      case ValueType::Float:
+         return "float";
+      case ValueType::Object:
+         return isString() ? "string" : isMatrix() ? "matrix" : "object";
+   }
+   return "unknown";
+}
+
+Value literalValue(const std::variant<int, float, std::string, bool, std::nullptr_t> &literal) {
+   return std::visit([](const auto &val) -> Value {
+       using T = std::decay_t<decltype(val)>;
+       if constexpr (std::is_same_v<T, std::nullptr_t>) {
+          return Value::null();
+       } else if constexpr (std::is_same_v<T, std::string>) {
+          return Value::string(val);
+       } else if constexpr (std::is_same_v<T, bool>) {
+          return Value::boolean(val);
+       } else if constexpr (std::is_same_v<T, int>) {
+          return Value::integer(val);
+       } else {
+          return Value::number(val);
+       }
+   }, literal);
+}
+
+static RuntimeError operandError(BinaryOperator op, const Value &left, const Value &right) {
+   return RuntimeError(std::string("Operator '") + operatorLexeme(op) + "' cannot be applied to " +
+                       left.typeName() + " and " + right.typeName());
+}
+
+static Value compareStrings(BinaryOperator op, const std::string &a, const std::string &b) {
+   int order = a.compare(b);
+   switch (op) {
+      case BinaryOperator::Less:
+         return Value::boolean(order < 0);
+      case BinaryOperator::LessEqual:
+         return Value::boolean(order <= 0);
+      case BinaryOperator::Greater:
+         return Value::boolean(order > 0);
+      default:
+         return Value::boolean(order >= 0);
+   }
+}
+
+Value applyBinarySlow(BinaryOperator op, const Value &left, const Value &right) {
+   switch (op) {
+      case BinaryOperator::Equal:
+         return Value::boolean(left.equals(right));
+      case BinaryOperator::NotEqual:
+         return Value::boolean(!left.equals(right));
+      case BinaryOperator::And:
+         return Value::boolean(left.truthy() && right.truthy());
+      case BinaryOperator::Or:
+         return Value::boolean(left.truthy() || right.truthy());
+      default:
+         break;
+   }
+
+   if (op == BinaryOperator::Add && (left.isString() || right.isString())) {
+      return Value::string(left.toString() + right.toString());
+   }
+
+   if ((left.isMatrix() || right.isMatrix()) && (left.isMatrix() || left.isNumber()) &&
+       (right.isMatrix() || right.isNumber())) {
+      switch (op) {
+         case BinaryOperator::Add:
+         case BinaryOperator::Subtract:
+         case BinaryOperator::Multiply:
+            return matrixElementwise(op, left, right);
+         default:
+            throw operandError(op, left, right);
+      }
+   }
+
+   if (left.isInt() && right.isInt()) {
+      std::int64_t a = left.asInt();
+      std::int64_t b = right.asInt();
+      switch (op) {
+         case BinaryOperator::Add:
+            return Value::integer(wrapInt(a + b));
+         case BinaryOperator::Subtract:
+            return Value::integer(wrapInt(a - b));
+         case BinaryOperator::Multiply:
+            return Value::integer(wrapInt(a * b));
+         case BinaryOperator::Divide:
+            if (b == 0) throw RuntimeError("Division by zero");
+            return Value::integer(wrapInt(a / b));
+         case BinaryOperator::Less:
+            return Value::boolean(a < b);
+         case BinaryOperator::LessEqual:
+            return Value::boolean(a <= b);
+         case BinaryOperator::Greater:
+            return Value::boolean(a > b);
+         case BinaryOperator::GreaterEqual:
+            return Value::boolean(a >= b);
+         default:
+            throw operandError(op, left, right);
+      }
+   }
+
+   if (left.isNumber() && right.isNumber()) {
+      double a = left.toNumber();
+      double b = right.toNumber();
+      switch (op) {
+         case BinaryOperator::Add:
+            return Value::number(a + b);
+         case BinaryOperator::Subtract:
+            return Value::number(a - b);
+         case BinaryOperator::Multiply:
+            return Value::number(a * b);
+         case BinaryOperator::Divide:
+            return Value::number(a / b);
+         case BinaryOperator::Less:
+            return Value::boolean(a < b);
+         case BinaryOperator::LessEqual:
+            return Value::boolean(a <= b);
+         case BinaryOperator::Greater:
+            return Value::boolean(a > b);
+         case BinaryOperator::GreaterEqual:
+            return Value::boolean(a >= b);
+         default:
+            throw operandError(op, left, right);
+      }
+   }
+
+   if (left.isString() && right.isString()) {
+      switch (op) {
+         case BinaryOperator::Less:
+         case BinaryOperator::LessEqual:
+         case BinaryOperator::Greater:
+         case BinaryOperator::GreaterEqual:
+            return compareStrings(op, left.asString()->chars, right.asString()->chars);
+         default:
+            break;
+      }
+   }
+
+   throw operandError(op, left, right);
+}
+
+Value applyUnary(UnaryOperator op, const Value &operand) {
+   switch (op) {
+      case UnaryOperator::Not:
+         return Value::boolean(!operand.truthy());
+      case UnaryOperator::Plus:
+         if (operand.isNumber()) return operand;
+         if (operand.isMatrix()) return matrixUnary(op, operand);
+         break;
+      case UnaryOperator::Negate:
+         if (operand.isMatrix()) return matrixUnary(op, operand);
+         if (operand.isInt()) return Value::integer(wrapInt(-static_cast<std::int64_t>(operand.asInt())));
+         if (operand.isFloat()) return Value::number(-operand.asFloat());
+         break;
+      case UnaryOperator::BitwiseNot:
+         if (operand.isInt()) return Value::integer(~operand.asInt());
+         break;
+      case UnaryOperator::Unknown:
+         break;
+   }
+   throw RuntimeError(std::string("Unary operator cannot be applied to ") + operand.typeName());
+}
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <functional>
+
+#include "value_numbering.h"
+#include "dominators.h"
+
+ValueNumberingStats &ValueNumberingStats::operator+=(const ValueNumberingStats &other) {
+   expressions += other.expressions;
+   loads += other.loads;
+   phis += other.phis;
+   return *this;
+}
+
+size_t ValueNumbering::KeyHash::operator()(const Key &key) const {
+   size_t hash = static_cast<size_t>(key.op) * 31 + key.code;
+   hash = hash * 0x9E3779B97F4A7C15ull ^ std::hash<const IrInstr *>()(key.left);
+   return hash * 0x9E3779B97F4A7C15ull ^ std::hash<const IrInstr *>()(key.right);
+}
+
+// Host functions that never change their arguments.
+static bool leavesArgumentsAlone(const std::string &name) {
+   static const std::unordered_set<std::string> names = {
+           "print", "throw", "str", "len", "clock", "matrix", "rows", "cols", "at",
+   };
+   return names.count(name) != 0;
+}
+
+ValueNumberingStats ValueNumbering::eliminate(IrModule &module) {
+   std::unordered_set<std::string> defined;
+   for (const auto &function: module.functions) defined.insert(function->name);
+   bool changes = false;
+   for (const auto &function: module.functions) {
+      for (const auto &block: function->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::Call && !defined.count(instr->name) && !leavesArgumentsAlone(instr->name)) {
+               changes = true;
+            }
+         }
+      }
+   }
+
+   ValueNumberingStats total;
+   for (const auto &function: module.functions) {
+      matricesChange = changes;
+      total += eliminate(*function);
+   }
+   matricesChange = true;
+   return total;
+}
+
+const IrInstr *ValueNumbering::canonical(const IrInstr *value) {
+   if (value->op != IrOp::Const) return value;
+   if (value->constant.isString()) return strings.emplace(value->constant.asString()->chars, value).first->second;
+   return constants.emplace(value->constant.raw(), value).first->second;
+}
+
+static bool isComparison(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Equal:
+      case BinaryOperator::NotEqual:
+      case BinaryOperator::Less:
+      case BinaryOperator::LessEqual:
+      case BinaryOperator::Greater:
+      case BinaryOperator::GreaterEqual:
+         return true;
+      default:
+         return false;
+   }
+}
+
+// Whether instr makes a new matrix when one of its operands is a matrix.
+static bool propagatesMatrices(const IrInstr *instr) {
+   switch (instr->op) {
+      case IrOp::Phi:
+         return true;
+      case IrOp::Binary:
+         return !isComparison(instr->binary) && instr->binary != BinaryOperator::Divide;
+      case IrOp::Unary:
+         return instr->unary != UnaryOperator::Not;
+      default:
+         return false;
+   }
+}
+
+// Values that may hold a matrix: whatever comes from outside the function
+// or from a matmul, and what arithmetic and phis make of them.
+void ValueNumbering::findMatrices(const IrFunction &function) {
+   mayBeMatrix.clear();
+   if (!matricesChange) return;
+   std::vector<const IrInstr *> work;
+   auto add = [&](const IrInstr *value) {
+       if (mayBeMatrix.insert(value).second) work.push_back(value);
+   };
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         switch (instr->op) {
+            case IrOp::Param:
+            case IrOp::Catch:
+            case IrOp::LoadGlobal:
+            case IrOp::MatMul:
+            case IrOp::MatChain:
+            case IrOp::Call:
+               add(instr);
+               break;
+            default:
+               break;
+         }
+      }
+   }
+   while (!work.empty()) {
+      const IrInstr *value = work.back();
+      work.pop_back();
+      for (const IrInstr *user: value->users) {
+         if (propagatesMatrices(user)) add(user);
+      }
+   }
+}
+
+bool ValueNumbering::keyOf(const IrInstr *instr, Key &key) {
+   switch (instr->op) {
+      case IrOp::Binary:
+         if (!isComparison(instr->binary) && mayBeMatrix.count(instr)) return false;
+         key = {instr->op, static_cast<std::uint8_t>(instr->binary), canonical(instr->operands[0]),
+                canonical(instr->operands[1])};
+         // Only equality is symmetric for every kind of value: `+` joins
+         // strings and `*` multiplies matrices in order.
+         if ((instr->binary == BinaryOperator::Equal || instr->binary == BinaryOperator::NotEqual) &&
+             std::less<const IrInstr *>()(key.right, key.left)) {
+            std::swap(key.left, key.right);
+         }
+         return true;
+      case IrOp::Unary:
+         if (instr->unary != UnaryOperator::Not && mayBeMatrix.count(instr)) return false;
+         key = {instr->op, static_cast<std::uint8_t>(instr->unary), canonical(instr->operands[0]), nullptr};
+         return true;
+      case IrOp::Truthy:
+         key = {instr->op, 0, canonical(instr->operands[0]), nullptr};
+         return true;
+      default:
+         return false;
+   }
+}
+
+// Detaches a replaced instruction; its block's list is compacted after the
+// walk over it.
+static void discard(IrInstr *instr) {
+   instr->clearOperands();
+   instr->block = nullptr;
+}
+
+void ValueNumbering::numberPhis(IrBlock *block) {
+   std::vector<std::pair<std::vector<const IrInstr *>, IrInstr *>> seen;
+   size_t kept = 0;
+   for (IrInstr *phi: block->phis) {
+      std::vector<const IrInstr *> operands;
+      for (const IrInstr *operand: phi->operands) operands.push_back(canonical(operand));
+      auto same = std::find_if(seen.begin(), seen.end(), [&](const auto &entry) { return entry.first == operands; });
+      if (same == seen.end()) {
+         seen.emplace_back(std::move(operands), phi);
+         block->phis[kept++] = phi;
+         continue;
+      }
+      phi->replaceAllUsesWith(same->second);
+      discard(phi);
+      stats.phis++;
+   }
+   block->phis.resize(kept);
+}
+
+ValueNumberingStats ValueNumbering::eliminate(IrFunction &function) {
+   stats = ValueNumberingStats();
+   constants.clear();
+   strings.clear();
+   available.clear();
+   findMatrices(function);
+   DominatorTree dominators(function);
+
+   // Walks the dominator tree without recursion. Each frame undoes the
+   // expressions its block made available when the walk leaves it.
+   using Globals = std::unordered_map<int, IrInstr *>;
+   struct Frame {
+       IrBlock *block;
+       size_t child;
+       std::vector<Key> added;
+       Globals globals; // slot -> its value at the end of the block
+   };
+   std::vector<Frame> stack;
+   auto enter = [&](IrBlock *block, Globals globals) {
+       stack.push_back({block, 0, {}, std::move(globals)});
+       Frame &frame = stack.back();
+       numberPhis(block);
+       auto &instructions = block->instructions;
+       size_t kept = 0;
+       for (IrInstr *instr: instructions) {
+          IrInstr *earlier = nullptr;
+          Key key{};
+          if (instr->op == IrOp::LoadGlobal) {
+             auto known = frame.globals.find(instr->index);
+             if (known != frame.globals.end()) {
+                earlier = known->second;
+                stats.loads++;
+             } else {
+                frame.globals[instr->index] = instr;
+             }
+          } else if (instr->op == IrOp::StoreGlobal) {
+             frame.globals[instr->index] = instr->operands[0];
+          } else if (instr->op == IrOp::Call) {
+             frame.globals.clear();
+          } else if (keyOf(instr, key)) {
+             auto found = available.find(key);
+             if (found != available.end()) {
+                earlier = found->second;
+                stats.expressions++;
+             } else {
+                available.emplace(key, instr);
+                frame.added.push_back(key);
+             }
+          }
+          if (!earlier) {
+             instructions[kept++] = instr;
+             continue;
+          }
+          instr->replaceAllUsesWith(earlier);
+          discard(instr);
+       }
+       instructions.resize(kept);
+   };
+
+   enter(function.entry(), {});
+   while (!stack.empty()) {
+      Frame &frame = stack.back();
+      const std::vector<IrBlock *> &children = dominators.children(frame.block);
+      if (frame.child == children.size()) {
+         for (const Key &key: frame.added) available.erase(key);
+         stack.pop_back();
+         continue;
+      }
+      IrBlock *child = children[frame.child++];
+      // The globals known at the end of the dominator hold on entry only
+      // when no other path leads in; a handler is entered mid-block.
+      bool extends = child->predecessors.size() == 1 && frame.block->handler != child;
+      enter(child, extends ? frame.globals : Globals());
+   }
+   return stats;
+}
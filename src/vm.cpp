@@ -0,0 +1,479 @@
+#include "vm.h"
+#include "bytecode_compiler.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "error.h"
+#include "matrix.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(COMPILER_SWITCH_DISPATCH)
+#define COMPILER_THREADED_DISPATCH 1
+#endif
+
+static inline bool isTruthy(const Value &value) {
+   return value.isBool() ? value.asBool() : value.truthy();
+}
+
+VM::VM(std::ostream &out) : out(out) {
+   hostFunctions.defineBuiltins(out);
+}
+
+void VM::defineGlobal(const std::string &name, Value value) {
+   int index = resolver.declareGlobal(name);
+   if (globals.size() <= static_cast<size_t>(index)) globals.resize(index + 1);
+   globals[index] = std::move(value);
+   hostGlobals.push_back(name);
+}
+
+void VM::run(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+
+   Parser parser(tokens);
+   hostFunctions.declareIn(parser.scopeManager);
+   for (const auto &name: hostGlobals) {
+      parser.scopeManager.declare(Symbol(name, SymbolType::Variable, TypeContext::global().unknownType(),
+                                         true, 0, 0));
+   }
+
+   std::unique_ptr<Expr> program = parser.parse();
+   execute(*program);
+}
+
+void VM::execute(Expr &program) {
+   ConstantFolder().fold(program);
+   DeadCodeEliminator().eliminate(program);
+   resolver.resolve(program);
+   globals.resize(resolver.globalCount());
+
+   std::unique_ptr<Program> compiled;
+   if (optimize) compiled = Optimizer(optimizerOptions).compile(program);
+   if (!compiled) compiled = BytecodeCompiler().compile(program);
+   programs.push_back(std::move(compiled));
+   FunctionProto &main = programs.back()->main();
+
+   registers.clear();
+   registers.resize(main.registerCount);
+   savedExceptions.clear();
+   frames.clear();
+   frames.push_back(CallFrame{&main, main.code.data(), 0});
+
+   for (;;) {
+      try {
+         dispatch();
+         return;
+      } catch (ScriptException &e) {
+         if (!unwind(e.value)) throw;
+      } catch (RuntimeError &e) {
+         if (!unwind(Value::string(e.reason()))) throw;
+      }
+   }
+}
+
+void VM::bindCallSite(CallSite &site) {
+   auto it = functions.find(site.callee);
+   if (it != functions.end()) {
+      FunctionProto *callee = it->second;
+      if (callee->arity != site.argumentCount) {
+         throw RuntimeError("Function '" + callee->name + "' expects " + std::to_string(callee->arity) +
+                            " argument(s) but got " + std::to_string(site.argumentCount));
+      }
+      site.target = callee;
+      site.host = nullptr;
+   } else {
+      const HostFunction *host = hostFunctions.find(site.callee);
+      if (!host) throw RuntimeError("Undefined function '" + site.callee + "'");
+      if (host->arity >= 0 && host->arity != site.argumentCount) {
+         throw RuntimeError("Function '" + site.callee + "' expects " + std::to_string(host->arity) +
+                            " argument(s) but got " + std::to_string(site.argumentCount));
+      }
+      site.target = nullptr;
+      site.host = host;
+   }
+   site.epoch = bindingEpoch;
+}
+
+// Called from a catch block: transfers control to the innermost handler
+// covering the raising instruction, looked up in the function's table, or in
+// its callers' at their calls. Every frame's ip is just past that instruction.
+bool VM::unwind(Value thrown) {
+   for (; !frames.empty(); frames.pop_back()) {
+      CallFrame &frame = frames.back();
+      const Instruction *code = frame.function->code.data();
+      auto pc = static_cast<std::uint32_t>(frame.ip - code - 1);
+      for (const ExceptionHandler &handler: frame.function->handlers) {
+         if (pc < handler.start || pc >= handler.end) continue;
+         frame.ip = frame.function->code.data() + handler.target;
+         if (handler.reg >= 0) registers[frame.base + handler.reg] = std::move(thrown);
+         else savedExceptions.push_back(std::current_exception());
+         return true;
+      }
+   }
+   return false;
+}
+
+void VM::dispatch() {
+   CallFrame *frame = &frames.back();
+   Instruction *ip = frame->ip;
+   Value *R = registers.data() + frame->base;
+   const Value *K = frame->function->constants.data();
+   Instruction i;
+
+#define VM_REFRESH() \
+   do { frame = &frames.back(); ip = frame->ip; R = registers.data() + frame->base; \
+        K = frame->function->constants.data(); } while (0)
+
+// Runs the native code of the frame's function, if any, from ip on, and goes
+// on interpreting where it stops.
+#define VM_ENTER_JIT() \
+   do { \
+      if (const JitFunction *native = frame->function->jitCode; native && jitEnabled) { \
+         Instruction *code = frame->function->code.data(); \
+         if (native->entersAt(ip - code)) ip = code + native->run(R, globals.data(), ip - code); \
+      } \
+   } while (0)
+
+// A call to, or a loop backedge in, the frame's function.
+#define VM_HOT_SPOT() \
+   do { \
+      if (jitEnabled) { \
+         countHot(*frame->function); \
+         VM_ENTER_JIT(); \
+      } \
+   } while (0)
+
+// Rewrites the instruction being executed, for quickening.
+#define VM_REWRITE(op) (ip[-1] = withOpcode(i, OpCode::op))
+
+// The JMP after a compare-and-branch is taken when the comparison is false.
+#define VM_BRANCH_UNLESS(condition) (ip += (condition) ? 1 : 1 + argSBx(*ip))
+
+#define VM_BINARY(name, op, intOp, floatOp) \
+   VM_CASE(name): generic_##name: { \
+      const Value &b = R[argB(i)]; \
+      const Value &c = R[argC(i)]; \
+      if (Value::bothInt(b, c)) VM_REWRITE(intOp); \
+      else if (Value::bothFloat(b, c)) VM_REWRITE(floatOp); \
+      R[argA(i)] = applyBinary(BinaryOperator::op, b, c); \
+      VM_NEXT(); \
+   }
+
+#define VM_INT_BINARY(name, generic, result) \
+   VM_CASE(name): { \
+      const Value &b = R[argB(i)]; \
+      const Value &c = R[argC(i)]; \
+      if (!Value::bothInt(b, c)) { VM_REWRITE(generic); goto generic_##generic; } \
+      std::int64_t x = b.asInt(); \
+      std::int64_t y = c.asInt(); \
+      R[argA(i)] = result; \
+      VM_NEXT(); \
+   }
+
+#define VM_FLOAT_BINARY(name, generic, result) \
+   VM_CASE(name): { \
+      const Value &b = R[argB(i)]; \
+      const Value &c = R[argC(i)]; \
+      if (!Value::bothFloat(b, c)) { VM_REWRITE(generic); goto generic_##generic; } \
+      double x = b.asFloat(); \
+      double y = c.asFloat(); \
+      R[argA(i)] = result; \
+      VM_NEXT(); \
+   }
+
+#define VM_CONST_BINARY(name, op, binaryOp, result) \
+   VM_CASE(name): generic_##name: { \
+      const Value &b = R[argB(i)]; \
+      if (b.isInt()) VM_REWRITE(op##_INT_CONST); \
+      R[argA(i)] = applyBinary(BinaryOperator::binaryOp, b, Value::integer(argSC(i))); \
+      VM_NEXT(); \
+   } \
+   VM_CASE(op##_INT_CONST): { \
+      const Value &b = R[argB(i)]; \
+      if (!b.isInt()) { VM_REWRITE(name); goto generic_##name; } \
+      std::int64_t x = b.asInt(); \
+      std::int64_t y = argSC(i); \
+      R[argA(i)] = Value::integer(wrapInt(result)); \
+      VM_NEXT(); \
+   }
+
+#define VM_BRANCH(name, op, cmp) \
+   VM_CASE(name): generic_##name: { \
+      const Value &b = R[argA(i)]; \
+      const Value &c = R[argB(i)]; \
+      if (Value::bothInt(b, c)) VM_REWRITE(name##_INT_INT); \
+      VM_BRANCH_UNLESS(applyBinary(BinaryOperator::op, b, c).asBool()); \
+      VM_NEXT(); \
+   } \
+   VM_CASE(name##_CONST): generic_##name##_CONST: { \
+      const Value &b = R[argA(i)]; \
+      if (b.isInt()) VM_REWRITE(name##_INT_CONST); \
+      VM_BRANCH_UNLESS(applyBinary(BinaryOperator::op, b, Value::integer(argSBx(i))).asBool()); \
+      VM_NEXT(); \
+   } \
+   VM_CASE(name##_INT_INT): { \
+      const Value &b = R[argA(i)]; \
+      const Value &c = R[argB(i)]; \
+      if (!Value::bothInt(b, c)) { VM_REWRITE(name); goto generic_##name; } \
+      VM_BRANCH_UNLESS(b.asInt() cmp c.asInt()); \
+      VM_NEXT(); \
+   } \
+   VM_CASE(name##_INT_CONST): { \
+      const Value &b = R[argA(i)]; \
+      if (!b.isInt()) { VM_REWRITE(name##_CONST); goto generic_##name##_CONST; } \
+      VM_BRANCH_UNLESS(b.asInt() cmp argSBx(i)); \
+      VM_NEXT(); \
+   }
+
+#define VM_UNARY(name, op) \
+   VM_CASE(name): { R[argA(i)] = applyUnary(UnaryOperator::op, R[argB(i)]); VM_NEXT(); }
+
+   // Nothing is recorded on the way into a protected range; only a raise
+   // pays, saving ip for unwind to find the handler by.
+   try {
+#ifdef COMPILER_THREADED_DISPATCH
+   static const void *const labels[] = {
+#define COMPILER_OPCODE_LABEL(name) &&op_##name,
+           COMPILER_OPCODES(COMPILER_OPCODE_LABEL)
+#undef COMPILER_OPCODE_LABEL
+   };
+#define VM_CASE(name) op_##name
+#define VM_NEXT() do { i = *ip++; goto *labels[i & 0xff]; } while (0)
+   VM_NEXT();
+#else
+#define VM_CASE(name) case OpCode::name
+#define VM_NEXT() continue
+   for (;;) {
+      i = *ip++;
+      switch (opcodeOf(i)) {
+#endif
+
+   VM_CASE(MOVE): {
+      R[argA(i)] = R[argB(i)];
+      VM_NEXT();
+   }
+
+   VM_CASE(LOADK): {
+      R[argA(i)] = K[argBx(i)];
+      VM_NEXT();
+   }
+
+   VM_CASE(LOADINT): {
+      R[argA(i)] = Value::integer(argSBx(i));
+      VM_NEXT();
+   }
+
+   VM_CASE(LOADBOOL): {
+      R[argA(i)] = Value::boolean(argB(i) != 0);
+      VM_NEXT();
+   }
+
+   VM_CASE(LOADNULL): {
+      R[argA(i)] = Value::null();
+      VM_NEXT();
+   }
+
+   VM_CASE(GETGLOBAL): {
+      R[argA(i)] = globals[argBx(i)];
+      VM_NEXT();
+   }
+
+   VM_CASE(SETGLOBAL): {
+      globals[argBx(i)] = R[argA(i)];
+      VM_NEXT();
+   }
+
+   VM_BINARY(ADD, Add, ADD_INT_INT, ADD_FLOAT_FLOAT)
+   VM_BINARY(SUB, Subtract, SUB_INT_INT, SUB_FLOAT_FLOAT)
+   VM_BINARY(MUL, Multiply, MUL_INT_INT, MUL_FLOAT_FLOAT)
+   VM_BINARY(DIV, Divide, DIV, DIV_FLOAT_FLOAT)
+   VM_BINARY(EQ, Equal, EQ_INT_INT, EQ)
+   VM_BINARY(NE, NotEqual, NE_INT_INT, NE)
+   VM_BINARY(LT, Less, LT_INT_INT, LT)
+   VM_BINARY(LE, LessEqual, LE_INT_INT, LE)
+   VM_BINARY(GT, Greater, GT_INT_INT, GT)
+   VM_BINARY(GE, GreaterEqual, GE_INT_INT, GE)
+
+   VM_INT_BINARY(ADD_INT_INT, ADD, Value::integer(wrapInt(x + y)))
+   VM_INT_BINARY(SUB_INT_INT, SUB, Value::integer(wrapInt(x - y)))
+   VM_INT_BINARY(MUL_INT_INT, MUL, Value::integer(wrapInt(x * y)))
+   VM_INT_BINARY(EQ_INT_INT, EQ, Value::boolean(x == y))
+   VM_INT_BINARY(NE_INT_INT, NE, Value::boolean(x != y))
+   VM_INT_BINARY(LT_INT_INT, LT, Value::boolean(x < y))
+   VM_INT_BINARY(LE_INT_INT, LE, Value::boolean(x <= y))
+   VM_INT_BINARY(GT_INT_INT, GT, Value::boolean(x > y))
+   VM_INT_BINARY(GE_INT_INT, GE, Value::boolean(x >= y))
+
+   VM_FLOAT_BINARY(ADD_FLOAT_FLOAT, ADD, Value::number(x + y))
+   VM_FLOAT_BINARY(SUB_FLOAT_FLOAT, SUB, Value::number(x - y))
+   VM_FLOAT_BINARY(MUL_FLOAT_FLOAT, MUL, Value::number(x * y))
+   VM_FLOAT_BINARY(DIV_FLOAT_FLOAT, DIV, Value::number(x / y))
+
+   VM_CONST_BINARY(ADD_CONST, ADD, Add, x + y)
+   VM_CONST_BINARY(SUB_CONST, SUB, Subtract, x - y)
+
+   VM_BRANCH(IFLT, Less, <)
+   VM_BRANCH(IFLE, LessEqual, <=)
+   VM_BRANCH(IFGT, Greater, >)
+   VM_BRANCH(IFGE, GreaterEqual, >=)
+   VM_BRANCH(IFEQ, Equal, ==)
+   VM_BRANCH(IFNE, NotEqual, !=)
+
+   VM_CASE(MATMUL): {
+      R[argA(i)] = matrixMultiply(R[argB(i)], R[argC(i)]);
+      VM_NEXT();
+   }
+
+   VM_CASE(MATCHAIN): {
+      R[argA(i)] = matrixChainMultiply(R + argB(i), argC(i));
+      VM_NEXT();
+   }
+
+   VM_UNARY(NEG, Negate)
+   VM_UNARY(PLUS, Plus)
+   VM_UNARY(NOT, Not)
+   VM_UNARY(BNOT, BitwiseNot)
+
+   VM_CASE(TRUTHY): {
+      R[argA(i)] = Value::boolean(isTruthy(R[argB(i)]));
+      VM_NEXT();
+   }
+
+   VM_CASE(JMP): {
+      ip += argSBx(i);
+      if (argSBx(i) < 0) VM_HOT_SPOT();
+      VM_NEXT();
+   }
+
+   VM_CASE(JMPF): {
+      if (!isTruthy(R[argA(i)])) {
+         ip += argSBx(i);
+         if (argSBx(i) < 0) VM_HOT_SPOT();
+      }
+      VM_NEXT();
+   }
+
+   VM_CASE(JMPT): {
+      if (isTruthy(R[argA(i)])) {
+         ip += argSBx(i);
+         if (argSBx(i) < 0) VM_HOT_SPOT();
+      }
+      VM_NEXT();
+   }
+
+   VM_CASE(SWITCH): {
+      int offset = frame->function->switchTables[argBx(i)].lookup(R[argA(i)]);
+      if (offset != SwitchTable::NO_MATCH) ip += offset;
+      VM_NEXT();
+   }
+
+   VM_CASE(CALL): {
+      CallSite &site = frame->function->callSites[argBx(i)];
+      int a = argA(i);
+      if (site.epoch != bindingEpoch) bindCallSite(site);
+
+      if (FunctionProto *callee = site.target) {
+         if (static_cast<int>(frames.size()) > maxCallDepth) {
+            throw RuntimeError("Stack overflow in '" + callee->name + "'");
+         }
+
+         frame->ip = ip;
+         size_t base = frame->base + a;
+         if (registers.size() < base + callee->registerCount) registers.resize(base + callee->registerCount);
+         frames.push_back(CallFrame{callee, callee->code.data(), base});
+         VM_REFRESH();
+         VM_HOT_SPOT();
+         VM_NEXT();
+      }
+
+      R[a] = site.host->callback(R + a, site.argumentCount);
+      VM_ENTER_JIT();
+      VM_NEXT();
+   }
+
+   VM_CASE(TAILCALL): {
+      CallSite &site = frame->function->callSites[argBx(i)];
+      int a = argA(i);
+      if (site.epoch != bindingEpoch) bindCallSite(site);
+
+      if (FunctionProto *callee = site.target) {
+         for (int k = 0; k < site.argumentCount; ++k) R[k] = std::move(R[a + k]);
+         if (registers.size() < frame->base + callee->registerCount) {
+            registers.resize(frame->base + callee->registerCount);
+         }
+         frame->function = callee;
+         frame->ip = callee->code.data();
+         VM_REFRESH();
+         VM_HOT_SPOT();
+         VM_NEXT();
+      }
+
+      Value result = site.host->callback(R + a, site.argumentCount);
+      size_t base = frame->base;
+      frames.pop_back();
+      if (frames.empty()) return;
+      registers[base] = std::move(result);
+      VM_REFRESH();
+      VM_ENTER_JIT();
+      VM_NEXT();
+   }
+
+   VM_CASE(RETURN): {
+      Value result = std::move(R[argA(i)]);
+      size_t base = frame->base;
+      frames.pop_back();
+      if (frames.empty()) return;
+      registers[base] = std::move(result);
+      VM_REFRESH();
+      VM_ENTER_JIT();
+      VM_NEXT();
+   }
+
+   VM_CASE(DEFFN): {
+      FunctionProto *function = frame->function->nestedFunctions[argBx(i)];
+      FunctionProto *&binding = functions[function->name];
+      if (binding != function) {
+         binding = function;
+         bindingEpoch++;
+      }
+      VM_NEXT();
+   }
+
+   VM_CASE(RETHROW): {
+      std::exception_ptr exception = savedExceptions.back();
+      savedExceptions.pop_back();
+      std::rethrow_exception(exception);
+   }
+
+   VM_CASE(DISCARD): {
+      savedExceptions.pop_back();
+      VM_NEXT();
+   }
+
+   VM_CASE(ERROR): {
+      throw RuntimeError(K[argBx(i)].toString());
+   }
+
+#ifndef COMPILER_THREADED_DISPATCH
+      }
+   }
+#endif
+   } catch (...) {
+      frames.back().ip = ip;
+      throw;
+   }
+
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_UNARY
+#undef VM_BRANCH
+#undef VM_CONST_BINARY
+#undef VM_FLOAT_BINARY
+#undef VM_INT_BINARY
+#undef VM_BINARY
+#undef VM_BRANCH_UNLESS
+#undef VM_REWRITE
+#undef VM_HOT_SPOT
+#undef VM_ENTER_JIT
+#undef VM_REFRESH
+}
@@ -0,0 +1,1225 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "x86_64_backend.h"
+#include "inliner.h"
+#include "error.h"
+
+namespace {
+
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+const char *const NAMES64[] = {"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+                               "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+const char *const NAMES32[] = {"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+                               "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+// A unit holds a Value: its tag in the low half of one register, its
+// payload in another. rax, rcx, rdx, rsi, rdi and r10 stay free as scratch.
+struct Unit {
+    Reg tag;
+    Reg payload;
+};
+
+const Unit UNITS[] = {{RBX, R12}, {R13, R14}, {R8, R9}, {R15, R11}};
+constexpr int UNIT_COUNT = 4;
+constexpr unsigned CALLEE_SAVED_UNITS = 0x3;
+constexpr unsigned ALL_UNITS = 0xf;
+const Reg CALLER_SAVED[] = {R8, R9, R11};
+const Reg CALLEE_SAVED[] = {RBX, R12, R13, R14, R15};
+
+// Value tags, as the runtime numbers them.
+enum Tag { T_NULL, T_BOOL, T_INT, T_FLOAT, T_STRING, T_MATRIX };
+
+// Room for the runtime's RtHandler (a jmp_buf and two words); the runtime
+// checks that it fits.
+constexpr int HANDLER_SIZE = 512;
+
+bool isCallerSaved(Reg reg) {
+   return std::find(std::begin(CALLER_SAVED), std::end(CALLER_SAVED), reg) != std::end(CALLER_SAVED);
+}
+
+bool callsOut(const IrInstr *instr) {
+   switch (instr->op) {
+      case IrOp::Call:
+      case IrOp::MatMul:
+      case IrOp::MatChain:
+      case IrOp::DefineFunction:
+      case IrOp::Catch:
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool isComparison(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Less:
+      case BinaryOperator::LessEqual:
+      case BinaryOperator::Greater:
+      case BinaryOperator::GreaterEqual:
+      case BinaryOperator::Equal:
+      case BinaryOperator::NotEqual:
+         return true;
+      default:
+         return false;
+   }
+}
+
+// The condition code an integer comparison sets.
+const char *intCondition(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Less:
+         return "l";
+      case BinaryOperator::LessEqual:
+         return "le";
+      case BinaryOperator::Greater:
+         return "g";
+      case BinaryOperator::GreaterEqual:
+         return "ge";
+      case BinaryOperator::Equal:
+         return "e";
+      default:
+         return "ne";
+   }
+}
+
+// The runtime's OP_* code of an arithmetic or ordering operator.
+int runtimeOperator(BinaryOperator op) {
+   switch (op) {
+      case BinaryOperator::Add:
+         return 0;
+      case BinaryOperator::Subtract:
+         return 1;
+      case BinaryOperator::Multiply:
+         return 2;
+      case BinaryOperator::Divide:
+         return 3;
+      case BinaryOperator::Less:
+         return 4;
+      case BinaryOperator::LessEqual:
+         return 5;
+      case BinaryOperator::Greater:
+         return 6;
+      case BinaryOperator::GreaterEqual:
+         return 7;
+      default:
+         throw CompilerError(std::string("Unsupported binary operator '") + operatorLexeme(op) + "'");
+   }
+}
+
+int unaryCode(UnaryOperator op) {
+   switch (op) {
+      case UnaryOperator::Plus:
+         return 0;
+      case UnaryOperator::Negate:
+         return 1;
+      case UnaryOperator::Not:
+         return 2;
+      case UnaryOperator::BitwiseNot:
+         return 3;
+      default:
+         throw CompilerError("Unsupported unary operator");
+   }
+}
+
+// The tag of a constant, or -1 for a value only known at run time.
+int knownTag(const IrInstr *value) {
+   if (value->op != IrOp::Const) return -1;
+   const Value &constant = value->constant;
+   if (constant.isNull()) return T_NULL;
+   if (constant.isBool()) return T_BOOL;
+   if (constant.isInt()) return T_INT;
+   if (constant.isFloat()) return T_FLOAT;
+   if (constant.isString()) return T_STRING;
+   throw CompilerError(std::string("Cannot emit a ") + constant.typeName() + " constant as assembly");
+}
+
+std::string functionName(int id) {
+   return "fn_" + std::to_string(id);
+}
+
+std::string memory(int offset, const char *base = "%rbp") {
+   return std::to_string(offset) + "(" + base + ")";
+}
+
+}
+
+X86RegisterAllocator::X86RegisterAllocator(const IrFunction &function, const Liveness &liveness, int unitCount,
+                                           unsigned allowedUnits, unsigned calleeSavedUnits) {
+   std::vector<const IrInstr *> byId;
+   auto number = [&](const IrInstr *value) {
+       if (value->id < 0) return;
+       if (byId.size() <= static_cast<size_t>(value->id)) byId.resize(value->id + 1, nullptr);
+       byId[value->id] = value;
+   };
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *phi: block->phis) number(phi);
+      for (const IrInstr *instr: block->instructions) number(instr);
+   }
+   locations.assign(byId.size(), Location{});
+
+   // Positions as in the RegisterAllocator: phis at the block's start,
+   // instruction k at start + 2(k + 1), phi copies at its end.
+   auto needsHome = [](const IrInstr *value) { return value->op != IrOp::Const && !value->users.empty(); };
+   std::vector<Interval> all(byId.size());
+   auto extend = [&](const IrInstr *value, int position) {
+       if (!needsHome(value)) return;
+       Interval &interval = all[value->id];
+       if (!interval.value) {
+          interval = Interval{value, position, position};
+          return;
+       }
+       interval.start = std::min(interval.start, position);
+       interval.end = std::max(interval.end, position);
+   };
+   auto extendAll = [&](const BitVector &live, int position) {
+       live.forEach([&](size_t id) {
+           if (id < byId.size() && byId[id]) extend(byId[id], position);
+       });
+   };
+   std::vector<int> calls;
+   int position = 0;
+   for (const auto &block: function.blocks) {
+      int start = position;
+      int end = start + 2 * static_cast<int>(block->instructions.size() + 1);
+      extendAll(liveness.liveIn(block.get()), start);
+      for (const IrInstr *phi: block->phis) extend(phi, start);
+      for (size_t k = 0; k < block->instructions.size(); ++k) {
+         const IrInstr *instr = block->instructions[k];
+         int at = start + 2 * static_cast<int>(k + 1);
+         positions[instr] = at;
+         if (callsOut(instr)) calls.push_back(at);
+         if (instr->id >= 0) extend(instr, at);
+         for (const IrInstr *operand: instr->operands) extend(operand, at);
+      }
+      extendAll(liveness.liveOut(block.get()), end);
+      position = end + 2;
+   }
+
+   std::vector<Interval> order;
+   for (const Interval &interval: all) {
+      if (interval.value) order.push_back(interval);
+   }
+   std::sort(order.begin(), order.end(), [](const Interval &a, const Interval &b) {
+       return a.start != b.start ? a.start < b.start : a.value->id < b.value->id;
+   });
+
+   std::vector<bool> busy(unitCount, false);
+   std::vector<Interval> active; // holding units
+   std::vector<int> slotEnds;    // end of each slot's last owner
+   auto unitOf = [&](const IrInstr *value) { return locations[value->id].unit; };
+   auto available = [&](int unit) { return unit >= 0 && (allowedUnits >> unit & 1) && !busy[unit]; };
+   // A slot is shared only by values whose whole intervals are disjoint: a
+   // victim evicted from a unit keeps its slot back to its own start.
+   auto newSlot = [&](const Interval &owner) {
+       for (int slot = 0; slot < slots; ++slot) {
+          if (slotEnds[slot] > owner.start) continue;
+          slotEnds[slot] = owner.end;
+          return slot;
+       }
+       slotEnds.push_back(owner.end);
+       return slots++;
+   };
+   for (const Interval &interval: order) {
+      const IrInstr *value = interval.value;
+      auto expired = std::partition(active.begin(), active.end(), [&](const Interval &other) {
+          return other.end > interval.start;
+      });
+      for (auto it = expired; it != active.end(); ++it) busy[unitOf(it->value)] = false;
+      active.erase(expired, active.end());
+
+      int unit = -1;
+      auto hinted = [&](const IrInstr *other) { return available(unitOf(other)) ? unitOf(other) : -1; };
+      if (value->op == IrOp::Phi) {
+         for (const IrInstr *operand: value->operands) {
+            if (unit < 0 && operand->id >= 0 && static_cast<size_t>(operand->id) < locations.size()) {
+               unit = hinted(operand);
+            }
+         }
+      }
+      for (const IrInstr *user: value->users) {
+         if (unit < 0 && user->op == IrOp::Phi) unit = hinted(user);
+      }
+      // Across a call a callee-saved unit costs nothing; elsewhere the
+      // caller-saved ones are saved only on slow paths.
+      auto first = std::lower_bound(calls.begin(), calls.end(), interval.start + 1);
+      bool crossesCall = first != calls.end() && *first < interval.end;
+      for (int pass = 0; pass < 2 && unit < 0; ++pass) {
+         bool wantCalleeSaved = crossesCall == (pass == 0);
+         for (int u = 0; u < unitCount && unit < 0; ++u) {
+            if (static_cast<bool>(calleeSavedUnits >> u & 1) == wantCalleeSaved && available(u)) unit = u;
+         }
+      }
+
+      if (unit >= 0) {
+         locations[value->id].unit = unit;
+         busy[unit] = true;
+         active.push_back(interval);
+         continue;
+      }
+      ++spills;
+      auto victim = std::max_element(active.begin(), active.end(), [](const Interval &a, const Interval &b) {
+          return a.end < b.end;
+      });
+      if (victim != active.end() && victim->end > interval.end) {
+         Location &spilled = locations[victim->value->id];
+         locations[value->id].unit = spilled.unit;
+         spilled = Location{-1, newSlot(*victim)};
+         *victim = interval;
+      } else {
+         locations[value->id].slot = newSlot(interval);
+      }
+   }
+
+   for (const Interval &interval: order) {
+      int unit = unitOf(interval.value);
+      if (unit < 0) continue;
+      intervals.push_back(interval);
+      used |= 1u << unit;
+   }
+}
+
+unsigned X86RegisterAllocator::unitsLiveAcross(int position) const {
+   unsigned live = 0;
+   for (const Interval &interval: intervals) {
+      if (interval.start >= position) break;
+      if (interval.end > position) live |= 1u << locations[interval.value->id].unit;
+   }
+   return live;
+}
+
+// Layout of a function's frame below the callee-saved registers pushed after
+// rbp. Offsets are from rbp; outgoing stack arguments sit at rsp.
+struct X86Emitter::Frame {
+    std::vector<int> saved; // pushed in this order
+    int size = 0;
+    int params = 0;      // register arguments, as received
+    int slots = 0;       // spill slot 0
+    int scratch = 0;     // arguments and results of calls out
+    int temps = 0;       // parallel phi copies
+    int callerSaves = 0; // r8, r9 and r11 around calls
+    int handler = 0;     // an RtHandler, when the function protects blocks
+    std::unordered_map<const IrInstr *, int> kinds; // catch -> its error flag
+    bool script = false;
+    std::string overflow;
+
+    [[nodiscard]] int slot(int index) const { return slots + 16 * index; }
+
+    [[nodiscard]] int scratchValue(int index) const { return scratch + 16 * index; }
+};
+
+void X86Emitter::line(const std::string &text) {
+   *out << '\t' << text << '\n';
+}
+
+std::string X86Emitter::label() {
+   return ".LX" + std::to_string(labelCount++);
+}
+
+std::string X86Emitter::blockLabel(const IrBlock *block) const {
+   return ".L" + std::to_string(functionIds.at(function)) + "_" + std::to_string(block->id);
+}
+
+std::string X86Emitter::literal(const std::string &text) {
+   literals.push_back(text);
+   return ".LC" + std::to_string(literals.size() - 1);
+}
+
+void X86Emitter::collect() {
+   bindings.clear();
+   strings.clear();
+   functionIds.clear();
+   for (const auto &irFunction: module->functions) {
+      functionIds.emplace(irFunction.get(), static_cast<int>(functionIds.size()));
+   }
+   for (const auto &irFunction: module->functions) {
+      for (const auto &block: irFunction->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::DefineFunction) bindings.emplace(instr->name, static_cast<int>(bindings.size()));
+            if (instr->op == IrOp::Const && instr->constant.isString()) {
+               strings.emplace(instr->constant.asString()->chars, static_cast<int>(strings.size()));
+            }
+         }
+      }
+   }
+}
+
+void X86Emitter::loadTag(const IrInstr *value, int reg) {
+   int tag = knownTag(value);
+   if (tag >= 0) {
+      line("movl $" + std::to_string(tag) + ", " + NAMES32[reg]);
+      return;
+   }
+   X86RegisterAllocator::Location location = allocator->location(value);
+   if (location.unit >= 0) {
+      if (UNITS[location.unit].tag != reg) line(std::string("movl ") + NAMES32[UNITS[location.unit].tag] + ", " + NAMES32[reg]);
+   } else if (location.slot >= 0) {
+      line("movl " + memory(frame->slot(location.slot)) + ", " + NAMES32[reg]);
+   } else {
+      throw CompilerError("Value without a home in " + function->name);
+   }
+}
+
+void X86Emitter::loadPayload(const IrInstr *value, int reg) {
+   int tag = knownTag(value);
+   if (tag >= 0) {
+      const Value &constant = value->constant;
+      if (tag == T_FLOAT) {
+         double number = constant.asFloat();
+         std::uint64_t bits;
+         std::memcpy(&bits, &number, sizeof(bits));
+         std::ostringstream hex;
+         hex << "movabsq $0x" << std::hex << bits << ", " << NAMES64[reg];
+         line(hex.str());
+      } else if (tag == T_STRING) {
+         int index = strings.at(constant.asString()->chars);
+         line("movq K+" + std::to_string(16 * index + 8) + "(%rip), " + NAMES64[reg]);
+      } else {
+         int payload = tag == T_INT ? constant.asInt() : tag == T_BOOL ? constant.asBool() : 0;
+         line("movl $" + std::to_string(payload) + ", " + NAMES32[reg]);
+      }
+      return;
+   }
+   X86RegisterAllocator::Location location = allocator->location(value);
+   if (location.unit >= 0) {
+      if (UNITS[location.unit].payload != reg) {
+         line(std::string("movq ") + NAMES64[UNITS[location.unit].payload] + ", " + NAMES64[reg]);
+      }
+   } else if (location.slot >= 0) {
+      line("movq " + memory(frame->slot(location.slot) + 8) + ", " + NAMES64[reg]);
+   } else {
+      throw CompilerError("Value without a home in " + function->name);
+   }
+}
+
+void X86Emitter::stage(const IrInstr *value, int offset) {
+   X86RegisterAllocator::Location location = allocator->location(value);
+   if (value->op != IrOp::Const && location.unit >= 0) {
+      const Unit &unit = UNITS[location.unit];
+      line(std::string("movl ") + NAMES32[unit.tag] + ", " + memory(offset));
+      line(std::string("movq ") + NAMES64[unit.payload] + ", " + memory(offset + 8));
+      return;
+   }
+   loadTag(value, R10);
+   line("movl %r10d, " + memory(offset));
+   loadPayload(value, R10);
+   line("movq %r10, " + memory(offset + 8));
+}
+
+void X86Emitter::define(const IrInstr *value, int tagReg, int payloadReg) {
+   X86RegisterAllocator::Location location = allocator->location(value);
+   if (location.unit >= 0) {
+      const Unit &unit = UNITS[location.unit];
+      line(std::string("movl ") + NAMES32[tagReg] + ", " + NAMES32[unit.tag]);
+      line(std::string("movq ") + NAMES64[payloadReg] + ", " + NAMES64[unit.payload]);
+   } else if (location.slot >= 0) {
+      line(std::string("movl ") + NAMES32[tagReg] + ", " + memory(frame->slot(location.slot)));
+      line(std::string("movq ") + NAMES64[payloadReg] + ", " + memory(frame->slot(location.slot) + 8));
+   }
+}
+
+void X86Emitter::defineTag(const IrInstr *value, int tag, int payloadReg) {
+   X86RegisterAllocator::Location location = allocator->location(value);
+   std::string immediate = "movl $" + std::to_string(tag) + ", ";
+   if (location.unit >= 0) {
+      const Unit &unit = UNITS[location.unit];
+      line(immediate + NAMES32[unit.tag]);
+      line(std::string("movq ") + NAMES64[payloadReg] + ", " + NAMES64[unit.payload]);
+   } else if (location.slot >= 0) {
+      line(immediate + memory(frame->slot(location.slot)));
+      line(std::string("movq ") + NAMES64[payloadReg] + ", " + memory(frame->slot(location.slot) + 8));
+   }
+}
+
+void X86Emitter::defineFrom(const IrInstr *value, int offset) {
+   X86RegisterAllocator::Location location = allocator->location(value);
+   if (location.unit >= 0) {
+      const Unit &unit = UNITS[location.unit];
+      line("movl " + memory(offset) + ", " + NAMES32[unit.tag]);
+      line("movq " + memory(offset + 8) + ", " + NAMES64[unit.payload]);
+   } else if (location.slot >= 0) {
+      line("movq " + memory(offset) + ", %r10");
+      line("movq %r10, " + memory(frame->slot(location.slot)));
+      line("movq " + memory(offset + 8) + ", %r10");
+      line("movq %r10, " + memory(frame->slot(location.slot) + 8));
+   }
+}
+
+template<typename F>
+void X86Emitter::callRuntime(const char *helper, int position, F setArguments) {
+   std::vector<std::pair<Reg, int>> saves;
+   unsigned live = allocator->unitsLiveAcross(position);
+   for (int u = 0; u < UNIT_COUNT; ++u) {
+      if (!(live >> u & 1)) continue;
+      for (Reg reg: {UNITS[u].tag, UNITS[u].payload}) {
+         if (!isCallerSaved(reg)) continue;
+         int index = static_cast<int>(std::find(std::begin(CALLER_SAVED), std::end(CALLER_SAVED), reg) - std::begin(CALLER_SAVED));
+         saves.emplace_back(reg, frame->callerSaves + 8 * index);
+      }
+   }
+   for (const auto &[reg, offset]: saves) line(std::string("movq ") + NAMES64[reg] + ", " + memory(offset));
+   setArguments();
+   line(std::string("call ") + helper + "@PLT");
+   for (const auto &[reg, offset]: saves) line("movq " + memory(offset) + ", " + NAMES64[reg]);
+}
+
+// True when the edge from -> to has phi copies to make.
+static bool hasCopies(const IrBlock *from, const IrBlock *to, const X86RegisterAllocator &allocator) {
+   size_t index = to->predecessorIndex(from);
+   for (const IrInstr *phi: to->phis) {
+      X86RegisterAllocator::Location home = allocator.location(phi);
+      if (home.unit < 0 && home.slot < 0) continue;
+      const IrInstr *operand = phi->operands[index];
+      X86RegisterAllocator::Location source = allocator.location(operand);
+      if (operand->op == IrOp::Const || source.unit != home.unit || source.slot != home.slot) return true;
+   }
+   return false;
+}
+
+std::string X86Emitter::edgeTarget(const IrBlock *from, const IrBlock *to) {
+   if (!hasCopies(from, to, *allocator)) return blockLabel(to);
+   std::string stub = label();
+   stubs.emplace_back(stub, from, to);
+   return stub;
+}
+
+void X86Emitter::emitEdge(const IrBlock *from, const IrBlock *to, const IrBlock *next) {
+   size_t index = to->predecessorIndex(from);
+   std::vector<std::pair<const IrInstr *, const IrInstr *>> copies;
+   for (const IrInstr *phi: to->phis) {
+      X86RegisterAllocator::Location home = allocator->location(phi);
+      if (home.unit < 0 && home.slot < 0) continue;
+      const IrInstr *operand = phi->operands[index];
+      X86RegisterAllocator::Location source = allocator->location(operand);
+      if (operand->op != IrOp::Const && source.unit == home.unit && source.slot == home.slot) continue;
+      copies.emplace_back(phi, operand);
+   }
+   if (copies.size() == 1) {
+      loadTag(copies[0].second, RAX);
+      loadPayload(copies[0].second, RCX);
+      define(copies[0].first, RAX, RCX);
+   } else {
+      // The phis take their values in parallel: one may read another.
+      for (size_t i = 0; i < copies.size(); ++i) stage(copies[i].second, frame->temps + 16 * static_cast<int>(i));
+      for (size_t i = 0; i < copies.size(); ++i) defineFrom(copies[i].first, frame->temps + 16 * static_cast<int>(i));
+   }
+   if (to != next) line("jmp " + blockLabel(to));
+}
+
+std::string X86Emitter::emitAssembly(IrModule &irModule) {
+   module = &irModule;
+   collect();
+   CallGraph graph(irModule);
+   targets.clear();
+   for (const auto &irFunction: irModule.functions) {
+      for (const IrInstr *call: graph.sites(irFunction.get())) targets[call] = graph.target(call);
+   }
+   literals.clear();
+   labelCount = 0;
+   std::ostringstream text;
+   out = &text;
+
+   text << "\t.text\n";
+   for (const auto &irFunction: irModule.functions) {
+      irFunction->renumber();
+      emitFunction(*irFunction);
+   }
+   text << "\t.section .rodata\n";
+   for (size_t i = 0; i < literals.size(); ++i) {
+      text << ".LC" << i << ":\n\t.asciz " << cQuote(literals[i]) << "\n";
+   }
+   text << "\t.section .note.GNU-stack,\"\",@progbits\n";
+   out = nullptr;
+   module = nullptr;
+   return text.str();
+}
+
+void X86Emitter::emitFunction(const IrFunction &irFunction) {
+   function = &irFunction;
+   bool protects = false;
+   for (const auto &block: irFunction.blocks) protects |= block->handler != nullptr;
+   Liveness liveness(irFunction);
+   // longjmp restores only the callee-saved registers.
+   X86RegisterAllocator registers(irFunction, liveness, UNIT_COUNT, protects ? CALLEE_SAVED_UNITS : ALL_UNITS,
+                                  CALLEE_SAVED_UNITS);
+   allocator = &registers;
+
+   Frame layout;
+   layout.script = &irFunction == &module->main();
+   for (Reg reg: CALLEE_SAVED) {
+      for (int u = 0; u < UNIT_COUNT; ++u) {
+         if ((registers.usedUnits() >> u & 1) && (UNITS[u].tag == reg || UNITS[u].payload == reg)) {
+            layout.saved.push_back(reg);
+         }
+      }
+   }
+   int scratchValues = 3;
+   int temps = 0;
+   int outgoing = 0;
+   std::vector<const IrInstr *> catches;
+   for (const auto &block: irFunction.blocks) {
+      temps = std::max(temps, static_cast<int>(block->phis.size()));
+      for (const IrInstr *instr: block->instructions) {
+         scratchValues = std::max(scratchValues, static_cast<int>(instr->operands.size()) + 1);
+         if (instr->op == IrOp::Call && targets.count(instr)) {
+            outgoing = std::max(outgoing, 16 * (static_cast<int>(instr->operands.size()) - 3));
+         }
+         if (instr->op == IrOp::Catch) catches.push_back(instr);
+      }
+   }
+   int cursor = 8 * static_cast<int>(layout.saved.size());
+   auto reserve = [&](int bytes) {
+       cursor += bytes;
+       return -cursor;
+   };
+   layout.params = reserve(16 * std::min(irFunction.arity, 3));
+   layout.slots = reserve(16 * registers.slotCount());
+   layout.scratch = reserve(16 * scratchValues);
+   layout.temps = reserve(16 * temps);
+   layout.callerSaves = reserve(8 * 3);
+   if (protects) layout.handler = reserve(HANDLER_SIZE);
+   for (const IrInstr *instr: catches) layout.kinds[instr] = reserve(8);
+   layout.size = (cursor + outgoing + 15) / 16 * 16 - 8 * static_cast<int>(layout.saved.size());
+   frame = &layout;
+   stubs.clear();
+
+   std::ostream &text = *out;
+   std::string name = functionName(functionIds.at(&irFunction));
+   text << "\n# " << irFunction.name << ": " << registers.spillCount() << " spilled, "
+        << registers.slotCount() << " stack slots\n";
+   text << "\t.globl " << name << "\n\t.hidden " << name << "\n\t.type " << name << ", @function\n";
+   text << name << ":\n";
+   line("pushq %rbp");
+   line("movq %rsp, %rbp");
+   for (int reg: layout.saved) line(std::string("pushq ") + NAMES64[reg]);
+   if (layout.size > 0) line("subq $" + std::to_string(layout.size) + ", %rsp");
+   const Reg arguments[] = {RDI, RSI, RDX, RCX, R8, R9};
+   for (int i = 0; i < std::min(irFunction.arity, 3); ++i) {
+      line(std::string("movq ") + NAMES64[arguments[2 * i]] + ", " + memory(layout.params + 16 * i));
+      line(std::string("movq ") + NAMES64[arguments[2 * i + 1]] + ", " + memory(layout.params + 16 * i + 8));
+   }
+   if (!layout.script) {
+      layout.overflow = label();
+      line("movq rtx_max_depth(%rip), %rax");
+      line("cmpq %rax, rt_depth(%rip)");
+      line("jge " + layout.overflow);
+      line("incq rt_depth(%rip)");
+   }
+
+   for (size_t b = 0; b < irFunction.blocks.size(); ++b) {
+      const IrBlock *block = irFunction.blocks[b].get();
+      const IrBlock *next = b + 1 < irFunction.blocks.size() ? irFunction.blocks[b + 1].get() : nullptr;
+      text << blockLabel(block) << ":\n";
+      const IrInstr *terminator = block->terminator();
+      const IrInstr *raising = nullptr;
+      if (block->handler && block->instructions.size() > 1) {
+         const IrInstr *last = block->instructions[block->instructions.size() - 2];
+         if (last->mayThrow()) raising = last;
+      }
+      // A comparison only its block's branch reads sets the flags the branch
+      // jumps on instead of a boolean.
+      const IrInstr *fused = nullptr;
+      if (terminator && terminator->op == IrOp::Branch && !block->handler && block->instructions.size() > 1) {
+         const IrInstr *condition = terminator->operands[0];
+         if (condition == block->instructions[block->instructions.size() - 2] && condition->op == IrOp::Binary &&
+             isComparison(condition->binary) && condition->users.size() == 1) {
+            fused = condition;
+         }
+      }
+      for (const IrInstr *instr: block->instructions) {
+         if (instr == terminator) break;
+         if (instr == fused) continue;
+         if (instr == raising) {
+            std::string handler = memory(layout.handler);
+            line("leaq " + handler + ", %rdi");
+            line("call rtx_push@PLT");
+            line("leaq " + handler + ", %rdi");
+            line("call _setjmp@PLT");
+            line("testl %eax, %eax");
+            line("jne " + edgeTarget(block, block->handler));
+            emitInstruction(instr);
+            line("leaq " + handler + ", %rdi");
+            line("call rtx_pop@PLT");
+            continue;
+         }
+         emitInstruction(instr);
+      }
+      if (!terminator) throw CompilerError("Block without a terminator in " + irFunction.name);
+      emitTerminator(block, terminator, fused, next);
+   }
+
+   for (size_t i = 0; i < stubs.size(); ++i) {
+      auto [stub, from, to] = stubs[i];
+      text << stub << ":\n";
+      emitEdge(from, to);
+   }
+   if (!layout.script) {
+      text << layout.overflow << ":\n";
+      line("leaq " + literal(irFunction.name) + "(%rip), %rdi");
+      line("call rtx_stack_overflow@PLT");
+   }
+   text << "\t.size " << name << ", .-" << name << "\n";
+   frame = nullptr;
+   allocator = nullptr;
+   function = nullptr;
+}
+
+void X86Emitter::emitInstruction(const IrInstr *instr) {
+   int position = allocator->position(instr);
+   auto lea = [&](int offset, Reg reg) { line("leaq " + memory(offset) + ", " + NAMES64[reg]); };
+   auto immediate = [&](long value, Reg reg) { line("movl $" + std::to_string(value) + ", " + NAMES32[reg]); };
+   switch (instr->op) {
+      case IrOp::Const:
+         break;
+      case IrOp::Param: {
+         int offset = instr->index < 3 ? frame->params + 16 * instr->index : 16 + 16 * (instr->index - 3);
+         defineFrom(instr, offset);
+         break;
+      }
+      case IrOp::Catch:
+         callRuntime("rtx_caught", position, [&] { lea(frame->scratchValue(0), RDI); });
+         line("movl %eax, " + memory(frame->kinds.at(instr)));
+         defineFrom(instr, frame->scratchValue(0));
+         break;
+      case IrOp::LoadGlobal: {
+         std::string global = "rt_globals+" + std::to_string(16 * instr->index);
+         line("movl " + global + "(%rip), %eax");
+         line("movq " + global + "+8(%rip), %rcx");
+         define(instr, RAX, RCX);
+         break;
+      }
+      case IrOp::StoreGlobal: {
+         std::string global = "rt_globals+" + std::to_string(16 * instr->index);
+         loadTag(instr->operands[0], RAX);
+         loadPayload(instr->operands[0], RCX);
+         line("movl %eax, " + global + "(%rip)");
+         line("movq %rcx, " + global + "+8(%rip)");
+         break;
+      }
+      case IrOp::Binary:
+         emitBinary(instr, nullptr, nullptr);
+         break;
+      case IrOp::Unary:
+         emitUnary(instr);
+         break;
+      case IrOp::Truthy:
+         emitTruthy(instr->operands[0], position);
+         defineTag(instr, T_BOOL, RAX);
+         break;
+      case IrOp::MatMul:
+         stage(instr->operands[0], frame->scratchValue(1));
+         stage(instr->operands[1], frame->scratchValue(2));
+         callRuntime("rtx_matmul", position, [&] {
+             lea(frame->scratchValue(0), RDI);
+             lea(frame->scratchValue(1), RSI);
+             lea(frame->scratchValue(2), RDX);
+         });
+         defineFrom(instr, frame->scratchValue(0));
+         break;
+      case IrOp::MatChain:
+         for (size_t i = 0; i < instr->operands.size(); ++i) {
+            stage(instr->operands[i], frame->scratchValue(1 + static_cast<int>(i)));
+         }
+         callRuntime("rtx_matchain", position, [&] {
+             lea(frame->scratchValue(0), RDI);
+             lea(frame->scratchValue(1), RSI);
+             immediate(static_cast<long>(instr->operands.size()), RDX);
+         });
+         defineFrom(instr, frame->scratchValue(0));
+         break;
+      case IrOp::Call:
+         emitCall(instr);
+         break;
+      case IrOp::DefineFunction:
+         callRuntime("rtx_define", position, [&] {
+             immediate(bindings.at(instr->name), RDI);
+             immediate(functionIds.at(instr->function), RSI);
+         });
+         break;
+      case IrOp::Error: {
+         std::string message = literal(instr->name);
+         callRuntime("rtx_error", position, [&] { line("leaq " + message + "(%rip), %rdi"); });
+         break;
+      }
+      default:
+         throw CompilerError(std::string("Unexpected ") + irOpName(instr->op) + " in " + function->name);
+   }
+}
+
+void X86Emitter::emitBinary(const IrInstr *instr, const IrBlock *block, const IrInstr *branch) {
+   const IrInstr *left = instr->operands[0];
+   const IrInstr *right = instr->operands[1];
+   BinaryOperator op = instr->binary;
+   bool equality = op == BinaryOperator::Equal || op == BinaryOperator::NotEqual;
+   if (!equality) runtimeOperator(op);
+   int leftTag = knownTag(left);
+   int rightTag = knownTag(right);
+   auto may = [](int known, int tag) { return known < 0 || known == tag; };
+   bool tryInt = op != BinaryOperator::Divide && may(leftTag, T_INT) && may(rightTag, T_INT);
+   bool tryFloat = !equality && may(leftTag, T_FLOAT) && may(rightTag, T_FLOAT);
+   std::string trueTarget, falseTarget;
+   if (branch) {
+      trueTarget = edgeTarget(block, block->successors[0]);
+      falseTarget = edgeTarget(block, block->successors[1]);
+   }
+   std::string done = label();
+
+   // Jumps to otherwise unless both operands carry tag.
+   auto checkTags = [&](int tag, const std::string &otherwise) {
+       if (leftTag < 0) {
+          loadTag(left, RAX);
+          line("cmpl $" + std::to_string(tag) + ", %eax");
+          line("jne " + otherwise);
+       }
+       if (rightTag < 0) {
+          loadTag(right, RCX);
+          line("cmpl $" + std::to_string(tag) + ", %ecx");
+          line("jne " + otherwise);
+       }
+       loadPayload(left, RAX);
+       loadPayload(right, RCX);
+   };
+   // Finishes a fast path whose comparison set the flags for condition.
+   auto compared = [&](const std::string &condition) {
+       if (branch) {
+          line("j" + condition + " " + trueTarget);
+          line("jmp " + falseTarget);
+          return;
+       }
+       line("set" + condition + " %al");
+       line("movzbl %al, %eax");
+       defineTag(instr, T_BOOL, RAX);
+       line("jmp " + done);
+   };
+
+   if (tryInt) {
+      std::string notInt = label();
+      checkTags(T_INT, notInt);
+      if (isComparison(op)) {
+         line("cmpl %ecx, %eax");
+         compared(intCondition(op));
+      } else {
+         const char *mnemonic = op == BinaryOperator::Add ? "addl" : op == BinaryOperator::Subtract ? "subl" : "imull";
+         line(std::string(mnemonic) + " %ecx, %eax");
+         defineTag(instr, T_INT, RAX);
+         line("jmp " + done);
+      }
+      *out << notInt << ":\n";
+   }
+   if (tryFloat) {
+      std::string notFloat = label();
+      checkTags(T_FLOAT, notFloat);
+      line("movq %rax, %xmm0");
+      line("movq %rcx, %xmm1");
+      if (isComparison(op)) {
+         // Unordered operands set CF, so NaN compares false.
+         bool flipped = op == BinaryOperator::Less || op == BinaryOperator::LessEqual;
+         line(flipped ? "ucomisd %xmm0, %xmm1" : "ucomisd %xmm1, %xmm0");
+         compared(op == BinaryOperator::Less || op == BinaryOperator::Greater ? "a" : "ae");
+      } else {
+         const char *mnemonic = op == BinaryOperator::Add ? "addsd" : op == BinaryOperator::Subtract ? "subsd"
+                                                          : op == BinaryOperator::Multiply ? "mulsd" : "divsd";
+         line(std::string(mnemonic) + " %xmm1, %xmm0");
+         line("movq %xmm0, %rax");
+         defineTag(instr, T_FLOAT, RAX);
+         line("jmp " + done);
+      }
+      *out << notFloat << ":\n";
+   }
+
+   int position = allocator->position(instr);
+   stage(left, frame->scratchValue(1));
+   stage(right, frame->scratchValue(2));
+   auto operands = [&] {
+       line("leaq " + memory(frame->scratchValue(1)) + ", %rdx");
+       line("leaq " + memory(frame->scratchValue(2)) + ", %rcx");
+   };
+   if (equality) {
+      callRuntime("rtx_equals", position, [&] {
+          line("leaq " + memory(frame->scratchValue(0)) + ", %rdi");
+          line("leaq " + memory(frame->scratchValue(1)) + ", %rsi");
+          line("leaq " + memory(frame->scratchValue(2)) + ", %rdx");
+          line(std::string("movl $") + (op == BinaryOperator::NotEqual ? "1" : "0") + ", %ecx");
+      });
+   } else {
+      callRuntime("rtx_binary", position, [&] {
+          line("movl $" + std::to_string(runtimeOperator(op)) + ", %edi");
+          line("leaq " + memory(frame->scratchValue(0)) + ", %rsi");
+          operands();
+      });
+   }
+   if (branch) {
+      line("cmpl $0, " + memory(frame->scratchValue(0) + 8));
+      line("jne " + trueTarget);
+      line("jmp " + falseTarget);
+   } else {
+      defineFrom(instr, frame->scratchValue(0));
+   }
+   *out << done << ":\n";
+}
+
+void X86Emitter::emitUnary(const IrInstr *instr) {
+   const IrInstr *operand = instr->operands[0];
+   int position = allocator->position(instr);
+   UnaryOperator op = instr->unary;
+   int code = unaryCode(op);
+   std::string done = label();
+   if (op == UnaryOperator::Not) {
+      emitTruthy(operand, position);
+      line("xorl $1, %eax");
+      defineTag(instr, T_BOOL, RAX);
+      return;
+   }
+   std::string slow = label();
+   loadTag(operand, RAX);
+   loadPayload(operand, RCX);
+   if (op == UnaryOperator::BitwiseNot) {
+      line("cmpl $" + std::to_string(T_INT) + ", %eax");
+      line("jne " + slow);
+      line("notl %ecx");
+   } else {
+      std::string isFloat = label();
+      std::string result = label();
+      line("cmpl $" + std::to_string(T_FLOAT) + ", %eax");
+      line("je " + isFloat);
+      line("cmpl $" + std::to_string(T_INT) + ", %eax");
+      line("jne " + slow);
+      if (op == UnaryOperator::Negate) line("negl %ecx");
+      line("jmp " + result);
+      *out << isFloat << ":\n";
+      if (op == UnaryOperator::Negate) line("btcq $63, %rcx");
+      *out << result << ":\n";
+   }
+   define(instr, RAX, RCX);
+   line("jmp " + done);
+   *out << slow << ":\n";
+   stage(operand, frame->scratchValue(1));
+   callRuntime("rtx_unary", position, [&] {
+       line("movl $" + std::to_string(code) + ", %edi");
+       line("leaq " + memory(frame->scratchValue(0)) + ", %rsi");
+       line("leaq " + memory(frame->scratchValue(1)) + ", %rdx");
+   });
+   defineFrom(instr, frame->scratchValue(0));
+   *out << done << ":\n";
+}
+
+void X86Emitter::emitTruthy(const IrInstr *value, int position) {
+   std::string nonzero = label();
+   std::string done = label();
+   loadTag(value, RAX);
+   loadPayload(value, RCX);
+   line("cmpl $" + std::to_string(T_BOOL) + ", %eax");
+   line("je " + nonzero);
+   line("cmpl $" + std::to_string(T_INT) + ", %eax");
+   line("je " + nonzero);
+   stage(value, frame->scratchValue(1));
+   callRuntime("rtx_truthy", position, [&] { line("leaq " + memory(frame->scratchValue(1)) + ", %rdi"); });
+   line("jmp " + done);
+   *out << nonzero << ":\n";
+   line("xorl %eax, %eax");
+   line("testl %ecx, %ecx");
+   line("setne %al");
+   *out << done << ":\n";
+}
+
+void X86Emitter::emitCall(const IrInstr *instr) {
+   int position = allocator->position(instr);
+   int count = static_cast<int>(instr->operands.size());
+   for (int i = 0; i < count; ++i) stage(instr->operands[i], frame->scratchValue(1 + i));
+   auto target = targets.find(instr);
+   if (target != targets.end()) {
+      // System V: a Value is two INTEGER eightbytes, so the first three
+      // arguments take rdi:rsi, rdx:rcx and r8:r9 and the rest go on the
+      // stack in order; the result comes back in rax:rdx.
+      for (int i = 3; i < count; ++i) {
+         for (int half = 0; half < 16; half += 8) {
+            line("movq " + memory(frame->scratchValue(1 + i) + half) + ", %r10");
+            line("movq %r10, " + memory(16 * (i - 3) + half, "%rsp"));
+         }
+      }
+      std::string callee = functionName(functionIds.at(target->second));
+      const Reg arguments[] = {RDI, RSI, RDX, RCX, R8, R9};
+      callRuntime(callee.c_str(), position, [&] {
+          for (int i = 0; i < std::min(count, 3); ++i) {
+             line("movq " + memory(frame->scratchValue(1 + i)) + ", " + NAMES64[arguments[2 * i]]);
+             line("movq " + memory(frame->scratchValue(1 + i) + 8) + ", " + NAMES64[arguments[2 * i + 1]]);
+          }
+      });
+      define(instr, RAX, RDX);
+      return;
+   }
+
+   auto slot = bindings.find(instr->name);
+   const CHostFunction *host = findCHostFunction(instr->name);
+   int hostIndex = host ? static_cast<int>(host - cHostFunctions().data()) : -1;
+   std::string name = literal(instr->name);
+   callRuntime("rtx_call", position, [&] {
+       line("leaq " + memory(frame->scratchValue(0)) + ", %rdi");
+       line("movl $" + std::to_string(slot != bindings.end() ? slot->second : -1) + ", %esi");
+       line("leaq " + name + "(%rip), %rdx");
+       line("movl $" + std::to_string(hostIndex) + ", %ecx");
+       line("leaq " + memory(frame->scratchValue(1)) + ", %r8");
+       line("movl $" + std::to_string(count) + ", %r9d");
+   });
+   defineFrom(instr, frame->scratchValue(0));
+}
+
+void X86Emitter::emitTerminator(const IrBlock *block, const IrInstr *terminator, const IrInstr *fused,
+                                const IrBlock *next) {
+   int position = allocator->position(terminator);
+   switch (terminator->op) {
+      case IrOp::Jump:
+         emitEdge(block, block->successors[0], next);
+         break;
+      case IrOp::Branch:
+         if (fused) {
+            emitBinary(fused, block, terminator);
+            break;
+         }
+         emitTruthy(terminator->operands[0], position);
+         line("testl %eax, %eax");
+         line("jne " + edgeTarget(block, block->successors[0]));
+         emitEdge(block, block->successors[1], next);
+         break;
+      case IrOp::Switch:
+         emitSwitch(block, terminator);
+         emitEdge(block, block->successors[0], next);
+         break;
+      case IrOp::Return:
+         loadTag(terminator->operands[0], RAX);
+         loadPayload(terminator->operands[0], RDX);
+         if (!frame->script) line("decq rt_depth(%rip)");
+         if (frame->saved.empty()) {
+            line("movq %rbp, %rsp");
+         } else {
+            line("leaq " + memory(-8 * static_cast<int>(frame->saved.size())) + ", %rsp");
+            for (auto reg = frame->saved.rbegin(); reg != frame->saved.rend(); ++reg) {
+               line(std::string("popq ") + NAMES64[*reg]);
+            }
+         }
+         line("popq %rbp");
+         line("ret");
+         break;
+      case IrOp::Rethrow: {
+         const IrInstr *caught = terminator->operands[0];
+         if (caught->op != IrOp::Catch) throw CompilerError("Rethrow of a value that was not caught");
+         stage(caught, frame->scratchValue(1));
+         callRuntime(block->handler ? "rtx_set_caught" : "rtx_raise", position, [&] {
+             line("leaq " + memory(frame->scratchValue(1)) + ", %rdi");
+             line("movl " + memory(frame->kinds.at(caught)) + ", %esi");
+         });
+         if (block->handler) emitEdge(block, block->handler, next);
+         break;
+      }
+      default:
+         line("ud2");
+         break;
+   }
+}
+
+void X86Emitter::emitSwitch(const IrBlock *block, const IrInstr *terminator) {
+   const IrInstr *subject = terminator->operands[0];
+   int position = allocator->position(terminator);
+   std::vector<std::pair<std::int32_t, int>> integers;
+   std::vector<std::pair<std::string, int>> keys;
+   terminator->table->forEachKey([&](std::int32_t key, int target) { integers.emplace_back(key, target); },
+                                 [&](const std::string &key, int target) { keys.emplace_back(key, target); });
+   std::string strings = label();
+   if (!integers.empty()) {
+      std::string compare = label();
+      std::string convert = label();
+      loadTag(subject, RAX);
+      line("cmpl $" + std::to_string(T_INT) + ", %eax");
+      line("jne " + convert);
+      loadPayload(subject, RAX);
+      *out << compare << ":\n";
+      for (const auto &[key, target]: integers) {
+         line("cmpl $" + std::to_string(key) + ", %eax");
+         line("je " + edgeTarget(block, block->successors[target]));
+      }
+      line("jmp " + strings);
+      // Floats with an integral value find the integer keys.
+      *out << convert << ":\n";
+      line("cmpl $" + std::to_string(T_FLOAT) + ", %eax");
+      line("jne " + strings);
+      stage(subject, frame->scratchValue(1));
+      callRuntime("rtx_switch_key", position, [&] {
+          line("leaq " + memory(frame->scratchValue(1)) + ", %rdi");
+          line("leaq " + memory(frame->scratchValue(0)) + ", %rsi");
+      });
+      line("testl %eax, %eax");
+      line("je " + strings);
+      line("movl " + memory(frame->scratchValue(0)) + ", %eax");
+      line("jmp " + compare);
+   }
+   *out << strings << ":\n";
+   if (keys.empty()) return;
+   std::string otherwise = label();
+   loadTag(subject, RAX);
+   line("cmpl $" + std::to_string(T_STRING) + ", %eax");
+   line("jne " + otherwise);
+   stage(subject, frame->scratchValue(1));
+   for (const auto &[key, target]: keys) {
+      std::string chars = literal(key);
+      callRuntime("rtx_string_is", position, [&] {
+          line("leaq " + memory(frame->scratchValue(1)) + ", %rdi");
+          line("leaq " + chars + "(%rip), %rsi");
+          line("movq $" + std::to_string(key.size()) + ", %rdx");
+      });
+      line("testl %eax, %eax");
+      line("jne " + edgeTarget(block, block->successors[target]));
+   }
+   *out << otherwise << ":\n";
+}
+
+std::string X86Emitter::emitRuntime(const IrModule &irModule, bool library) {
+   module = &irModule;
+   collect();
+   std::ostringstream text;
+   text << "#define RT_STATE __attribute__((visibility(\"hidden\")))\n";
+   text << cRuntime();
+   int globals = 0;
+   for (const auto &irFunction: irModule.functions) {
+      for (const auto &block: irFunction->blocks) {
+         for (const IrInstr *instr: block->instructions) {
+            if (instr->op == IrOp::LoadGlobal || instr->op == IrOp::StoreGlobal) {
+               globals = std::max(globals, instr->index + 1);
+            }
+         }
+      }
+   }
+   text << "/* The program: state the assembly reads, its functions and the helpers it calls. */\n";
+   text << "#define RTX __attribute__((visibility(\"hidden\")))\n\n";
+   text << "RT_STATE Value rt_globals[" << std::max(globals, 1) << "];\n";
+   text << "RT_STATE Value K[" << std::max(static_cast<int>(strings.size()), 1) << "];\n";
+   text << "RT_STATE const long rtx_max_depth = RT_MAX_DEPTH;\n";
+   text << "static RtBinding rt_bindings[" << std::max(static_cast<int>(bindings.size()), 1) << "];\n";
+   text << "typedef char rtx_handler_fits[sizeof(RtHandler) <= " << HANDLER_SIZE << " ? 1 : -1];\n\n";
+
+   for (const auto &irFunction: irModule.functions) {
+      std::string name = functionName(functionIds.at(irFunction.get()));
+      text << "RTX Value " << name << "(";
+      for (int i = 0; i < irFunction->arity; ++i) text << (i > 0 ? ", " : "") << "Value";
+      text << (irFunction->arity == 0 ? "void" : "") << ");\n";
+      if (irFunction.get() == &irModule.main()) continue;
+      text << "static Value " << name << "_entry(const Value *a) {\n";
+      if (irFunction->arity == 0) text << "   (void) a;\n";
+      text << "   return " << name << "(";
+      for (int i = 0; i < irFunction->arity; ++i) text << (i > 0 ? ", " : "") << "a[" << i << "]";
+      text << ");\n}\n";
+   }
+   text << "\nstatic const RtBinding rtx_functions[] = {";
+   for (const auto &irFunction: irModule.functions) {
+      if (irFunction.get() == &irModule.main()) text << "\n   {NULL, 0},";
+      else text << "\n   {" << functionName(functionIds.at(irFunction.get())) << "_entry, " << irFunction->arity << "},";
+   }
+   text << "\n};\n\nstatic Value (*const rtx_hosts[])(const Value *, int) = {";
+   for (const CHostFunction &host: cHostFunctions()) text << "rt_host_" << host.name << ", ";
+   text << "};\nstatic const int rtx_host_arities[] = {";
+   for (const CHostFunction &host: cHostFunctions()) text << host.arity << ", ";
+   text << "};\n";
+
+   text << R"(
+RTX void rtx_binary(int op, Value *out, const Value *a, const Value *b) { *out = rt_binary(op, *a, *b); }
+
+RTX void rtx_equals(Value *out, const Value *a, const Value *b, int negate) {
+   *out = rt_bool(rt_equals(*a, *b) != negate);
+}
+
+RTX void rtx_unary(int op, Value *out, const Value *v) {
+   switch (op) {
+      case 0:
+         *out = rt_plus(*v);
+         break;
+      case 1:
+         *out = rt_negate(*v);
+         break;
+      case 2:
+         *out = rt_not(*v);
+         break;
+      default:
+         *out = rt_bitnot(*v);
+   }
+}
+
+RTX int rtx_truthy(const Value *v) { return rt_truthy(*v); }
+
+RTX void rtx_matmul(Value *out, const Value *a, const Value *b) { *out = rt_matmul(*a, *b); }
+
+RTX void rtx_matchain(Value *out, const Value *operands, int count) { *out = rt_matchain(operands, count); }
+
+RTX void rtx_call(Value *out, int slot, const char *name, int host, const Value *args, int count) {
+   if (slot >= 0 && rt_bindings[slot].entry) {
+      *out = rt_invoke(&rt_bindings[slot], name, args, count);
+   } else if (host < 0) {
+      rt_undefined(name);
+   } else if (rtx_host_arities[host] >= 0 && rtx_host_arities[host] != count) {
+      rt_arity_error(name, rtx_host_arities[host], count);
+   } else {
+      *out = rtx_hosts[host](args, count);
+   }
+}
+
+RTX void rtx_define(int slot, int function) { rt_bindings[slot] = rtx_functions[function]; }
+
+RTX RT_NORETURN void rtx_error(const char *message) { rt_error("%s", message); }
+
+RTX RT_NORETURN void rtx_stack_overflow(const char *name) { rt_error("Stack overflow in '%s'", name); }
+
+RTX void rtx_push(RtHandler *h) { rt_push(h); }
+
+RTX void rtx_pop(RtHandler *h) { rt_handlers = h->prev; }
+
+RTX int rtx_caught(Value *out) {
+   *out = rt_caught;
+   return rt_caught_error;
+}
+
+RTX void rtx_set_caught(const Value *v, int error) {
+   rt_caught = *v;
+   rt_caught_error = error;
+}
+
+RTX RT_NORETURN void rtx_raise(const Value *v, int error) { rt_raise(*v, error); }
+
+RTX int rtx_switch_key(const Value *v, int32_t *key) { return rt_switch_key(*v, key); }
+
+RTX int rtx_string_is(const Value *v, const char *chars, size_t len) { return rt_string_is(*v, chars, len); }
+
+)";
+   std::vector<std::pair<int, std::string>> constants;
+   for (const auto &[chars, index]: strings) constants.emplace_back(index, chars);
+   std::sort(constants.begin(), constants.end());
+   text << "static void rt_init(void) {\n";
+   text << "   rt_handlers = NULL;\n   rt_depth = 0;\n";
+   text << "   memset(rt_globals, 0, sizeof rt_globals);\n";
+   text << "   memset(rt_bindings, 0, sizeof rt_bindings);\n";
+   text << "   rt_gc_roots(rt_globals, sizeof rt_globals / sizeof(Value), K, sizeof K / sizeof(Value));\n";
+   for (const auto &[index, chars]: constants) {
+      text << "   K[" << index << "] = rt_string(rt_new_str(" << cQuote(chars) << ", " << chars.size() << "));\n";
+   }
+   text << "}\n\n";
+   text << cRuntimeEntry(library);
+   module = nullptr;
+   return text.str();
+}
+
+void buildX86Native(IrModule &module, const std::string &output, const NativeBuildOptions &options) {
+   std::string assembly = output + ".s";
+   std::string runtime = output + ".rt.c";
+   X86Emitter emitter;
+   {
+      std::ofstream file(assembly);
+      if (!file) throw CompilerError("Cannot write " + assembly);
+      file << emitter.emitAssembly(module);
+   }
+   {
+      std::ofstream file(runtime);
+      if (!file) throw CompilerError("Cannot write " + runtime);
+      file << emitter.emitRuntime(module, options.library);
+   }
+   runCCompiler({assembly, runtime}, output, options);
+}
@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <dlfcn.h>
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "c_emitter.h"
+#include "host_registry.h"
+#include "test_helpers.h"
+
+// The optimized IR of source, lowered as the VM would.
+static std::unique_ptr<IrModule> optimize(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+   Parser parser(tokens);
+   HostRegistry hosts;
+   hosts.defineBuiltins(std::cout);
+   hosts.declareIn(parser.scopeManager);
+   std::unique_ptr<Expr> program = parser.parse();
+   ConstantFolder().fold(*program);
+   DeadCodeEliminator().eliminate(*program);
+   Resolver().resolve(*program);
+   return Optimizer(OptimizerOptions::native()).optimize(*program);
+}
+
+static bool haveCompiler() {
+   static const bool found = std::system("cc --version > /dev/null 2>&1") == 0;
+   return found;
+}
+
+static std::string runNative(const std::string &source, const std::string &name, const std::string &limits = "") {
+   std::string path = testing::TempDir() + "c_emitter_" + name;
+   buildNative(*optimize(source), path);
+   return runExecutable(path, limits);
+}
+
+TEST(CEmitterTests, EmitsOneSelfContainedUnit) {
+   const char *source = R"(
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+function f() { return 1; }
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+print(fib(10), f(), redefine(), f());
+)";
+   std::string program = CEmitter().emit(*optimize(source));
+   EXPECT_NE(program.find("int run_script(void)"), std::string::npos);
+   EXPECT_NE(program.find("int main(void)"), std::string::npos);
+   // fib is bound once and calls itself directly; f is rebound, so its
+   // calls go through the binding table.
+   EXPECT_NE(program.find("= fn_1(v"), std::string::npos) << program;
+   EXPECT_NE(program.find("rt_invoke(&rt_bindings["), std::string::npos) << program;
+   EXPECT_NE(program.find("rt_host_print(a, 4)"), std::string::npos);
+
+   std::string library = CEmitter().emit(*optimize(source), true);
+   EXPECT_EQ(library.find("int main(void)"), std::string::npos);
+}
+
+TEST(CEmitterTests, OptimizesForNativeCosts) {
+   // A multiply costs more than the add replacing it in native code.
+   std::string text = CEmitter().emit(*optimize(R"(
+function kernel(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = total + i * 12 + 7; }
+    return total;
+}
+print(kernel(300000));
+)"));
+   std::string program = text.substr(text.find("/* The program. */"));
+   EXPECT_EQ(program.find("rt_mul("), std::string::npos) << program;
+}
+
+TEST(CEmitterTests, CompiledProgramsBehaveLikeTheVm) {
+   if (!haveCompiler()) GTEST_SKIP() << "no C compiler";
+   const char *programs[] = {
+           R"(
+print(2147483647 + 1, -7 / 2, 7.0 / 2, 0.1 + 0.2, 1 / 3.0, 1000000000.0 * 1000000000.0, ~5, !0, +3, -(-2147483647 - 1));
+print("a" + 1.5, "x" + null + true, str(12) + str(0.5), len("hello"), "abc" < "abd", "b" >= "abc");
+print(1 == 1.0, null == null, "x" == "x", "x" != "y", 0.0 == -0.0, 1 == "1", !"", !"a");
+var zero = 0.0;
+print(-zero, 1 / zero, -1 / zero);
+var runtimeZero = clock() * 0.0;
+var grid = matrix(1, 2);
+put(grid, 0, 1, runtimeZero / runtimeZero);
+print(runtimeZero / runtimeZero, -(runtimeZero / runtimeZero), grid);
+)",
+           R"(
+var count = 0;
+function bump(n) { count = count + n; return count; }
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+function f() { return 1; }
+function get() { return f(); }
+print(get(), fib(20), bump(2), bump(3), count);
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+redefine();
+print(get());
+function one(a) { return a; }
+try { one(); } catch (e) { print(e); }
+)",
+           R"(
+function name(x) {
+    switch (x) {
+        case 1: return "one";
+        case 2: return "two";
+        case 3: return "three";
+        case -4: return "minus four";
+        case "s": return "ess";
+        case "t": return "tee";
+        case "u": return "you";
+        default: return "other";
+    }
+}
+var names = "";
+for (var i = -5; i < 5; i = i + 1) { names = names + name(i) + ","; }
+print(names, name(2.0), name(2.5), name("t"), name(null));
+var total = 0;
+var k = 0;
+while (k < 100) { if (k > 50) { total = total + k * 2; } else { total = total - k; } k = k + 1; }
+print(total);
+)",
+           R"(
+function risky(x) {
+    if (x > 2) { throw("big " + str(x)); }
+    return x / (x - 1);
+}
+var log = "";
+for (var i = 0; i < 5; i = i + 1) {
+    try {
+        log = log + str(risky(i)) + ";";
+    } catch (e) {
+        log = log + "caught " + e + ";";
+    } finally {
+        log = log + "f" + str(i) + ";";
+    }
+}
+print(log);
+function cleanup() {
+    try { throw(42); } finally { print("cleanup"); }
+}
+try { cleanup(); } catch (e) { print("outer", e + 1); }
+try { try { print(1 + null); } catch (e) { throw("again: " + e); } } catch (e) { print(e); }
+cleanup();
+)",
+           R"(
+var a = matrix(2, 3);
+var b = matrix(3, 2);
+var c = matrix(2, 2);
+for (var i = 0; i < 2; i = i + 1) {
+    for (var j = 0; j < 3; j = j + 1) { put(a, i, j, i + j); put(b, j, i, i * j + 1); }
+    put(c, i, i, 2);
+}
+print(a @ b, a @ b @ c, c @ a @ b @ c, rows(a), cols(a), at(b, 2, 1));
+var d = c;
+put(d, 0, 1, 5);
+print(c, c * 2 + 1, 1 - c, -c, +c == c, c == d, c + c * c);
+try { print(a + b); } catch (e) { print(e); }
+try { print(a @ a); } catch (e) { print(e); }
+try { print(at(a, 5, 0)); } catch (e) { print(e); }
+try { print(matrix(-1, 2)); } catch (e) { print(e); }
+print(rows(3));
+)",
+           R"(
+function down(n) { return down(n + 1) + 1; }
+try { down(0); } catch (e) { print(e); }
+function divide(a) { return 10 / a; }
+print(divide(4), divide(4.0));
+divide(0);
+)",
+   };
+   int index = 0;
+   for (const char *program: programs) {
+      EXPECT_EQ(runNative(program, "program" + std::to_string(index++)), runVm(program)) << program;
+   }
+}
+
+TEST(CEmitterTests, ReclaimsUnreachableValues) {
+   if (!haveCompiler()) GTEST_SKIP() << "no C compiler";
+   // Every iteration drops a 320 KB matrix; kept, they would overrun the
+   // address space limit. grow keeps one live on each of its frames.
+   const char *source = R"(
+function grow(m, depth) {
+    if (depth == 0) { return m; }
+    var k = m + depth;
+    var r = grow(m, depth - 1);
+    return r + at(k, 0, 0);
+}
+var m = matrix(200, 200);
+var s = "";
+var total = 0;
+for (var i = 0; i < 2000; i = i + 1) {
+    var n = m + i;
+    try { if (i == 1999) { throw("last " + str(at(n, 3, 3))); } } catch (e) { s = e; }
+    total = total + at(n, 1, 1);
+}
+var g = grow(matrix(200, 200), 100);
+print(total, s, at(g, 0, 0), at(m, 0, 0));
+)";
+   EXPECT_EQ(runVm(source), "1999000 last 1999 5050 0\n");
+   EXPECT_EQ(runNative(source, "reclaims", "ulimit -v 262144; "), runVm(source));
+}
+
+TEST(CEmitterTests, BuildsSharedLibraries) {
+   if (!haveCompiler()) GTEST_SKIP() << "no C compiler";
+   NativeBuildOptions options;
+   options.library = true;
+   auto run = [&](const char *source, const std::string &name) {
+       std::string path = testing::TempDir() + "c_emitter_" + name + ".so";
+       buildNative(*optimize(source), path, options);
+       void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+       if (!library) throw std::runtime_error(dlerror());
+       auto entry = reinterpret_cast<int (*)()>(dlsym(library, "run_script"));
+       if (!entry) throw std::runtime_error("no run_script in " + path);
+       int status = entry();
+       int again = entry();
+       dlclose(library);
+       EXPECT_EQ(status, again) << "a second run starts afresh";
+       return status;
+   };
+   EXPECT_EQ(run("var x = 0; for (var i = 0; i < 10; i = i + 1) { x = x + i; } if (x != 45) { throw(x); }", "ok"), 0);
+   EXPECT_EQ(run("function f() { return 1; } var n = f(); if (n != 1) { throw(n); }", "bound"), 0);
+   EXPECT_EQ(run("function fail(x) { throw(x); } fail(\"expected failure\");", "fails"), 1);
+}
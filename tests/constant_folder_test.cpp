@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "constant_folder.h"
+#include "test_helpers.h"
+
+// Folds source after a prelude declaring g() and p(v) and returns the folded
+// statements of source.
+static std::string folded(const std::string &source) {
+   auto program = parseProgram("function g() { return 1; } function p(v) { return v; } " + source);
+   ConstantFolder().fold(*program);
+   std::string result;
+   auto &statements = static_cast<BlockStatementExpr *>(program.get())->statements;
+   for (size_t i = 2; i < statements.size(); ++i) {
+      result += (i > 2 ? "; " : "") + statements[i]->toString();
+   }
+   return result;
+}
+
+TEST(ConstantFolderTests, FoldsLiteralOperators) {
+   EXPECT_EQ(folded("var a = 3 * (2 + 1);"), "VarDeclaration(a, Literal(9))");
+   EXPECT_EQ(folded("var b = !true;"), "VarDeclaration(b, Literal(false))");
+   EXPECT_EQ(folded("var c = 2147483647 + 1;"), "VarDeclaration(c, Literal(-2147483648))");
+   EXPECT_EQ(folded("var d = 7 / 2 + 1.5;"), "VarDeclaration(d, Literal(4.500000))");
+   EXPECT_EQ(folded("var e = \"n\" + 4 + (1 < 2);"), "VarDeclaration(e, Literal(\"n4true\"))");
+   EXPECT_EQ(folded("var f = false && g(); var h = 0 || 2;"),
+             "VarDeclaration(f, Literal(false)); VarDeclaration(h, Literal(true))");
+
+   // Left for the runtime: the error, and a sum a float literal cannot hold.
+   EXPECT_EQ(folded("var x = 1 / 0;"), "VarDeclaration(x, Binary(/, Literal(1), Literal(0)))");
+   EXPECT_EQ(folded("var y = 0.1 + 0.2;"), "VarDeclaration(y, Binary(+, Literal(0.100000), Literal(0.200000)))");
+}
+
+TEST(ConstantFolderTests, PropagatesUnassignedVariables) {
+   EXPECT_EQ(folded("var n = 4; var m = n * 2; p(m + n);"),
+             "VarDeclaration(n, Literal(4)); VarDeclaration(m, Literal(8)); "
+             "ExprStmt: FunctionCall(p, args: [Literal(12)])");
+   EXPECT_EQ(folded("var n = 4; n = 5; p(n * 2);"),
+             "VarDeclaration(n, Literal(4)); ExprStmt: Assign: n = Literal(5); "
+             "ExprStmt: FunctionCall(p, args: [Binary(*, Identifier(n), Literal(2))])");
+   EXPECT_EQ(folded("var k = 1; { var k = g(); p(k); } p(k);"),
+             "VarDeclaration(k, Literal(1)); Block(VarDeclaration(k, FunctionCall(g, args: [])), "
+             "ExprStmt: FunctionCall(p, args: [Identifier(k)])); ExprStmt: FunctionCall(p, args: [Literal(1)])");
+   EXPECT_EQ(folded("var k = 1; function f(k) { var j = 2; return k + j; } function h() { return k; }"),
+             "VarDeclaration(k, Literal(1)); FunctionDeclaration(f, params: [k], "
+             "body: Block(VarDeclaration(j, Literal(2)), Return(Binary(+, Identifier(k), Literal(2))))); "
+             "FunctionDeclaration(h, params: [], body: Block(Return(Literal(1))))");
+}
+
+TEST(ConstantFolderTests, SimplifiesSignChains) {
+   EXPECT_EQ(folded("var x = g(); var a = -(-x);"),
+             "VarDeclaration(x, FunctionCall(g, args: [])); VarDeclaration(a, Unary: + Identifier(x))");
+   EXPECT_EQ(folded("var x = g(); var b = +(-(+x));").substr(46), "VarDeclaration(b, Unary: - Identifier(x))");
+   EXPECT_EQ(folded("var x = g(); var c = !!!x;").substr(46), "VarDeclaration(c, Unary: ! Identifier(x))");
+   EXPECT_EQ(folded("var x = g(); var d = !!x;").substr(46), "VarDeclaration(d, Unary: ! Unary: ! Identifier(x))");
+}
+
+TEST(ConstantFolderTests, FoldedProgramsBehaveTheSame) {
+   const char *source = R"(
+var limit = 2 * 5;
+var label = "total: ";
+var total = 0;
+for (var i = 0; i < limit; i = i + 1) { total = total + i * (3 - 2); }
+print(label + total, -(-total), 10 / 4, 10.0 / 4);
+try { print(1 / 0); } catch (e) { print(e); }
+)";
+   EXPECT_EQ(runVm(source), "total: 45 45 2 2.5\nDivision by zero\n");
+   EXPECT_EQ(runInterpreter(source), runVm(source));
+
+   VM vm;
+   EXPECT_THROW(vm.run("var s = -(-\"text\");"), RuntimeError);
+}
@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+
+#include "resolver.h"
+#include "ir_builder.h"
+#include "dataflow.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> lower(const std::string &source) {
+   std::unique_ptr<Expr> program = parseProgram(source);
+   Resolver().resolve(*program);
+   std::unique_ptr<IrModule> module = IrBuilder().build(*program);
+   verifyIr(*module);
+   return module;
+}
+
+static std::vector<size_t> members(const BitVector &set) {
+   std::vector<size_t> result;
+   set.forEach([&](size_t i) { result.push_back(i); });
+   return result;
+}
+
+static std::vector<const IrInstr *> instructions(const IrFunction &function, IrOp op) {
+   std::vector<const IrInstr *> result;
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         if (instr->op == op) result.push_back(instr);
+      }
+   }
+   return result;
+}
+
+TEST(DataflowTests, BitVectorWorksAWordAtATime) {
+   BitVector a(130);
+   BitVector b(130);
+   a.set(0);
+   a.set(64);
+   a.set(129);
+   b.set(64);
+   b.set(100);
+   EXPECT_TRUE(a.test(129));
+   EXPECT_FALSE(a.test(128));
+
+   BitVector both = a;
+   EXPECT_TRUE(both.intersectWith(b));
+   EXPECT_EQ(members(both), (std::vector<size_t>{64}));
+   EXPECT_FALSE(both.intersectWith(b));
+
+   BitVector either = a;
+   EXPECT_TRUE(either.unionWith(b));
+   EXPECT_FALSE(either.unionWith(b));
+   EXPECT_EQ(members(either), (std::vector<size_t>{0, 64, 100, 129}));
+
+   either.subtract(a);
+   EXPECT_EQ(members(either), (std::vector<size_t>{100}));
+   either.reset(100);
+   EXPECT_FALSE(either.any());
+
+   BitVector full(130, true);
+   EXPECT_EQ(full.count(), 130u);
+   either.setAll();
+   EXPECT_EQ(either, full);
+}
+
+TEST(DataflowTests, ComputesLivenessAroundLoops) {
+   auto module = lower(R"(
+function count(n) {
+    var i = 0;
+    var total = 0;
+    var unchanged = 7;
+    while (i < n) {
+        total = total + i + unchanged;
+        i = i + 1;
+    }
+    return total;
+})");
+   // b0 defines n (%0), the initial i and total (%1, %2) and unchanged (%3),
+   // and tests the condition once; b1 is the preheader. The body b2 holds
+   // the phis %5 (total) and %6 (i) and computes %8 and %10, which the latch
+   // b3 tests and feeds back. The exit b4 merges total into %12.
+   IrFunction &count = function(*module, "count");
+   Liveness liveness(count);
+   auto block = [&](int id) { return count.blocks[id].get(); };
+
+   EXPECT_EQ(members(liveness.liveOut(block(0))), (std::vector<size_t>{0, 1, 2, 3}));
+   EXPECT_EQ(members(liveness.liveIn(block(2))), (std::vector<size_t>{0, 3}));
+   EXPECT_EQ(members(liveness.liveOut(block(2))), (std::vector<size_t>{0, 3, 8, 10}));
+   EXPECT_EQ(members(liveness.liveIn(block(3))), (std::vector<size_t>{0, 3, 8, 10}));
+   EXPECT_EQ(members(liveness.liveOut(block(3))), (std::vector<size_t>{0, 3, 8, 10}));
+   EXPECT_FALSE(liveness.liveIn(block(4)).any());
+   EXPECT_FALSE(liveness.liveOut(block(4)).any());
+}
+
+TEST(DataflowTests, KeepsValuesLiveIntoHandlers) {
+   auto module = lower(R"(
+function guarded(x) {
+    var before = x + 1;
+    try {
+        x = x / 0;
+    } catch (e) {
+        return before;
+    }
+    return x;
+})");
+   IrFunction &guarded = function(*module, "guarded");
+   Liveness liveness(guarded);
+   const IrInstr *before = instructions(guarded, IrOp::Binary).front();
+   const IrInstr *division = instructions(guarded, IrOp::Binary).back();
+   ASSERT_NE(division->block->handler, nullptr);
+   EXPECT_TRUE(liveness.isLiveOut(before, division->block));
+   EXPECT_TRUE(liveness.liveIn(division->block->handler).test(static_cast<size_t>(before->id)));
+}
+
+TEST(DataflowTests, FindsReachingStoresOfGlobals) {
+   auto module = lower(R"(
+function f(n) { return n; }
+var a = 1;
+var c = f(0);
+if (c) { a = 2; }
+var b = a;
+a = 3;
+var d = a;
+)");
+   IrFunction &script = module->main();
+   ReachingDefinitions reaching(script);
+   std::vector<const IrInstr *> stores;
+   for (const IrInstr *store: instructions(script, IrOp::StoreGlobal)) {
+      if (store->name == "a") stores.push_back(store);
+   }
+   ASSERT_EQ(stores.size(), 3u);
+   std::vector<const IrInstr *> loads = instructions(script, IrOp::LoadGlobal);
+   auto loadOf = [&](const std::string &name, int nth) {
+       for (const IrInstr *load: loads) {
+          if (load->name == name && nth-- == 0) return load;
+       }
+       return static_cast<const IrInstr *>(nullptr);
+   };
+
+   bool external = false;
+   EXPECT_EQ(reaching.reachingStores(loadOf("a", 0), &external),
+             (std::vector<const IrInstr *>{stores[0], stores[1]}));
+   // f(0) ran after the first store and may have written a.
+   EXPECT_TRUE(external);
+
+   EXPECT_EQ(reaching.reachingStores(loadOf("a", 1), &external), (std::vector<const IrInstr *>{stores[2]}));
+   EXPECT_FALSE(external);
+}
+
+TEST(DataflowTests, WarnsAboutReadsBeforeAssignment) {
+   auto module = lower(R"(
+var x;
+var y;
+var k;
+function init() { y = 1; }
+function g(flag) {
+    var z;
+    if (flag) { z = 1; }
+    var assigned;
+    assigned = 2;
+    return z + assigned;
+}
+init();
+if (g(true)) { x = 2; }
+k = 5;
+var w = x + y + k;
+)");
+   std::vector<UninitializedRead> reads = findUninitializedReads(*module);
+   ASSERT_EQ(reads.size(), 2u);
+   EXPECT_EQ(reads[0].name, "x");
+   EXPECT_EQ(reads[0].function, &module->main());
+   EXPECT_EQ(reads[0].use->op, IrOp::LoadGlobal);
+   EXPECT_EQ(reads[1].name, "z");
+   EXPECT_EQ(reads[1].function->name, "g");
+   EXPECT_EQ(reads[1].use->op, IrOp::Binary);
+}
+
+TEST(DataflowTests, FollowsGlobalReadsIntoCalls) {
+   auto module = lower(R"(
+var g;
+var h;
+var set;
+function r() { return g; }
+function viaR() { return r(); }
+function own() { h = 1; return h; }
+function late() { return set; }
+var first = viaR() + own();
+set = 1;
+var second = late();
+g = 1;
+)");
+   std::vector<UninitializedRead> reads = findUninitializedReads(*module);
+   ASSERT_EQ(reads.size(), 1u);
+   EXPECT_EQ(reads[0].name, "g");
+   EXPECT_EQ(reads[0].function, &module->main());
+   EXPECT_EQ(reads[0].use->op, IrOp::Call);
+   EXPECT_EQ(reads[0].use->name, "viaR");
+}
+
+TEST(DataflowTests, AcceptsAssignmentsOnEveryPath) {
+   auto module = lower(R"(
+var total;
+var i = 0;
+if (i) { total = 1; } else { total = 2; }
+while (i < 3) {
+    var step;
+    step = i;
+    total = total + step;
+    i = i + 1;
+}
+)");
+   EXPECT_TRUE(findUninitializedReads(*module).empty());
+}
+
+TEST(DataflowTests, SettlesLargeFunctionsInFewSweeps) {
+   std::string body = "function big(n) { var x = 0; var i = 0; while (i < n) { ";
+   for (int k = 0; k < 2000; ++k) body += "if (n > " + std::to_string(k) + ") { x = x + " + std::to_string(k) + "; } ";
+   body += "i = i + 1; } return x; }";
+   auto module = lower(body);
+   IrFunction &big = function(*module, "big");
+   ASSERT_GT(big.blocks.size(), 4000u);
+
+   DataflowProblem problem;
+   problem.direction = DataflowDirection::Forward;
+   problem.meet = DataflowMeet::Union;
+   problem.size = big.blocks.size();
+   problem.gen.assign(big.blocks.size(), BitVector(problem.size));
+   problem.kill.assign(big.blocks.size(), BitVector(problem.size));
+   problem.boundary = BitVector(problem.size);
+   // Which blocks may have run before each block: the loop feeds the whole
+   // body back to its header, b2 after the guard and preheader, once.
+   for (const auto &block: big.blocks) problem.gen[block->id].set(static_cast<size_t>(block->id));
+   DataflowResult result = solveDataflow(big, problem);
+   EXPECT_LE(result.visits, static_cast<int>(3 * big.blocks.size()));
+   EXPECT_EQ(result.in[2].count(), big.blocks.size() - 1);
+
+   Liveness liveness(big);
+   EXPECT_TRUE(liveness.liveIn(big.blocks[1].get()).test(0));
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "test_helpers.h"
+
+static std::string optimized(const std::string &source, int &removed) {
+   auto program = parseProgram(source);
+   ConstantFolder().fold(*program);
+   removed = DeadCodeEliminator().eliminate(*program);
+   return program->toString();
+}
+
+TEST(DeadCodeTests, RemovesUnreachableStatements) {
+   int removed = 0;
+   EXPECT_EQ(optimized("function f(n) { return n; f(2); var x = 3; } f(1);", removed),
+             "Block(FunctionDeclaration(f, params: [n], body: Block(Return(Identifier(n)))), "
+             "ExprStmt: FunctionCall(f, args: [Literal(1)]))");
+   EXPECT_EQ(removed, 5);
+
+   EXPECT_EQ(optimized("function f(n) { while (n) { if (n) { break; } else { continue; } n = 0; } } f(1);",
+                       removed),
+             "Block(FunctionDeclaration(f, params: [n], body: Block(While(Identifier(n), body: "
+             "Block(If(Identifier(n), then: Block(Break), else: Block(Continue)))))), "
+             "ExprStmt: FunctionCall(f, args: [Literal(1)]))");
+   EXPECT_EQ(removed, 3);
+}
+
+TEST(DeadCodeTests, RemovesFlaggedBranchesAndLoops) {
+   int removed = 0;
+   EXPECT_EQ(optimized(R"(
+var DEBUG = false;
+var LEVEL = 2;
+if (DEBUG) { LEVEL; } else { 1; }
+if (LEVEL > 1) { var x = 1; } else { var y = 2; }
+while (DEBUG) { 3; }
+for (var i = 0; DEBUG && i < 2; i = i + 1) { 4; }
+)", removed),
+             "Block(VarDeclaration(DEBUG, Literal(false)), VarDeclaration(LEVEL, Literal(2)), Block(), "
+             "Block(VarDeclaration(x, Literal(1))), Block(VarDeclaration(i, Literal(0))))");
+   EXPECT_EQ(removed, 27);
+}
+
+TEST(DeadCodeTests, RemovesUncalledFunctions) {
+   int removed = 0;
+   EXPECT_EQ(optimized(R"(
+function leaf() { return 1; }
+function used() { function inner() { return 2; } return leaf(); }
+function recursive(n) { return recursive(n); }
+function unused() { return used(); }
+used();
+)", removed),
+             "Block(FunctionDeclaration(leaf, params: [], body: Block(Return(Literal(1)))), "
+             "FunctionDeclaration(used, params: [], body: Block(Return(FunctionCall(leaf, args: [])))), "
+             "ExprStmt: FunctionCall(used, args: []))");
+   EXPECT_EQ(removed, 13);
+
+   EXPECT_EQ(optimized("function f() { return 1; } if (false) { f(); }", removed), "Block()");
+   EXPECT_EQ(removed, 9);
+}
+
+TEST(DeadCodeTests, OptimizedProgramsBehaveTheSame) {
+   const char *source = R"(
+var TRACE = false;
+function log(m) { print("log", m); }
+function step(n) {
+    if (TRACE) { log(n); }
+    if (n > 2) { return n * 10; print("never"); }
+    return n;
+}
+var total = 0;
+for (var i = 0; i < 5; i = i + 1) {
+    total = total + step(i);
+    if (i == 3) { break; total = -1; }
+}
+print(total);
+)";
+   EXPECT_EQ(runVm(source), "33\n");
+   EXPECT_EQ(runInterpreter(source), runVm(source));
+   VM vm;
+   vm.run(source);
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_EQ(listing.find("function log"), std::string::npos) << listing;
+   EXPECT_EQ(listing.find("never"), std::string::npos) << listing;
+}
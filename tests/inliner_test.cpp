@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "ir_builder.h"
+#include "ir_simplifier.h"
+#include "inliner.h"
+#include "host_registry.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> lower(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+   Parser parser(tokens);
+   HostRegistry hosts;
+   hosts.defineBuiltins(std::cout);
+   hosts.declareIn(parser.scopeManager);
+   std::unique_ptr<Expr> program = parser.parse();
+   Resolver().resolve(*program);
+   std::unique_ptr<IrModule> module = IrBuilder().build(*program);
+   IrSimplifier().simplify(*module);
+   return module;
+}
+
+static InlineStats inlineCalls(IrModule &module, InlinerOptions options = {}) {
+   InlineStats stats = Inliner(options).inlineCalls(module);
+   verifyIr(module);
+   return stats;
+}
+
+static int calls(const IrFunction &function, const std::string &callee) {
+   int result = 0;
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) result += instr->op == IrOp::Call && instr->name == callee;
+   }
+   return result;
+}
+
+// A callee too big to inline everywhere but small enough to inline where it
+// runs often.
+static const char *const MEDIUM = R"(
+function medium(x) {
+    var y = x * 3 + 1;
+    if (y > 10) { y = y - 10; }
+    return y * y + x;
+}
+)";
+
+TEST(InlinerTests, BuildsTheCallGraph) {
+   auto module = lower(R"(
+function leaf(x) { return x + 1; }
+function middle(x) { return leaf(x) * 2; }
+function top(x) { return middle(x) + leaf(x); }
+function fact(n) { if (n < 2) { return 1; } return n * fact(n - 1); }
+function outer() {
+    function inner() { return 1; }
+    return inner();
+}
+print(top(1), fact(5), outer(), leaf(1, 2));
+)");
+   CallGraph graph(*module);
+   std::vector<std::string> order;
+   for (const IrFunction *f: graph.bottomUp()) order.push_back(f->name);
+   auto position = [&](const std::string &name) { return std::find(order.begin(), order.end(), name) - order.begin(); };
+   EXPECT_LT(position("leaf"), position("middle"));
+   EXPECT_LT(position("middle"), position("top"));
+   EXPECT_EQ(order.back(), "<script>");
+
+   EXPECT_TRUE(graph.isRecursive(&function(*module, "fact")));
+   EXPECT_FALSE(graph.isRecursive(&function(*module, "top")));
+
+   EXPECT_EQ(graph.sites(&function(*module, "top")).size(), 2u);
+   // inner is bound only once outer runs, and leaf(1, 2) has the wrong arity.
+   EXPECT_TRUE(graph.sites(&function(*module, "outer")).empty());
+   std::vector<std::string> bound;
+   for (const IrInstr *call: graph.sites(&module->main())) bound.push_back(call->name);
+   EXPECT_EQ(bound, (std::vector<std::string>{"top", "fact", "outer"}));
+}
+
+TEST(InlinerTests, BindsCallsDefinedBeforeEveryEntry) {
+   auto module = lower(R"(
+function leaf() { return 1; }
+function viaLeaf() { return leaf(); }
+var flag = clock() > 0;
+if (flag) { print(viaLeaf()); } else { print(viaLeaf() + 1); }
+while (flag) { flag = viaLeaf() < 0; }
+function unused() { return leaf(); }
+)");
+   CallGraph graph(*module);
+   // Entered from both branches and the loop, all after leaf is defined.
+   EXPECT_EQ(graph.sites(&function(*module, "viaLeaf")).size(), 1u);
+   // Never entered, so nothing is known to have run before it.
+   EXPECT_TRUE(graph.sites(&function(*module, "unused")).empty());
+}
+
+TEST(InlinerTests, InlinesTinyFunctionsAndFoldsTheirConstants) {
+   auto module = lower(R"(
+function square(x) { return x * x; }
+function sign(x) { if (x < 0) { return -1; } return 1; }
+function norm(x, y) { return square(x) + square(y); }
+print(norm(3, 4), sign(-2), norm(1, 1));
+)");
+   InlineStats stats = inlineCalls(*module);
+   EXPECT_EQ(stats.inlined, 5);
+   IrFunction &script = module->main();
+   EXPECT_EQ(calls(script, "norm"), 0);
+   EXPECT_EQ(calls(script, "sign"), 0);
+   EXPECT_EQ(calls(function(*module, "norm"), "square"), 0);
+   std::string dump = dumpIr(script);
+   EXPECT_NE(dump.find("const 25"), std::string::npos) << dump;
+   EXPECT_NE(dump.find("const -1"), std::string::npos) << dump;
+   EXPECT_NE(dump.find("const 2"), std::string::npos) << dump;
+}
+
+TEST(InlinerTests, WeighsSizeAgainstFrequency) {
+   std::string source = std::string(MEDIUM) + R"(
+var once = medium(1);
+var total = 0;
+for (var i = 0; i < 100; i = i + 1) { total = total + medium(i); }
+)";
+   auto module = lower(source);
+   EXPECT_EQ(inlineCalls(*module).inlined, 1);
+   // The call outside the loop stays.
+   EXPECT_EQ(calls(module->main(), "medium"), 1);
+
+   InlinerOptions small;
+   small.maxSize = 10;
+   auto capped = lower(source);
+   EXPECT_EQ(inlineCalls(*capped, small).inlined, 0);
+
+   auto fib = lower("function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } print(fib(10));");
+   EXPECT_EQ(inlineCalls(*fib).inlined, 0);
+}
+
+TEST(InlinerTests, FollowsProfilesWhenGiven) {
+   std::string source = std::string(MEDIUM) + R"(
+function run(n) { return medium(n); }
+print(run(3));
+)";
+   auto module = lower(source);
+   // Statically medium runs once per run of run and is not worth it...
+   InlinerOptions options;
+   options.alwaysSize = 2;
+   inlineCalls(*module, options);
+   EXPECT_EQ(calls(function(*module, "run"), "medium"), 1);
+
+   // ...but the profile says it ran far more often.
+   std::unordered_map<std::string, long> profile = {{"<script>", 1}, {"run", 10}, {"medium", 1000}};
+   options.profile = &profile;
+   auto profiled = lower(source);
+   inlineCalls(*profiled, options);
+   EXPECT_EQ(calls(function(*profiled, "run"), "medium"), 0);
+}
+
+TEST(InlinerTests, StaysWithinTheGrowthBudget) {
+   std::string source = MEDIUM;
+   source += "var total = 0;\nfor (var i = 0; i < 100; i = i + 1) {\n";
+   for (int k = 0; k < 20; ++k) source += "    total = total + medium(i + " + std::to_string(k) + ");\n";
+   source += "}\n";
+   auto module = lower(source);
+   InlinerOptions options;
+   options.growth = 1.0;
+   int inlined = inlineCalls(*module, options).inlined;
+   EXPECT_GT(inlined, 0);
+   EXPECT_LT(inlined, 20);
+}
+
+TEST(InlinerTests, InlinedProgramsBehaveTheSame) {
+   expectSameWhenOptimized({
+           R"(
+var count = 0;
+function bump(n) { count = count + n; return count; }
+function pick(x) { if (x > 2) { return "big"; } if (x > 0) { return "small"; } return null; }
+function twice(x) { return bump(x) + bump(x); }
+var total = 0;
+for (var i = 0; i < 5; i = i + 1) { total = total + twice(i); print(pick(i)); }
+print(total, count);
+)",
+           R"(
+function f() { return 1; }
+function get() { return f(); }
+print(get(), get());
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+redefine();
+print(get());
+)",
+           R"(
+function fail(x) { throw("bad " + str(x)); }
+function check(x) { if (x > 3) { fail(x); } return x; }
+print(check(1), check(2));
+check(5);
+)",
+           R"(
+function one(a) { return a; }
+print(one(1));
+one();
+)",
+   });
+}
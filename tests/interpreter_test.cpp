@@ -0,0 +1,105 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "interpreter.h"
+#include "error.h"
+
+static std::string interpret(const std::string &source) {
+   std::ostringstream out;
+   Interpreter interpreter(out);
+   interpreter.run(source);
+   return out.str();
+}
+
+TEST(InterpreterTests, Arithmetic) {
+   EXPECT_EQ(interpret(R"(print(1 + 2 * 3, 7 / 2, 7.0 / 2, -(-4), 2147483647 + 1);)"),
+             "7 3 3.5 4 -2147483648\n");
+   EXPECT_EQ(interpret(R"(print(1 < 2, 2 <= 1, "a" < "b", 1 == 1.0, !true, "x" + 1);)"),
+             "true false true true false x1\n");
+}
+
+TEST(InterpreterTests, VariablesAndLoops) {
+   auto output = interpret(R"(
+var total = 0;
+for (var i = 0; i < 10; i = i + 1) {
+    if (i == 3) { continue; }
+    if (i == 8) { break; }
+    total = total + i;
+}
+var n = 0;
+do { n = n + 1; } while (n < 5);
+var w = 3;
+while (w > 0) { w = w - 1; }
+print(total, n, w);
+)");
+   EXPECT_EQ(output, "25 5 0\n");
+}
+
+TEST(InterpreterTests, RecursiveFunctions) {
+   auto output = interpret(R"(
+function fib(n) {
+    if (n < 2) { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+function greet(name) { return "hello " + name; }
+print(fib(20), greet("world"));
+)");
+   EXPECT_EQ(output, "6765 hello world\n");
+}
+
+TEST(InterpreterTests, Switch) {
+   auto output = interpret(R"(
+function name(n) {
+    var result = "other";
+    switch (n) {
+        case 1: result = "one";
+        case 2: { result = "two"; break; }
+        default: result = "many";
+    }
+    return result;
+}
+print(name(1), name(2), name(9));
+)");
+   EXPECT_EQ(output, "one two many\n");
+}
+
+TEST(InterpreterTests, TryCatchFinally) {
+   auto output = interpret(R"(
+function risky(n) {
+    if (n > 1) { throw("too big"); }
+    return n;
+}
+function guarded(n) {
+    try {
+        return risky(n);
+    } catch (e) {
+        print("caught", e);
+    } finally {
+        print("finally", n);
+    }
+    return -1;
+}
+print(guarded(1));
+print(guarded(5));
+try { var z = 1 / 0; } catch (e) { print(e); }
+)");
+   EXPECT_EQ(output, "finally 1\n1\ncaught too big\nfinally 5\n-1\nDivision by zero\n");
+}
+
+TEST(InterpreterTests, RuntimeErrors) {
+   EXPECT_THROW(interpret(R"(var s = "a" - 1;)"), RuntimeError);
+   EXPECT_THROW(interpret(R"(function f(a) { return a; } f(1, 2);)"), RuntimeError);
+   EXPECT_THROW(interpret(R"(function down(n) { return down(n + 1); } down(0);)"), RuntimeError);
+}
+
+TEST(InterpreterTests, HostFunctions) {
+   std::ostringstream out;
+   Interpreter interpreter(out);
+   interpreter.host().define("twice", 1, [](const Value *args, int) {
+       return Value::integer(args[0].asInt() * 2);
+   });
+   interpreter.defineGlobal("base", Value::integer(20));
+   interpreter.run(R"(print(twice(base) + len("abc"));)");
+   EXPECT_EQ(out.str(), "43\n");
+}
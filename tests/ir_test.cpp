@@ -0,0 +1,317 @@
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "resolver.h"
+#include "ir_builder.h"
+#include "dominators.h"
+#include "error.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> lower(const std::string &source) {
+   std::unique_ptr<Expr> program = parseProgram(source);
+   Resolver().resolve(*program);
+   std::unique_ptr<IrModule> module = IrBuilder().build(*program);
+   verifyIr(*module);
+   return module;
+}
+
+TEST(IrTests, LowersBranchesAndCalls) {
+   auto module = lower("function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }");
+   EXPECT_EQ(dumpIr(function(*module, "fib")),
+             "function fib (arity 1)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  %1 = const 2\n"
+             "  %2 = lt %0, %1\n"
+             "  branch %2, b1, b2\n"
+             "b1 (preds b0):\n"
+             "  return %0\n"
+             "b2 (preds b0):\n"
+             "  %3 = const 1\n"
+             "  %4 = sub %0, %3\n"
+             "  %5 = call fib(%4)\n"
+             "  %6 = const 2\n"
+             "  %7 = sub %0, %6\n"
+             "  %8 = call fib(%7)\n"
+             "  %9 = add %5, %8\n"
+             "  return %9\n");
+   EXPECT_EQ(dumpIr(module->main()),
+             "function <script> (arity 0)\n"
+             "b0:\n"
+             "  define fib\n"
+             "  %0 = const null\n"
+             "  return %0\n");
+}
+
+TEST(IrTests, PlacesPhisOnlyWhereDefinitionsMeet) {
+   auto module = lower(R"(
+function count(n) {
+    var i = 0;
+    var total = 0;
+    var unchanged = 7;
+    while (i < n) {
+        total = total + i + unchanged;
+        i = i + 1;
+    }
+    return total;
+})");
+   EXPECT_EQ(dumpIr(function(*module, "count")),
+             "function count (arity 1)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  %1 = const 0\n"
+             "  %2 = const 0\n"
+             "  %3 = const 7\n"
+             "  %4 = lt %1, %0\n"
+             "  branch %4, b1, b4\n"
+             "b1 (preds b0):\n"
+             "  jump b2\n"
+             "b2 (preds b1, b3):\n"
+             "  %5 = phi %2, %8\n"
+             "  %6 = phi %1, %10\n"
+             "  %7 = add %5, %6\n"
+             "  %8 = add %7, %3\n"
+             "  %9 = const 1\n"
+             "  %10 = add %6, %9\n"
+             "  jump b3\n"
+             "b3 (preds b2):\n"
+             "  %11 = lt %10, %0\n"
+             "  branch %11, b2, b4\n"
+             "b4 (preds b0, b3):\n"
+             "  %12 = phi %2, %8\n"
+             "  return %12\n");
+}
+
+TEST(IrTests, ShortCircuitsConditionsAndValues) {
+   auto module = lower("function both(a, b) { var x; if (a && !b) { x = 1; } else { x = 2; } return x || a; }");
+   EXPECT_EQ(dumpIr(function(*module, "both")),
+             "function both (arity 2)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  %1 = param 1\n"
+             "  %2 = const null\n"
+             "  branch %0, b1, b3\n"
+             "b1 (preds b0):\n"
+             "  branch %1, b3, b2\n"
+             "b2 (preds b1):\n"
+             "  %3 = const 1\n"
+             "  jump b4\n"
+             "b3 (preds b0, b1):\n"
+             "  %4 = const 2\n"
+             "  jump b4\n"
+             "b4 (preds b2, b3):\n"
+             "  %5 = phi %3, %4\n"
+             "  %6 = truthy %5\n"
+             "  branch %6, b6, b5\n"
+             "b5 (preds b4):\n"
+             "  %7 = truthy %0\n"
+             "  jump b6\n"
+             "b6 (preds b4, b5):\n"
+             "  %8 = phi %6, %7\n"
+             "  return %8\n");
+}
+
+TEST(IrTests, GivesRaisingInstructionsExceptionalEdges) {
+   auto module = lower(R"(
+function guarded(x) {
+    var state = 1;
+    try {
+        state = 2;
+        x = x / 0;
+        state = 3;
+    } catch (e) {
+        state = state + 10;
+    } finally {
+        state = state * 2;
+    }
+    return state;
+})");
+   EXPECT_EQ(dumpIr(function(*module, "guarded")),
+             "function guarded (arity 1)\n"
+             "b0 (handler b2):\n"
+             "  %0 = param 0\n"
+             "  %1 = const 1\n"
+             "  %2 = const 2\n"
+             "  %3 = const 0\n"
+             "  %4 = div %0, %3\n"
+             "  jump b1\n"
+             "b1 (preds b0):\n"
+             "  %5 = const 3\n"
+             "  jump b4\n"
+             "b2 (preds b0; handler b5):\n"
+             "  %6 = catch\n"
+             "  %7 = const 10\n"
+             "  %8 = add %2, %7\n"
+             "  jump b3\n"
+             "b3 (preds b2):\n"
+             "  jump b4\n"
+             "b4 (preds b1, b3):\n"
+             "  %9 = phi %5, %8\n"
+             "  %10 = const 2\n"
+             "  %11 = mul %9, %10\n"
+             "  return %11\n"
+             "b5 (preds b2):\n"
+             "  %12 = catch\n"
+             "  %13 = const 2\n"
+             "  %14 = mul %2, %13\n"
+             "  rethrow %12\n");
+}
+
+TEST(IrTests, RunsFinallyOnEveryExit) {
+   auto module = lower(R"(
+function loopy(n) {
+    var i = 0;
+    do {
+        try { if (i > 5) { break; } i = i + n; } finally { n = n - 1; }
+    } while (i < 100);
+    return i;
+})");
+   std::string dump = dumpIr(function(*module, "loopy"));
+   // The finally body is lowered on the break, normal and exceptional paths.
+   size_t copies = 0;
+   for (size_t at = dump.find("sub %"); at != std::string::npos; at = dump.find("sub %", at + 1)) ++copies;
+   EXPECT_EQ(copies, 3u);
+   EXPECT_NE(dump.find("rethrow"), std::string::npos);
+}
+
+TEST(IrTests, LowersSwitchRunsToTables) {
+   auto module = lower(R"(
+function pick(k) {
+    switch (k) {
+        case 1: return "a";
+        case 2: return "b";
+        case 3: return "c";
+        case 4: return "d";
+        case k: return "e";
+        default: return "z";
+    }
+})");
+   std::string dump = dumpIr(function(*module, "pick"));
+   EXPECT_NE(dump.find("switch %0 [b5, b6, b7, b8] else b1 ; jump table 1..4"), std::string::npos);
+   EXPECT_NE(dump.find("eq %0, %0"), std::string::npos);
+}
+
+TEST(IrTests, GlobalsStayInMemory) {
+   auto module = lower("var total = 0; function add(n) { total = total + n; return total; } add(2);");
+   EXPECT_EQ(dumpIr(function(*module, "add")),
+             "function add (arity 1)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  %1 = loadglobal g0 (total)\n"
+             "  %2 = add %1, %0\n"
+             "  storeglobal g0 (total), %2\n"
+             "  %3 = loadglobal g0 (total)\n"
+             "  return %3\n");
+}
+
+TEST(IrTests, DropsUnreachableCode) {
+   auto module = lower("function f(n) { while (true) { return n; } return 0; } f(1);");
+   EXPECT_EQ(dumpIr(function(*module, "f")),
+             "function f (arity 1)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  jump b1\n"
+             "b1 (preds b0):\n"
+             "  jump b2\n"
+             "b2 (preds b1):\n"
+             "  return %0\n");
+}
+
+TEST(IrTests, BuildsDominatorTree) {
+   auto module = lower(R"(
+function f(n) {
+    var x = 0;
+    if (n) { x = 1; } else { x = 2; }
+    while (x < n) { x = x + 1; }
+    return x;
+})");
+   IrFunction &f = function(*module, "f");
+   DominatorTree dominators(f);
+   // b0 branches to b1/b2, which join in b3; b3 enters the loop header b4.
+   auto block = [&](int id) { return f.blocks[id].get(); };
+   EXPECT_EQ(dominators.idom(block(0)), nullptr);
+   EXPECT_EQ(dominators.idom(block(1)), block(0));
+   EXPECT_EQ(dominators.idom(block(2)), block(0));
+   EXPECT_EQ(dominators.idom(block(3)), block(0));
+   EXPECT_EQ(dominators.idom(block(4)), block(3));
+   EXPECT_TRUE(dominators.dominates(block(0), block(4)));
+   EXPECT_TRUE(dominators.dominates(block(4), block(4)));
+   EXPECT_FALSE(dominators.dominates(block(1), block(3)));
+   EXPECT_EQ(dominators.preorder().front(), block(0));
+   EXPECT_EQ(dominators.preorder().size(), f.blocks.size());
+}
+
+TEST(IrTests, VerifierRejectsBrokenIr) {
+   auto module = lower("function f(n) { var x = 0; if (n) { x = n + 1; } return x; } f(1);");
+   IrFunction &f = function(*module, "f");
+
+   IrBlock *join = f.blocks.back().get();
+   ASSERT_EQ(join->phis.size(), 1u);
+   IrInstr *phi = join->phis.front();
+   IrInstr *dropped = phi->operands.back();
+   phi->operands.pop_back();
+   EXPECT_THROW(verifyIr(f), CompilerError);
+   phi->operands.push_back(dropped);
+   EXPECT_NO_THROW(verifyIr(f));
+
+   // Using the sum in the entry block, before it is computed.
+   IrInstr *sum = nullptr;
+   for (const auto &block: f.blocks) {
+      for (IrInstr *instr: block->instructions) {
+         if (instr->op == IrOp::Binary) sum = instr;
+      }
+   }
+   ASSERT_NE(sum, nullptr);
+   IrInstr *early = f.newInstr(IrOp::Truthy);
+   early->addOperand(sum);
+   early->block = f.entry();
+   f.entry()->instructions.insert(f.entry()->instructions.begin(), early);
+   EXPECT_THROW(verifyIr(f), CompilerError);
+}
+
+TEST(IrTests, BuildsLargeFunctionsWithoutDeepRecursion) {
+   std::string body = "function big(n) { var x = 0; try { ";
+   for (int i = 0; i < 5000; ++i) body += "x = x + n; ";
+   body += "} catch (e) { return x; } return x; } big(1);";
+   auto module = lower(body);
+   IrFunction &big = function(*module, "big");
+   EXPECT_GT(big.blocks.size(), 5000u);
+   DominatorTree dominators(big);
+   EXPECT_EQ(dominators.preorder().size(), big.blocks.size());
+}
+
+TEST(IrTests, UseListsFollowEveryChange) {
+   auto module = lower("function f(n) { var x = n * n; if (n > 2) { x = x + n; } return x - n; } f(1);");
+   IrFunction &f = function(*module, "f");
+   IrInstr *param = f.entry()->instructions.front();
+   ASSERT_EQ(param->op, IrOp::Param);
+   auto uses = [&] {
+       size_t count = 0;
+       for (const auto &block: f.blocks) {
+          for (const IrInstr *phi: block->phis) count += std::count(phi->operands.begin(), phi->operands.end(), param);
+          for (const IrInstr *instr: block->instructions) {
+             count += std::count(instr->operands.begin(), instr->operands.end(), param);
+          }
+       }
+       return count;
+   };
+   EXPECT_EQ(param->users.size(), uses());
+
+   IrInstr *square = f.entry()->instructions[1];
+   ASSERT_EQ(square->binary, BinaryOperator::Multiply);
+   // Re-recording its first use moves the parameter's last use into its place.
+   ASSERT_NE(param->users.front(), param->users.back());
+   square->setOperand(0, param);
+   EXPECT_NO_THROW(verifyIr(f));
+   EXPECT_EQ(param->users.size(), uses());
+
+   // Every use of the square becomes a use of the parameter.
+   square->replaceAllUsesWith(param);
+   square->clearOperands();
+   auto &code = f.entry()->instructions;
+   code.erase(std::find(code.begin(), code.end(), square));
+   EXPECT_NO_THROW(verifyIr(f));
+   EXPECT_EQ(param->users.size(), uses());
+   EXPECT_TRUE(square->users.empty());
+}
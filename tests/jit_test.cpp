@@ -0,0 +1,142 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "jit.h"
+#include "vm.h"
+#include "error.h"
+
+static std::string runVm(const std::string &source, bool jit) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.setJit(jit, 2);
+   try {
+      vm.run(source);
+   } catch (const RuntimeError &error) {
+      out << error.what() << "\nfailed\n";
+   } catch (const ScriptException &thrown) {
+      out << "Uncaught exception: " << thrown.value.toString() << "\nfailed\n";
+   }
+   return out.str();
+}
+
+TEST(JitTests, RunsFromAnyInstructionAndExitsWhereItStops) {
+   if (!BaselineJit::supported()) GTEST_SKIP() << "no baseline JIT on this host";
+   FunctionProto function;
+   function.registerCount = 3;
+   function.code = {
+           encodeAsBx(OpCode::LOADINT, 0, 5),
+           encodeABC(OpCode::ADD_CONST, 1, 0, 3 + SC_BIAS),
+           encodeABC(OpCode::MUL, 2, 1, 1),
+           encodeABC(OpCode::SUB, 2, 2, 0),
+           encodeABC(OpCode::RETURN, 2),
+   };
+   BaselineJit jit;
+   ASSERT_TRUE(jit.compile(function));
+   ASSERT_NE(function.jitCode, nullptr);
+   EXPECT_EQ(jit.compiledCount(), 1u);
+   // Three instructions before the exit at RETURN are too few to enter for.
+   EXPECT_TRUE(function.jitCode->entersAt(0));
+   EXPECT_FALSE(function.jitCode->entersAt(1));
+
+   std::vector<Value> registers(3);
+   EXPECT_EQ(function.jitCode->run(registers.data(), nullptr, 0), 4u);
+   EXPECT_TRUE(registers[2].equals(Value::integer(59)));
+
+   // A string operand fails the integer guard: nothing is written.
+   registers[0] = Value::string("s");
+   registers[1] = Value::number(0.5);
+   EXPECT_EQ(function.jitCode->run(registers.data(), nullptr, 1), 1u);
+   EXPECT_TRUE(registers[1].equals(Value::number(0.5)));
+   EXPECT_EQ(function.jitCode->run(registers.data(), nullptr, 2), 3u);
+   EXPECT_TRUE(registers[2].equals(Value::number(0.25)));
+}
+
+TEST(JitTests, CompilesFunctionsOnceTheyAreHot) {
+   if (!BaselineJit::supported()) GTEST_SKIP() << "no baseline JIT on this host";
+   std::ostringstream out;
+   VM vm(out);
+   vm.setJit(true, 50);
+   vm.run(R"(
+function cold(n) { return n + 1; }
+function called(n) { var a = n * 2; var b = a - 1; return a + b - n; }
+function short(n) { return n * 2; }
+function looping(n) { var s = 0; for (var i = 0; i < n; i = i + 1) { s = s + i; } return s; }
+var t = cold(1);
+for (var k = 0; k < 60; k = k + 1) { t = t + called(k) + short(k); }
+print(t, looping(100));
+)");
+   EXPECT_EQ(out.str(), "8792 4950\n");
+   std::unordered_map<std::string, const FunctionProto *> byName;
+   for (const auto &function: vm.lastProgram()->functions) byName[function->name] = function.get();
+   EXPECT_EQ(byName.at("cold")->jitCode, nullptr);
+   // Hot, but too short for native code to pay off.
+   EXPECT_EQ(byName.at("short")->jitCode, nullptr);
+   EXPECT_NE(byName.at("called")->jitCode, nullptr);
+   EXPECT_NE(byName.at("looping")->jitCode, nullptr);
+   EXPECT_NE(vm.lastProgram()->main().jitCode, nullptr);
+   EXPECT_EQ(vm.jit().compiledCount(), 3u);
+}
+
+TEST(JitTests, MatchesTheInterpreter) {
+   const char *programs[] = {
+           R"(
+var zero = 0.0;
+var nan = zero / zero;
+var values = "";
+for (var i = 0; i < 6; i = i + 1) {
+    var x = i - 2;
+    var f = x * 0.5;
+    values = values + str(x * x - 3) + " " + str(f / 2) + " " + str(-x) + " " + str(-f) + " " + str(!x) + ";";
+    values = values + str((x * 0 - 2147483647 - 1) / (x - 4)) + " " + str(x / 2) + " " + str(x / 2.0) + ";";
+    values = values + str(x < 1) + str(f <= 0.0) + str(x == 0) + str(f != 0.5) + str(nan == nan) + str(nan != nan) + ";";
+}
+print(values, 2147483647 + 1, -2147483647 - 1 - 1, 65536 * 65536, -nan, 1 / zero);
+)",
+           R"(
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+var total = 0;
+var k = 0;
+do { total = total + fib(k); k = k + 1; } while (k < 15);
+var words = "";
+for (var i = 0; i < 10; i = i + 1) {
+    if (i > 6) { words = words + "big"; } else { words = words + str(i); }
+    var copy = words;
+    words = copy;
+}
+print(total, words, len(words));
+)",
+           R"(
+var log = "";
+function risky(x) {
+    if (x > 5) { throw("big " + str(x)); }
+    return 10 / (x - 2);
+}
+for (var i = 0; i < 8; i = i + 1) {
+    try { log = log + str(risky(i)) + ","; } catch (e) { log = log + e + ","; } finally { log = log + "."; }
+}
+print(log);
+var m = matrix(2, 2);
+for (var j = 0; j < 4; j = j + 1) { put(m, j / 2, j - j / 2 * 2, j + 0.5); m = m * 1; }
+print(m, null == null, true != false);
+function down(n) { return down(n + 1) + 1; }
+down(0);
+)",
+           R"(
+var flag = true;
+var n = null;
+var count = 0;
+while (flag) {
+    count = count + 1;
+    if (count >= 20 || n) { flag = false; }
+    if (!flag) { n = count; } else { n = null; }
+}
+var s = 0.0;
+for (var i = 0; i < 100; i = i + 1) { s = s + i * 1.5; if (s > 1000.0) { s = s - 999.5; } }
+print(count, n, s, 1.5 < 2, 2 > 1.5);
+)",
+   };
+   for (const char *program: programs) {
+      EXPECT_EQ(runVm(program, true), runVm(program, false)) << program;
+   }
+}
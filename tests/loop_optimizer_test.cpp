@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include "resolver.h"
+#include "ir_builder.h"
+#include "ir_simplifier.h"
+#include "dominators.h"
+#include "loops.h"
+#include "loop_optimizer.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> lower(const std::string &source) {
+   std::unique_ptr<Expr> program = parseProgram(source);
+   Resolver().resolve(*program);
+   std::unique_ptr<IrModule> module = IrBuilder().build(*program);
+   IrSimplifier().simplify(*module);
+   verifyIr(*module);
+   return module;
+}
+
+static LoopStats optimize(IrFunction &function, LoopOptions options = {}) {
+   LoopStats stats = LoopOptimizer(options).optimize(function);
+   verifyIr(function);
+   return stats;
+}
+
+static std::vector<const IrInstr *> binaries(const IrFunction &function, BinaryOperator op) {
+   std::vector<const IrInstr *> result;
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) {
+         if (instr->op == IrOp::Binary && instr->binary == op) result.push_back(instr);
+      }
+   }
+   return result;
+}
+
+TEST(LoopOptimizerTests, FindsNestedLoops) {
+   auto module = lower(R"(
+function grid(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        for (var j = 0; j < n; j = j + 1) { total = total + j; }
+    }
+    return total;
+})");
+   IrFunction &grid = function(*module, "grid");
+   DominatorTree dominators(grid);
+   LoopInfo info(grid, dominators);
+   ASSERT_EQ(info.loops().size(), 2u);
+   const NaturalLoop &inner = *info.loops()[0];
+   const NaturalLoop &outer = *info.loops()[1];
+   EXPECT_EQ(inner.parent, &outer);
+   EXPECT_EQ(inner.depth, 2);
+   EXPECT_EQ(outer.depth, 1);
+   EXPECT_TRUE(outer.contains(inner.header));
+   EXPECT_EQ(info.loopFor(inner.header), &inner);
+   EXPECT_NE(inner.preheader(), nullptr);
+   EXPECT_NE(outer.preheader(), nullptr);
+   EXPECT_EQ(inner.latches.size(), 1u);
+}
+
+TEST(LoopOptimizerTests, ForgetsRemovedLoops) {
+   auto module = lower(R"(
+function cube(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        for (var j = 0; j < n; j = j + 1) {
+            for (var k = 0; k < n; k = k + 1) { total = total + k; }
+        }
+    }
+    return total;
+})");
+   IrFunction &cube = function(*module, "cube");
+   DominatorTree dominators(cube);
+   LoopInfo info(cube, dominators);
+   ASSERT_EQ(info.loops().size(), 3u);
+   NaturalLoop *inner = info.loops()[0].get();
+   NaturalLoop *middle = info.loops()[1].get();
+   NaturalLoop *outer = info.loops()[2].get();
+   EXPECT_EQ(inner->depth, 3);
+   EXPECT_EQ(outer->children, std::vector<NaturalLoop *>{middle});
+   EXPECT_TRUE(outer->contains(inner->header));
+   EXPECT_FALSE(inner->contains(middle->header));
+
+   const IrBlock *middleHeader = middle->header;
+   info.remove(middle);
+   ASSERT_EQ(info.loops().size(), 2u);
+   EXPECT_EQ(inner->parent, outer);
+   EXPECT_EQ(inner->depth, 2);
+   EXPECT_EQ(outer->children, std::vector<NaturalLoop *>{inner});
+   EXPECT_EQ(info.loopFor(middleHeader), outer);
+}
+
+TEST(LoopOptimizerTests, HoistsInvariantsToThePreheader) {
+   auto module = lower(R"(
+var scale = 3;
+function sum(n, k) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = total + k * scale + i; }
+    return total;
+}
+function store(n) {
+    for (var i = 0; i < n; i = i + 1) { scale = scale + 1; }
+    return scale;
+})");
+   IrFunction &sum = function(*module, "sum");
+   LoopStats stats = optimize(sum);
+   EXPECT_EQ(stats.loops, 1);
+   EXPECT_GE(stats.hoisted, 2);
+   DominatorTree dominators(sum);
+   LoopInfo info(sum, dominators);
+   ASSERT_EQ(info.loops().size(), 1u);
+   const NaturalLoop &loop = *info.loops().front();
+   std::vector<const IrInstr *> products = binaries(sum, BinaryOperator::Multiply);
+   ASSERT_EQ(products.size(), 1u);
+   EXPECT_FALSE(loop.contains(products[0]->block));
+   EXPECT_EQ(products[0]->operands[1]->op, IrOp::LoadGlobal);
+   EXPECT_FALSE(loop.contains(products[0]->operands[1]->block));
+
+   // The loop stores scale, so each trip must load it again.
+   IrFunction &store = function(*module, "store");
+   optimize(store);
+   DominatorTree storeDominators(store);
+   LoopInfo storeInfo(store, storeDominators);
+   ASSERT_EQ(storeInfo.loops().size(), 1u);
+   bool loadsInLoop = false;
+   for (const IrBlock *block: storeInfo.loops().front()->blocks) {
+      for (const IrInstr *instr: block->instructions) loadsInLoop |= instr->op == IrOp::LoadGlobal;
+   }
+   EXPECT_TRUE(loadsInLoop);
+}
+
+TEST(LoopOptimizerTests, KeepsRaisingInstructionsBehindEffects) {
+   auto module = lower(R"(
+function note(x) { return x; }
+function f(n, d) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { note(i); total = total + n / d; }
+    return total;
+})");
+   IrFunction &f = function(*module, "f");
+   optimize(f);
+   // Hoisting the division would raise before the first call.
+   DominatorTree dominators(f);
+   LoopInfo info(f, dominators);
+   ASSERT_EQ(info.loops().size(), 1u);
+   std::vector<const IrInstr *> divisions = binaries(f, BinaryOperator::Divide);
+   ASSERT_EQ(divisions.size(), 1u);
+   EXPECT_TRUE(info.loops().front()->contains(divisions[0]->block));
+}
+
+TEST(LoopOptimizerTests, ReducesMultipliesWhereTheyCostMore) {
+   const char *source = R"(
+function f(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = total + i * 8 + 5; }
+    return total;
+})";
+   auto vmModule = lower(source);
+   EXPECT_EQ(optimize(function(*vmModule, "f")).reduced, 0);
+
+   LoopOptions native;
+   native.costs = LoopCostModel::native();
+   auto module = lower(source);
+   IrFunction &f = function(*module, "f");
+   EXPECT_EQ(optimize(f, native).reduced, 1);
+   EXPECT_TRUE(binaries(f, BinaryOperator::Multiply).empty());
+
+   LoopOptions off = native;
+   off.strengthReduce = false;
+   auto kept = lower(source);
+   EXPECT_EQ(optimize(function(*kept, "f"), off).reduced, 0);
+}
+
+TEST(LoopOptimizerTests, UnrollsShortCountedLoops) {
+   auto module = lower(R"(
+function f() {
+    var total = 0;
+    for (var i = 0; i < 4; i = i + 1) { total = total + i * i; }
+    return total;
+}
+function g(n) {
+    var total = 0;
+    for (var i = 0; i < 100; i = i + 1) { total = total + n; }
+    return total;
+})");
+   IrFunction &f = function(*module, "f");
+   LoopStats stats = optimize(f);
+   EXPECT_EQ(stats.unrolled, 1);
+   // Unrolled, the loop folds to its result.
+   EXPECT_EQ(dumpIr(f),
+             "function f (arity 0)\n"
+             "b0:\n"
+             "  %0 = const 14\n"
+             "  return %0\n");
+
+   // Too many trips for the budget.
+   IrFunction &g = function(*module, "g");
+   EXPECT_EQ(optimize(g).unrolled, 0);
+}
+
+TEST(LoopOptimizerTests, OptimizedProgramsBehaveTheSame) {
+   expectSameWhenOptimized({
+           R"(
+function sum(n, k) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = total + k * 3 + i * 4; }
+    return total;
+}
+function small() {
+    var total = 0;
+    var i = 0;
+    while (i < 5) { total = total * 2 + i; i = i + 1; }
+    return total;
+}
+function nested(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        for (var j = i; j < n; j = j + 2) { if (j == 7) { continue; } total = total + j * i; }
+        if (total > 1000) { break; }
+    }
+    return total;
+}
+print(sum(10, 2), sum(0, 2), small(), nested(12), nested(0));
+)",
+           R"(
+var seen = 0;
+function bump() { seen = seen + 1; return seen; }
+function f(n) {
+    var last = 0;
+    for (var i = 0; i < n; i = i + 1) { last = bump() + seen; }
+    return last;
+}
+print(f(4), seen);
+var k = 0;
+do { k = k + 3; } while (k < 10);
+print(k, 2147483647 + 1, "a" + 1);
+)",
+           R"(
+function guarded(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        try { total = total + 10 / (i - 2); } catch (e) { total = total + 100; }
+    }
+    return total;
+}
+print(guarded(5));
+)",
+   });
+}
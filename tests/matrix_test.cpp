@@ -0,0 +1,257 @@
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gemm.h"
+#include "matrix.h"
+#include "matrix_expr.h"
+#include "thread_pool.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "error.h"
+
+static std::vector<double> randomMatrix(int rows, int cols, std::uint32_t seed) {
+   std::vector<double> values(static_cast<size_t>(rows) * cols);
+   for (auto &v: values) {
+      seed = seed * 1664525u + 1013904223u;
+      v = static_cast<double>(seed >> 8) / (1u << 24) - 0.5;
+   }
+   return values;
+}
+
+TEST(MatrixTests, GemmKernelsMatchNaive) {
+   const int shapes[][3] = {{1, 1, 1}, {3, 5, 7}, {6, 8, 4}, {17, 13, 29}, {100, 97, 300}, {130, 2100, 3}};
+   for (GemmKernel kernel: {GemmKernel::Generic, GemmKernel::SSE2, GemmKernel::AVX2}) {
+      if (!gemmKernelSupported(kernel)) continue;
+      for (const auto &shape: shapes) {
+         int m = shape[0], n = shape[1], k = shape[2];
+         auto a = randomMatrix(m, k, 1);
+         auto b = randomMatrix(k, n, 2);
+         std::vector<double> expected(static_cast<size_t>(m) * n);
+         std::vector<double> actual(expected.size(), 42.0);
+         gemmNaive(m, n, k, a.data(), b.data(), expected.data());
+         gemm(m, n, k, a.data(), b.data(), actual.data(), kernel);
+         for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_NEAR(actual[i], expected[i], 1e-9) << gemmKernelName(kernel) << " " << m << "x" << n << "x" << k;
+         }
+      }
+   }
+}
+
+TEST(MatrixTests, ParallelGemmMatchesNaive) {
+   ThreadPool pool(4);
+   const int shapes[][3] = {{5, 7, 3}, {200, 1100, 70}, {301, 513, 260}};
+   for (const auto &shape: shapes) {
+      int m = shape[0], n = shape[1], k = shape[2];
+      auto a = randomMatrix(m, k, 3);
+      auto b = randomMatrix(k, n, 4);
+      std::vector<double> expected(static_cast<size_t>(m) * n);
+      std::vector<double> actual(expected.size(), -1.0);
+      gemmNaive(m, n, k, a.data(), b.data(), expected.data());
+      gemmParallel(m, n, k, a.data(), b.data(), actual.data(), pool);
+      for (size_t i = 0; i < expected.size(); ++i) {
+         ASSERT_NEAR(actual[i], expected[i], 1e-9) << m << "x" << n << "x" << k;
+      }
+   }
+}
+
+TEST(MatrixTests, StorageIsAligned) {
+   MatrixObject matrix(3, 5);
+   EXPECT_EQ(reinterpret_cast<std::uintptr_t>(matrix.data.get()) % MATRIX_ALIGNMENT, 0u);
+   EXPECT_EQ(matrix.at(2, 4), 0.0);
+   EXPECT_THROW(MatrixObject(-1, 2), RuntimeError);
+}
+
+TEST(MatrixTests, MultiplyOperatorInBothEngines) {
+   const char *source = R"(
+var a = matrix(2, 3);
+var b = matrix(3, 2);
+for (var i = 0; i < 2; i = i + 1) {
+    for (var j = 0; j < 3; j = j + 1) {
+        put(a, i, j, i * 3 + j + 1);
+        put(b, j, i, j * 2 + i + 1);
+    }
+}
+var c = a @ b;
+print(rows(c), cols(c), at(c, 1, 0));
+print(c);
+)";
+   std::ostringstream vmOut;
+   VM vm(vmOut);
+   vm.run(source);
+   EXPECT_EQ(vmOut.str(), "2 2 49\n[[22, 28], [49, 64]]\n");
+
+   std::ostringstream astOut;
+   Interpreter interpreter(astOut);
+   interpreter.run(source);
+   EXPECT_EQ(astOut.str(), vmOut.str());
+}
+
+TEST(MatrixTests, MultiplyErrors) {
+   std::ostringstream out;
+   VM vm(out);
+   EXPECT_THROW(vm.run("var c = matrix(2, 3) @ matrix(2, 3);"), RuntimeError);
+   EXPECT_THROW(vm.run("var m = matrix(2, 2); put(m, 2, 0, 1.0);"), RuntimeError);
+   EXPECT_THROW(vm.run("var n = matrix(2, 2) @ 3;"), CompilerError);
+}
+
+TEST(MatrixTests, ChainPlanIsOptimal) {
+   MatrixChainPlan plan = planMatrixChain({30, 35, 15, 5, 10, 20, 25});
+   EXPECT_EQ(plan.cost, 15125.0);
+   EXPECT_EQ(plan.split[0][5], 2);
+   EXPECT_EQ(plan.split[0][2], 0);
+   EXPECT_EQ(plan.split[3][5], 4);
+
+   EXPECT_EQ(planMatrixChain({400, 8, 400, 8}).split[0][2], 0);
+}
+
+TEST(MatrixTests, ChainsAreReorderedInBothEngines) {
+   const char *source = R"(
+function fill(m, seed) {
+    for (var i = 0; i < rows(m); i = i + 1) {
+        for (var j = 0; j < cols(m); j = j + 1) { put(m, i, j, (i * 7 + j * 3 + seed) / 4 - 2); }
+    }
+    return m;
+}
+var a = fill(matrix(9, 2), 1);
+var b = fill(matrix(2, 11), 2);
+var c = fill(matrix(11, 3), 3);
+var d = fill(matrix(3, 5), 4);
+var chained = a @ b @ c @ d;
+var ab = a @ b;
+var abc = ab @ c;
+var stepwise = abc @ d;
+var same = true;
+for (var i = 0; i < 9; i = i + 1) {
+    for (var j = 0; j < 5; j = j + 1) {
+        if (at(chained, i, j) != at(stepwise, i, j)) { same = false; }
+    }
+}
+print(rows(chained), cols(chained), same, at(chained, 8, 4));
+)";
+   std::ostringstream vmOut;
+   VM vm(vmOut);
+   vm.run(source);
+   EXPECT_EQ(vmOut.str(), "9 5 true 98720\n");
+   EXPECT_NE(disassemble(*vm.lastProgram()).find("MATCHAIN"), std::string::npos);
+
+   std::ostringstream astOut;
+   Interpreter interpreter(astOut);
+   interpreter.run(source);
+   EXPECT_EQ(astOut.str(), vmOut.str());
+
+   EXPECT_THROW(vm.run("var x = matrix(2, 3) @ matrix(3, 4) @ matrix(5, 1);"), RuntimeError);
+}
+
+static MatrixObject *filledMatrix(int rows, int cols, std::uint32_t seed) {
+   auto *matrix = new MatrixObject(rows, cols);
+   auto values = randomMatrix(rows, cols, seed);
+   std::copy(values.begin(), values.end(), matrix->mutableElements());
+   return matrix;
+}
+
+TEST(MatrixTests, FusedExpressionsMatchEagerEvaluation) {
+   const int m = 70, n = 45, k = 33;
+   Value a = Value::object(filledMatrix(m, k, 5));
+   Value b = Value::object(filledMatrix(k, n, 6));
+   Value c = Value::object(filledMatrix(m, n, 7));
+   Value d = Value::object(filledMatrix(m, n, 8));
+
+   // (a @ b) * 2 + c - d * c, then negated and shifted by 1.5
+   Value product = matrixMultiply(a, b);
+   Value scaled = matrixElementwise(BinaryOperator::Multiply, product, Value::integer(2));
+   Value biased = matrixElementwise(BinaryOperator::Add, scaled, c);
+   Value result = matrixElementwise(BinaryOperator::Subtract, biased,
+                                    matrixElementwise(BinaryOperator::Multiply, d, c));
+   result = matrixElementwise(BinaryOperator::Subtract, Value::number(1.5), result);
+   EXPECT_TRUE(asMatrix(result)->pending);
+
+   std::vector<double> ab(static_cast<size_t>(m) * n);
+   gemmNaive(m, n, k, asMatrix(a)->elements(), asMatrix(b)->elements(), ab.data());
+   const double *cv = asMatrix(c)->elements();
+   const double *dv = asMatrix(d)->elements();
+   const double *actual = asMatrix(result)->elements();
+   EXPECT_FALSE(asMatrix(result)->pending);
+   for (size_t i = 0; i < ab.size(); ++i) {
+      ASSERT_NEAR(actual[i], 1.5 - (ab[i] * 2 + cv[i] - dv[i] * cv[i]), 1e-9) << i;
+   }
+
+   Value negated = matrixUnary(UnaryOperator::Negate, product);
+   for (size_t i = 0; i < ab.size(); ++i) ASSERT_NEAR(asMatrix(negated)->elements()[i], -ab[i], 1e-9);
+   EXPECT_THROW(matrixElementwise(BinaryOperator::Add, a, b), RuntimeError);
+}
+
+TEST(MatrixTests, SharedProductsAreComputedOnce) {
+   const int m = 20, n = 15, k = 11;
+   auto leaf = [](int rows, int cols, std::uint32_t seed) {
+       auto values = randomMatrix(rows, cols, seed);
+       MatrixStorage storage(new double[values.size()]);
+       std::copy(values.begin(), values.end(), storage.get());
+       return matrixLeaf(storage, rows, cols);
+   };
+   MatrixExprRef a = leaf(m, k, 1), b = leaf(k, n, 2), c = leaf(m, n, 3);
+   std::vector<double> ab(static_cast<size_t>(m) * n);
+   gemmNaive(m, n, k, a->leaf.get(), b->leaf.get(), ab.data());
+
+   // h + h and h * c - h: the linear use is not multiplied again once the
+   // rest of the expression has computed h.
+   MatrixExprRef h = matrixBinary(MatrixExprNode::Kind::Product, a, b);
+   MatrixStorage twice = evaluateMatrixExpr(matrixBinary(MatrixExprNode::Kind::Add, h, h));
+   ASSERT_TRUE(h->computed);
+   for (size_t i = 0; i < ab.size(); ++i) ASSERT_NEAR(twice[i], 2 * ab[i], 1e-9) << i;
+
+   MatrixExprRef g = matrixBinary(MatrixExprNode::Kind::Product, a, b);
+   MatrixExprRef scaled = matrixBinary(MatrixExprNode::Kind::Multiply, g, c);
+   MatrixStorage mixed = evaluateMatrixExpr(matrixBinary(MatrixExprNode::Kind::Subtract, scaled, g));
+   ASSERT_TRUE(g->computed);
+   for (size_t i = 0; i < ab.size(); ++i) ASSERT_NEAR(mixed[i], ab[i] * c->leaf[i] - ab[i], 1e-9) << i;
+}
+
+TEST(MatrixTests, SharedSubexpressionsAreEvaluatedOnce) {
+   // Each step uses the pending value twice; evaluated as a tree this would
+   // take 2^30 passes.
+   const char *source = R"(
+var x = matrix(2, 2);
+put(x, 0, 0, 1); put(x, 1, 1, 0.5);
+for (var i = 0; i < 30; i = i + 1) { x = x + x; }
+var v = matrix(100, 100);
+put(v, 3, 4, 2);
+for (var j = 0; j < 15; j = j + 1) { v = v + v * 0.5; }
+print(at(x, 0, 0), at(x, 1, 1), at(x, 0, 1), at(v, 3, 4) > 875.0);
+)";
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(source);
+   EXPECT_EQ(out.str(), "1073741824 536870912 0 true\n");
+}
+
+TEST(MatrixTests, PendingResultsSnapshotTheirInputs) {
+   const char *source = R"(
+var a = matrix(2, 2);
+put(a, 0, 0, 1); put(a, 0, 1, 2); put(a, 1, 0, 3); put(a, 1, 1, 4);
+var b = a * 10 + a @ a;
+var c = -a + 1;
+put(a, 0, 0, 100);
+print(b);
+print(c);
+print(a - a * 2);
+var s = a;
+for (var i = 0; i < 100; i = i + 1) { s = s + a; }
+print(at(s, 1, 1));
+)";
+   std::ostringstream vmOut;
+   VM vm(vmOut);
+   vm.run(source);
+   EXPECT_EQ(vmOut.str(), "[[17, 30], [45, 62]]\n[[0, -1], [-2, -3]]\n[[-100, -2], [-3, -4]]\n404\n");
+
+   std::ostringstream astOut;
+   Interpreter interpreter(astOut);
+   interpreter.run(source);
+   EXPECT_EQ(astOut.str(), vmOut.str());
+
+   EXPECT_THROW(vm.run("var m = matrix(2, 2) + matrix(2, 3);"), RuntimeError);
+   EXPECT_THROW(vm.run("var m = matrix(2, 2) + true;"), CompilerError);
+}
@@ -11,7 +11,7 @@ std::string parseAndPrintAST(const std::string &source) {
    Parser parser(tokens);
 
    parser.scopeManager.declare(
-           Symbol("x", SymbolType::Variable, std::make_shared<Type>(TypeKind::Int), true, 0, 0)
+           Symbol("x", SymbolType::Variable, TypeContext::global().intType(), true, 0, 0)
    );
 
    std::unique_ptr<Expr> ast = parser.parse();
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "resolver.h"
+#include "test_helpers.h"
+
+static Expr *topLevel(const std::unique_ptr<Expr> &program, size_t index) {
+   return static_cast<BlockStatementExpr *>(program.get())->statements[index].get();
+}
+
+TEST(ResolverTests, AssignsGlobalAndLocalSlots) {
+   auto program = parseProgram(R"(
+var g = 1;
+function f(a, b) {
+    var c = a + b;
+    { var d = c; }
+    { var e = g; }
+    return c;
+}
+)");
+   Resolver resolver;
+   resolver.resolve(*program);
+
+   auto *global = static_cast<VarDeclarationExpr *>(topLevel(program, 0));
+   EXPECT_EQ(global->slot.kind, VariableSlot::Kind::Global);
+   EXPECT_EQ(global->slot.index, 0);
+
+   auto *function = static_cast<FunctionDeclarationExpr *>(topLevel(program, 1));
+   EXPECT_EQ(function->frameSize, 4);
+
+   auto &body = static_cast<BlockStatementExpr *>(function->body.get())->statements;
+   auto *c = static_cast<VarDeclarationExpr *>(body[0].get());
+   EXPECT_EQ(c->slot.kind, VariableSlot::Kind::Local);
+   EXPECT_EQ(c->slot.index, 2);
+
+   auto *sum = static_cast<BinaryExpr *>(c->initializer.get());
+   EXPECT_EQ(static_cast<IdentifierExpr *>(sum->left.get())->slot.index, 0);
+   EXPECT_EQ(static_cast<IdentifierExpr *>(sum->right.get())->slot.index, 1);
+
+   auto *inner = static_cast<BlockStatementExpr *>(body[2].get());
+   auto *e = static_cast<VarDeclarationExpr *>(inner->statements[0].get());
+   EXPECT_EQ(e->slot.index, 3);
+   auto *useOfG = static_cast<IdentifierExpr *>(e->initializer.get());
+   EXPECT_EQ(useOfG->slot.kind, VariableSlot::Kind::Global);
+   EXPECT_EQ(useOfG->slot.index, 0);
+}
+
+TEST(ResolverTests, ReusesSlotsAcrossSiblingLoops) {
+   auto program = parseProgram(R"(
+function h(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) { total = total + i; }
+    for (var j = 0; j < n; j = j + 1) { total = total + j; }
+    return total;
+}
+for (var k = 0; k < 2; k = k + 1) { }
+)");
+   Resolver resolver;
+   resolver.resolve(*program);
+
+   EXPECT_EQ(static_cast<FunctionDeclarationExpr *>(topLevel(program, 0))->frameSize, 3);
+   ASSERT_EQ(resolver.globalNames().size(), 1u);
+   EXPECT_EQ(resolver.globalNames()[0], "k");
+}
+
+TEST(ResolverTests, RejectsCapturingEnclosingLocals) {
+   auto program = parseProgram(R"(
+function outer(x) {
+    function inner() { return x; }
+    return 0;
+}
+)");
+   Resolver resolver;
+   EXPECT_THROW(resolver.resolve(*program), CompilerError);
+}
@@ -0,0 +1,43 @@
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "switch_table.h"
+
+TEST(SwitchTableTests, IntegerKeys) {
+   SwitchTable dense;
+   for (int key: {3, 4, 6, 7, 8}) dense.addInteger(key, key * 10);
+   dense.addInteger(4, 99);
+   dense.build();
+   EXPECT_EQ(dense.describe(), "jump table 3..8");
+   EXPECT_EQ(dense.lookup(Value::integer(4)), 40);
+   EXPECT_EQ(dense.lookup(Value::number(8.0)), 80);
+   EXPECT_EQ(dense.lookup(Value::number(7.5)), SwitchTable::NO_MATCH);
+   EXPECT_EQ(dense.lookup(Value::integer(5)), SwitchTable::NO_MATCH);
+   EXPECT_EQ(dense.lookup(Value::integer(2)), SwitchTable::NO_MATCH);
+   EXPECT_EQ(dense.lookup(Value::integer(9)), SwitchTable::NO_MATCH);
+
+   SwitchTable sparse;
+   for (int key: {-2000000000, -7, 12, 4096, 2000000000}) sparse.addInteger(key, key == 12 ? 1 : 0);
+   sparse.build();
+   EXPECT_EQ(sparse.describe(), "binary search 5 keys");
+   EXPECT_EQ(sparse.lookup(Value::integer(12)), 1);
+   EXPECT_EQ(sparse.lookup(Value::integer(-2000000000)), 0);
+   EXPECT_EQ(sparse.lookup(Value::integer(13)), SwitchTable::NO_MATCH);
+   EXPECT_EQ(sparse.lookup(Value::boolean(true)), SwitchTable::NO_MATCH);
+}
+
+TEST(SwitchTableTests, PerfectHashFindsEveryString) {
+   SwitchTable table;
+   for (int i = 0; i < 500; ++i) table.addString("op" + std::to_string(i * 7), i);
+   table.addString("", 500);
+   table.build();
+   EXPECT_EQ(table.describe(), "perfect hash 501 keys");
+   for (int i = 0; i < 500; ++i) ASSERT_EQ(table.lookup(Value::string("op" + std::to_string(i * 7))), i);
+   EXPECT_EQ(table.lookup(Value::string("")), 500);
+   EXPECT_EQ(table.lookup(Value::string("op1")), SwitchTable::NO_MATCH);
+   EXPECT_EQ(table.lookup(Value::integer(0)), SwitchTable::NO_MATCH);
+
+   table.mapTargets([](int target) { return target + 1; });
+   EXPECT_EQ(table.lookup(Value::string("op21")), 4);
+}
@@ -0,0 +1,87 @@
+#ifndef COMPILER_TEST_HELPERS_H
+#define COMPILER_TEST_HELPERS_H
+
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "ir.h"
+#include "vm.h"
+#include "error.h"
+
+// source as the Parser gives it, before any pass has run.
+inline std::unique_ptr<Expr> parseProgram(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+   Parser parser(tokens);
+   return parser.parse();
+}
+
+inline IrFunction &function(const IrModule &module, const std::string &name) {
+   for (const auto &function: module.functions) {
+      if (function->name == name) return *function;
+   }
+   throw std::runtime_error("no function " + name);
+}
+
+// What source prints on the VM, followed by the message of an error nothing
+// caught and "failed". The native backends' tests report their programs the
+// same way.
+inline std::string runVm(const std::string &source, bool optimized = false) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.setOptimize(optimized);
+   try {
+      vm.run(source);
+   } catch (const RuntimeError &error) {
+      out << error.what() << "\nfailed\n";
+   } catch (const ScriptException &thrown) {
+      out << "Uncaught exception: " << thrown.value.toString() << "\nfailed\n";
+   }
+   return out.str();
+}
+
+// As runVm, on the tree-walking Interpreter.
+inline std::string runInterpreter(const std::string &source) {
+   std::ostringstream out;
+   Interpreter interpreter(out);
+   try {
+      interpreter.run(source);
+   } catch (const RuntimeError &error) {
+      out << error.what() << "\nfailed\n";
+   } catch (const ScriptException &thrown) {
+      out << "Uncaught exception: " << thrown.value.toString() << "\nfailed\n";
+   }
+   return out.str();
+}
+
+// What the program at path prints on stdout and stderr, followed by "failed"
+// when it exits with an error, as runVm reports. limits is a shell prefix,
+// such as a ulimit, to run it under.
+inline std::string runExecutable(const std::string &path, const std::string &limits = "") {
+   FILE *pipe = popen((limits + "'" + path + "' 2>&1").c_str(), "r");
+   if (!pipe) throw std::runtime_error("cannot run " + path);
+   std::string output;
+   char buffer[4096];
+   for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0;) output.append(buffer, n);
+   return pclose(pipe) != 0 ? output + "failed\n" : output;
+}
+
+// Expects each program to print the same, and fail the same way, through the
+// Optimizer as through the BytecodeCompiler.
+inline void expectSameWhenOptimized(std::initializer_list<const char *> programs) {
+   for (const char *program: programs) {
+      EXPECT_EQ(runVm(program, true), runVm(program)) << program;
+   }
+}
+
+#endif //COMPILER_TEST_HELPERS_H
@@ -0,0 +1,37 @@
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "thread_pool.h"
+
+TEST(ThreadPoolTests, RunsEveryIndexOnce) {
+   ThreadPool pool(4);
+   EXPECT_EQ(pool.threadCount(), 4);
+   for (int round = 0; round < 50; ++round) {
+      std::vector<std::atomic<int>> hits(257);
+      pool.parallelFor(static_cast<int>(hits.size()), [&](int i) { hits[i]++; });
+      for (auto &hit: hits) ASSERT_EQ(hit.load(), 1);
+   }
+}
+
+TEST(ThreadPoolTests, PropagatesExceptions) {
+   ThreadPool pool(3);
+   std::atomic<int> finished{0};
+   EXPECT_THROW(pool.parallelFor(40, [&](int i) {
+       if (i == 17) throw std::runtime_error("task failed");
+       finished++;
+   }), std::runtime_error);
+   EXPECT_EQ(finished.load(), 39);
+
+   pool.parallelFor(8, [&](int) { finished++; });
+   EXPECT_EQ(finished.load(), 47);
+}
+
+TEST(ThreadPoolTests, SingleThreadRunsInline) {
+   ThreadPool pool(1);
+   int sum = 0;
+   pool.parallelFor(10, [&](int i) { sum += i; });
+   EXPECT_EQ(sum, 45);
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "type_checker.h"
+
+struct CheckedProgram {
+    std::unique_ptr<Expr> ast;
+    std::vector<TypeError> errors;
+
+    [[nodiscard]] const Expr *statement(size_t index) const {
+       return static_cast<BlockStatementExpr *>(ast.get())->statements[index].get();
+    }
+
+    [[nodiscard]] std::string initializerType(size_t index) const {
+       return static_cast<const VarDeclarationExpr *>(statement(index))->initializer->resolvedType.toString();
+    }
+};
+
+static CheckedProgram typeCheck(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+
+   Parser parser(tokens);
+   CheckedProgram program{parser.parse(), {}};
+
+   TypeChecker checker;
+   checker.check(*program.ast);
+   program.errors = checker.errors();
+   return program;
+}
+
+TEST(TypeCheckerTests, InfersVariableTypes) {
+   auto program = typeCheck(R"(
+var a = 1;
+var b = a * 2;
+var c = 1.5;
+var d = a + c;
+var e = "n = " + a;
+var f = a < 3;
+)");
+   EXPECT_TRUE(program.errors.empty());
+   EXPECT_EQ(program.initializerType(1), "int");
+   EXPECT_EQ(program.initializerType(3), "float");
+   EXPECT_EQ(program.initializerType(4), "string");
+   EXPECT_EQ(program.initializerType(5), "bool");
+}
+
+TEST(TypeCheckerTests, InfersRecursiveFunction) {
+   auto program = typeCheck(R"(
+function fact(n) {
+    if (n < 2) { return 1; }
+    return n * fact(n - 1);
+}
+var r = fact(10);
+)");
+   EXPECT_TRUE(program.errors.empty());
+   EXPECT_EQ(program.statement(0)->resolvedType.toString(), "fn(int) -> int");
+   EXPECT_EQ(program.initializerType(1), "int");
+}
+
+TEST(TypeCheckerTests, GeneralizesFunctions) {
+   auto program = typeCheck(R"(
+function same(a, b) { return a + b; }
+var i = same(1, 2);
+var s = same("x", "y");
+)");
+   EXPECT_TRUE(program.errors.empty());
+   EXPECT_EQ(program.initializerType(1), "int");
+   EXPECT_EQ(program.initializerType(2), "string");
+}
+
+TEST(TypeCheckerTests, ReportsMismatches) {
+   EXPECT_EQ(typeCheck(R"(var a: int = "hello";)").errors.size(), 1u);
+   EXPECT_EQ(typeCheck(R"(var a = 1; a = "s";)").errors.size(), 1u);
+   EXPECT_EQ(typeCheck(R"(var t = true; var u = t - 1;)").errors.size(), 1u);
+   EXPECT_EQ(typeCheck(R"(function f(p, q) { return p; } var r = f(1);)").errors.size(), 1u);
+   EXPECT_EQ(typeCheck(R"(
+function g(n) {
+    if (n > 0) { return 1; }
+    return "none";
+}
+)").errors.size(), 1u);
+}
+
+TEST(TypeCheckerTests, AllowsIntToFloatWidening) {
+   auto program = typeCheck(R"(var x: float = 1; x = 2;)");
+   EXPECT_TRUE(program.errors.empty());
+}
+
+TEST(TypeCheckerTests, JoinsNumbersInsteadOfUnifyingThem) {
+   auto twice = typeCheck(R"(
+function twice(x) { return x * 2; }
+var a = twice(1.5);
+var b = twice(3);
+var c = twice(2) + 0.5;
+)");
+   EXPECT_TRUE(twice.errors.empty()) << twice.errors.front().what();
+   EXPECT_EQ(twice.initializerType(1), "float");
+   EXPECT_EQ(twice.initializerType(2), "int");
+   EXPECT_EQ(twice.initializerType(3), "float");
+
+   // The return type receives an int first and widens when a float follows.
+   auto halves = typeCheck(R"(
+function f(n) { if (n == 0) { return 0; } return f(n - 1) + 0.5; }
+var r = f(4);
+)");
+   EXPECT_TRUE(halves.errors.empty()) << halves.errors.front().what();
+   EXPECT_EQ(halves.initializerType(1), "float");
+
+   // Widening is for flows only: an int that '~' required stays int.
+   EXPECT_EQ(typeCheck(R"(var n = 1; var m = ~n; n = 0.5;)").errors.size(), 1u);
+   EXPECT_EQ(typeCheck(R"(function g(x) { return x * 2; } var s = g("s");)").errors.size(), 1u);
+}
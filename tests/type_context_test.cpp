@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "type_context.h"
+
+TEST(TypeContextTests, PrimitivesAreSingletons) {
+   TypeContext context;
+   EXPECT_EQ(context.intType(), context.fromName("int"));
+   EXPECT_EQ(context.primitive(TypeKind::Float), context.floatType());
+   EXPECT_NE(context.intType(), context.floatType());
+   EXPECT_EQ(context.intType().toString(), "int");
+}
+
+TEST(TypeContextTests, FunctionTypesAreHashConsed) {
+   TypeContext context;
+   TypeRef a = context.function({context.intType(), context.stringType()}, context.boolType());
+   TypeRef b = context.function({context.intType(), context.stringType()}, context.boolType());
+   TypeRef c = context.function({context.intType()}, context.boolType());
+   TypeRef d = context.function({context.intType(), context.stringType()}, context.intType());
+
+   EXPECT_EQ(a, b);
+   EXPECT_NE(a, c);
+   EXPECT_NE(a, d);
+   EXPECT_EQ(a.toString(), "fn(int, string) -> bool");
+}
+
+TEST(TypeContextTests, CompositeTypesAreStructural) {
+   TypeContext context;
+   TypeRef list = context.generic("List", {context.intType()});
+   EXPECT_EQ(list, context.generic("List", {context.intType()}));
+   EXPECT_NE(list, context.generic("List", {context.floatType()}));
+   EXPECT_NE(list, context.generic("Set", {context.intType()}));
+
+   TypeRef point = context.structType("Point", {{"x", context.intType()}, {"y", context.intType()}});
+   EXPECT_EQ(point, context.structType("Point", {{"x", context.intType()}, {"y", context.intType()}}));
+   EXPECT_NE(point, context.structType("Point", {{"x", context.intType()}, {"z", context.intType()}}));
+   EXPECT_NE(point, context.classType("Point", {{"x", context.intType()}, {"y", context.intType()}}));
+   EXPECT_EQ(point.toString(), "struct Point { int x; int y }");
+
+   EXPECT_EQ(context.custom("Matrix"), context.fromName("Matrix"));
+}
+
+TEST(TypeContextTests, ParserSharesTypesAcrossDeclarations) {
+   std::string source = R"(
+function f(a, b) { return a; }
+function g(c, d) { return c; }
+)";
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+
+   TypeContext context;
+   Parser parser(tokens, context);
+   parser.parse();
+
+   size_t before = context.size();
+   TypeRef unknown = context.unknownType();
+   EXPECT_EQ(context.function({unknown, unknown}, unknown), context.function({unknown, unknown}, unknown));
+   EXPECT_EQ(context.size(), before);
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "ir_builder.h"
+#include "ir_simplifier.h"
+#include "value_numbering.h"
+#include "host_registry.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> lower(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+   Parser parser(tokens);
+   HostRegistry hosts;
+   hosts.defineBuiltins(std::cout);
+   hosts.declareIn(parser.scopeManager);
+   std::unique_ptr<Expr> program = parser.parse();
+   Resolver().resolve(*program);
+   std::unique_ptr<IrModule> module = IrBuilder().build(*program);
+   IrSimplifier().simplify(*module);
+   return module;
+}
+
+// Numbers the module and cleans up after it, as the Optimizer does.
+static ValueNumberingStats number(IrModule &module) {
+   ValueNumberingStats stats = ValueNumbering().eliminate(module);
+   IrSimplifier().simplify(module);
+   verifyIr(module);
+   return stats;
+}
+
+static int count(const IrFunction &function, IrOp op) {
+   int result = 0;
+   for (const auto &block: function.blocks) {
+      for (const IrInstr *instr: block->instructions) result += instr->op == op;
+   }
+   return result;
+}
+
+TEST(ValueNumberingTests, ReusesExpressionsFromDominatingBlocks) {
+   auto module = lower(R"(
+function f(a, b, c) {
+    var x = a * b;
+    if (c) { return a * b + c; }
+    var y = a * 2 + b;
+    return x + (a * 2 + b) + y;
+})");
+   ValueNumberingStats stats = number(*module);
+   EXPECT_EQ(stats.expressions, 3);
+   EXPECT_EQ(dumpIr(function(*module, "f")),
+             "function f (arity 3)\n"
+             "b0:\n"
+             "  %0 = param 0\n"
+             "  %1 = param 1\n"
+             "  %2 = param 2\n"
+             "  %3 = mul %0, %1\n"
+             "  branch %2, b1, b2\n"
+             "b1 (preds b0):\n"
+             "  %4 = add %3, %2\n"
+             "  return %4\n"
+             "b2 (preds b0):\n"
+             "  %5 = const 2\n"
+             "  %6 = mul %0, %5\n"
+             "  %7 = add %6, %1\n"
+             "  %8 = add %3, %7\n"
+             "  %9 = add %8, %7\n"
+             "  return %9\n");
+}
+
+TEST(ValueNumberingTests, KeepsExpressionsToTheirScope) {
+   auto module = lower(R"(
+function f(a, b, c) {
+    var x = 0;
+    if (c) { x = a - b; } else { x = b - a; }
+    return x + (a - b) + (b == a) + (a == b);
+})");
+   ValueNumberingStats stats = number(*module);
+   // Neither branch dominates the join, so a - b is computed again there;
+   // equality is symmetric.
+   EXPECT_EQ(stats.expressions, 1);
+   EXPECT_EQ(count(function(*module, "f"), IrOp::Binary), 7);
+}
+
+TEST(ValueNumberingTests, ForgetsGlobalsAcrossStoresAndCalls) {
+   auto module = lower(R"(
+var g = 1;
+function touch() { g = g + 1; }
+function f(n) {
+    var a = g + g;
+    g = n;
+    var b = g * 2;
+    touch();
+    return a + b + g;
+})");
+   IrFunction &f = function(*module, "f");
+   ValueNumberingStats stats = number(*module);
+   // The second g is the first; after the store g is n; the call reloads it.
+   EXPECT_EQ(stats.loads, 2);
+   EXPECT_EQ(count(f, IrOp::LoadGlobal), 2);
+}
+
+TEST(ValueNumberingTests, MergesPhisOfTheSameValues) {
+   auto module = lower(R"(
+function f(c, a) {
+    var x = 0;
+    var y = 0;
+    if (c) { x = a; y = a; }
+    return x + y;
+})");
+   EXPECT_EQ(number(*module).phis, 1);
+}
+
+TEST(ValueNumberingTests, LeavesMatricesThatMayChangeAlone) {
+   const char *source = R"(
+function f(m) {
+    var a = m + 1;
+    var b = m + 1;
+    put(a, 0, 0, 5);
+    return at(b, 0, 0);
+}
+print(f(matrix(2, 2)));
+)";
+   auto module = lower(source);
+   EXPECT_EQ(number(*module).expressions, 0);
+
+   auto pure = lower("function f(m) { return rows(m + 1) + cols(m + 1); } print(f(matrix(2, 2)));");
+   EXPECT_EQ(number(*pure).expressions, 1);
+}
+
+TEST(ValueNumberingTests, OptimizedProgramsBehaveTheSame) {
+   expectSameWhenOptimized({
+           R"(
+var scale = 3;
+function index(i, j, n) { return i * n + j; }
+function sum(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        for (var j = 0; j < n; j = j + 1) {
+            total = total + (i * n + j) * scale + index(i, j, n) - (i * n + j);
+            if (i * n + j > 40) { scale = scale + 1; }
+        }
+    }
+    return total + scale * scale;
+}
+print(sum(8), "a" + 1 == "a" + 1, 1 + "a" == "a" + 1);
+)",
+           R"(
+function f(m) {
+    var a = m + 1;
+    var b = m + 1;
+    put(a, 0, 0, 5);
+    return at(b, 0, 0);
+}
+print(f(matrix(2, 2)));
+)",
+   });
+}
@@ -0,0 +1,71 @@
+#include <cmath>
+#include <limits>
+
+#include <gtest/gtest.h>
+
+#include "value.h"
+#include "error.h"
+
+TEST(ValueTests, ScalarsRoundTrip) {
+   for (std::int32_t i: {0, 1, -1, std::numeric_limits<std::int32_t>::max(), std::numeric_limits<std::int32_t>::min()}) {
+      Value v = Value::integer(i);
+      EXPECT_TRUE(v.isInt());
+      EXPECT_FALSE(v.isFloat());
+      EXPECT_EQ(v.asInt(), i);
+   }
+   for (double d: {0.0, -0.0, 1.5, -2.25, 1e308, std::numeric_limits<double>::infinity(),
+                   -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min()}) {
+      Value v = Value::number(d);
+      EXPECT_TRUE(v.isFloat());
+      EXPECT_EQ(v.type(), ValueType::Float);
+      EXPECT_EQ(std::signbit(v.asFloat()), std::signbit(d));
+      EXPECT_EQ(v.asFloat(), d);
+   }
+
+   Value nan = Value::number(-std::numeric_limits<double>::quiet_NaN());
+   EXPECT_TRUE(nan.isFloat());
+   EXPECT_TRUE(std::isnan(nan.asFloat()));
+
+   EXPECT_EQ(Value::null().type(), ValueType::Null);
+   EXPECT_EQ(Value::boolean(true).type(), ValueType::Bool);
+   EXPECT_TRUE(Value::boolean(true).asBool());
+   EXPECT_FALSE(Value::boolean(false).asBool());
+   EXPECT_FALSE(Value::null().isBool());
+   EXPECT_FALSE(Value::integer(3).isBool());
+}
+
+TEST(ValueTests, ObjectsAreReferenceCounted) {
+   Value s = Value::string("hello");
+   ASSERT_TRUE(s.isString());
+   EXPECT_EQ(s.type(), ValueType::Object);
+   EXPECT_EQ(s.asString()->refCount, 1u);
+   {
+      Value copy = s;
+      EXPECT_EQ(copy.raw(), s.raw());
+      EXPECT_EQ(s.asString()->refCount, 2u);
+      Value moved = std::move(copy);
+      EXPECT_TRUE(copy.isNull());
+      EXPECT_EQ(s.asString()->refCount, 2u);
+   }
+   EXPECT_EQ(s.asString()->refCount, 1u);
+   EXPECT_EQ(s.toString(), "hello");
+}
+
+TEST(ValueTests, Arithmetic) {
+   EXPECT_TRUE(Value::bothInt(Value::integer(1), Value::integer(-1)));
+   EXPECT_FALSE(Value::bothInt(Value::integer(1), Value::number(1.0)));
+   EXPECT_FALSE(Value::bothInt(Value::integer(1), Value::boolean(true)));
+   EXPECT_FALSE(Value::bothInt(Value::integer(1), Value::string("1")));
+
+   EXPECT_EQ(applyBinary(BinaryOperator::Add, Value::integer(2147483647), Value::integer(1)).asInt(),
+             -2147483647 - 1);
+   EXPECT_EQ(applyBinary(BinaryOperator::Multiply, Value::number(1.5), Value::integer(2)).asFloat(), 3.0);
+   EXPECT_EQ(applyBinary(BinaryOperator::Divide, Value::number(1.0), Value::number(4.0)).asFloat(), 0.25);
+   EXPECT_TRUE(applyBinary(BinaryOperator::Equal, Value::integer(1), Value::number(1.0)).asBool());
+   EXPECT_EQ(applyBinary(BinaryOperator::Add, Value::string("x"), Value::integer(1)).toString(), "x1");
+   EXPECT_THROW(applyBinary(BinaryOperator::Divide, Value::integer(1), Value::integer(0)), RuntimeError);
+
+   EXPECT_FALSE(Value::number(0.0).truthy());
+   EXPECT_FALSE(Value::string("").truthy());
+   EXPECT_TRUE(Value::integer(-1).truthy());
+}
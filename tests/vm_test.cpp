@@ -0,0 +1,324 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "vm.h"
+#include "interpreter.h"
+#include "error.h"
+
+static std::string runVm(const std::string &source) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(source);
+   return out.str();
+}
+
+static std::string runInterpreter(const std::string &source) {
+   std::ostringstream out;
+   Interpreter interpreter(out);
+   interpreter.run(source);
+   return out.str();
+}
+
+TEST(VMTests, MatchesInterpreter) {
+   const char *programs[] = {
+           R"(print(1 + 2 * 3, 7 / 2, 7.0 / 2, -(-4), 2147483647 + 1, "x" + 1, !0, 1 < 2 && 2 < 1 || true);)",
+           R"(
+var total = 0;
+for (var i = 0; i < 10; i = i + 1) {
+    if (i == 3) { continue; }
+    if (i == 8) { break; }
+    total = total + i;
+}
+var n = 0;
+do { n = n + 1; if (n == 2) { continue; } } while (n < 5);
+print(total, n);
+)",
+           R"(
+function fib(n) {
+    if (n < 2) { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+function count(limit) {
+    var sum = 0;
+    var i = 0;
+    while (i < limit) { var sq = i * i; sum = sum + sq; i = i + 1; }
+    return sum;
+}
+print(fib(15), count(10), str(2.5) + "!", len("four"));
+)",
+           R"(
+function name(n) {
+    var result = "other";
+    switch (n) {
+        case 1: result = "one";
+        case 2: { result = "two"; break; }
+        default: result = "many";
+    }
+    return result;
+}
+print(name(1), name(2), name(9));
+)",
+   };
+   for (const char *program: programs) {
+      EXPECT_EQ(runVm(program), runInterpreter(program)) << program;
+   }
+}
+
+TEST(VMTests, SwitchesDispatchThroughTables) {
+   const char *source = R"(
+var probes = 0;
+function probe(v) { probes = probes + 1; return v; }
+function classify(x) {
+    var result = "none";
+    switch (x) {
+        case 0: result = "zero";
+        case 1: result = "one";
+        case 2: result = "two";
+        case 3: result = "three";
+        case 5: result = "five";
+        case 1: result = "duplicate";
+        case probe(40): result = "probed";
+        case -7: result = "minus seven";
+        case 1000: result = "thousand";
+        case 123456: result = "big";
+        case 99: result = "ninety-nine";
+        case "add": result = "+";
+        case "sub": result = "-";
+        case "mul": result = "*";
+        case "div": result = "/";
+        default: result = "default";
+    }
+    return result;
+}
+print(classify(0), classify(1), classify(3.0), classify(4), classify(5));
+print(probes);
+print(classify(40), classify(-7), classify(123456), classify(99), classify(98));
+print(classify("mul"), classify("div"), classify("mod"), classify(true));
+print(probes);
+)";
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(source);
+   EXPECT_EQ(out.str(), "zero one three default five\n"
+                        "1\n"
+                        "probed minus seven big ninety-nine default\n"
+                        "* / default default\n"
+                        "10\n");
+   EXPECT_EQ(runInterpreter(source), out.str());
+
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_NE(listing.find("SWITCH          r2 t0 ; jump table 0..5"), std::string::npos) << listing;
+   EXPECT_NE(listing.find("t1 ; binary search 4 keys, perfect hash 4 keys"), std::string::npos) << listing;
+}
+
+TEST(VMTests, TryCatchFinally) {
+   auto output = runVm(R"(
+function risky(n) {
+    if (n > 1) { throw("too big"); }
+    return n;
+}
+function guarded(n) {
+    try {
+        return risky(n);
+    } catch (e) {
+        print("caught", e);
+    } finally {
+        print("finally", n);
+    }
+    return -1;
+}
+print(guarded(1));
+print(guarded(5));
+try { var z = 1 / 0; } catch (e) { print(e); }
+)");
+   EXPECT_EQ(output, "finally 1\n1\ncaught too big\nfinally 5\n-1\nDivision by zero\n");
+}
+
+TEST(VMTests, FinallyOnEveryExit) {
+   auto output = runVm(R"(
+function loop() {
+    var i = 0;
+    while (i < 5) {
+        i = i + 1;
+        try {
+            if (i == 2) { continue; }
+            if (i == 4) { break; }
+        } finally {
+            print("f", i);
+        }
+    }
+    return i;
+}
+function inner() {
+    try { throw("boom"); } finally { print("cleanup"); }
+}
+function outer() {
+    try { inner(); } catch (e) { return "outer caught " + e; }
+}
+function keep() {
+    var x = 1;
+    try { return x; } finally { x = 2; }
+}
+print(loop());
+print(outer());
+print(keep());
+)");
+   EXPECT_EQ(output, "f 1\nf 2\nf 3\nf 4\n4\ncleanup\nouter caught boom\n1\n");
+
+   EXPECT_THROW(runVm(R"(try { var a = 1 / 0; } finally { print("done"); })"), RuntimeError);
+}
+
+TEST(VMTests, HandlersLiveInTables) {
+   const char *source = R"(
+function sum(n) {
+    var s = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        try { s = s + i; if (i == 2) { continue; } s = s + 10 / (i - 3); } catch (e) { s = s + 100; }
+    }
+    return s;
+}
+function nested(x) {
+    try {
+        try { if (x) { return "r"; } throw("t"); } finally { print("inner"); }
+    } catch (e) {
+        try { throw(e + "2"); } catch (z) { return z; }
+    } finally { print("outer"); }
+}
+print(sum(5), nested(true), nested(false));
+)";
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(source);
+   EXPECT_EQ(out.str(), "inner\nouter\ninner\nouter\n112 r t2\n");
+   EXPECT_EQ(out.str(), runInterpreter(source));
+
+   // The continue splits the protected range in two; nothing runs on entry.
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_NE(listing.find("try   0004-0006 -> 0013 catch r4\n  try   0008-0011 -> 0013 catch r4"),
+             std::string::npos) << listing;
+   EXPECT_NE(listing.find("finally\n"), std::string::npos) << listing;
+}
+
+TEST(VMTests, RuntimeErrors) {
+   EXPECT_THROW(runVm(R"(var s = "a" - 1;)"), RuntimeError);
+   EXPECT_THROW(runVm(R"(function f(a) { return a; } f(1, 2);)"), RuntimeError);
+   EXPECT_THROW(runVm(R"(function down(n) { return down(n + 1) + 1; } down(0);)"), RuntimeError);
+   EXPECT_THROW(runVm(R"(throw("x");)"), ScriptException);
+}
+
+TEST(VMTests, HostFunctionsAndGlobals) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.host().define("twice", 1, [](const Value *args, int) {
+       return Value::integer(args[0].asInt() * 2);
+   });
+   vm.defineGlobal("base", Value::integer(20));
+   vm.run(R"(var seen = twice(base) + len("abc"); print(seen);)");
+   EXPECT_EQ(out.str(), "43\n");
+}
+
+TEST(VMTests, Disassembly) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(R"(function add(a, b) { return a + b; } print(add(1, 2));)");
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_NE(listing.find("function add (arity 2"), std::string::npos) << listing;
+   EXPECT_NE(listing.find("ADD_INT_INT     r2 r0 r1"), std::string::npos) << listing;
+   EXPECT_NE(listing.find("CALL            r1 add/2"), std::string::npos) << listing;
+   EXPECT_EQ(out.str(), "3\n");
+}
+
+TEST(VMTests, SuperinstructionsAndQuickening) {
+   std::ostringstream out;
+   VM vm(out);
+   vm.run(R"(
+function count(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        if (i < 100) { total = total + i; }
+    }
+    return total;
+}
+print(count(10));
+)");
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_NE(listing.find("IFLT_INT_INT    r2 r0"), std::string::npos) << listing;
+   EXPECT_NE(listing.find("IFLT_INT_CONST  r2 #100"), std::string::npos) << listing;
+   EXPECT_NE(listing.find("ADD_INT_CONST   r2 r2 #1"), std::string::npos) << listing;
+   EXPECT_EQ(out.str(), "45\n");
+}
+
+TEST(VMTests, QuickenedOpsFallBackOnTypeMiss) {
+   auto output = runVm(R"(
+function add(a, b) { return a + b; }
+function less(a, b) {
+    if (a < b) { return "yes"; }
+    return "no";
+}
+function step(x) { return x - 1; }
+print(add(1, 2), add(1.5, 2.25), add("a", 1), add(2147483647, 1), add(3, 4));
+print(less(1, 2), less(2.5, 1), less("a", "b"), less(5, 1));
+print(step(10), step(0.5), step(-2147483647 - 1));
+)");
+   EXPECT_EQ(output, "3 3.75 a1 -2147483648 7\nyes no yes no\n9 -0.5 2147483647\n");
+}
+
+TEST(VMTests, CallSiteCacheFollowsRedefinition) {
+   const char *source = R"(
+function f() { return 1; }
+function get() { return f(); }
+print(get(), get());
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+redefine();
+print(get());
+)";
+   EXPECT_EQ(runVm(source), "1 1\n2\n");
+   EXPECT_EQ(runVm(source), runInterpreter(source));
+   EXPECT_THROW(runVm("function f(a) { return a; } for (var i = 0; i < 2; i = i + 1) { f(); }"), RuntimeError);
+}
+
+TEST(VMTests, TailCallsReuseTheFrame) {
+   auto output = runVm(R"(
+function count(n, total) {
+    if (n == 0) { return total; }
+    return count(n - 1, total + 1);
+}
+function parity(n, even) {
+    if (n == 0) {
+        return even;
+    } else {
+        { return parity(n - 1, !even); }
+    }
+}
+function length(s) { return len(s); }
+print(count(10000000, 0), parity(1000001, true), length("abc"));
+)");
+   EXPECT_EQ(output, "10000000 false 3\n");
+}
+
+TEST(VMTests, CallsInsideTryAreNotTailCalls) {
+   VM vm;
+   vm.run(R"(
+function fail() { throw("boom"); }
+function guarded() {
+    try { return fail(); } catch (e) { return "caught " + e; }
+}
+function recurse(n) {
+    if (n == 0) { return 0; }
+    try { return recurse(n - 1); } finally { }
+}
+)");
+   std::string listing = disassemble(*vm.lastProgram());
+   EXPECT_EQ(listing.find("TAILCALL"), std::string::npos) << listing;
+   EXPECT_EQ(runVm(R"(
+function fail() { throw("boom"); }
+function guarded() {
+    try { return fail(); } catch (e) { return "caught " + e; }
+}
+print(guarded());
+)"), "caught boom\n");
+}
@@ -0,0 +1,288 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "constant_folder.h"
+#include "dead_code.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "x86_64_backend.h"
+#include "host_registry.h"
+#include "test_helpers.h"
+
+static std::unique_ptr<IrModule> optimize(const std::string &source) {
+   Tokenizer tokenizer(source);
+   std::vector<Token> tokens = tokenizer.tokenize();
+   Parser parser(tokens);
+   HostRegistry hosts;
+   hosts.defineBuiltins(std::cout);
+   hosts.declareIn(parser.scopeManager);
+   std::unique_ptr<Expr> program = parser.parse();
+   ConstantFolder().fold(*program);
+   DeadCodeEliminator().eliminate(*program);
+   Resolver().resolve(*program);
+   return Optimizer(OptimizerOptions::native()).optimize(*program);
+}
+
+static bool canRun() {
+#if defined(__x86_64__) && defined(__linux__)
+   static const bool found = std::system("cc --version > /dev/null 2>&1") == 0;
+   return found;
+#else
+   return false;
+#endif
+}
+
+static std::string runNative(const std::string &source, const std::string &name, const std::string &limits = "") {
+   std::string path = testing::TempDir() + "x86_64_" + name;
+   buildX86Native(*optimize(source), path);
+   return runExecutable(path, limits);
+}
+
+TEST(X86BackendTests, AllocatesUnitsAndSpillsUnderPressure) {
+   auto module = optimize(R"(
+function few(a, b) { return a * b + a; }
+function many(a, b, c, d, e, f) {
+    var x = a * b; var y = c * d; var z = e * f; var w = a * f;
+    return x + y + z + w + a + b + c + d + e + f;
+}
+print(few(1, 2), many(1, 2, 3, 4, 5, 6));
+)");
+   auto allocate = [](IrFunction &function, unsigned allowed) {
+       function.renumber();
+       Liveness liveness(function);
+       return X86RegisterAllocator(function, liveness, 4, allowed, 0x3);
+   };
+   IrFunction &few = function(*module, "few");
+   X86RegisterAllocator small = allocate(few, 0xf);
+   EXPECT_EQ(small.spillCount(), 0);
+   EXPECT_EQ(small.slotCount(), 0);
+
+   IrFunction &many = function(*module, "many");
+   X86RegisterAllocator full = allocate(many, 0xf);
+   EXPECT_GT(full.spillCount(), 0);
+   // Six parameters live at once: four in units, the rest in distinct slots.
+   std::vector<std::pair<int, int>> homes;
+   for (const IrInstr *instr: many.blocks[0]->instructions) {
+      if (instr->op != IrOp::Param) continue;
+      X86RegisterAllocator::Location location = full.location(instr);
+      EXPECT_TRUE(location.unit >= 0 || location.slot >= 0);
+      homes.emplace_back(location.unit, location.slot);
+   }
+   ASSERT_EQ(homes.size(), 6u);
+   std::sort(homes.begin(), homes.end());
+   EXPECT_EQ(std::unique(homes.begin(), homes.end()), homes.end());
+
+   // With only the callee-saved units, as in functions with handlers.
+   X86RegisterAllocator narrow = allocate(many, 0x3);
+   EXPECT_EQ(narrow.usedUnits() & ~0x3u, 0u);
+   EXPECT_GT(narrow.spillCount(), full.spillCount());
+}
+
+TEST(X86BackendTests, EmitsAssemblyForTheSystemAssembler) {
+   auto module = optimize(R"(
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+function f() { return 1; }
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+print(fib(10), f(), redefine(), f());
+)");
+   X86Emitter emitter;
+   std::string assembly = emitter.emitAssembly(*module);
+   EXPECT_NE(assembly.find("fn_1:"), std::string::npos) << assembly;
+   // fib calls itself directly and compares and branches without a boolean.
+   EXPECT_NE(assembly.find("call fn_1@PLT"), std::string::npos) << assembly;
+   EXPECT_NE(assembly.find("jl "), std::string::npos) << assembly;
+   EXPECT_NE(assembly.find("call rtx_call@PLT"), std::string::npos) << assembly;
+   EXPECT_NE(assembly.find(".note.GNU-stack"), std::string::npos);
+
+   std::string runtime = emitter.emitRuntime(*module, false);
+   EXPECT_NE(runtime.find("RTX Value fn_1(Value);"), std::string::npos);
+   EXPECT_NE(runtime.find("int main(void)"), std::string::npos);
+   EXPECT_EQ(emitter.emitRuntime(*module, true).find("int main(void)"), std::string::npos);
+}
+
+TEST(X86BackendTests, CompiledProgramsBehaveLikeTheVm) {
+   if (!canRun()) GTEST_SKIP() << "not an x86-64 Linux host with a C compiler";
+   const char *programs[] = {
+           R"(
+print(2147483647 + 1, -7 / 2, 7.0 / 2, 0.1 + 0.2, 1 / 3.0, 1000000000.0 * 1000000000.0, ~5, !0, +3, -(-2147483647 - 1));
+print("a" + 1.5, "x" + null + true, str(12) + str(0.5), len("hello"), "abc" < "abd", "b" >= "abc");
+print(1 == 1.0, null == null, "x" == "x", "x" != "y", 0.0 == -0.0, 1 == "1", !"", !"a");
+var zero = 0.0;
+var nan = zero / zero;
+print(-zero, 1 / zero, -1 / zero, nan < 1.0, nan >= 1.0, 1.5 < 2.5, 2.5 <= 2.5, 1 < 1.5);
+var runtimeZero = clock() * 0.0;
+var grid = matrix(1, 2);
+put(grid, 0, 1, runtimeZero / runtimeZero);
+print(runtimeZero / runtimeZero, -(runtimeZero / runtimeZero), grid);
+)",
+           R"(
+var count = 0;
+function bump(n) { count = count + n; return count; }
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+function f() { return 1; }
+function get() { return f(); }
+print(get(), fib(20), bump(2), bump(3), count);
+function redefine() {
+    function f() { return 2; }
+    return 0;
+}
+redefine();
+print(get());
+function one(a) { return a; }
+try { one(); } catch (e) { print(e); }
+)",
+           R"(
+function five(a, b, c, d, e) { return a - b * 2 + c * 3 - d * 4 + e * 5; }
+function mix(a, b, c, d, e, f) {
+    var x = a * b; var y = c * d; var z = e * f; var w = a * f;
+    var total = 0;
+    for (var i = 0; i < 10; i = i + 1) { total = total + x - y + z * i - w + five(a, b, c, d, i); }
+    return total + x + y + z + w + a + b + c + d + e + f;
+}
+print(five(1, 2, 3, 4, 5), five(1.5, 2, 3, 4.5, 5), mix(1, 2, 3, 4, 5, 6), mix(0.5, 2, 3, 4, 5, 6));
+var sum = 0.0;
+for (var k = 0; k < 100; k = k + 1) { sum = sum + k * 0.5; if (sum > 1000) { sum = sum - 999.5; } }
+print(sum);
+)",
+           R"(
+function name(x) {
+    switch (x) {
+        case 1: return "one";
+        case 2: return "two";
+        case 3: return "three";
+        case -4: return "minus four";
+        case "s": return "ess";
+        case "t": return "tee";
+        case "u": return "you";
+        default: return "other";
+    }
+}
+var names = "";
+for (var i = -5; i < 5; i = i + 1) { names = names + name(i) + ","; }
+print(names, name(2.0), name(2.5), name("t"), name(null));
+var total = 0;
+var k = 0;
+while (k < 100) { if (k > 50) { total = total + k * 2; } else { total = total - k; } k = k + 1; }
+print(total);
+)",
+           R"(
+function risky(x) {
+    if (x > 2) { throw("big " + str(x)); }
+    return x / (x - 1);
+}
+var log = "";
+for (var i = 0; i < 5; i = i + 1) {
+    try {
+        log = log + str(risky(i)) + ";";
+    } catch (e) {
+        log = log + "caught " + e + ";";
+    } finally {
+        log = log + "f" + str(i) + ";";
+    }
+}
+print(log);
+function cleanup() {
+    try { throw(42); } finally { print("cleanup"); }
+}
+try { cleanup(); } catch (e) { print("outer", e + 1); }
+try { try { print(1 + null); } catch (e) { throw("again: " + e); } } catch (e) { print(e); }
+cleanup();
+)",
+           R"(
+var a = matrix(2, 3);
+var b = matrix(3, 2);
+var c = matrix(2, 2);
+for (var i = 0; i < 2; i = i + 1) {
+    for (var j = 0; j < 3; j = j + 1) { put(a, i, j, i + j); put(b, j, i, i * j + 1); }
+    put(c, i, i, 2);
+}
+print(a @ b, a @ b @ c, c @ a @ b @ c, rows(a), cols(a), at(b, 2, 1));
+print(c * 2 + 1, 1 - c, -c, +c == c, c + c * c);
+try { print(a @ a); } catch (e) { print(e); }
+)",
+           R"(
+function down(n) { return down(n + 1) + 1; }
+try { down(0); } catch (e) { print(e); }
+function divide(a) { return 10 / a; }
+print(divide(4), divide(4.0));
+divide(0);
+)",
+   };
+   int index = 0;
+   for (const char *program: programs) {
+      EXPECT_EQ(runNative(program, "program" + std::to_string(index++)), runVm(program)) << program;
+   }
+}
+
+TEST(X86BackendTests, SpilledValuesKeepTheirSlots) {
+   if (!canRun()) GTEST_SKIP() << "not an x86-64 Linux host with a C compiler";
+   // More live values than units: values evicted from a unit must not share
+   // a slot with anything live over their earlier part.
+   const char *programs[] = {
+           R"(
+function p(n) {
+    var a = 1; var b = 2; var c = 3; var d = 4; var e = 5; var f = 6; var g = 7; var h = 8;
+    for (var i = 0; i < n; i = i + 1) {
+        if (i == 2) { a = a + b; } else { b = b + c * i; }
+        c = c + d; d = d + e; e = e + f; f = f + g; g = g + h; h = h + a;
+    }
+    return a + b + c + d + e + f + g + h;
+}
+print(p(6));
+)",
+           R"(
+function q(n) {
+    var t = 7;
+    for (var i = 0; i < n; i = i + 1) {
+        try { if (i == 1) { throw("x"); } } catch (e) { t = t + 100; }
+    }
+    return t;
+}
+function r(n) {
+    var a = 1; var b = 2; var c = 3; var d = 4;
+    for (var i = 0; i < n; i = i + 1) {
+        try { a = a + b; b = b + c; if (i == 2) { throw(i); } c = c + d; d = d + a; } catch (e) { a = a + e * 100; }
+    }
+    return a + b + c + d;
+}
+print(q(3), r(5));
+)",
+   };
+   EXPECT_EQ(runVm(programs[0]), "2821\n");
+   int index = 0;
+   for (const char *program: programs) {
+      EXPECT_EQ(runNative(program, "pressure" + std::to_string(index++)), runVm(program)) << program;
+   }
+}
+
+TEST(X86BackendTests, ReclaimsUnreachableValues) {
+   if (!canRun()) GTEST_SKIP() << "not an x86-64 Linux host with a C compiler";
+   // Every iteration drops a 320 KB matrix; kept, they would overrun the
+   // address space limit. grow keeps one live on each of its frames.
+   const char *source = R"(
+function grow(m, depth) {
+    if (depth == 0) { return m; }
+    var k = m + depth;
+    var r = grow(m, depth - 1);
+    return r + at(k, 0, 0);
+}
+var m = matrix(200, 200);
+var s = "";
+var total = 0;
+for (var i = 0; i < 2000; i = i + 1) {
+    var n = m + i;
+    try { if (i == 1999) { throw("last " + str(at(n, 3, 3))); } } catch (e) { s = e; }
+    total = total + at(n, 1, 1);
+}
+var g = grow(matrix(200, 200), 100);
+print(total, s, at(g, 0, 0), at(m, 0, 0));
+)";
+   EXPECT_EQ(runNative(source, "reclaims", "ulimit -v 262144; "), "1999000 last 1999 5050 0\n");
+}